@@ -0,0 +1,925 @@
+/**
+ * Micro-benchmarks for the kernels used in the reconstruction of semileptonic tt events.
+ * 
+ * Events with a lepton, MET, and a given number of jets with CMVA values are either generated
+ * randomly or read from a text file. They are fed directly into NuRecoRochester, the quadratic
+ * solver of NuRecoRunI, the batched kernels from NuKernels.hpp on which both rely, and the full jet
+ * assignment performed by TTSemilepRecoRochester, with both the scalar and the batch engines and
+ * with early termination of the search. The jet assignment is also performed by TTSemilepRecoChi2
+ * and TTSemilepRecoChi2Fixed with the same chi^2 terms, using neutrinos from NuRecoRunI. This is
+ * done for the production set of terms, with the separable and the exhaustive search, and for the
+ * same terms complemented with pt of the tt system, which makes the rank non-separable. No
+ * RunManager is involved, and by default the likelihoods
+ * for the reconstruction are built in memory, so that no external files are needed. Results are
+ * reported for each jet multiplicity in nanoseconds per event, per jet, or per interpretation, and
+ * numbers of memory allocations per event are given. The time per interpretation is normalized to
+ * the number of interpretations in the exhaustive search, even though the separable search
+ * implemented in the base class of TTSemilepRecoRochester evaluates fewer of them. The mean
+ * number of interpretations actually evaluated per event is reported as well. In a build with
+ * ALLOC_CHECK=1, allocations are counted with the instrumented operators new from AllocationCheck.
+ * 
+ * With option --check, no timing is performed. Instead, every event is reconstructed with the
+ * exhaustive search, the scalar and the batch engines for the separable rank, and the early
+ * termination with both engines, storing either one or several interpretations. The optimized
+ * searches are run with the validation enabled (see TTSemilepRecoBase::SetEngine). Their status
+ * codes and stored interpretations (jet indices, ranks, and neutrinos) are compared with those of
+ * the exhaustive search. In addition, results of TTSemilepRecoChi2Fixed are compared with those of
+ * TTSemilepRecoChi2 for the three configurations of chi^2 described above. The program exits with
+ * a failure code if any of the results differ.
+ * 
+ * The text file with recorded events contains one record per event. A record starts with a line
+ *   nJets lepPx lepPy lepPz lepE metPx metPy
+ * followed by nJets lines
+ *   px py pz E CMVA
+ * Jets must be ordered in pt. Lines starting with '#' are ignored.
+ */
+
+#include <AllocationCheck.hpp>
+#include <NuKernels.hpp>
+#include <NuRecoRochester.hpp>
+#include <NuRecoRunI.hpp>
+#include <TTSemilepRecoChi2.hpp>
+#include <TTSemilepRecoChi2Fixed.hpp>
+#include <TTSemilepRecoRochester.hpp>
+
+#include <mensura/core/PhysicsObjects.hpp>
+
+#include <TH1.h>
+#include <TH2.h>
+
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <new>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+
+using namespace std;
+namespace po = boost::program_options;
+
+
+#ifdef TTRES_CHECK_ALLOCATIONS
+// Global operators new are already replaced in the library (see AllocationCheck), and their counter
+//is used
+
+/// Returns number of dynamic memory allocations performed so far in the current thread
+static unsigned long GetNumAllocations()
+{
+    return AllocationCheck::GetNumAllocations();
+}
+
+#else
+
+/// Number of dynamic memory allocations performed so far
+static unsigned long numAllocations = 0;
+
+
+// Replace global allocation functions in order to count allocations
+void *operator new(size_t size)
+{
+    ++numAllocations;
+    void *p = malloc((size > 0) ? size : 1);
+    
+    if (not p)
+        throw bad_alloc();
+    
+    return p;
+}
+
+
+// The nothrow version is used for instance for temporary buffers in std::stable_sort
+void *operator new(size_t size, nothrow_t const &) noexcept
+{
+    ++numAllocations;
+    return malloc((size > 0) ? size : 1);
+}
+
+
+void operator delete(void *p) noexcept
+{
+    free(p);
+}
+
+
+void operator delete(void *p, size_t) noexcept
+{
+    free(p);
+}
+
+
+void operator delete(void *p, nothrow_t const &) noexcept
+{
+    free(p);
+}
+
+
+/// Returns number of dynamic memory allocations performed so far
+static unsigned long GetNumAllocations()
+{
+    return numAllocations;
+}
+
+#endif  // TTRES_CHECK_ALLOCATIONS
+
+
+/// Reconstructed objects in a single event
+struct Event
+{
+    Lepton lepton;
+    Candidate met;
+    vector<Jet> jets;
+    
+    /// Neutrino candidates reconstructed with NuRecoRunI
+    vector<Candidate> neutrinos;
+};
+
+
+using Chi2Expression = TTSemilepRecoChi2::Expression;
+
+/// Reconstruction with the production set of chi^2 terms fixed at compile time
+using TTRecoChi2Production = TTSemilepRecoChi2Fixed<Chi2Expression::MassTopLep,
+  Chi2Expression::MassTopHad, Chi2Expression::MassWHad>;
+
+/// Reconstruction with the production set of chi^2 terms and pt of the tt system
+using TTRecoChi2PtTT = TTSemilepRecoChi2Fixed<Chi2Expression::MassTopLep,
+  Chi2Expression::MassTopHad, Chi2Expression::MassWHad, Chi2Expression::PtTT>;
+
+/// Means and variances of chi^2 terms, in the order of template arguments of the above classes
+array<double, 4> const chi2Means{{172.5, 172.5, 80.4, 0.}};
+array<double, 4> const chi2Variances{{30., 25., 15., 50.}};
+
+
+/// Constructs a four-momentum from pt, eta, phi, and mass
+TLorentzVector BuildP4(double pt, double eta, double phi, double mass)
+{
+    TLorentzVector p4;
+    p4.SetPtEtaPhiM(pt, eta, phi, mass);
+    return p4;
+}
+
+
+/**
+ * \brief Generates a random event with the given number of jets
+ * 
+ * Transverse momenta follow falling exponential distributions above the usual thresholds.
+ */
+Event GenerateEvent(mt19937 &generator, unsigned nJets)
+{
+    exponential_distribution<double> leptonPt(1. / 40.), jetPt(1. / 50.), metPt(1. / 40.);
+    uniform_real_distribution<double> eta(-2.4, 2.4), phi(-M_PI, M_PI), jetMass(5., 20.),
+      cmva(-1., 1.);
+    
+    Event event;
+    event.lepton.SetP4(BuildP4(30. + leptonPt(generator), eta(generator) * 0.9, phi(generator),
+      0.106));
+    event.met.SetP4(BuildP4(20. + metPt(generator), 0., phi(generator), 0.));
+    
+    vector<double> pts;
+    
+    for (unsigned i = 0; i < nJets; ++i)
+        pts.push_back(30. + jetPt(generator));
+    
+    sort(pts.begin(), pts.end(), greater<double>());
+    
+    for (double const pt: pts)
+    {
+        Jet jet;
+        jet.SetP4(BuildP4(pt, eta(generator), phi(generator), jetMass(generator)));
+        jet.SetBTag(BTagger::Algorithm::CMVA, cmva(generator));
+        event.jets.emplace_back(jet);
+    }
+    
+    return event;
+}
+
+
+/**
+ * \brief Reads events from a text file
+ * 
+ * Consult documentation at the top of the file for the format. Throws an exception if the file
+ * cannot be read or is malformed.
+ */
+vector<Event> ReadEvents(string const &path)
+{
+    ifstream file(path);
+    
+    if (not file)
+        throw runtime_error("ReadEvents: Failed to open file \"" + path + "\".");
+    
+    vector<Event> events;
+    string line;
+    
+    // Reads the next line that is not a comment
+    auto const readLine = [&file, &line]()
+    {
+        while (getline(file, line))
+        {
+            if (not line.empty() and line[0] != '#')
+                return true;
+        }
+        
+        return false;
+    };
+    
+    while (readLine())
+    {
+        istringstream header(line);
+        unsigned nJets;
+        double lepPx, lepPy, lepPz, lepE, metPx, metPy;
+        
+        if (not (header >> nJets >> lepPx >> lepPy >> lepPz >> lepE >> metPx >> metPy))
+            throw runtime_error("ReadEvents: Malformed event header \"" + line + "\".");
+        
+        Event event;
+        event.lepton.SetP4(TLorentzVector(lepPx, lepPy, lepPz, lepE));
+        event.met.SetP4(TLorentzVector(metPx, metPy, 0., hypot(metPx, metPy)));
+        
+        for (unsigned i = 0; i < nJets; ++i)
+        {
+            double px, py, pz, e, cmva;
+            
+            if (not readLine() or not (istringstream(line) >> px >> py >> pz >> e >> cmva))
+                throw runtime_error("ReadEvents: Malformed or missing jet record.");
+            
+            Jet jet;
+            jet.SetP4(TLorentzVector(px, py, pz, e));
+            jet.SetBTag(BTagger::Algorithm::CMVA, cmva);
+            event.jets.emplace_back(jet);
+        }
+        
+        events.emplace_back(event);
+    }
+    
+    return events;
+}
+
+
+/**
+ * \brief Provides synthetic likelihoods to the given reconstruction plugin
+ * 
+ * The neutrino distance follows an exponential distribution, and masses of the W boson and the
+ * top quark follow an uncorrelated Gaussian distribution on top of a flat background. Binning is
+ * similar to the one of the likelihoods used in the analysis.
+ */
+void SetSyntheticLikelihood(TTSemilepRecoRochester &ttReco)
+{
+    TH1::AddDirectory(false);
+    
+    TH1D histNeutrino("nu", "", 100, 0., 200.);
+    
+    for (int bin = 1; bin <= histNeutrino.GetNbinsX(); ++bin)
+        histNeutrino.SetBinContent(bin, exp(-histNeutrino.GetBinCenter(bin) / 30.));
+    
+    TH2D histMass("mass", "", 60, 0., 300., 100, 0., 500.);
+    
+    for (int binX = 1; binX <= histMass.GetNbinsX(); ++binX)
+        for (int binY = 1; binY <= histMass.GetNbinsY(); ++binY)
+        {
+            double const mW = histMass.GetXaxis()->GetBinCenter(binX);
+            double const mTop = histMass.GetYaxis()->GetBinCenter(binY);
+            histMass.SetBinContent(binX, binY, 1e-3 +
+              exp(-0.5 * pow((mW - 80.) / 10., 2) - 0.5 * pow((mTop - 173.) / 20., 2)));
+        }
+    
+    histNeutrino.Scale(1. / histNeutrino.Integral(), "width");
+    histMass.Scale(1. / histMass.Integral(), "width");
+    
+    ttReco.SetLikelihood(histNeutrino, histMass);
+}
+
+
+/**
+ * \brief Reconstructs neutrino candidates in the given event with NuRecoRunI
+ * 
+ * They are used by reconstruction based on chi^2.
+ */
+void ReconstructNeutrinos(Event &event)
+{
+    event.neutrinos.clear();
+    NuRecoRunI::Reconstruct(event.lepton.P4(), event.met.P4(), event.neutrinos);
+}
+
+
+/**
+ * \brief Creates reconstruction plugins based on chi^2
+ * 
+ * The first plugin uses TTSemilepRecoChi2 and the second one TTSemilepRecoChi2Fixed, with the same
+ * chi^2 terms. If the flag is true, the term for pt of the tt system is included.
+ */
+pair<unique_ptr<TTSemilepRecoChi2>, unique_ptr<TTSemilepRecoChi2>> BuildTTRecoChi2(bool ptTT)
+{
+    unique_ptr<TTSemilepRecoChi2> runtime(new TTSemilepRecoChi2("TTRecoChi2"));
+    vector<Chi2Expression> const types{Chi2Expression::MassTopLep, Chi2Expression::MassTopHad,
+      Chi2Expression::MassWHad, Chi2Expression::PtTT};
+    
+    for (unsigned i = 0; i < ((ptTT) ? 4 : 3); ++i)
+        runtime->AddChi2Term(types[i], chi2Means[i], chi2Variances[i]);
+    
+    unique_ptr<TTSemilepRecoChi2> fixed;
+    
+    if (ptTT)
+        fixed.reset(new TTRecoChi2PtTT(chi2Means, chi2Variances, "TTRecoChi2Fixed"));
+    else
+        fixed.reset(new TTRecoChi2Production({{chi2Means[0], chi2Means[1], chi2Means[2]}},
+          {{chi2Variances[0], chi2Variances[1], chi2Variances[2]}}, "TTRecoChi2Fixed"));
+    
+    return {move(runtime), move(fixed)};
+}
+
+
+/// Configures the given reconstruction plugin according to the command line options
+void ConfigureTTReco(TTSemilepRecoRochester &ttReco, po::variables_map const &optionsMap)
+{
+    if (optionsMap.count("likelihood"))
+        ttReco.SetLikelihood(optionsMap["likelihood"].as<string>());
+    else
+        SetSyntheticLikelihood(ttReco);
+    
+    ttReco.SetNuMinimizer(NuRecoRochester::Minimizer::Analytic);
+    ttReco.SetBTagSelection(BTagger::Algorithm::CMVA, optionsMap["btag-cut"].as<double>(), false);
+}
+
+
+/**
+ * \brief Checks if results of the reconstruction in the current event agree
+ * 
+ * Status codes, numbers of stored interpretations, and their jet indices must coincide exactly.
+ * Ranks and components of four-momenta of neutrinos must agree within the given relative
+ * tolerance.
+ */
+bool CompareReco(TTSemilepRecoBase const &reference, TTSemilepRecoBase const &tested,
+  double tolerance)
+{
+    auto const close = [tolerance](double a, double b)
+    {
+        return (a == b or abs(a - b) <= tolerance * max(abs(a), abs(b)));
+    };
+    
+    if (tested.GetRecoStatus() != reference.GetRecoStatus() or
+      tested.GetNumInterpretations() != reference.GetNumInterpretations())
+        return false;
+    
+    for (unsigned i = 0; i < reference.GetNumInterpretations(); ++i)
+    {
+        auto const &a = reference.GetInterpretation(i);
+        auto const &b = tested.GetInterpretation(i);
+        
+        if (a.jetIndices != b.jetIndices or not close(a.rank, b.rank))
+            return false;
+        
+        if (not close(a.p4Nu.Px(), b.p4Nu.Px()) or not close(a.p4Nu.Py(), b.p4Nu.Py()) or
+          not close(a.p4Nu.Pz(), b.p4Nu.Pz()) or not close(a.p4Nu.E(), b.p4Nu.E()))
+            return false;
+    }
+    
+    return true;
+}
+
+
+/**
+ * \brief Checks that all search algorithms give the same results in the given events
+ * 
+ * Consult documentation at the top of the file. Prints the numbers of mismatches for each jet
+ * multiplicity and returns their total number. An exception thrown by the validation of an engine
+ * is counted as a mismatch.
+ */
+unsigned long CheckEngines(map<unsigned, vector<Event>> const &events,
+  po::variables_map const &optionsMap)
+{
+    double const tolerance = 1e-9;
+    vector<string> const labels{"Scalar", "Batch", "EarlyScalar", "EarlyBatch"};
+    
+    cout << "Comparison of search algorithms with the exhaustive search, numbers of mismatches:\n";
+    cout << setw(6) << "nJets" << setw(10) << "Events" << setw(6) << "K";
+    
+    for (auto const &label: labels)
+        cout << setw(14) << label;
+    
+    cout << '\n';
+    unsigned long numMismatches = 0;
+    
+    for (unsigned const maxNumInterpretations: {1u, 3u})
+    {
+        // The first plugin performs the exhaustive search and serves as the reference
+        vector<unique_ptr<TTSemilepRecoRochester>> ttRecos;
+        
+        for (unsigned i = 0; i < labels.size() + 1; ++i)
+        {
+            ttRecos.emplace_back(new TTSemilepRecoRochester("TTReco"));
+            ConfigureTTReco(*ttRecos.back(), optionsMap);
+            ttRecos.back()->SetMaxNumInterpretations(maxNumInterpretations);
+        }
+        
+        ttRecos[0]->SetEngine(TTSemilepRecoBase::Engine::Exhaustive);
+        ttRecos[1]->SetEngine(TTSemilepRecoBase::Engine::Scalar, true);
+        ttRecos[2]->SetEngine(TTSemilepRecoBase::Engine::Batch, true);
+        ttRecos[3]->SetEngine(TTSemilepRecoBase::Engine::Scalar, true);
+        ttRecos[3]->SetEarlyTermination();
+        ttRecos[4]->SetEngine(TTSemilepRecoBase::Engine::Batch, true);
+        ttRecos[4]->SetEarlyTermination();
+        
+        for (auto const &group: events)
+        {
+            vector<unsigned long> groupMismatches(labels.size(), 0);
+            
+            for (auto const &event: group.second)
+            {
+                ttRecos[0]->ReconstructEvent(&event.lepton, event.met, event.jets);
+                
+                for (unsigned i = 0; i < labels.size(); ++i)
+                {
+                    auto &ttReco = *ttRecos[i + 1];
+                    
+                    try
+                    {
+                        ttReco.ReconstructEvent(&event.lepton, event.met, event.jets);
+                    }
+                    catch (runtime_error const &e)
+                    {
+                        cerr << e.what() << '\n';
+                        ++groupMismatches[i];
+                        continue;
+                    }
+                    
+                    if (not CompareReco(*ttRecos[0], ttReco, tolerance))
+                        ++groupMismatches[i];
+                }
+            }
+            
+            cout << setw(6) << group.first << setw(10) << group.second.size() << setw(6) <<
+              maxNumInterpretations;
+            
+            for (auto const n: groupMismatches)
+            {
+                cout << setw(14) << n;
+                numMismatches += n;
+            }
+            
+            cout << '\n';
+        }
+    }
+    
+    return numMismatches;
+}
+
+
+/**
+ * \brief Checks that TTSemilepRecoChi2Fixed gives the same results as TTSemilepRecoChi2
+ * 
+ * Consult documentation at the top of the file. Prints the numbers of mismatches for each jet
+ * multiplicity and returns their total number.
+ */
+unsigned long CheckChi2(map<unsigned, vector<Event>> const &events)
+{
+    double const tolerance = 1e-9;
+    
+    cout << "\nComparison of TTSemilepRecoChi2Fixed with TTSemilepRecoChi2, numbers of " <<
+      "mismatches:\n";
+    cout << setw(6) << "nJets" << setw(10) << "Events" << setw(6) << "K" << setw(14) <<
+      "Separable" << setw(14) << "Exhaustive" << setw(14) << "PtTT" << '\n';
+    unsigned long numMismatches = 0;
+    
+    for (unsigned const maxNumInterpretations: {1u, 3u})
+    {
+        // Pairs of plugins for the three configurations
+        vector<pair<unique_ptr<TTSemilepRecoChi2>, unique_ptr<TTSemilepRecoChi2>>> ttRecos;
+        
+        for (bool const ptTT: {false, false, true})
+        {
+            ttRecos.emplace_back(BuildTTRecoChi2(ptTT));
+            
+            for (auto *ttReco: {ttRecos.back().first.get(), ttRecos.back().second.get()})
+            {
+                ttReco->SetMaxNumInterpretations(maxNumInterpretations);
+                
+                if (ttRecos.size() == 2)
+                    ttReco->SetEngine(TTSemilepRecoBase::Engine::Exhaustive);
+            }
+        }
+        
+        for (auto const &group: events)
+        {
+            vector<unsigned long> groupMismatches(ttRecos.size(), 0);
+            
+            for (auto const &event: group.second)
+                for (unsigned i = 0; i < ttRecos.size(); ++i)
+                {
+                    ttRecos[i].first->ReconstructEvent(&event.lepton, event.neutrinos,
+                      event.jets);
+                    ttRecos[i].second->ReconstructEvent(&event.lepton, event.neutrinos,
+                      event.jets);
+                    
+                    if (not CompareReco(*ttRecos[i].first, *ttRecos[i].second, tolerance))
+                        ++groupMismatches[i];
+                }
+            
+            cout << setw(6) << group.first << setw(10) << group.second.size() << setw(6) <<
+              maxNumInterpretations;
+            
+            for (auto const n: groupMismatches)
+            {
+                cout << setw(14) << n;
+                numMismatches += n;
+            }
+            
+            cout << '\n';
+        }
+    }
+    
+    return numMismatches;
+}
+
+
+/// Returns the number of interpretations considered in the exhaustive search with n jets
+unsigned long GetNumInterpretations(unsigned n)
+{
+    return (n < 4) ? 0 : (unsigned long)n * (n - 1) * (n - 2) * (n - 3) / 2;
+}
+
+
+/// Measures time and number of allocations in a section of code
+class Measurement
+{
+public:
+    /// Starts the measurement
+    Measurement():
+        start(chrono::steady_clock::now()),
+        startAllocations(GetNumAllocations())
+    {}
+    
+public:
+    /// Returns time elapsed since the start, in nanoseconds
+    double GetTime() const
+    {
+        return chrono::duration<double, nano>(chrono::steady_clock::now() - start).count();
+    }
+    
+    /// Returns number of allocations performed since the start
+    unsigned long GetAllocations() const
+    {
+        return GetNumAllocations() - startAllocations;
+    }
+    
+private:
+    chrono::steady_clock::time_point start;
+    unsigned long startAllocations;
+};
+
+
+int main(int argc, char **argv)
+{
+    // Parse arguments
+    po::options_description options("Allowed options");
+    options.add_options()
+      ("help,h", "Prints help message")
+      ("events,n", po::value<unsigned>()->default_value(2000),
+        "Number of synthetic events per jet multiplicity")
+      ("min-jets", po::value<unsigned>()->default_value(4), "Minimal jet multiplicity")
+      ("max-jets", po::value<unsigned>()->default_value(12), "Maximal jet multiplicity")
+      ("seed", po::value<unsigned>()->default_value(1), "Seed for generation of synthetic events")
+      ("input,i", po::value<string>(), "Text file with recorded events")
+      ("likelihood", po::value<string>(),
+        "ROOT file with likelihoods for TTSemilepRecoRochester, instead of synthetic ones")
+      ("btag-cut", po::value<double>()->default_value(0.4432),
+        "Cut on CMVA for jets assigned to b quarks")
+      ("repeat", po::value<unsigned>()->default_value(5),
+        "Number of passes over events in each measurement")
+      ("check", "Compare results of all search algorithms instead of measuring time");
+    
+    po::variables_map optionsMap;
+    po::store(po::parse_command_line(argc, argv, options), optionsMap);
+    po::notify(optionsMap);
+    
+    if (optionsMap.count("help"))
+    {
+        cerr << "Runs micro-benchmarks for the reconstruction kernels.\n";
+        cerr << "Usage: bench-reco [options]\n";
+        cerr << options << endl;
+        return EXIT_FAILURE;
+    }
+    
+    unsigned const minJets = max(optionsMap["min-jets"].as<unsigned>(), 4u);
+    unsigned const maxJets = optionsMap["max-jets"].as<unsigned>();
+    unsigned const nRepeat = max(optionsMap["repeat"].as<unsigned>(), 1u);
+    
+    
+    // Prepare events and group them by jet multiplicity
+    map<unsigned, vector<Event>> events;
+    
+    if (optionsMap.count("input"))
+    {
+        for (auto &event: ReadEvents(optionsMap["input"].as<string>()))
+        {
+            unsigned const nJets = event.jets.size();
+            
+            if (nJets >= minJets and nJets <= maxJets)
+                events[nJets].emplace_back(move(event));
+        }
+    }
+    else
+    {
+        mt19937 generator(optionsMap["seed"].as<unsigned>());
+        unsigned const nEvents = optionsMap["events"].as<unsigned>();
+        
+        for (unsigned nJets = minJets; nJets <= maxJets; ++nJets)
+            for (unsigned i = 0; i < nEvents; ++i)
+                events[nJets].emplace_back(GenerateEvent(generator, nJets));
+    }
+    
+    if (events.empty())
+    {
+        cerr << "No events with requested jet multiplicities.\n";
+        return EXIT_FAILURE;
+    }
+    
+    for (auto &group: events)
+        for (auto &event: group.second)
+            ReconstructNeutrinos(event);
+    
+    
+    // Check consistency of the search algorithms if requested
+    if (optionsMap.count("check"))
+    {
+        unsigned long const numMismatches = CheckEngines(events, optionsMap) + CheckChi2(events);
+        
+        if (numMismatches > 0)
+        {
+            cerr << "Reconstruction algorithms disagree in " << numMismatches << " cases.\n";
+            return EXIT_FAILURE;
+        }
+        
+        return EXIT_SUCCESS;
+    }
+    
+    
+    // Set up reconstruction plugins for the two engines and for the early termination. They are
+    //not managed by a RunManager, and the reconstruction is invoked directly
+    TTSemilepRecoRochester ttRecoScalar("TTRecoScalar"), ttRecoBatch("TTRecoBatch"),
+      ttRecoEarly("TTRecoEarly");
+    
+    for (auto *ttReco: {&ttRecoScalar, &ttRecoBatch, &ttRecoEarly})
+        ConfigureTTReco(*ttReco, optionsMap);
+    
+    ttRecoScalar.SetEngine(TTSemilepRecoBase::Engine::Scalar);
+    ttRecoBatch.SetEngine(TTSemilepRecoBase::Engine::Batch);
+    ttRecoEarly.SetEngine(TTSemilepRecoBase::Engine::Batch);
+    ttRecoEarly.SetEarlyTermination();
+    
+    
+    // A checksum that prevents the compiler from optimizing away the benchmarked code
+    double checksum = 0.;
+    
+    
+    // Benchmark the neutrino reconstruction. It is performed for every jet in every event
+    cout << "Neutrino reconstruction, ns per call:\n";
+    cout << setw(6) << "nJets" << setw(16) << "Rochester:build" << setw(16) << "Rochester:batch" <<
+      setw(16) << "Rochester:step" << setw(16) << "Rochester:anal" << setw(12) << "RunI" <<
+      setw(12) << "RunI:batch" << '\n';
+    cout << fixed << setprecision(1);
+    
+    for (auto const &group: events)
+    {
+        unsigned long nCalls = 0;
+        double timeBuild = 0., timeBatch = 0., timeStep = 0., timeAnalytic = 0.;
+        
+        
+        // Components of four-momenta of jets for the batched construction of ellipses
+        vector<vector<double>> jetComponents(4 * group.second.size());
+        
+        for (unsigned iEvent = 0; iEvent < group.second.size(); ++iEvent)
+            for (auto const &jet: group.second[iEvent].jets)
+            {
+                jetComponents[4 * iEvent].emplace_back(jet.P4().Px());
+                jetComponents[4 * iEvent + 1].emplace_back(jet.P4().Py());
+                jetComponents[4 * iEvent + 2].emplace_back(jet.P4().Pz());
+                jetComponents[4 * iEvent + 3].emplace_back(jet.P4().E());
+            }
+        
+        vector<double> ellipses(NuKernels::ellipseSize * group.first);
+        unique_ptr<bool[]> reconstructable(new bool[group.first]);
+        
+        for (unsigned iRepeat = 0; iRepeat < nRepeat; ++iRepeat)
+        {
+            Measurement build;
+            
+            for (auto const &event: group.second)
+                for (auto const &jet: event.jets)
+                {
+                    NuRecoRochester nuBuilder(&event.lepton.P4(), &jet.P4());
+                    checksum += nuBuilder.IsReconstructable();
+                    ++nCalls;
+                }
+            
+            timeBuild += build.GetTime();
+            
+            Measurement batch;
+            
+            for (unsigned iEvent = 0; iEvent < group.second.size(); ++iEvent)
+            {
+                TLorentzVector const &p4Lep = group.second[iEvent].lepton.P4();
+                NuKernels::ComputeRochesterEllipses(p4Lep.Px(), p4Lep.Py(), p4Lep.Pz(), p4Lep.E(),
+                  group.second[iEvent].jets.size(), jetComponents[4 * iEvent].data(),
+                  jetComponents[4 * iEvent + 1].data(), jetComponents[4 * iEvent + 2].data(),
+                  jetComponents[4 * iEvent + 3].data(), ellipses.data(), reconstructable.get());
+                checksum += reconstructable[0];
+            }
+            
+            timeBatch += batch.GetTime();
+            
+            for (auto const minimizer:
+              {NuRecoRochester::Minimizer::StepHalving, NuRecoRochester::Minimizer::Analytic})
+            {
+                Measurement measurement;
+                
+                for (auto const &event: group.second)
+                    for (auto const &jet: event.jets)
+                    {
+                        NuRecoRochester nuBuilder(&event.lepton.P4(), &jet.P4());
+                        nuBuilder.SetMinimizer(minimizer, 1e-5);
+                        double distance;
+                        checksum += nuBuilder.GetBest(event.met.P4().Px(), event.met.P4().Py(),
+                          1., 1., 0., distance).Pz();
+                    }
+                
+                ((minimizer == NuRecoRochester::Minimizer::Analytic) ? timeAnalytic : timeStep) +=
+                  measurement.GetTime();
+            }
+        }
+        
+        
+        // The solver of NuRecoRunI only uses the lepton and MET
+        vector<Candidate> neutrinos;
+        neutrinos.reserve(2);
+        unsigned long nCallsRunI = 0;
+        Measurement measurementRunI;
+        
+        for (unsigned iRepeat = 0; iRepeat < nRepeat; ++iRepeat)
+            for (auto const &event: group.second)
+            {
+                neutrinos.clear();
+                NuRecoRunI::Reconstruct(event.lepton.P4(), event.met.P4(), neutrinos);
+                checksum += neutrinos.size();
+                ++nCallsRunI;
+            }
+        
+        double const timeRunI = measurementRunI.GetTime();
+        
+        
+        // The batched solver processes all events of the group in a single call
+        unsigned const nEvents = group.second.size();
+        vector<double> lepPx(nEvents), lepPy(nEvents), lepPz(nEvents), lepE(nEvents);
+        vector<double> metPx(nEvents), metPy(nEvents);
+        
+        for (unsigned iEvent = 0; iEvent < nEvents; ++iEvent)
+        {
+            TLorentzVector const &p4Lep = group.second[iEvent].lepton.P4();
+            lepPx[iEvent] = p4Lep.Px();
+            lepPy[iEvent] = p4Lep.Py();
+            lepPz[iEvent] = p4Lep.Pz();
+            lepE[iEvent] = p4Lep.E();
+            metPx[iEvent] = group.second[iEvent].met.P4().Px();
+            metPy[iEvent] = group.second[iEvent].met.P4().Py();
+        }
+        
+        vector<unsigned> numSolutions(nEvents);
+        vector<double> pz1(nEvents), pz2(nEvents), nuPx(nEvents), nuPy(nEvents);
+        Measurement measurementRunIBatch;
+        
+        for (unsigned iRepeat = 0; iRepeat < nRepeat; ++iRepeat)
+        {
+            NuKernels::SolveWMass(nEvents, lepPx.data(), lepPy.data(), lepPz.data(), lepE.data(),
+              metPx.data(), metPy.data(), numSolutions.data(), pz1.data(), pz2.data(),
+              nuPx.data(), nuPy.data());
+            checksum += numSolutions[0];
+        }
+        
+        double const timeRunIBatch = measurementRunIBatch.GetTime();
+        
+        cout << setw(6) << group.first << setw(16) << timeBuild / nCalls <<
+          setw(16) << timeBatch / nCalls << setw(16) << timeStep / nCalls <<
+          setw(16) << timeAnalytic / nCalls << setw(12) << timeRunI / nCallsRunI <<
+          setw(12) << timeRunIBatch / nCallsRunI << '\n';
+    }
+    
+    
+    // Benchmark the full jet assignment with both engines and with early termination
+    cout << "\nJet assignment in TTSemilepRecoRochester:\n";
+    cout << setw(6) << "nJets" << setw(10) << "Events" << setw(10) << "Interp." <<
+      setw(10) << "Success";
+    
+    for (string const label: {"Scalar", "Batch", "Early"})
+        cout << setw(14) << label + ":ns/ev" << setw(14) << label + ":ns/int" << setw(14) <<
+          label + ":alloc" << setw(14) << label + ":visit";
+    
+    cout << '\n';
+    
+    for (auto const &group: events)
+    {
+        unsigned const nJets = group.first;
+        unsigned long const nEvents = group.second.size() * nRepeat;
+        unsigned long const nInterpretations = GetNumInterpretations(nJets);
+        
+        cout << setw(6) << nJets << setw(10) << group.second.size() << setw(10) <<
+          nInterpretations;
+        
+        for (auto *ttReco: {&ttRecoScalar, &ttRecoBatch, &ttRecoEarly})
+        {
+            // Reconstruct each event once before the measurement so that buffers inside the
+            //plugin have reached their final sizes
+            unsigned long nSuccesses = 0, nVisited = 0;
+            
+            for (auto const &event: group.second)
+            {
+                ttReco->ReconstructEvent(&event.lepton, event.met, event.jets);
+                nSuccesses += (ttReco->GetRecoStatus() == 0);
+                nVisited += ttReco->GetNumVisitedInterpretations();
+            }
+            
+            if (ttReco == &ttRecoScalar)
+                cout << setw(9) << 100. * nSuccesses / group.second.size() << '%';
+            
+            
+            Measurement measurement;
+            
+            for (unsigned iRepeat = 0; iRepeat < nRepeat; ++iRepeat)
+                for (auto const &event: group.second)
+                {
+                    ttReco->ReconstructEvent(&event.lepton, event.met, event.jets);
+                    checksum += ttReco->GetRecoStatus();
+                }
+            
+            double const time = measurement.GetTime();
+            unsigned long const allocations = measurement.GetAllocations();
+            
+            cout << setw(14) << time / nEvents << setw(14) <<
+              time / (nEvents * nInterpretations) << setw(14) <<
+              double(allocations) / nEvents << setw(14) <<
+              double(nVisited) / group.second.size();
+        }
+        
+        cout << '\n';
+    }
+    
+    // Benchmark the jet assignment based on chi^2 with the terms evaluated at run time and fixed at
+    //compile time
+    cout << "\nJet assignment in TTSemilepRecoChi2 and TTSemilepRecoChi2Fixed, ns per event:\n";
+    cout << setw(6) << "nJets";
+    
+    for (string const label: {"Separable", "Exhaustive", "PtTT"})
+        cout << setw(20) << label + ":runtime" << setw(20) << label + ":fixed";
+    
+    cout << '\n';
+    vector<pair<unique_ptr<TTSemilepRecoChi2>, unique_ptr<TTSemilepRecoChi2>>> ttRecosChi2;
+    
+    for (bool const ptTT: {false, false, true})
+        ttRecosChi2.emplace_back(BuildTTRecoChi2(ptTT));
+    
+    ttRecosChi2[1].first->SetEngine(TTSemilepRecoBase::Engine::Exhaustive);
+    ttRecosChi2[1].second->SetEngine(TTSemilepRecoBase::Engine::Exhaustive);
+    
+    for (auto const &group: events)
+    {
+        unsigned long const nEvents = group.second.size() * nRepeat;
+        cout << setw(6) << group.first;
+        
+        for (auto const &ttRecoPair: ttRecosChi2)
+            for (auto *ttReco: {ttRecoPair.first.get(), ttRecoPair.second.get()})
+            {
+                // Reconstruct each event once before the measurement so that buffers inside the
+                //plugin have reached their final sizes
+                for (auto const &event: group.second)
+                    ttReco->ReconstructEvent(&event.lepton, event.neutrinos, event.jets);
+                
+                Measurement measurement;
+                
+                for (unsigned iRepeat = 0; iRepeat < nRepeat; ++iRepeat)
+                    for (auto const &event: group.second)
+                    {
+                        ttReco->ReconstructEvent(&event.lepton, event.neutrinos, event.jets);
+                        checksum += ttReco->GetRecoStatus();
+                    }
+                
+                cout << setw(20) << measurement.GetTime() / nEvents;
+            }
+        
+        cout << '\n';
+    }
+    
+    cout << "\nChecksum: " << setprecision(6) << checksum << endl;
+    
+    
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <string>
+
+
+/**
+ * \class AllocationCheck
+ * \brief Verifies that a plugin does not allocate memory from the global heap in steady state
+ * 
+ * Reconstruction plugins keep all per-event temporaries in member buffers, which are cleared (but
+ * not deallocated) at the start of each event and thus act as per-clone scratch arenas. After a
+ * few events have been processed, the buffers reach their working sizes, and no further heap
+ * allocations should occur. With many threads this avoids contention in the global allocator.
+ * 
+ * This class allows to check that the above holds. An instance is owned by each plugin (a new one
+ * is used for every clone), and the body of ProcessEvent is enclosed in calls to methods Begin and
+ * End. When the package is built with the macro TTRES_CHECK_ALLOCATIONS defined (make
+ * ALLOC_CHECK=1), global operators new are replaced with versions that count allocations in each
+ * thread, and End throws an exception if an allocation has happened in between after the warm-up
+ * period. Otherwise both methods do nothing.
+ */
+class AllocationCheck
+{
+public:
+    /// Constructor from the number of events not to be checked at the beginning
+    AllocationCheck(unsigned numWarmUpEvents = 100);
+    
+public:
+    /// Starts monitoring of allocations in the current thread
+    void Begin()
+    {
+#ifdef TTRES_CHECK_ALLOCATIONS
+        startCount = GetNumAllocations();
+#endif
+    }
+    
+    /**
+     * \brief Stops monitoring of allocations
+     * 
+     * Throws an exception if an allocation has happened since the matching call to Begin, unless
+     * the warm-up period is still ongoing. The given name of the plugin is used in the message.
+     */
+    void End(std::string const &pluginName)
+    {
+#ifdef TTRES_CHECK_ALLOCATIONS
+        if (numEvents < numWarmUpEvents)
+            ++numEvents;
+        else if (GetNumAllocations() != startCount)
+            ReportFailure(pluginName);
+#else
+        (void) pluginName;
+#endif
+    }
+    
+    /**
+     * \brief Returns the number of heap allocations performed in the current thread so far
+     * 
+     * Always returns zero unless the macro TTRES_CHECK_ALLOCATIONS is defined.
+     */
+    static unsigned long GetNumAllocations();
+    
+    /// Checks if allocations are counted in the current build
+    static bool IsEnabled();
+    
+private:
+    /// Throws an exception describing unexpected allocations
+    void ReportFailure(std::string const &pluginName) const;
+    
+private:
+    /// Number of events at the beginning for which allocations are allowed
+    unsigned numWarmUpEvents;
+    
+    /// Number of events processed so far, saturated at numWarmUpEvents
+    unsigned numEvents;
+    
+    /// Number of allocations in the current thread at the time Begin was called
+    unsigned long startCount;
+};
@@ -4,29 +4,39 @@
 
 #include <mensura/core/BTagger.hpp>
 
-#include <TTree.h>
+#include <AllocationCheck.hpp>
+#include <NtupleWriter.hpp>
 
+#include <Rtypes.h>
+
+#include <cstdint>
 #include <string>
 
 
 class BTagWPService;
+class JetFlags;
 class LeptonReader;
 class JetMETReader;
 class PileUpReader;
-class TFileService;
 
 
 /**
  * \class BasicObservables
  * \brief A plugin to store basic kinematical information
  * 
- * Saves TTree with a number of simple observables.
+ * Computes a number of simple observables and registers them as columns with an NtupleWriter
+ * with the default name "NtupleWriter". If the name of a JetFlags plugin is provided, b-tagging
+ * decisions and HT are read from it instead of being computed here.
  */
 class BasicObservables: public AnalysisPlugin
 {
 public:
-    /// Constructor
-    BasicObservables(BTagger const &bTagger);
+    /**
+     * \brief Constructor
+     * 
+     * User is encouraged to keep the default name unless several instances are needed.
+     */
+    BasicObservables(BTagger const &bTagger, std::string const &name = "BasicObservables");
     
     /// Default move constructor
     BasicObservables(BasicObservables &&) = default;
@@ -43,10 +53,10 @@ private:
      * the copy constructor must not be used in a generic case and made private to prevent this.
      */
     BasicObservables(BasicObservables const &src);
-
+    
 public:
     /**
-     * \brief Saves pointers to dependencies and sets up the output tree
+     * \brief Saves pointers to dependencies and registers output columns
      * 
      * Reimplemented from Plugin.
      */
@@ -58,24 +68,53 @@ public:
      * Implemented from Plugin.
      */
     virtual Plugin *Clone() const override;
-
+    
+    /**
+     * \brief Specifies name of the plugin that provides flags of jets
+     * 
+     * The plugin must compute flags from the same collection of jets as used by this one and for
+     * the b-tagging working point given to the constructor. If the name is empty (default), the
+     * flags are not used.
+     */
+    void SetJetFlagsPluginName(std::string const &pluginName);
+    
+    /// Specifies name of the plugin that produces jets and MET
+    void SetJetMETPluginName(std::string const &pluginName);
+    
+    /**
+     * \brief Specifies a prefix to be added to names of all output columns
+     * 
+     * By default, the prefix is empty.
+     */
+    void SetColumnPrefix(std::string const &prefix);
+    
+    /**
+     * \brief Specifies storage schema for output columns
+     * 
+     * By default, all columns are stored with full precision.
+     */
+    void SetStorageSchema(NtupleWriter::Schema const &schema);
+    
 private:
     /**
-     * \brief Computes representative observables for the current event and fills the tree
+     * \brief Computes representative observables for the current event
      * 
      * Implemented from Plugin.
      */
     virtual bool ProcessEvent() override;
-
+    
 private:
     /// Selected b-tagging algorithm and working point
     BTagger bTagger;
     
-    /// Name of TFileService
-    std::string fileServiceName;
+    /// Name of the plugin that writes output columns
+    std::string writerName;
+    
+    /// Prefix for names of output columns
+    std::string columnPrefix;
     
-    /// Non-owning pointer to TFileService
-    TFileService const *fileService;
+    /// Storage schema for output columns
+    NtupleWriter::Schema schema;
     
     /// Name of the service that provides b-tagging working points
     std::string bTagWPServiceName;
@@ -89,6 +128,15 @@ private:
     /// Non-owning pointer to the plugin that produces leptons
     LeptonReader const *leptonPlugin;
     
+    /// Name of the plugin that provides flags of jets
+    std::string jetFlagsPluginName;
+    
+    /// Non-owning pointer to the plugin that provides flags of jets
+    JetFlags const *jetFlagsPlugin;
+    
+    /// Bit that shows in flags of jets whether they are b-tagged
+    std::uint32_t bTagMask;
+    
     /// Name of the plugin that produces jets and MET
     std::string jetmetPluginName;
     
@@ -101,8 +149,8 @@ private:
     /// Non-owning pointer to the plugin that reads information about pile-up
     PileUpReader const *puPlugin;
     
-    /// Non-owning pointer to output tree
-    TTree *tree;
+    /// Checks that no memory is allocated in ProcessEvent in steady state
+    AllocationCheck allocationCheck;
     
     // Output buffers
     Int_t nJet30, nJet20, nBJet30, nBJet20;
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <mensura/core/AnalysisPlugin.hpp>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+
+class TFile;
+class TFileService;
+
+
+/**
+ * \class CompletionManifest
+ * \brief Records (parts of) datasets that have been processed completely
+ * 
+ * When processing of a dataset has finished, this plugin appends an entry to a text file. The entry
+ * consists of a key, written in hexadecimal form, and the source dataset ID, separated by a space.
+ * The key is computed by method ComputeKey from the hash of the source dataset ID and names of
+ * input files (see SkimWriter::GetInputHash) and a text description of the configuration of the
+ * job, so that a dataset processed with a different configuration is not considered completed.
+ * Each entry is written with a single system call in append mode and synchronized to the disk, so
+ * that entries from different threads are not interleaved and an entry is not lost if the job is
+ * killed later. A rerun of the job can read the file with method Read and skip
+ * datasets that have been recorded.
+ * 
+ * A dataset must only be recorded once its output files have been closed, which TFileService does
+ * after EndRun has been called for all plugins. For this reason, a dataset that has finished is
+ * only recorded when the same clone starts the next dataset. The last dataset processed by each
+ * clone is recorded by method WritePending, which must be called on this plugin after
+ * RunManager::Process has returned.
+ * 
+ * The key of each dataset is also saved in its output file, as the title of a TNamed object with
+ * name "ChunkKey". Method ReadKey allows to find out which chunk a file has been written for, so
+ * that files left by failed or outdated jobs can be told apart from outputs of recorded chunks.
+ */
+class CompletionManifest: public AnalysisPlugin
+{
+public:
+    /**
+     * \brief Constructor from the path to the manifest file and the description of the
+     * configuration of the job
+     */
+    CompletionManifest(std::string const &path, std::string const &configuration,
+      std::string const &name = "CompletionManifest");
+    
+    /// Assignment operator is deleted
+    CompletionManifest &operator=(CompletionManifest const &) = delete;
+    
+private:
+    /// Copy constructor that produces a newly initialized clone sharing pending entries
+    CompletionManifest(CompletionManifest const &src);
+    
+public:
+    /**
+     * \brief Saves the entry for the dataset that is about to be processed
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void BeginRun(Dataset const &dataset) override;
+    
+    /**
+     * \brief Creates a newly configured clone
+     * 
+     * Implemented from Plugin.
+     */
+    virtual Plugin *Clone() const override;
+    
+    /**
+     * \brief Marks the dataset that has been processed as pending for the manifest
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void EndRun() override;
+    
+    /// Computes the key for the given dataset processed with the given configuration
+    static std::uint64_t ComputeKey(Dataset const &dataset, std::string const &configuration);
+    
+    /**
+     * \brief Formats the entry for the given dataset and configuration, including the trailing new
+     * line character
+     */
+    static std::string FormatEntry(Dataset const &dataset, std::string const &configuration);
+    
+    /**
+     * \brief Reads entries from a manifest file
+     * 
+     * Returns a map from keys to source dataset IDs. If the file does not exist, the map is
+     * empty. Lines that cannot be parsed, e.g. one that has been truncated, are ignored.
+     */
+    static std::map<std::uint64_t, std::string> Read(std::string const &path);
+    
+    /**
+     * \brief Reads the key saved in the given output file
+     * 
+     * Returns false if the file does not contain a valid key.
+     */
+    static bool ReadKey(TFile &file, std::uint64_t &key);
+    
+    /**
+     * \brief Appends entries for all datasets that have been processed but not recorded yet
+     * 
+     * Pending entries are shared among all clones. This method must only be called after all
+     * output files have been closed, i.e. after RunManager::Process has returned.
+     */
+    void WritePending();
+    
+private:
+    /// Entries for datasets that have been processed but not recorded yet, shared among clones
+    class PendingEntries;
+    
+private:
+    /**
+     * \brief Does nothing
+     * 
+     * Implemented from Plugin.
+     */
+    virtual bool ProcessEvent() override;
+    
+    /// Formats the given key as a hexadecimal number with a fixed number of digits
+    static std::string FormatKey(std::uint64_t key);
+    
+    /**
+     * \brief Appends the given entry to the manifest
+     * 
+     * Throws an exception in case of a failure.
+     */
+    void Append(std::string const &entry) const;
+    
+private:
+    /// Path to the manifest file
+    std::string path;
+    
+    /// Description of the configuration of the job
+    std::string configuration;
+    
+    /// Name of TFileService
+    std::string fileServiceName;
+    
+    /// Non-owning pointer to TFileService
+    TFileService const *fileService;
+    
+    /// Entry for the current dataset
+    std::string entry;
+    
+    /// Entry for the dataset processed previously by this clone, or empty if it has been recorded
+    std::string finishedEntry;
+    
+    /// Entries that have not been recorded yet
+    std::shared_ptr<PendingEntries> pendingEntries;
+};
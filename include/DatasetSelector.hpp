@@ -0,0 +1,49 @@
+#pragma once
+
+#include <initializer_list>
+#include <map>
+#include <mutex>
+#include <regex>
+#include <string>
+#include <vector>
+
+
+/**
+ * \class DatasetSelector
+ * \brief Decides whether a dataset is selected based on regular expressions for its ID
+ * 
+ * Masks are compiled once at construction. The decision for every dataset ID is cached, so that
+ * the regular expressions are only matched once per dataset, even if the selector is shared
+ * among clones of a plugin running in different threads. A default-constructed selector accepts
+ * all datasets without any matching.
+ */
+class DatasetSelector
+{
+public:
+    /// Constructs a selector that accepts all datasets
+    DatasetSelector();
+    
+    /// Constructs a selector that accepts datasets whose ID matches at least one of the masks
+    DatasetSelector(std::initializer_list<std::string> const &masks);
+    
+public:
+    /**
+     * \brief Checks whether the dataset with the given ID is selected
+     * 
+     * This method is thread-safe.
+     */
+    bool IsSelected(std::string const &datasetID) const;
+    
+private:
+    /// Flag showing that all datasets are selected regardless of masks
+    bool selectAll;
+    
+    /// Compiled masks
+    std::vector<std::regex> masks;
+    
+    /// Mutex to protect the cache
+    mutable std::mutex mutex;
+    
+    /// Decisions for dataset IDs that have already been checked
+    mutable std::map<std::string, bool> decisions;
+};
@@ -2,7 +2,7 @@
 
 #include <mensura/core/AnalysisPlugin.hpp>
 
-#include <TTree.h>
+#include <Rtypes.h>
 
 #include <string>
 #include <vector>
@@ -18,20 +18,46 @@ class WeightCollector;
  * \class DumpWeights
  * \brief A plugin to save event weights
  * 
- * Creates a TTree with nominal event weight and alternative weights that account for systematic
- * variations. The weights are read from a WeightCollector, and all provided systematic variations
- * are evaluated. In addition to the WeightCollector, this plugin always reads the nominal
- * generator-level weight and trigger weight (i.e. the integrated luminosity). They are
- * incorporated into all stored weights.
+ * Saves nominal event weight and alternative weights that account for systematic variations. The
+ * weights are read from a WeightCollector, and all provided systematic variations are evaluated.
+ * In addition to the WeightCollector, this plugin always reads the nominal generator-level weight
+ * and trigger weight (i.e. the integrated luminosity). They are incorporated into all stored
+ * weights.
  * 
- * Nominal and alternative weights are written into two different branches. The alternative weights
- * are stored as an array, whose size is equal to the number of variations provided by the
- * WeightCollector and thus might depend on the dataset.
+ * Nominal and alternative weights are registered as two columns with an NtupleWriter with the
+ * default name "NtupleWriter". The alternative weights are stored as an array, whose size is equal
+ * to the number of variations provided by the WeightCollector and thus might depend on the
+ * dataset. Plugins that are not active for the current dataset provide no variations and do not
+ * contribute to the array. By default, the alternative weights are stored as absolute values.
+ * Alternatively, they can be stored as ratios to the nominal weight. In this encoding
+ * variations that coincide with the nominal weight are stored as exact unity, which compresses
+ * very well.
+ * 
+ * To describe the layout of the array, a TNamed object "SystWeightsLayout" is saved in the root
+ * directory of the output file. Its title is of the form
+ *   encoding=ratio;variations=PileUpWeight:0:up,PileUpWeight:0:down,...
+ * where the encoding is "absolute" or "ratio", and the comma-separated list gives the name of the
+ * plugin, the index of the variation, and its direction for each element of the array.
  * 
  * This plugin should only be used with simulation.
  */
 class DumpWeights: public AnalysisPlugin
 {
+public:
+    /// Supported encodings for alternative weights
+    enum class Encoding
+    {
+        /// Alternative weights are stored as they are
+        Absolute,
+        
+        /**
+         * \brief Alternative weights are divided by the nominal one
+         * 
+         * If the nominal weight is zero, the ratio is set to zero.
+         */
+        Ratio
+    };
+    
 public:
     /**
      * \brief Constructor
@@ -53,10 +79,10 @@ public:
 private:
     /// Copy constructor
     DumpWeights(DumpWeights const &src);
-
+    
 public:
     /**
-     * \brief Saves pointers to dependencies and sets up the output tree
+     * \brief Saves pointers to dependencies and registers output columns
      * 
      * Reimplemented from Plugin.
      */
@@ -68,7 +94,27 @@ public:
      * Implemented from Plugin.
      */
     virtual Plugin *Clone() const override;
-
+    
+    /**
+     * \brief Returns description of the layout of alternative weights
+     * 
+     * The format is the same as for the title of the TNamed object "SystWeightsLayout".
+     */
+    std::string const &GetLayout() const;
+    
+    /// Returns alternative weights for the current event, encoded as requested
+    std::vector<Float_t> const &GetSystWeights() const;
+    
+    /// Returns nominal weight for the current event
+    Float_t GetWeight() const;
+    
+    /**
+     * \brief Specifies how alternative weights are encoded
+     * 
+     * The default encoding is Encoding::Absolute.
+     */
+    void SetEncoding(Encoding encoding);
+    
 private:
     /**
      * \brief Saves event weights
@@ -76,8 +122,11 @@ private:
      * Implemented from Plugin.
      */
     virtual bool ProcessEvent() override;
-
+    
 private:
+    /// Name of the plugin that writes output columns
+    std::string writerName;
+    
     /// Name of TFileService
     std::string fileServiceName;
     
@@ -109,8 +158,11 @@ private:
      */
     double weightDataset;
     
-    /// Non-owning pointer to output tree
-    TTree *tree;
+    /// Encoding for alternative weights
+    Encoding encoding;
+    
+    /// Description of the layout of alternative weights
+    std::string layout;
     
     // Output buffers
     Float_t weight;
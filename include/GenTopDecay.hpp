@@ -0,0 +1,126 @@
+#pragma once
+
+#include <mensura/core/AnalysisPlugin.hpp>
+
+#include <TLorentzVector.h>
+
+#include <array>
+#include <string>
+
+
+class GenParticle;
+class GenParticleReader;
+
+
+/**
+ * \class GenTopDecay
+ * \brief Finds generator-level top quarks and their decay products
+ * 
+ * For each event, finds top quarks in the collection of generator-level particles read by a
+ * GenParticleReader with the default name "GenParticles", and identifies their decay products.
+ * Particles are exposed as indices in the collection returned by GenParticleReader::GetParticles,
+ * so that plugins that need generator-level top quarks do not have to scan the collection again.
+ * 
+ * The momentum of a top quark is computed as the sum of momenta of its decay products, which
+ * gives the momentum of the last top quark in the event history. It is expected that a top quark
+ * has three decay products, counting daughters of the W boson instead of the W boson itself. An
+ * exception is thrown if this is not the case or if more than two top quarks are found. Events
+ * with fewer top quarks are not considered an error, and the number of found top quarks can be
+ * checked with GetNumTops.
+ * 
+ * The b quark, the W boson, and daughters of the W boson are only identified if the top quark has
+ * exactly one daughter other than a W boson and exactly one W boson, which in turn has exactly two
+ * daughters. Otherwise their indices are set to -1, while the momentum of the top quark is still
+ * computed from all its decay products.
+ * 
+ * This plugin never rejects events.
+ */
+class GenTopDecay: public AnalysisPlugin
+{
+public:
+    /// Indices of a top quark and its decay products
+    struct Decay
+    {
+        /// Index of the top quark
+        int top;
+        
+        /**
+         * \brief Index of the daughter that is not a W boson, normally a b quark
+         * 
+         * Set to -1 unless the decay products have been identified (see documentation for the
+         * class).
+         */
+        int b;
+        
+        /**
+         * \brief Index of the W boson
+         * 
+         * Set to -1 unless the decay products have been identified.
+         */
+        int w;
+        
+        /**
+         * \brief Indices of the two daughters of the W boson
+         * 
+         * Set to -1 unless the decay products have been identified.
+         */
+        std::array<int, 2> wDaughters;
+        
+        /// Sum of momenta of the decay products
+        TLorentzVector p4;
+    };
+    
+public:
+    /// Constructor
+    GenTopDecay(std::string const &name = "GenTopDecay");
+    
+public:
+    /**
+     * \brief Saves pointer to the GenParticleReader
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void BeginRun(Dataset const &) override;
+    
+    /**
+     * \brief Creates a newly configured clone
+     * 
+     * Implemented from Plugin.
+     */
+    virtual Plugin *Clone() const override;
+    
+    /**
+     * \brief Returns decay of the top quark with the given index
+     * 
+     * Top quarks are given in the order in which they appear in the collection of
+     * generator-level particles. The index must be smaller than GetNumTops.
+     */
+    Decay const &GetDecay(unsigned index) const;
+    
+    /// Returns number of top quarks found in the current event
+    unsigned GetNumTops() const;
+    
+    /// Returns the generator-level particle with the given index
+    GenParticle const &GetParticle(int index) const;
+    
+private:
+    /**
+     * \brief Finds top quarks and their decay products
+     * 
+     * Implemented from Plugin.
+     */
+    virtual bool ProcessEvent() override;
+    
+private:
+    /// Name of plugin that provides generator-level particles
+    std::string genParticleReaderName;
+    
+    /// Non-owning pointer to plugin that provides generator-level particles
+    GenParticleReader const *genParticleReader;
+    
+    /// Number of top quarks found in the current event
+    unsigned numTops;
+    
+    /// Decays of found top quarks
+    std::array<Decay, 2> decays;
+};
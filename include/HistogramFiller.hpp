@@ -0,0 +1,171 @@
+#pragma once
+
+#include <mensura/core/AnalysisPlugin.hpp>
+
+#include <NtupleWriter.hpp>
+
+#include <string>
+#include <vector>
+
+
+class TFileService;
+
+
+/**
+ * \class HistogramFiller
+ * \brief Fills histograms of observables registered with an NtupleWriter
+ * 
+ * This plugin reads values of columns registered by other plugins with an NtupleWriter directly
+ * from their source buffers and fills histograms of them, which allows to skip writing and
+ * reading of per-event trees when only a fixed set of distributions is needed. Histograms are
+ * described in a JSON file of the following format:
+ *   {
+ *     "weights": ["weight", "systWeights"],
+ *     "histograms": [
+ *       {"observable": "MassTT", "bins": 300, "range": [0, 3000]},
+ *       {"name": "NumBTags", "observable": "nBJet30", "binEdges": [-0.5, 0.5, 1.5, 2.5, 3.5]}
+ *     ]
+ *   }
+ * Each histogram is filled with every event weight obtained from the listed columns. Array
+ * columns, such as "systWeights", provide one weight per element. The histogram filled with the
+ * first weight is named after the histogram (by default, after the observable), while names of
+ * the others are extended with the name of the column and, for array columns, the index of the
+ * element, e.g. "MassTT_systWeights3". The first column is mandatory, while the others are
+ * skipped for datasets in which they have not been registered. If the list of weights is absent
+ * or empty, or if method SetUnweighted has been called, a single histogram is filled with unit
+ * weights.
+ * 
+ * Each clone of the plugin (i.e. each thread) accumulates sums of weights and of their squares in
+ * its own arrays, so no locking is needed during event processing. For each histogram, the sums
+ * for all weights are stored contiguously for every bin, so that filling of all weights only
+ * touches consecutive memory. At the end of a dataset the arrays are converted into histograms
+ * in the output file. Underflow and overflow bins are included.
+ * 
+ * The plugin must be placed after the NtupleWriter (named "NtupleWriter" by default) so that all
+ * columns have been registered when its BeginRun is executed. Writing of the tree by the
+ * NtupleWriter can be disabled. This plugin never rejects events.
+ */
+class HistogramFiller: public AnalysisPlugin
+{
+private:
+    /// Histogram of an observable together with accumulated sums of weights
+    struct Histogram
+    {
+        /// Base name of the histogram
+        std::string name;
+        
+        /// Name of the column with the observable
+        std::string observable;
+        
+        /// Bin edges
+        std::vector<double> binEdges;
+        
+        /// Indicates whether all bins have the same width
+        bool uniform;
+        
+        /// Source buffer of the observable
+        NtupleWriter::ColumnSource source;
+        
+        /**
+         * \brief Sums of weights and of their squares
+         * 
+         * Index is (bin * numWeights + weight), where bin 0 is the underflow and the last bin is
+         * the overflow.
+         */
+        std::vector<double> sumW, sumW2;
+        
+        /// Number of events in which the observable has been defined
+        unsigned long numEntries;
+    };
+    
+public:
+    /**
+     * \brief Constructor from the path to the configuration file
+     * 
+     * The path is resolved with FileInPath. Throws an exception if the file cannot be read or if
+     * its content is not valid.
+     */
+    HistogramFiller(std::string const &configPath, std::string const &name = "HistogramFiller");
+    
+    /// Default move constructor
+    HistogramFiller(HistogramFiller &&) = default;
+    
+    /// Assignment operator is deleted
+    HistogramFiller &operator=(HistogramFiller const &) = delete;
+    
+private:
+    /// Copy constructor that produces a newly initialized clone
+    HistogramFiller(HistogramFiller const &src);
+    
+public:
+    /**
+     * \brief Finds source buffers of observables and weights and resets the sums
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void BeginRun(Dataset const &) override;
+    
+    /**
+     * \brief Creates a newly configured clone
+     * 
+     * Implemented from Plugin.
+     */
+    virtual Plugin *Clone() const override;
+    
+    /**
+     * \brief Writes accumulated histograms into the output file
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void EndRun() override;
+    
+    /**
+     * \brief Requests that histograms are filled with unit weights
+     * 
+     * Weights listed in the configuration are then ignored. This is intended for data.
+     */
+    void SetUnweighted();
+    
+private:
+    /**
+     * \brief Reads the observables and weights and fills the histograms
+     * 
+     * Implemented from Plugin.
+     */
+    virtual bool ProcessEvent() override;
+    
+    /// Returns the index of the bin for the given value, including underflow and overflow
+    static unsigned FindBin(Histogram const &histogram, double value);
+    
+    /// Reads the value with the given index from the given source buffer
+    static double ReadValue(NtupleWriter::ColumnSource const &source, unsigned index);
+    
+private:
+    /// Name of TFileService
+    std::string fileServiceName;
+    
+    /// Non-owning pointer to TFileService
+    TFileService const *fileService;
+    
+    /// Name of the NtupleWriter with which the columns are registered
+    std::string writerName;
+    
+    /// Names of columns with event weights
+    std::vector<std::string> weightColumns;
+    
+    /// Source buffers of columns with event weights
+    std::vector<NtupleWriter::ColumnSource> weightSources;
+    
+    /**
+     * \brief Labels of weights appended to names of histograms
+     * 
+     * The label for the first weight is empty.
+     */
+    std::vector<std::string> weightLabels;
+    
+    /// Values of all weights in the current event
+    std::vector<double> weights;
+    
+    /// Histograms to be filled
+    std::vector<Histogram> histograms;
+};
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/**
+ * \class JECUncertaintyTable
+ * \brief Uncertainties of jet energy corrections read from a text file with uncertainty sources
+ * 
+ * The file consists of sections whose headers give names of sources of uncertainty in square
+ * brackets. In each section, every line describes a bin in pseudorapidity: its boundaries, the
+ * number of remaining values in the line, and triplets of pt and relative uncertainties in the
+ * upward and downward directions. Uncertainties are interpolated linearly in pt between these
+ * nodes and are kept constant beyond the first and last ones. Jets outside of the range in
+ * pseudorapidity get the uncertainty from the closest bin.
+ * 
+ * All sources are read at once. Method Get parses every file only once per process and shares
+ * resulting objects between all users, including clones of plugins in different threads.
+ */
+class JECUncertaintyTable
+{
+private:
+    /// Bin in pseudorapidity
+    struct Bin
+    {
+        /// Boundaries of the bin
+        double etaMin, etaMax;
+        
+        /// Nodes in pt together with the upward and downward uncertainties
+        std::vector<double> pt, up, down;
+    };
+    
+    /// Single source of uncertainty
+    struct Source
+    {
+        std::string name;
+        
+        /// Bins in pseudorapidity ordered in eta
+        std::vector<Bin> bins;
+    };
+    
+public:
+    /**
+     * \brief Constructor from the path to the file
+     * 
+     * Throws an exception if the file cannot be read or if its format is not recognized.
+     */
+    JECUncertaintyTable(std::string const &path);
+    
+public:
+    /**
+     * \brief Evaluates relative uncertainty for the source with the given index
+     * 
+     * Returns the uncertainty in the upward direction if the last argument is true and in the
+     * downward direction otherwise. The uncertainty is non-negative in both cases.
+     */
+    double Eval(unsigned sourceIndex, double eta, double pt, bool up) const;
+    
+    /**
+     * \brief Returns the table read from the given file
+     * 
+     * The path is resolved with FileInPath, using "JERC/" as the default location. The file is
+     * read when it is requested for the first time, and later calls with the same path return the
+     * same object. This method is thread-safe.
+     */
+    static std::shared_ptr<JECUncertaintyTable const> Get(std::string const &path);
+    
+    /**
+     * \brief Returns index of the source with the given name
+     * 
+     * Throws an exception if there is no such source in the file.
+     */
+    unsigned GetSourceIndex(std::string const &name) const;
+    
+private:
+    /// Path to the file
+    std::string path;
+    
+    /// All sources of uncertainty
+    std::vector<Source> sources;
+};
@@ -0,0 +1,120 @@
+#pragma once
+
+#include <string>
+#include <vector>
+
+
+/**
+ * \class JERCFormula
+ * \brief Compiled formula from a text file with jet energy corrections or resolution
+ * 
+ * Formulas in JERC text files are written in the syntax of TFormula. They use variables x, y, z,
+ * and t, parameters [0], [1], etc., arithmetic operators including ^, and a few mathematical
+ * functions, optionally prefixed with "TMath::". The expression is parsed once in the constructor
+ * and translated into a short program for a stack machine. Evaluation does not allocate memory
+ * nor modify the object, and thus the same formula can be evaluated from several threads.
+ */
+class JERCFormula
+{
+private:
+    /// Operations of the stack machine
+    enum class Op
+    {
+        Constant,
+        Variable,
+        Parameter,
+        Add,
+        Subtract,
+        Multiply,
+        Divide,
+        Power,
+        Negate,
+        Abs,
+        Exp,
+        Log,
+        Log10,
+        Sqrt,
+        Max,
+        Min
+    };
+    
+    /// Single instruction of the stack machine
+    struct Instruction
+    {
+        Op op;
+        
+        /// Index of the variable or parameter
+        unsigned index;
+        
+        /// Value of a constant
+        double value;
+    };
+    
+public:
+    /// Maximal depth of the stack needed to evaluate a formula
+    static unsigned const maxStackDepth = 32;
+    
+public:
+    /**
+     * \brief Constructor from the text of the expression
+     * 
+     * Throws an exception if the expression cannot be parsed.
+     */
+    JERCFormula(std::string const &expression);
+    
+public:
+    /**
+     * \brief Evaluates the formula
+     * 
+     * The arrays must contain at least GetNumVariables() and GetNumParameters() elements
+     * respectively.
+     */
+    double Eval(double const *variables, double const *parameters) const;
+    
+    /// Returns number of parameters used in the formula, i.e. the largest index plus one
+    unsigned GetNumParameters() const;
+    
+    /// Returns number of variables used in the formula, with x counted as the first one
+    unsigned GetNumVariables() const;
+    
+private:
+    /// Appends an instruction and keeps track of the stack depth
+    void Emit(Op op, unsigned index = 0, double value = 0.);
+    
+    /// Parses a sum or difference of terms
+    void ParseExpression();
+    
+    /// Parses a product or ratio of factors
+    void ParseTerm();
+    
+    /// Parses a unary minus or plus and exponentiation
+    void ParseFactor();
+    
+    /// Parses a number, variable, parameter, function call, or an expression in parentheses
+    void ParsePrimary();
+    
+    /// Skips white space and checks if the next character is the given one
+    bool Peek(char c);
+    
+    /// Consumes the given character or throws an exception if it is not found
+    void Expect(char c);
+    
+    /// Throws an exception that describes a parsing error at the current position
+    [[noreturn]] void Fail(std::string const &what) const;
+    
+private:
+    /// Original expression
+    std::string expression;
+    
+    /// Current position in the expression, used while parsing
+    std::string::size_type position;
+    
+    /// Compiled program
+    std::vector<Instruction> program;
+    
+    /// Current and maximal depths of the stack, used while parsing
+    unsigned stackDepth, maxDepth;
+    
+    /// Numbers of variables and parameters used in the formula
+    unsigned numVariables, numParameters;
+};
@@ -0,0 +1,113 @@
+#pragma once
+
+#include <JERCFormula.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+/**
+ * \class JERCTable
+ * \brief Binned parameterization read from a text file with jet energy corrections or resolution
+ * 
+ * Supports the standard format used for levels of jet energy corrections, jet pt resolution, and
+ * data-to-simulation scale factors for the resolution. The first line of the file gives the names
+ * of the variables that define the binning, the names of the variables that are passed to the
+ * formula, and the formula itself. Each following line describes one bin: the ranges of the
+ * binning variables, the number of remaining values in the line, the ranges of the formula
+ * variables, and the parameters of the formula. Values of formula variables are clamped to
+ * their ranges. If the file does not define a formula (as for scale factors), the parameters are
+ * returned directly.
+ * 
+ * Variables are identified with enumeration Variable, so that the caller provides all properties
+ * of a jet at once and each table picks the ones it needs. Tables are immutable once constructed.
+ * Method Get parses every file only once per process and shares resulting objects between all
+ * users, including clones of plugins in different threads.
+ */
+class JERCTable
+{
+public:
+    /// Supported variables
+    enum Variable
+    {
+        JetEta,
+        JetPt,
+        JetA,
+        Rho,
+        numVariables
+    };
+    
+private:
+    /// Bin of the parameterization
+    struct Bin
+    {
+        /// Lower and upper boundaries of the bin for each binning variable
+        std::vector<double> lower, upper;
+        
+        /// Ranges of formula variables, followed by parameters
+        std::vector<double> values;
+    };
+    
+public:
+    /**
+     * \brief Constructor from the path to the file
+     * 
+     * Throws an exception if the file cannot be read or if its format is not recognized.
+     */
+    JERCTable(std::string const &path);
+    
+public:
+    /**
+     * \brief Evaluates the parameterization for the given values of the variables
+     * 
+     * The array must be indexed with enumeration Variable. If the values of the binning variables
+     * fall outside of all bins, the fallback value is returned. For a table without formula, the
+     * parameter with the given index is returned.
+     */
+    double Eval(double const *variables, double fallback, unsigned paramIndex = 0) const;
+    
+    /**
+     * \brief Returns the table read from the given file
+     * 
+     * The path is resolved with FileInPath, using "JERC/" as the default location. The file is
+     * read when it is requested for the first time, and later calls with the same path return the
+     * same object. This method is thread-safe.
+     */
+    static std::shared_ptr<JERCTable const> Get(std::string const &path);
+    
+private:
+    /// Finds the bin for the given values of the variables, or returns nullptr if there is none
+    Bin const *FindBin(double const *variables) const;
+    
+    /// Translates the name of a variable into its index, throwing an exception if not supported
+    static Variable ParseVariable(std::string const &name, std::string const &path);
+    
+private:
+    /// Binning variables
+    std::vector<Variable> binVariables;
+    
+    /// Variables passed to the formula, in the order x, y, z, t
+    std::vector<Variable> formulaVariables;
+    
+    /// Compiled formula, or a null pointer if the file does not define one
+    std::unique_ptr<JERCFormula> formula;
+    
+    /**
+     * \brief All bins
+     * 
+     * Bins are sorted in the order of lower boundaries in the first binning variable, as in the
+     * file.
+     */
+    std::vector<Bin> bins;
+    
+    /**
+     * \brief Indices of first bins for each distinct range in the first binning variable
+     * 
+     * The last element is the total number of bins.
+     */
+    std::vector<unsigned> groupStarts;
+    
+    /// Lower boundaries in the first binning variable for the above groups
+    std::vector<double> groupLowerEdges;
+};
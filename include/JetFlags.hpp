@@ -0,0 +1,160 @@
+#pragma once
+
+#include <mensura/core/AnalysisPlugin.hpp>
+
+#include <mensura/core/BTagger.hpp>
+
+#include <AllocationCheck.hpp>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+class BTagWPService;
+class JetMETReader;
+
+
+/**
+ * \class JetFlags
+ * \brief Computes per-jet flags shared by several plugins
+ * 
+ * For each jet in the current event, this plugin computes a bit mask that shows whether the jet
+ * has pt above 20 and 30 GeV, whether it falls into the range in |eta| used in the reconstruction
+ * of tt, and whether it is b-tagged according to each of the registered b-tagging working points.
+ * The scalar sum of pt of all jets is computed as well. Consumers such as BasicObservables and
+ * TTSemilepRecoRochester read the flags instead of querying BTagWPService or comparing b-tagging
+ * discriminators for every jet on their own.
+ * 
+ * The plugin is intended to be placed right after the event selection. It relies on a
+ * BTagWPService with the default name "BTagWP" and by default reads jets from a plugin named
+ * "JetMET".
+ */
+class JetFlags: public AnalysisPlugin
+{
+public:
+    /**
+     * \brief Bits in the mask of a jet that do not depend on b-tagging
+     * 
+     * Bits for registered b-tagging working points follow these ones. They are obtained with
+     * method GetBTagMask.
+     */
+    enum Flag: std::uint32_t
+    {
+        Pt20 = 1u << 0,    ///< Jet pt > 20 GeV
+        Pt30 = 1u << 1,    ///< Jet pt > 30 GeV
+        RecoEta = 1u << 2  ///< Jet |eta| within the range used in reconstruction
+    };
+    
+    /// Position of the bit for the first registered b-tagging working point
+    static unsigned const firstBTagBit = 3;
+    
+    /// Maximal number of b-tagging working points that can be registered
+    static unsigned const maxBTaggers = 32 - firstBTagBit;
+    
+public:
+    /**
+     * \brief Constructor
+     * 
+     * User is encouraged to keep the default name unless several instances are needed.
+     */
+    JetFlags(std::string const &name = "JetFlags");
+    
+    /// Default move constructor
+    JetFlags(JetFlags &&) = default;
+    
+    /// Assignment operator is deleted
+    JetFlags &operator=(JetFlags const &) = delete;
+    
+private:
+    /// Copy constructor that produces a newly initialized clone
+    JetFlags(JetFlags const &src);
+    
+public:
+    /**
+     * \brief Registers a b-tagging working point for which flags are to be computed
+     * 
+     * Registering the same working point repeatedly has no effect. Throws an exception if more
+     * than maxBTaggers working points are requested.
+     */
+    void AddBTagger(BTagger const &bTagger);
+    
+    /**
+     * \brief Saves pointers to dependencies
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void BeginRun(Dataset const &) override;
+    
+    /**
+     * \brief Creates a newly configured clone
+     * 
+     * Implemented from Plugin.
+     */
+    virtual Plugin *Clone() const override;
+    
+    /**
+     * \brief Returns bit that shows whether a jet is tagged with the given b-tagging working point
+     * 
+     * Throws an exception if the working point has not been registered with method AddBTagger.
+     */
+    std::uint32_t GetBTagMask(BTagger const &bTagger) const;
+    
+    /**
+     * \brief Returns flags of jets in the current event
+     * 
+     * The flags are indexed in the same way as the collection of jets from which they have been
+     * computed.
+     */
+    std::vector<std::uint32_t> const &GetFlags() const;
+    
+    /// Returns scalar sum of pt of all jets in the current event
+    double GetHt() const;
+    
+    /// Specifies name of the plugin that produces jets and MET
+    void SetJetMETPluginName(std::string const &pluginName);
+    
+    /**
+     * \brief Specifies the range in |eta| used in reconstruction
+     * 
+     * Jets with |eta| not larger than the given value are marked with flag RecoEta. The default
+     * value is 2.4.
+     */
+    void SetRecoEtaRange(double maxAbsEta);
+    
+private:
+    /**
+     * \brief Computes flags for jets in the current event
+     * 
+     * Implemented from Plugin.
+     */
+    virtual bool ProcessEvent() override;
+    
+private:
+    /// Registered b-tagging working points
+    std::vector<BTagger> bTaggers;
+    
+    /// Name of the service that provides b-tagging working points
+    std::string bTagWPServiceName;
+    
+    /// Non-owning pointer to the service that provides b-tagging working points
+    BTagWPService const *bTagWPService;
+    
+    /// Name of the plugin that produces jets and MET
+    std::string jetmetPluginName;
+    
+    /// Non-owning pointer to the plugin that produces jets and MET
+    JetMETReader const *jetmetPlugin;
+    
+    /// Maximal |eta| for flag RecoEta
+    double maxAbsEtaReco;
+    
+    /// Checks that no memory is allocated in ProcessEvent in steady state
+    AllocationCheck allocationCheck;
+    
+    /// Flags of jets in the current event
+    std::vector<std::uint32_t> flags;
+    
+    /// Scalar sum of pt of jets in the current event
+    double ht;
+};
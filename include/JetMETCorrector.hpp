@@ -0,0 +1,218 @@
+#pragma once
+
+#include <mensura/core/JetMETReader.hpp>
+
+#include <mensura/core/SystService.hpp>
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+
+class JECUncertaintyTable;
+class JERCTable;
+class PileUpReader;
+
+
+/**
+ * \class JetMETCorrector
+ * \brief Applies jet energy corrections and resolution smearing and propagates them into MET
+ * 
+ * This plugin replaces the combination of JetMETUpdate with separate instances of
+ * JetCorrectorService for full corrections with and without smearing and for the L1 correction in
+ * simulation, including variations of unclustered MET.
+ * For every jet from the source JetMETReader (by default, "OrigJetMET"), it evaluates in a single
+ * pass the L1 correction, the full L1L2L3 correction, optionally including a variation of the JEC
+ * uncertainty, and the JER smearing factor. The three factors are exposed through method
+ * GetCorrections. Parameterizations are obtained from JERCTable and JECUncertaintyTable when the
+ * first dataset is processed, so each text file is parsed only once per process, on its first use,
+ * whatever the number of instances and clones of this plugin.
+ * 
+ * Raw four-momenta of jets are corrected with the full correction and smeared. For jets matched
+ * to generator-level jets (as done by the source reader), the difference from the generator-level
+ * pt is scaled. Other jets are smeared stochastically according to the pt resolution. The random
+ * number generator is seeded from names of input files at the start of every dataset so that
+ * results are reproducible. Corrected jets that pass the kinematic selection are sorted in pt.
+ * 
+ * MET is computed from the raw MET of the source reader by subtracting the difference between
+ * full and L1-corrected momenta of jets whose pt with the full correction but without smearing
+ * exceeds 15 GeV. Smearing is thus not propagated into MET. If a variation of unclustered energy
+ * is requested, the corresponding variation of raw MET from the source reader is used as the
+ * starting point instead of the nominal raw MET, so that jets are identical to the nominal ones.
+ */
+class JetMETCorrector: public JetMETReader
+{
+public:
+    /// Correction factors for a jet, to be multiplied with its raw momentum
+    struct Corrections
+    {
+        /// L1 correction
+        double l1;
+        
+        /// Full L1L2L3 correction, including a variation of the JEC uncertainty if requested
+        double full;
+        
+        /// JER smearing factor applied on top of the full correction
+        double jer;
+    };
+    
+public:
+    /**
+     * \brief Constructor
+     * 
+     * User is encouraged to keep the default name unless several instances are needed.
+     */
+    JetMETCorrector(std::string const &name = "JetMET");
+    
+    /// Default move constructor
+    JetMETCorrector(JetMETCorrector &&) = default;
+    
+    /// Assignment operator is deleted
+    JetMETCorrector &operator=(JetMETCorrector const &) = delete;
+    
+private:
+    /// Copy constructor that produces a newly initialized clone
+    JetMETCorrector(JetMETCorrector const &src);
+    
+public:
+    /**
+     * \brief Loads parameterizations, saves pointers to dependencies, and seeds the random number
+     * generator
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void BeginRun(Dataset const &dataset) override;
+    
+    /**
+     * \brief Creates a newly configured clone
+     * 
+     * Implemented from Plugin.
+     */
+    virtual Plugin *Clone() const override;
+    
+    /**
+     * \brief Returns correction factors for jets in the current event
+     * 
+     * The factors are indexed in the same way as the collection of jets returned by GetJets.
+     */
+    std::vector<Corrections> const &GetCorrections() const;
+    
+    /**
+     * \brief Returns radius parameter used in the jet clustering algorithm
+     * 
+     * Implemented from JetMETReader.
+     */
+    virtual double GetJetRadius() const override;
+    
+    /**
+     * \brief Specifies files with levels of jet energy corrections
+     * 
+     * The first file must describe the L1 correction. Other levels follow in the order in which
+     * they are applied.
+     */
+    void SetJEC(std::vector<std::string> const &paths);
+    
+    /**
+     * \brief Requests a variation of the JEC uncertainty from the given source
+     * 
+     * An empty name of the source selects the total uncertainty.
+     */
+    void SetJECVariation(std::string const &path, std::string const &source,
+      SystService::VarDirection direction);
+    
+    /**
+     * \brief Requests JER smearing with the given scale factors and pt resolution
+     * 
+     * If the direction is Up or Down, the corresponding variation of scale factors is used.
+     */
+    void SetJER(std::string const &sfPath, std::string const &resolutionPath,
+      SystService::VarDirection direction = SystService::VarDirection::Undefined);
+    
+    /**
+     * \brief Requests a variation of unclustered energy in MET
+     * 
+     * The variation is read from raw MET of the source reader, which must propagate variations of
+     * unclustered energy into it (see PECJetMETReader::PropagateUnclVarToRaw).
+     */
+    void SetMETUnclVariation(SystService::VarDirection direction);
+    
+    /// Specifies name of the plugin that provides source jets and raw MET
+    void SetJetMETReaderName(std::string const &pluginName);
+    
+    /// Specifies name of the plugin that provides the mean angular energy density rho
+    void SetPileUpReaderName(std::string const &pluginName);
+    
+    /// Sets kinematic selection applied to corrected jets
+    void SetSelection(double minPt, double maxAbsEta);
+    
+private:
+    /**
+     * \brief Corrects jets and MET in the current event
+     * 
+     * Implemented from ReaderPlugin.
+     */
+    virtual bool ProcessEvent() override;
+    
+private:
+    /// Name of the plugin that provides source jets and raw MET
+    std::string jetmetPluginName;
+    
+    /// Non-owning pointer to the plugin that provides source jets and raw MET
+    JetMETReader const *jetmetPlugin;
+    
+    /// Name of the plugin that provides rho
+    std::string puPluginName;
+    
+    /// Non-owning pointer to the plugin that provides rho
+    PileUpReader const *puPlugin;
+    
+    /// Paths to files with levels of jet energy corrections, starting from L1
+    std::vector<std::string> jecPaths;
+    
+    /// Path to the file with JEC uncertainties and the requested source
+    std::string jecUncertaintyPath, jecSource;
+    
+    /// Paths to files with JER scale factors and pt resolution
+    std::string jerSFPath, jerResolutionPath;
+    
+    /// Levels of jet energy corrections, starting from L1
+    std::vector<std::shared_ptr<JERCTable const>> jecLevels;
+    
+    /// JEC uncertainties, or a null pointer if no variation is requested
+    std::shared_ptr<JECUncertaintyTable const> jecUncertainty;
+    
+    /// Index of the requested source of JEC uncertainty
+    unsigned jecSourceIndex;
+    
+    /// Direction of the variation of JEC
+    SystService::VarDirection jecDirection;
+    
+    /// JER scale factors and pt resolution, or null pointers if smearing is not requested
+    std::shared_ptr<JERCTable const> jerSF, jerResolution;
+    
+    /// Index of the column with the JER scale factor to be used
+    unsigned jerSFIndex;
+    
+    /// Kinematic selection for corrected jets
+    double minPt, maxAbsEta;
+    
+    /// Threshold in pt for jets whose corrections are propagated into MET
+    double metJetPtThreshold;
+    
+    /// Direction of the variation of unclustered energy in MET
+    SystService::VarDirection metUnclDirection;
+    
+    /// Random number generator for stochastic smearing
+    std::mt19937_64 randomEngine;
+    
+    /// Correction factors for jets in the current event
+    std::vector<Corrections> corrections;
+    
+    /// Selected jets and their correction factors before sorting
+    std::vector<Jet> unsortedJets;
+    std::vector<Corrections> unsortedCorrections;
+    
+    /// Indices of selected jets in the order of decreasing pt
+    std::vector<unsigned> order;
+};
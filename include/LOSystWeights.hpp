@@ -2,9 +2,12 @@
 
 #include <mensura/extensions/EventWeightPlugin.hpp>
 
+#include <DatasetSelector.hpp>
+#include <PdfGrid.hpp>
+
 #include <initializer_list>
 #include <memory>
-#include <regex>
+#include <mutex>
 #include <string>
 #include <vector>
 #include <utility>
@@ -29,9 +32,28 @@ namespace LHAPDF{class PDF;};
  * 
  * User can specify for which datasets weights need to be computed using method SelectDatasets. In
  * the remaining datasets only the nominal weight of unity will be reported.
+ * 
+ * Parton densities are evaluated with a PdfGrid. Both the PDF set and the grid are loaded when the
+ * first selected dataset is encountered and are then shared among all clones, so that nothing is
+ * read from LHAPDF if no dataset is selected. Accuracy of the grid can be checked against direct
+ * evaluation with LHAPDF using method SetAccuracyCheck.
  */
 class LOSystWeights: public EventWeightPlugin
 {
+private:
+    /// Lazily loaded PDF set and PdfGrid shared among clones
+    struct SharedGrid
+    {
+        /// Flag to load the PDF set and build the grid only once
+        std::once_flag built;
+        
+        /// Requested PDF set
+        std::shared_ptr<LHAPDF::PDF const> pdfSet;
+        
+        /// The grid
+        std::unique_ptr<PdfGrid const> grid;
+    };
+    
 public:
     /**
      * \brief Constructs a new reweighting plugin with the given name
@@ -75,9 +97,18 @@ public:
      */
     void SelectDatasets(std::initializer_list<std::string> const &masks);
     
+    /**
+     * \brief Requests that weights computed with PdfGrid are compared to direct evaluation
+     * 
+     * If the relative difference between the two exceeds the given tolerance, an exception is
+     * thrown. The check makes the evaluation considerably slower and is intended for debugging
+     * only. A non-positive tolerance disables the check, which is the default.
+     */
+    void SetAccuracyCheck(double tolerance);
+    
 private:
-    /// Computes alpha_s at the given scale (in GeV)
-    static double AlphaS(double scale);
+    /// Computes alpha_s at the scale given by log(Q / m_Z)
+    static double AlphaS(double logScale);
     
     /**
      * \brief Computes systematic weights
@@ -93,8 +124,8 @@ private:
     /// Non-owning pointer to plugin that provides generator-level weights
     GeneratorReader const *generatorReader;
     
-    /// Masks to choose in which datasets to compute weights
-    std::vector<std::regex> datasetMasks;
+    /// Selection of datasets in which to compute weights, shared among clones
+    std::shared_ptr<DatasetSelector const> datasetSelector;
     
     /// Flag showing whether weights should be computed for the current dataset
     bool processCurDataset;
@@ -106,13 +137,18 @@ private:
      */
     double scaleVarFactor;
     
+    /// Logarithm of scaleVarFactor
+    double logScaleVarFactor;
+    
     /// Number of strong vertices used in reweighting for renomalization scale
     unsigned nQCDVert;
     
-    /**
-     * \brief Requested PDF set
-     * 
-     * It is shared among all clones of this plugin
-     */
-    std::shared_ptr<LHAPDF::PDF const> pdfSet;
+    /// Name of the requested PDF set
+    std::string pdfSetName;
+    
+    /// PDF set and interpolation grid for it, shared among all clones
+    std::shared_ptr<SharedGrid> sharedGrid;
+    
+    /// Tolerance for the accuracy check of PdfGrid
+    double checkTolerance;
 };
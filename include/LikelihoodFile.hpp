@@ -0,0 +1,102 @@
+#pragma once
+
+#include <LogLikelihoodTable.hpp>
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+/**
+ * \class LikelihoodFile
+ * \brief Binary file with named tables of log-likelihood
+ * 
+ * The file starts with a header, which is followed by a directory of tables and the serialized
+ * tables themselves (see LogLikelihoodTable::Serialize). Each entry of the directory contains the
+ * name of a table, its offset from the beginning of the file (a multiple of 8 bytes), and its
+ * size.
+ * 
+ * The file is memory-mapped read-only, and tables are constructed directly on top of the mapped
+ * memory without copying. The mapping is kept until all tables obtained from it are destroyed.
+ * If a file is opened several times, e.g. by several plugins, the same mapping is reused, unless
+ * the file has been replaced or modified in the meantime. No ROOT classes are involved, so that
+ * reading the file does not need to take ROOTLock.
+ */
+class LikelihoodFile
+{
+private:
+    /// Header of the file
+    struct Header
+    {
+        char magic[8];
+        std::uint32_t version;
+        std::uint32_t numTables;
+    };
+    
+    /// Entry of the directory of tables
+    struct Entry
+    {
+        char name[48];
+        std::uint64_t offset;
+        std::uint64_t size;
+    };
+    
+public:
+    /**
+     * \brief Opens the file with the given path
+     * 
+     * The path is used as given and is not resolved. Throws an exception if the file cannot be
+     * read or has an unexpected format.
+     */
+    LikelihoodFile(std::string const &path);
+    
+public:
+    /**
+     * \brief Returns table with the given name
+     * 
+     * Throws an exception if there is no such table in the file.
+     */
+    std::shared_ptr<LogLikelihoodTable const> GetTable(std::string const &name) const;
+    
+    /**
+     * \brief Writes a file with the given tables
+     * 
+     * Each table is given with its name, which must be shorter than 48 characters. Throws an
+     * exception if the file cannot be written.
+     */
+    static void Write(std::string const &path,
+      std::vector<std::pair<std::string, LogLikelihoodTable const *>> const &tables);
+    
+private:
+    /**
+     * \brief Maps the file with the given path or returns an existing mapping
+     * 
+     * An existing mapping is only returned if the path refers to the same file (identified by
+     * the device and the inode) with the same modification time and size. Sets the size of the
+     * mapped file.
+     */
+    static std::shared_ptr<void const> Map(std::string const &path, std::size_t &size);
+    
+private:
+    /// Identifier put at the beginning of every file
+    static char const magic[8];
+    
+    /// Version of the format
+    static std::uint32_t const version = 1;
+    
+    /// Path to the file
+    std::string path;
+    
+    /// Mapped memory
+    std::shared_ptr<void const> mapping;
+    
+    /// Size of the mapped file
+    std::size_t size;
+    
+    /// Offsets and sizes of tables, indexed by their names
+    std::map<std::string, std::pair<std::size_t, std::size_t>> tables;
+};
@@ -0,0 +1,227 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <iosfwd>
+#include <limits>
+#include <memory>
+
+
+class TAxis;
+class TH1;
+
+
+/**
+ * \class LogLikelihoodTable
+ * \brief Lookup table with logarithm of a one- or two-dimensional binned density
+ * 
+ * The table is constructed from a ROOT histogram, whose bin contents are converted to logarithms
+ * and stored in a contiguous array, which includes underflow and overflow bins. Lookup reproduces
+ * the behaviour of TH1::FindFixBin exactly. For an axis with uniform bins, the bin index is
+ * computed with the same floating-point expression as in TAxis::FindFixBin, so that points close
+ * to bin edges are assigned to the same bins as in ROOT. Otherwise a binary search over bin edges
+ * is performed.
+ * 
+ * Values in overflow bins (along any axis) are replaced by NaN, which serves as a sentinel. It can
+ * be checked with the static method IsOverflow. Underflow bins are treated as regular ones.
+ * 
+ * Methods EvalBatch perform lookup for arrays of points. If the binning is uniform and the CPU
+ * supports AVX2, they use SIMD instructions, otherwise they fall back to scalar lookups. Results
+ * are identical in both cases.
+ * 
+ * A table can be serialized into a binary block with method Serialize and later constructed from
+ * such a block without copying it, e.g. directly from a memory-mapped file (see class
+ * LikelihoodFile). The block contains the description of the binning followed by the logarithms,
+ * all stored as 8-byte words with the native byte order. Copies of a table share the underlying
+ * memory.
+ */
+class LogLikelihoodTable
+{
+private:
+    /// Serialized description of an axis
+    struct AxisRecord
+    {
+        std::uint32_t nBins;
+        std::uint32_t uniform;
+        double min, max;
+    };
+    
+    /// An auxiliary structure to describe binning along one axis
+    struct Axis
+    {
+        /**
+         * \brief Constructs axis with the same binning as the given ROOT axis
+         * 
+         * Bin edges are not set and, if needed, must be provided by the caller.
+         */
+        Axis(TAxis const &axis);
+        
+        /// Constructs axis from its serialized description
+        Axis(AxisRecord const &record);
+        
+        /**
+         * \brief Finds bin for the given value
+         * 
+         * Follows the convention of ROOT, i.e. returns 0 for underflow and nBins + 1 for overflow.
+         */
+        unsigned FindBin(double x) const
+        {
+            if (x < min)
+                return 0;
+            
+            if (not (x < max))
+                return nBins + 1;
+            
+            // Same expression as in TAxis::FindFixBin. As in ROOT, rounding can give the overflow
+            //bin for a value just below the upper edge
+            if (not edges)
+                return 1 + unsigned(nBins * (x - min) / (max - min));
+            else
+                return std::upper_bound(edges, edges + nBins + 1, x) - edges;
+        }
+        
+        /// Number of regular bins
+        unsigned nBins;
+        
+        /// Range of the axis
+        double min, max;
+        
+        /// Indicates whether the binning is uniform
+        bool uniform;
+        
+        /**
+         * \brief Edges of the bins
+         * 
+         * Points to an array of nBins + 1 values if the binning is not uniform, is null otherwise.
+         * The memory is owned by the table.
+         */
+        double const *edges;
+    };
+    
+    /**
+     * \brief Header of a serialized table
+     * 
+     * It is followed by bin edges for non-uniform axes (first x, then y) and values.
+     */
+    struct TableRecord
+    {
+        std::uint32_t dimension;
+        std::uint32_t numValues;
+        AxisRecord xAxis, yAxis;
+    };
+    
+public:
+    /**
+     * \brief Constructs a table from the given histogram
+     * 
+     * The histogram must be one- or two-dimensional, otherwise an exception is thrown. It should
+     * already be normalized as needed.
+     */
+    LogLikelihoodTable(TH1 const &hist);
+    
+    /**
+     * \brief Constructs a table from a serialized block of the given size
+     * 
+     * The block is not copied. The first argument keeps the memory of the block alive and is
+     * shared by the table. The block must be aligned to 8 bytes. An exception is thrown if it is
+     * not a valid table.
+     */
+    LogLikelihoodTable(std::shared_ptr<void const> const &storage, char const *block,
+      std::size_t size);
+    
+public:
+    /**
+     * \brief Returns logarithm of the density at the given point of a one-dimensional table
+     * 
+     * The behaviour is undefined if the table is two-dimensional.
+     */
+    double Eval(double x) const
+    {
+        return values[xAxis.FindBin(x)];
+    }
+    
+    /**
+     * \brief Returns logarithm of the density at the given point of a two-dimensional table
+     * 
+     * The behaviour is undefined if the table is one-dimensional.
+     */
+    double Eval(double x, double y) const
+    {
+        return values[xAxis.FindBin(x) + (xAxis.nBins + 2) * yAxis.FindBin(y)];
+    }
+    
+    /**
+     * \brief Evaluates a one-dimensional table for an array of n points
+     * 
+     * Results are written into array out. Equivalent to calling Eval for each point.
+     */
+    void EvalBatch(unsigned n, double const *x, double *out) const;
+    
+    /**
+     * \brief Evaluates a two-dimensional table for an array of n points
+     * 
+     * Results are written into array out. Equivalent to calling Eval for each point.
+     */
+    void EvalBatch(unsigned n, double const *x, double const *y, double *out) const;
+    
+    /// Returns the number of dimensions of the table
+    unsigned GetDimension() const
+    {
+        return dimension;
+    }
+    
+    /**
+     * \brief Returns the largest value stored in the table
+     * 
+     * Overflow bins are not considered. If all values are NaN, returns -infinity.
+     */
+    double GetMaxValue() const;
+    
+    /// Checks if the value returned by Eval corresponds to an overflow bin
+    static bool IsOverflow(double value)
+    {
+        return std::isnan(value);
+    }
+    
+    /**
+     * \brief Writes the table into the given binary stream
+     * 
+     * Returns the number of bytes written, which is always a multiple of 8.
+     */
+    std::size_t Serialize(std::ostream &out) const;
+    
+private:
+    /**
+     * \brief Returns header of a serialized table
+     * 
+     * Throws an exception if the block is too short to contain the header or is not aligned
+     * properly.
+     */
+    static TableRecord const &ReadHeader(char const *block, std::size_t size);
+    
+    /// Sets pointers to bin edges and values stored in the given contiguous array
+    void SetPointers(double const *data);
+    
+private:
+    /// Number of dimensions
+    unsigned dimension;
+    
+    /// Binning along the x and y axes
+    Axis xAxis, yAxis;
+    
+    /// Memory that holds bin edges and values, possibly shared with other tables
+    std::shared_ptr<void const> storage;
+    
+    /**
+     * \brief Logarithms of the density in all bins, including underflows and overflows
+     * 
+     * Bins are stored in the same order as in ROOT histograms, i.e. the index is
+     * binX + (nBinsX + 2) * binY. For one-dimensional tables there is a single row.
+     */
+    double const *values;
+    
+    /// Number of elements in array values
+    unsigned numValues;
+};
@@ -0,0 +1,459 @@
+#pragma once
+
+#include <mensura/core/AnalysisPlugin.hpp>
+
+#include <Rtypes.h>
+
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+
+class TFileService;
+class TTree;
+
+
+/**
+ * \class NtupleWriter
+ * \brief Writes observables computed by other plugins into a single wide tree
+ * 
+ * Instead of creating their own trees, plugins that compute observables register columns with
+ * this plugin. A column is described by a name and a pointer to a buffer, whose content is read
+ * every time this plugin is executed. Columns must be registered in BeginRun of the producing
+ * plugins, and this plugin must be registered in the processing path after all of them, so that
+ * its BeginRun is called last. In it a single tree is created for the current dataset, with a
+ * branch for every column. The list of columns is cleared in EndRun, and thus it can differ
+ * between datasets.
+ * 
+ * Values of all columns for the current event are copied into a columnar in-memory block. When the
+ * block is full, or when processing of the dataset finishes, the buffered events are written into
+ * the tree in one go. This way the global ROOT lock is taken once per block rather than once per
+ * event per tree, and all values of a branch are transferred into its basket consecutively.
+ * 
+ * Optionally, blocks can be written into the tree by a dedicated thread, which is started for
+ * each dataset (i.e. for each output file). The thread processing events then only copies values
+ * into a ring of blocks, and filling of the tree, including compression of baskets, happens in
+ * parallel with processing of following events. If no free block is available, the processing
+ * thread waits for one. Numbers of such stalls and the total time spent in them are reported
+ * when the last clone of the plugin is destroyed. See method SetAsyncWriting.
+ * 
+ * Supported column types are all fundamental ROOT types (Float_t, Int_t, UShort_t, Bool_t, etc.).
+ * A column can also hold a fixed-size array of such values. By default, a column is stored with
+ * the type of its source buffer. Alternatively, a producing plugin can declare the kind of the
+ * column and provide a storage schema. Depending on the schema, kinematic quantities are then
+ * stored with a truncated mantissa, which makes them compress much better, while counters and
+ * status codes are stored as 8- and 16-bit integers respectively. Compression algorithm and level
+ * for the output tree can be chosen with method SetCompression.
+ * 
+ * Other plugins, such as HistogramFiller, can read registered columns directly from their source
+ * buffers, which are described by method GetColumnSource. Writing of the tree can then be
+ * disabled with method SetTreeOutput, and this plugin only serves as a registry of columns.
+ * 
+ * This plugin never rejects events.
+ */
+class NtupleWriter: public AnalysisPlugin
+{
+public:
+    /// Kind of a column, which determines how it is treated by a storage schema
+    enum class ColumnKind
+    {
+        /// Always stored with the type of the source buffer
+        Generic,
+        
+        /// Kinematic quantity of type Float_t, whose mantissa can be truncated
+        Kinematic,
+        
+        /// Non-negative counter, which can be stored as an 8-bit integer
+        Count,
+        
+        /// Non-negative status code, which can be stored as a 16-bit integer
+        Status
+    };
+    
+    /// Storage schema applied by a producing plugin to its columns
+    struct Schema
+    {
+        /**
+         * \brief Number of mantissa bits kept in kinematic columns
+         * 
+         * Allowed values are from 1 to 23. With 23 bits, values are stored exactly. Truncated
+         * mantissas are rounded to the nearest representable value.
+         */
+        unsigned mantissaBits;
+        
+        /// Requests that counters and status codes are stored as 8- and 16-bit integers
+        bool compactIntegers;
+    };
+    
+    /// Description of the source buffer of a registered column
+    struct ColumnSource
+    {
+        /// Non-owning pointer to the buffer
+        void const *buffer;
+        
+        /// ROOT type code of values in the buffer, as used in leaf lists
+        char typeCode;
+        
+        /// Number of values in the buffer
+        unsigned length;
+    };
+    
+    /// Supported compression algorithms
+    enum class Compression
+    {
+        /// Use compression settings of the output file
+        Default,
+        
+        ZLIB,
+        LZMA,
+        LZ4
+    };
+    
+private:
+    /// Description of a registered column and its buffered values
+    struct Column
+    {
+        /// Name of the column
+        std::string name;
+        
+        /// Non-owning pointer to the buffer from which values are read
+        void const *source;
+        
+        /// ROOT type codes of the source buffer and of stored values
+        char sourceType, storedType;
+        
+        /// Number of values in one event
+        unsigned length;
+        
+        /// Size of stored values for one event, in bytes
+        unsigned size;
+        
+        /**
+         * \brief Mask applied to bit representation of stored Float_t values
+         * 
+         * Only used for kinematic columns.
+         */
+        std::uint32_t mantissaMask;
+        
+        /// Leaf list to create the branch
+        std::string leafList;
+        
+        /// Buffered values for all blocks of events
+        std::vector<char> block;
+        
+        /// Buffer to which the branch is attached
+        std::vector<char> row;
+    };
+    
+public:
+    /**
+     * \brief Constructor
+     * 
+     * The tree with the given name is created in the root directory of the output file. User is
+     * encouraged to keep the default name of the plugin unless several instances are needed.
+     */
+    NtupleWriter(std::string const &name = "NtupleWriter", std::string const &treeName = "Vars");
+    
+    /// Default move constructor
+    NtupleWriter(NtupleWriter &&) = default;
+    
+    /// Assignment operator is deleted
+    NtupleWriter &operator=(NtupleWriter const &) = delete;
+    
+private:
+    /**
+     * \brief Copy constructor that produces a newly initialized clone
+     * 
+     * Registered columns are not copied. The copy constructor must only be used before processing
+     * of the first dataset starts.
+     */
+    NtupleWriter(NtupleWriter const &src);
+    
+public:
+    /// Destructor
+    ~NtupleWriter() noexcept;
+    
+public:
+    /**
+     * \brief Creates the output tree with all registered columns
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void BeginRun(Dataset const &) override;
+    
+    /**
+     * \brief Creates a newly configured clone
+     * 
+     * Implemented from Plugin.
+     */
+    virtual Plugin *Clone() const override;
+    
+    /**
+     * \brief Writes remaining buffered events and clears the list of columns
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void EndRun() override;
+    
+    /**
+     * \brief Returns description of the source buffer of the column with the given name
+     * 
+     * Columns are only known between the moment when they are registered and the end of the
+     * current dataset. Throws an exception if there is no column with the given name.
+     */
+    ColumnSource GetColumnSource(std::string const &name) const;
+    
+    /// Checks if a column with the given name has been registered
+    bool HasColumn(std::string const &name) const;
+    
+    /**
+     * \brief Registers a new column
+     * 
+     * The source buffer must hold the given number of values of type T and must stay valid until
+     * the end of the current dataset. If the length is larger than 1, the column is stored as a
+     * fixed-size array. This method must be called from BeginRun of the producing plugin. Although
+     * it is a constant method, it modifies the list of columns, which allows to call it using the
+     * constant pointer obtained from Processor. Throws an exception if a column with the same name
+     * has already been registered.
+     */
+    template<typename T>
+    void RegisterColumn(std::string const &name, T const *source, unsigned length = 1) const;
+    
+    /**
+     * \brief Registers a new column to be stored according to the given schema
+     * 
+     * Throws an exception if the type of the source buffer is not compatible with the kind of the
+     * column or if the schema is not valid. Consult documentation for the above version for
+     * other details.
+     */
+    template<typename T>
+    void RegisterColumn(std::string const &name, T const *source, ColumnKind kind,
+      Schema const &schema, unsigned length = 1) const;
+    
+    /**
+     * \brief Requests that blocks are written into the tree by a dedicated thread
+     * 
+     * The given number of blocks, each of the size chosen with SetBlockSize, are allocated. While
+     * one of them is being filled, the others can be queued for writing. The number must be at
+     * least 2. A value of 0 (default) disables the dedicated thread, and then blocks are written
+     * by the thread that processes events.
+     * 
+     * If printStats is true, numbers of queued blocks and waits for a free block are accumulated
+     * over all clones of this plugin, and they are printed to the standard output when the last
+     * clone is destroyed.
+     */
+    void SetAsyncWriting(unsigned numBlocks, bool printStats = false);
+    
+    /**
+     * \brief Sets the number of events buffered before they are written into the tree
+     * 
+     * The default value is 1024.
+     */
+    void SetBlockSize(unsigned blockSize);
+    
+    /**
+     * \brief Specifies compression algorithm and level for all branches of the output tree
+     * 
+     * By default, compression settings of the output file are used.
+     */
+    void SetCompression(Compression algorithm, int level);
+    
+    /**
+     * \brief Specifies parameters of the output tree
+     * 
+     * The first argument is the initial size of baskets, in bytes. The second one is passed to
+     * TTree::SetAutoFlush. By default, baskets of 64 kB are used, and they are flushed after every
+     * 20 MB of uncompressed data.
+     */
+    void SetTreeParameters(int basketSize, Long64_t autoFlush);
+    
+    /**
+     * \brief Enables or disables writing of the output tree
+     * 
+     * When disabled, no tree is created, and registered columns can only be accessed by other
+     * plugins via method GetColumnSource. Writing is enabled by default.
+     */
+    void SetTreeOutput(bool enable);
+    
+private:
+    /**
+     * \brief Copies values of all columns into the block
+     * 
+     * The block is written into the tree when it gets full.
+     * 
+     * Implemented from Plugin.
+     */
+    virtual bool ProcessEvent() override;
+    
+    /// Writes all buffered events into the tree under the ROOT lock
+    void Flush();
+    
+    /**
+     * \brief Queues the current block for writing by the dedicated thread
+     * 
+     * Then switches to the next block, waiting until it has been written if needed.
+     */
+    void SubmitBlock();
+    
+    /// Main loop of the dedicated thread that writes blocks
+    void WriteQueuedBlocks();
+    
+    /// Writes the given number of events from the block with the given index under the ROOT lock
+    void WriteBlock(unsigned blockIndex, unsigned numEvents);
+    
+    /// Copies values of the given column for the current event into the given location
+    static void StoreValues(Column const &column, char *destination);
+    
+    /// Returns ROOT type code for the given type, as used in leaf lists
+    template<typename T>
+    static char GetTypeCode();
+    
+    /// Implementation of RegisterColumn
+    void RegisterColumnImpl(std::string const &name, void const *source, unsigned typeSize,
+      char typeCode, unsigned length, ColumnKind kind, Schema const &schema) const;
+    
+private:
+    /**
+     * \brief State shared between the thread processing events and the one that writes blocks
+     * 
+     * Blocks are used in a circular order. Block indices and counts of events are only accessed
+     * with the mutex locked.
+     */
+    struct AsyncQueue
+    {
+        /// Thread that writes blocks
+        std::thread thread;
+        
+        std::mutex mutex;
+        
+        /// Notified whenever a block is queued or has been written, or the thread should stop
+        std::condition_variable condition;
+        
+        /// Numbers of events in queued blocks
+        std::vector<unsigned> numEvents;
+        
+        /// Number of queued blocks, including the one that is being written
+        unsigned numQueued;
+        
+        /// Index of the next block to be written
+        unsigned nextToWrite;
+        
+        /// Flag requesting that the thread stops once all queued blocks have been written
+        bool stop;
+    };
+    
+    /// Statistics of waits for free blocks, accumulated over clones
+    class AsyncStats;
+    
+private:
+    /// Name of TFileService
+    std::string fileServiceName;
+    
+    /// Non-owning pointer to TFileService
+    TFileService const *fileService;
+    
+    /// Name of the output tree
+    std::string treeName;
+    
+    /// Initial size of baskets, in bytes
+    int basketSize;
+    
+    /// Parameter for TTree::SetAutoFlush
+    Long64_t autoFlush;
+    
+    /**
+     * \brief Compression settings for branches as understood by ROOT
+     * 
+     * A negative value means that settings of the output file are used.
+     */
+    int compressionSettings;
+    
+    /// Maximal number of buffered events
+    unsigned blockSize;
+    
+    /// Flag showing whether the output tree is written
+    bool writeTree;
+    
+    /// Number of blocks used with the dedicated writing thread, or 0 if it is disabled
+    unsigned numAsyncBlocks;
+    
+    /// Index of the block that is currently being filled
+    unsigned currentBlock;
+    
+    /// State of the dedicated writing thread for the current dataset
+    std::unique_ptr<AsyncQueue> asyncQueue;
+    
+    /// Statistics shared among all clones. Null if they are not reported
+    std::shared_ptr<AsyncStats> asyncStats;
+    
+    /**
+     * \brief Registered columns
+     * 
+     * Modified by the constant method RegisterColumn.
+     */
+    mutable std::vector<Column> columns;
+    
+    /// Flag showing that BeginRun has been executed for the current dataset
+    bool inRun;
+    
+    /// Non-owning pointer to the output tree
+    TTree *tree;
+    
+    /// Number of events buffered in the current block
+    unsigned numBuffered;
+};
+
+
+template<>
+char NtupleWriter::GetTypeCode<Char_t>();
+
+template<>
+char NtupleWriter::GetTypeCode<UChar_t>();
+
+template<>
+char NtupleWriter::GetTypeCode<Short_t>();
+
+template<>
+char NtupleWriter::GetTypeCode<UShort_t>();
+
+template<>
+char NtupleWriter::GetTypeCode<Int_t>();
+
+template<>
+char NtupleWriter::GetTypeCode<UInt_t>();
+
+template<>
+char NtupleWriter::GetTypeCode<Long64_t>();
+
+template<>
+char NtupleWriter::GetTypeCode<ULong64_t>();
+
+template<>
+char NtupleWriter::GetTypeCode<Float_t>();
+
+template<>
+char NtupleWriter::GetTypeCode<Double_t>();
+
+template<>
+char NtupleWriter::GetTypeCode<Bool_t>();
+
+
+template<typename T>
+void NtupleWriter::RegisterColumn(std::string const &name, T const *source,
+  unsigned length /*= 1*/) const
+{
+    RegisterColumnImpl(name, source, sizeof(T), GetTypeCode<T>(), length, ColumnKind::Generic,
+      Schema{23, false});
+}
+
+
+template<typename T>
+void NtupleWriter::RegisterColumn(std::string const &name, T const *source, ColumnKind kind,
+  Schema const &schema, unsigned length /*= 1*/) const
+{
+    RegisterColumnImpl(name, source, sizeof(T), GetTypeCode<T>(), length, kind, schema);
+}
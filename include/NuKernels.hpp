@@ -0,0 +1,216 @@
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+
+
+/**
+ * \file NuKernels.hpp
+ * \brief Closed-form kernels for the reconstruction of neutrinos that operate on arrays
+ * 
+ * The kernels take components of four-momenta as plain arrays and do not depend on ROOT. They
+ * process arrays of inputs in a single call, and computations that only depend on the lepton are
+ * done once per call. Bodies of the loops evaluate all branches of the algorithms and select the
+ * result at the end.
+ * 
+ * Function SolveWMass implements the W-mass constraint used in NuRecoRunI, and function
+ * ComputeRochesterEllipses builds the solution ellipses of NuRecoRochester. Both classes rely on
+ * these kernels. Arithmetic operations follow the original implementations with ROOT vectors and
+ * matrices.
+ */
+namespace NuKernels
+{
+    /// Number of values that describe a neutrino ellipse
+    unsigned const ellipseSize = 9;
+    
+    
+    /// Computes product of two 3x3 matrices stored in the row-major order
+    inline void Multiply3(double const *a, double const *b, double *res)
+    {
+        for (unsigned i = 0; i < 3; ++i)
+            for (unsigned j = 0; j < 3; ++j)
+                res[3 * i + j] = a[3 * i] * b[j] + a[3 * i + 1] * b[3 + j] +
+                  a[3 * i + 2] * b[6 + j];
+    }
+    
+    
+    /**
+     * \brief Solves the W-mass constraint for the longitudinal momentum of the neutrino
+     * 
+     * Processes n pairs of a lepton and MET, given by components of their momenta. For each pair,
+     * the W-mass constraint leads to a quadratic equation for pz of the neutrino. If it has two
+     * real-valued solutions, numSolutions[i] is set to 2, and the solutions are written into
+     * pz1[i] and pz2[i], the one with the smaller value first. Otherwise the magnitude of MET is
+     * modified, keeping its direction, until the discriminant turns zero, and the single solution
+     * is written into pz1[i] (and also pz2[i]), with numSolutions[i] = 1. In all cases the
+     * transverse momentum of the neutrino, which differs from MET only in the latter case, is
+     * written into nuPx[i] and nuPy[i]. If no positive value of MET can be found, numSolutions[i]
+     * is set to 0.
+     */
+    inline void SolveWMass(unsigned n, double const *lepPx, double const *lepPy,
+      double const *lepPz, double const *lepE, double const *metPx, double const *metPy,
+      unsigned *numSolutions, double *pz1, double *pz2, double *nuPx, double *nuPy,
+      double mW = 80.419)
+    {
+        for (unsigned i = 0; i < n; ++i)
+        {
+            double const lx = lepPx[i], ly = lepPy[i], lz = lepPz[i], e = lepE[i];
+            double const mx = metPx[i], my = metPy[i];
+            
+            // Mass of the lepton follows TLorentzVector::M
+            double const ml = std::sqrt(std::abs(e * e - (lx * lx + ly * ly + lz * lz)));
+            double const massDiff = mW * mW - ml * ml;
+            double const ratioZ = lz / e;
+            double const met = std::sqrt(mx * mx + my * my);
+            
+            
+            // Standard quadratic equation a * pz^2 + b * pz + c = 0
+            double const lambda = (massDiff + 2 * (mx * lx + my * ly)) / (2 * e);
+            double const a = 1. - ratioZ * ratioZ;
+            double const b = -2 * ratioZ * lambda;
+            double const c = met * met - lambda * lambda;
+            double const discriminant = b * b - 4 * a * c;
+            double const sqrtDiscriminant = std::sqrt(std::max(discriminant, 0.));
+            
+            double const pzLinear = -c / b;
+            double const pzLow = (-b - sqrtDiscriminant) / (2 * a);
+            double const pzHigh = (-b + sqrtDiscriminant) / (2 * a);
+            
+            
+            // Quadratic equation u * MET^2 + v * MET + w = 0 for the adjusted MET. If its
+            //discriminant is negative, both solutions are NaN, and the reconstruction fails
+            double const gammaX = lx / std::sqrt(1. + (my / mx) * (my / mx));
+            double const gammaY = ly / std::sqrt(1. + (mx / my) * (mx / my));
+            double const gamma = ((mx < 0.) ? -gammaX : gammaX) + ((my < 0.) ? -gammaY : gammaY);
+            
+            double const u = ratioZ * ratioZ + (gamma / e) * (gamma / e) - 1.;
+            double const v = (1. / e) * (1. / e) * gamma * massDiff;
+            double const w = (massDiff / (2 * e)) * (massDiff / (2 * e));
+            double const sqrtDiscriminantMET = std::sqrt(v * v - 4 * u * w);
+            
+            double const met1 = (-v - sqrtDiscriminantMET) / (2 * u);
+            double const met2 = (-v + sqrtDiscriminantMET) / (2 * u);
+            
+            // If both solutions are positive, choose the one closest to the measured MET
+            double const metQuadratic = (met1 > 0. and met2 > 0.) ?
+              ((std::abs(met - met1) < std::abs(met - met2)) ? met1 : met2) :
+              ((met1 > 0.) ? met1 : met2);
+            double const adjustedMET = (u == 0.) ? -w / v : metQuadratic;
+            bool const adjustedFound = (adjustedMET > 0.);
+            
+            double const phi = (mx == 0. and my == 0.) ? 0. : std::atan2(my, mx);
+            double const adjustedPx = adjustedMET * std::cos(phi);
+            double const adjustedPy = adjustedMET * std::sin(phi);
+            double const lambdaAdjusted = (massDiff + 2 * (adjustedPx * lx + adjustedPy * ly)) /
+              (2 * e);
+            double const pzAdjusted = -(-2 * ratioZ * lambdaAdjusted) / (2 * a);
+            
+            
+            // Select the result
+            bool const linear = (a == 0.);
+            bool const twoSolutions = (not linear and discriminant > 0.);
+            bool const adjusted = (not linear and not twoSolutions);
+            
+            numSolutions[i] = (linear) ? 1 : ((twoSolutions) ? 2 : ((adjustedFound) ? 1 : 0));
+            pz1[i] = (linear) ? pzLinear : ((twoSolutions) ? pzLow : pzAdjusted);
+            pz2[i] = (twoSolutions) ? pzHigh : pz1[i];
+            nuPx[i] = (adjusted) ? adjustedPx : mx;
+            nuPy[i] = (adjusted) ? adjustedPy : my;
+        }
+    }
+    
+    
+    /**
+     * \brief Builds neutrino solution ellipses for the given lepton and n b-quark jets
+     * 
+     * Implements the construction from B.A. Betchart, R. Demina, A. Harel, Nucl.Instrum.Meth.
+     * A736 (2014) 169, with the given masses of the W boson and the top quark. For the i-th jet,
+     * the matrix H that maps the unit circle onto the ellipse, so that the neutrino momentum is
+     * H * (cos t, sin t, 1)^T, is written in the row-major order into ellipses[9 * i] to
+     * ellipses[9 * i + 8]. If the masses cannot be reconciled for this jet, reconstructable[i] is
+     * set to false, and the matrix is meaningless.
+     */
+    inline void ComputeRochesterEllipses(double lepPx, double lepPy, double lepPz, double lepE,
+      unsigned n, double const *bPx, double const *bPy, double const *bPz, double const *bE,
+      double *ellipses, bool *reconstructable, double mW = 80., double mT = 173.)
+    {
+        // Quantities that only depend on the lepton. Masses follow TLorentzVector::M and only
+        //enter squared
+        double const pl2 = lepPx * lepPx + lepPy * lepPy + lepPz * lepPz;
+        double const pl = std::sqrt(pl2);
+        double const ml = std::sqrt(std::abs(lepE * lepE - pl2));
+        double const el = std::sqrt(ml * ml + pl * pl);
+        double const betal = pl / el;
+        double const gammali = ml / el;
+        double const x0 = -0.5 / el * (mW * mW - ml * ml);
+        double const epsilon = mW * mW * gammali * gammali;
+        double const sx = (x0 * betal - pl * gammali * gammali) / (betal * betal);
+        
+        
+        // Rotations that bring the lepton onto the x axis
+        double const w1 = std::atan2(lepPy, lepPx);
+        double const c1 = std::cos(-1. * w1), s1 = std::sin(-1. * w1);
+        double const w2 = std::atan2(lepPz, c1 * lepPx - s1 * lepPy);
+        double const c2 = std::cos(w2), s2 = std::sin(w2);
+        
+        double const rotationZ[9] = {
+          std::cos(w1), -std::sin(w1), 0.,
+          std::sin(w1), std::cos(w1),  0.,
+          0.,           0.,            1.};
+        double const rotationY[9] = {
+          std::cos(-1. * w2),  0., std::sin(-1. * w2),
+          0.,                  1., 0.,
+          -std::sin(-1. * w2), 0., std::cos(-1. * w2)};
+        double rotationLep[9];
+        Multiply3(rotationZ, rotationY, rotationLep);
+        
+        
+        for (unsigned i = 0; i < n; ++i)
+        {
+            double const px = bPx[i], py = bPy[i], pz = bPz[i];
+            double const pb2 = px * px + py * py + pz * pz;
+            double const pb = std::sqrt(pb2);
+            double const mb = std::sqrt(std::abs(bE[i] * bE[i] - pb2));
+            double const eb = std::sqrt(mb * mb + pb * pb);
+            
+            double const cosbl = (lepPx * px + lepPy * py + lepPz * pz) / (pl * pb);
+            double const sinbl = std::sqrt(1. - cosbl * cosbl);
+            double const betab = pb / eb;
+            double const x0p = -0.5 / eb * (mT * mT - mW * mW - mb * mb);
+            double const sy = 1. / sinbl * (x0p / betab - cosbl * sx);
+            
+            double const omega = 1. / sinbl * (betal / betab - cosbl);
+            double const omegaS = omega * omega - gammali * gammali;
+            double const omegaSqrt = std::sqrt(omegaS);
+            
+            double const x1 = sx - (sx + omega * sy) / omegaS;
+            double const y1 = sy - (sx + omega * sy) * omega / omegaS;
+            double const zS = x1 * x1 * omegaS - (sy - omega * sx) * (sy - omega * sx) -
+              mW * mW + x0 * x0 + epsilon * epsilon;
+            double const z = std::sqrt(zS);
+            
+            reconstructable[i] = not (zS < 0.);
+            
+            double const ht[9] = {
+              z / omegaSqrt,         0., x1 - pl,
+              z * omega / omegaSqrt, 0., y1,
+              0.,                    z,  0.};
+            
+            
+            // Rotation about the x axis that brings the jet into the xy plane. Components of the
+            //jet momentum are transformed with the same rotations as applied to the lepton
+            double const bx1 = c1 * px - s1 * py, by1 = s1 * px + c1 * py;
+            double const bz2 = c2 * pz - s2 * bx1;
+            double const w3 = std::atan2(bz2, by1);
+            double const c3 = std::cos(w3), s3 = std::sin(w3);
+            
+            double const rotationX[9] = {
+              1., 0., 0.,
+              0., c3, -s3,
+              0., s3, c3};
+            double rotation[9];
+            Multiply3(rotationLep, rotationX, rotation);
+            Multiply3(rotation, ht, ellipses + ellipseSize * i);
+        }
+    }
+}
@@ -2,6 +2,8 @@
 
 #include <mensura/core/AnalysisPlugin.hpp>
 
+#include <AllocationCheck.hpp>
+
 #include <mensura/core/PhysicsObjects.hpp>
 
 #include <string>
@@ -73,4 +75,7 @@ protected:
     
     /// Collection of neutrinos reconstructed in the current event
     std::vector<Candidate> neutrinos;
+    
+    /// Checks that no memory is allocated in ProcessEvent in steady state
+    AllocationCheck allocationCheck;
 };
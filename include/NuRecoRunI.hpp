@@ -44,6 +44,18 @@ public:
      */
     virtual Plugin *Clone() const override;
     
+    /**
+     * \brief Reconstructs neutrino from the given lepton and MET
+     * 
+     * Implements the algorithm described in the documentation of the class. Reconstructed
+     * neutrino candidates (if any) are appended to the given collection. This method does not
+     * depend on the state of the plugin and can be used outside of the framework. The computation
+     * is performed by NuKernels::SolveWMass, which can also be called directly for arrays of
+     * leptons and MET.
+     */
+    static void Reconstruct(TLorentzVector const &leptonP4, TLorentzVector const &metP4,
+      std::vector<Candidate> &neutrinos);
+    
 private:
     /**
      * \brief Reconstructs neutrino in the current event
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <vector>
+
+
+namespace LHAPDF{class PDF;};
+
+
+/**
+ * \class PdfGrid
+ * \brief Precomputed interpolation table for parton densities
+ * 
+ * The table stores values of x f(x, Q) for the gluon and (anti)quarks up to the b quark, evaluated
+ * with LHAPDF on a grid in variables log(x / (1 - x)) and log Q. The first variable makes the grid
+ * dense both at small and at large x. Values are interpolated with cubic polynomials along each
+ * axis, which reproduces the LHAPDF interpolation to a relative precision of about 10^-4 in the
+ * bulk of the phase space.
+ * 
+ * Points outside of the grid and unsupported flavours are evaluated with LHAPDF directly. The
+ * lower boundary of the grid in Q should be chosen above the thresholds of heavy quarks, as the
+ * parton densities are not smooth there.
+ * 
+ * The table is read-only after construction and can be shared between threads.
+ */
+class PdfGrid
+{
+public:
+    /**
+     * \brief Constructs the table from the given PDF set
+     * 
+     * The range in Q is given in GeV. The grid covers x from the lower boundary of the PDF set to
+     * 0.99. The last two arguments specify the numbers of nodes along x and Q.
+     */
+    PdfGrid(std::shared_ptr<LHAPDF::PDF const> const &pdf, double qMin, double qMax,
+      unsigned numNodesX = 400, unsigned numNodesQ = 80);
+    
+public:
+    /**
+     * \brief Evaluates x f(x, Q) for the given flavour at several scales
+     * 
+     * The flavour is identified with its PDG ID (the gluon can be given as 0 or 21). Interpolation
+     * coefficients along x are computed only once for all scales.
+     */
+    void Evaluate(int flavour, double x, unsigned numScales, double const *scales,
+      double *results) const;
+    
+    /// Evaluates x f(x, Q) for the given flavour at a single scale
+    double Evaluate(int flavour, double x, double scale) const;
+    
+private:
+    /**
+     * \brief Returns index of the given flavour in the table
+     * 
+     * Returns -1 if the flavour is not supported.
+     */
+    static int FlavourIndex(int flavour);
+    
+    /**
+     * \brief Finds position of the given coordinate along a uniform grid
+     * 
+     * Sets the index of the first of the four nodes to be used in the interpolation and computes
+     * their weights. Returns false if the coordinate is outside of the grid.
+     */
+    static bool Locate(double u, double uMin, double step, unsigned numNodes, unsigned &index,
+      std::array<double, 4> &weights);
+    
+private:
+    /// Number of supported flavours
+    static unsigned const numFlavours = 11;
+    
+    /// PDF set used to fill the table and to evaluate points outside of it
+    std::shared_ptr<LHAPDF::PDF const> pdf;
+    
+    /// Numbers of nodes along the two axes
+    unsigned numNodesX, numNodesQ;
+    
+    /// Position of the first node and distance between nodes along log(x / (1 - x))
+    double uMin, stepU;
+    
+    /// Position of the first node and distance between nodes along log Q
+    double logQMin, stepLogQ;
+    
+    /**
+     * \brief Tabulated values of x f(x, Q)
+     * 
+     * Indexed as [(iFlavour * numNodesQ + iQ) * numNodesX + iX].
+     */
+    std::vector<double> table;
+};
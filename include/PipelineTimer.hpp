@@ -0,0 +1,173 @@
+#pragma once
+
+#include <mensura/core/AnalysisPlugin.hpp>
+
+#include <iosfwd>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+/**
+ * \class PipelineTimer
+ * \brief Measures time spent in individual plugins
+ * 
+ * This plugin must be registered before all other plugins. Every plugin to be monitored must be
+ * followed by a TimingProbe. The time elapsed between two consecutive probes (or between this
+ * plugin and the first probe) is attributed to the plugin preceding the later probe. If an event
+ * is rejected by some plugin, the probe following it is not executed. In this case the time is
+ * attributed when this plugin is executed for the next event and finds out which probe has been
+ * the last one to run. Both the wall time and the CPU time of the current thread are measured.
+ * 
+ * Measurements are kept separately for each clone of this plugin, which corresponds to a single
+ * worker thread, and for each dataset. When processing of a dataset finishes, they are passed to
+ * a report shared by all clones. After all datasets have been processed, the report can be printed
+ * as a table or saved in JSON format using the original (non-cloned) instance of this plugin.
+ * 
+ * This plugin never rejects events.
+ */
+class PipelineTimer: public AnalysisPlugin
+{
+public:
+    /// Time measured for a single plugin
+    struct Segment
+    {
+        /// Label of the plugin
+        std::string label;
+        
+        /// Number of events processed by the plugin and number of them rejected by it
+        unsigned long calls, rejections;
+        
+        /// Total wall and CPU times, in seconds
+        double wallTime, cpuTime;
+    };
+    
+    /// Measurements for one worker thread and one dataset
+    struct Record
+    {
+        /// Index of the worker thread (i.e. of the clone of this plugin)
+        unsigned worker;
+        
+        /// ID of the source dataset
+        std::string datasetID;
+        
+        /// Number of processed events
+        unsigned long numEvents;
+        
+        /// Measurements for all monitored plugins, in the order of their execution
+        std::vector<Segment> segments;
+        
+        /**
+         * \brief Index of the last probe executed in the current event
+         * 
+         * Set to -1 at the start of each event.
+         */
+        int lastProbe;
+        
+        /// Wall and CPU time stamps set by the last executed probe, in seconds
+        double lastWallTime, lastCPUTime;
+    };
+    
+private:
+    /// Measurements collected from all clones
+    struct Report
+    {
+        /// Mutex to protect access from multiple threads
+        std::mutex mutex;
+        
+        /// Index to be given to the next clone
+        unsigned nextWorker;
+        
+        /// Measurements passed by clones, in the order of arrival
+        std::vector<Record> records;
+    };
+    
+public:
+    /// Creates plugin with the given name
+    PipelineTimer(std::string const &name = "PipelineTimer");
+    
+    /// Default move constructor
+    PipelineTimer(PipelineTimer &&) = default;
+    
+    /// Assignment operator is deleted
+    PipelineTimer &operator=(PipelineTimer const &) = delete;
+    
+private:
+    /**
+     * \brief Copy constructor that produces a newly initialized clone
+     * 
+     * The clone shares the report with the source and is assigned a new worker index.
+     */
+    PipelineTimer(PipelineTimer const &src);
+    
+public:
+    /**
+     * \brief Starts a new record for the given dataset
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void BeginRun(Dataset const &dataset) override;
+    
+    /**
+     * \brief Creates a newly configured clone
+     * 
+     * Implemented from Plugin.
+     */
+    virtual Plugin *Clone() const override;
+    
+    /**
+     * \brief Passes the record for the current dataset to the shared report
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void EndRun() override;
+    
+    /**
+     * \brief Returns the record for the current dataset
+     * 
+     * Intended to be used by probes. Although this is a constant method, probes update the
+     * returned record.
+     */
+    Record &GetRecord() const;
+    
+    /// Returns current wall and CPU time of the current thread, in seconds
+    static void GetTime(double &wallTime, double &cpuTime);
+    
+    /**
+     * \brief Prints a table with measurements summed over all threads and datasets
+     * 
+     * Must be called after processing has finished.
+     */
+    void PrintSummary(std::ostream &out) const;
+    
+    /**
+     * \brief Saves all measurements in a JSON file
+     * 
+     * The file contains a list of records for every worker thread and dataset, as well as
+     * measurements summed over them. Must be called after processing has finished. Throws an
+     * exception if the file cannot be created.
+     */
+    void WriteReport(std::string const &path) const;
+    
+private:
+    /**
+     * \brief Attributes time elapsed since the last probe to the plugin that rejected the event
+     * 
+     * Does nothing if the previous event has not been rejected.
+     */
+    virtual bool ProcessEvent() override;
+    
+    /// Sums measurements over all records, matching plugins by their labels
+    std::vector<Segment> SumSegments(unsigned long &numEvents) const;
+    
+private:
+    /// Index of this clone
+    unsigned worker;
+    
+    /// Measurements for the current dataset
+    std::unique_ptr<Record> record;
+    
+    /// Report shared among all clones
+    std::shared_ptr<Report> report;
+};
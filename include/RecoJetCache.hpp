@@ -0,0 +1,156 @@
+#pragma once
+
+#include <mensura/core/PhysicsObjects.hpp>
+
+#include <TLorentzVector.h>
+
+#include <vector>
+
+
+/**
+ * \class RecoJetCache
+ * \brief Per-event cache of kinematics of jets considered in reconstruction of tt system
+ * 
+ * Four-momenta of the jets are stored in a flat structure-of-arrays layout. In addition, the cache
+ * precomputes invariant masses of all pairs and of all triplets (b, q1, q2) with q1 < q2, which
+ * are needed to evaluate masses of the hadronically decaying W boson and top quark. Jets are
+ * referred to by their indices in the collection provided to method Fill.
+ * 
+ * Memory is reused between events and is only reallocated when the number of jets exceeds the
+ * largest one seen so far.
+ */
+class RecoJetCache
+{
+public:
+    /// Constructs an empty cache
+    RecoJetCache();
+    
+public:
+    /**
+     * \brief Fills the cache with jets with given indices
+     * 
+     * Jets are taken from the given collection, and their order is preserved. Consequently, jet
+     * with index i in the cache is jets[indices[i]].
+     */
+    void Fill(std::vector<Jet> const &jets, std::vector<unsigned> const &indices);
+    
+    /// Returns number of jets in the cache
+    unsigned GetNumJets() const
+    {
+        return nJets;
+    }
+    
+    /// Returns x component of momentum of jet with the given index
+    double Px(unsigned i) const
+    {
+        return px[i];
+    }
+    
+    /// Returns y component of momentum of jet with the given index
+    double Py(unsigned i) const
+    {
+        return py[i];
+    }
+    
+    /// Returns z component of momentum of jet with the given index
+    double Pz(unsigned i) const
+    {
+        return pz[i];
+    }
+    
+    /// Returns energy of jet with the given index
+    double E(unsigned i) const
+    {
+        return e[i];
+    }
+    
+    /**
+     * \brief Returns pointers to arrays with components of four-momenta of all jets
+     * 
+     * The arrays are indexed in the same way as the cache and remain valid until the next call to
+     * method Fill.
+     */
+    double const *PxData() const
+    {
+        return px.data();
+    }
+    
+    /// Consult documentation for PxData
+    double const *PyData() const
+    {
+        return py.data();
+    }
+    
+    /// Consult documentation for PxData
+    double const *PzData() const
+    {
+        return pz.data();
+    }
+    
+    /// Consult documentation for PxData
+    double const *EData() const
+    {
+        return e.data();
+    }
+    
+    /// Returns four-momentum of jet with the given index
+    TLorentzVector GetP4(unsigned i) const
+    {
+        return TLorentzVector(px[i], py[i], pz[i], e[i]);
+    }
+    
+    /**
+     * \brief Returns invariant mass of two jets with given indices
+     * 
+     * The indices must differ.
+     */
+    double GetMassPair(unsigned i, unsigned j) const
+    {
+        return massPair[i * nJets + j];
+    }
+    
+    /**
+     * \brief Returns invariant mass of three jets with given indices
+     * 
+     * All indices must differ, and the condition q1 < q2 must hold.
+     */
+    double GetMassTriplet(unsigned b, unsigned q1, unsigned q2) const
+    {
+        return massTriplet[(b * nJets + q1) * nJets + q2];
+    }
+    
+    /**
+     * \brief Reads masses for a batch of n triplets (b, q1, q2) of jets
+     * 
+     * The triplets are described by arrays of indices, and the same requirements as in
+     * GetMassTriplet apply. Masses of pairs (q1, q2) and of the triplets are written into arrays
+     * massPairs and massTriplets respectively.
+     */
+    void GetMassesBatch(unsigned n, unsigned const *b, unsigned const *q1, unsigned const *q2,
+      double *massPairs, double *massTriplets) const;
+    
+    /**
+     * \brief Computes invariant mass from given components of four-momentum
+     * 
+     * Follows the convention of TLorentzVector::M and returns a negative value for a space-like
+     * four-momentum.
+     */
+    static double Mass(double px, double py, double pz, double e);
+    
+private:
+    /// Number of jets in the current event
+    unsigned nJets;
+    
+    /// Components of four-momenta of jets
+    std::vector<double> px, py, pz, e;
+    
+    /// Invariant masses of pairs of jets, stored as a square matrix of size nJets
+    std::vector<double> massPair;
+    
+    /**
+     * \brief Invariant masses of triplets of jets
+     * 
+     * Stored as a cube of size nJets. Only elements with distinct indices and q1 < q2 are filled.
+     */
+    std::vector<double> massTriplet;
+};
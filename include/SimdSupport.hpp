@@ -0,0 +1,29 @@
+#pragma once
+
+
+/**
+ * \file SimdSupport.hpp
+ * \brief Auxiliary definitions for SIMD kernels with run-time dispatch
+ * 
+ * SIMD kernels are compiled with function-level target attributes, so that the rest of the package
+ * does not need to be built with -mavx2. Whether they can be used is decided at run time with the
+ * help of function IsAVX2Supported. The macro TTRES_AVX2_DISPATCH is defined if such dispatch is
+ * possible with the current compiler and architecture. Otherwise only scalar versions are built.
+ */
+
+
+#if defined(__GNUC__) and defined(__x86_64__)
+    #define TTRES_AVX2_DISPATCH
+#endif
+
+
+/// Checks if the CPU supports AVX2 instructions
+inline bool IsAVX2Supported()
+{
+#ifdef TTRES_AVX2_DISPATCH
+    static bool const supported = __builtin_cpu_supports("avx2");
+    return supported;
+#else
+    return false;
+#endif
+}
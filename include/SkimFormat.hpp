@@ -0,0 +1,116 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+
+/**
+ * \file SkimFormat.hpp
+ * \brief Binary layout of files with skimmed events
+ * 
+ * A skim file starts with a SkimFormat::Header. It is followed by a string that describes the
+ * layout of alternative event weights (as saved by DumpWeights) and, for each collection of jets
+ * and MET, its name given as a 32-bit length followed by characters. The header fixes the number
+ * of collections and alternative weights.
+ * 
+ * Then come the events. Each event starts with a SkimFormat::EventRecord, which is followed by
+ * numLeptons records of type SkimFormat::LeptonRecord and numSystWeights alternative weights of
+ * type float. Then, for each collection, there is a SkimFormat::CollectionRecord followed by
+ * numJets records of type SkimFormat::JetRecord.
+ * 
+ * All records consist of 4-byte fields, except for a few smaller fields that are grouped to keep
+ * the size of each record a multiple of 4 bytes. Data are stored with the native byte order.
+ */
+namespace SkimFormat
+{
+    /// Identifier put at the beginning of every file
+    char const magic[8] = {'T', 'T', 'R', 'S', 'K', 'I', 'M', '\0'};
+    
+    /// Version of the format, to be incremented whenever the layout changes
+    std::uint32_t const version = 1;
+    
+    
+    /// Header of a file
+    struct Header
+    {
+        char magic[8];
+        std::uint32_t version;
+        
+        /// Number of stored collections of jets and MET
+        std::uint32_t numCollections;
+        
+        /// Hash of the configuration with which the skim has been produced
+        std::uint64_t configHash;
+        
+        /// Hash of the dataset ID and names of input files
+        std::uint64_t inputHash;
+        
+        /// Number of stored events
+        std::uint64_t numEvents;
+        
+        /// Number of alternative event weights in each event
+        std::uint32_t numSystWeights;
+        
+        /// Length of the string that describes the layout of alternative weights
+        std::uint32_t layoutLength;
+    };
+    
+    
+    /// Per-event information
+    struct EventRecord
+    {
+        float weight;
+        float rho;
+        float expectedPileUp;
+        std::uint16_t numVertices;
+        std::uint16_t numLeptons;
+    };
+    
+    
+    /// Description of a lepton
+    struct LeptonRecord
+    {
+        float pt, eta, phi, mass;
+        
+        /// Flavour, encoded as an integer value of Lepton::Flavour
+        std::int8_t flavour;
+        
+        std::int8_t charge;
+        std::uint16_t padding;
+    };
+    
+    
+    /// MET and the number of jets in a collection
+    struct CollectionRecord
+    {
+        float metPt, metPhi;
+        std::uint32_t numJets;
+    };
+    
+    
+    /// Description of a jet
+    struct JetRecord
+    {
+        float pt, eta, phi, mass;
+        float bTagCSV, bTagCMVA;
+    };
+    
+    
+    /**
+     * \brief Computes 64-bit FNV-1a hash of the given string
+     * 
+     * The hash can be updated with several strings by providing the result of the previous call
+     * as the second argument.
+     */
+    inline std::uint64_t Hash(std::string const &text,
+      std::uint64_t hash = 0xcbf29ce484222325ULL)
+    {
+        for (unsigned char c: text)
+        {
+            hash ^= c;
+            hash *= 0x100000001b3ULL;
+        }
+        
+        return hash;
+    }
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <SkimFormat.hpp>
+
+#include <mensura/core/ReaderPlugin.hpp>
+
+#include <mensura/core/PhysicsObjects.hpp>
+
+#include <Rtypes.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+
+/**
+ * \class SkimInputData
+ * \brief Reads events from skim files produced with SkimWriter
+ * 
+ * This plugin replaces the usual input plugin when events are read from skims. For each dataset it
+ * memory-maps the skim file found at the path given by SkimWriter::GetSkimPath and iterates over
+ * the events in it. Content of the current event is exposed through dedicated methods. Plugins
+ * SkimLeptonReader, SkimJetMETReader, and SkimPileUpReader wrap it into the standard reader
+ * interfaces so that they can be used by other plugins.
+ * 
+ * An exception is thrown at the beginning of a dataset if the skim file does not exist, if it has
+ * been written with a different version of the format, or if it is stale, i.e. the hash of the
+ * configuration or of the input files stored in it does not match the ones expected.
+ */
+class SkimInputData: public ReaderPlugin
+{
+public:
+    /**
+     * \brief Constructor
+     * 
+     * The arguments are the name for the new plugin, the directory with skim files, and a text
+     * description of the configuration, which must coincide with the one that has been given to
+     * SkimWriter.
+     */
+    SkimInputData(std::string const &name, std::string const &directory,
+      std::string const &configuration);
+    
+    /// A short-cut for the above version with a default name "InputData"
+    SkimInputData(std::string const &directory, std::string const &configuration);
+    
+    /// Assignment operator is deleted
+    SkimInputData &operator=(SkimInputData const &) = delete;
+    
+    /// Unmaps the current file
+    virtual ~SkimInputData() noexcept;
+    
+private:
+    /// Copy constructor that produces a newly initialized clone
+    SkimInputData(SkimInputData const &src);
+    
+public:
+    /**
+     * \brief Maps the skim file for the given dataset and checks its header
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void BeginRun(Dataset const &dataset) override;
+    
+    /**
+     * \brief Creates a newly configured clone
+     * 
+     * Implemented from Plugin.
+     */
+    virtual Plugin *Clone() const override;
+    
+    /**
+     * \brief Unmaps the current file
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void EndRun() override;
+    
+    /**
+     * \brief Returns index of the collection of jets and MET with the given name
+     * 
+     * Throws an exception if there is no such collection in the current file.
+     */
+    unsigned FindCollection(std::string const &name) const;
+    
+    /// Returns expected number of pile-up interactions in the current event
+    double GetExpectedPileUp() const;
+    
+    /// Returns jets from the given collection in the current event
+    std::vector<Jet> const &GetJets(unsigned collection) const;
+    
+    /// Returns leptons in the current event
+    std::vector<Lepton> const &GetLeptons() const;
+    
+    /// Returns MET from the given collection in the current event
+    Candidate const &GetMET(unsigned collection) const;
+    
+    /// Returns number of reconstructed primary vertices in the current event
+    unsigned GetNumVertices() const;
+    
+    /// Returns mean angular pt density in the current event
+    double GetRho() const;
+    
+    /// Returns alternative event weights in the current event
+    std::vector<Float_t> const &GetSystWeights() const;
+    
+    /**
+     * \brief Returns description of the layout of alternative weights
+     * 
+     * It is empty if no weights have been stored.
+     */
+    std::string const &GetWeightLayout() const;
+    
+    /// Returns nominal weight of the current event
+    Float_t GetWeight() const;
+    
+private:
+    /**
+     * \brief Reads the next event
+     * 
+     * Returns false if there are no more events in the current file.
+     * 
+     * Implemented from ReaderPlugin.
+     */
+    virtual bool ProcessEvent() override;
+    
+    /**
+     * \brief Copies the given number of bytes from the current position in the file
+     * 
+     * Throws an exception if the file ends prematurely.
+     */
+    void Read(void *destination, std::size_t numBytes);
+    
+    /// Unmaps the current file if any
+    void Unmap();
+    
+private:
+    /// Directory with skim files
+    std::string directory;
+    
+    /// Expected hash of the configuration
+    std::uint64_t configHash;
+    
+    /// Path to the current file
+    std::string path;
+    
+    /// Beginning of the mapped file
+    char const *data;
+    
+    /// Size of the mapped file
+    std::size_t size;
+    
+    /// Current position in the mapped file
+    std::size_t position;
+    
+    /// Header of the current file
+    SkimFormat::Header header;
+    
+    /// Index of the next event to be read
+    std::uint64_t nextEvent;
+    
+    /// Names of collections of jets and MET in the current file
+    std::vector<std::string> collectionNames;
+    
+    /// Description of the layout of alternative weights
+    std::string weightLayout;
+    
+    /// Event-level information for the current event
+    SkimFormat::EventRecord event;
+    
+    /// Leptons in the current event
+    std::vector<Lepton> leptons;
+    
+    /// Alternative weights in the current event
+    std::vector<Float_t> systWeights;
+    
+    /// MET in the current event, for each collection
+    std::vector<Candidate> mets;
+    
+    /// Jets in the current event, for each collection
+    std::vector<std::vector<Jet>> jets;
+};
@@ -0,0 +1,78 @@
+#pragma once
+
+#include <mensura/core/JetMETReader.hpp>
+
+#include <string>
+
+
+class SkimInputData;
+
+
+/**
+ * \class SkimJetMETReader
+ * \brief Provides jets and MET read from a skim
+ * 
+ * Exposes a collection of jets and MET read by a SkimInputData plugin with the default name
+ * "InputData" through the standard interface of a JetMETReader. A skim can contain several
+ * collections, which are identified with names of plugins that produced them when the skim was
+ * written. By default, the collection whose name coincides with the name of this plugin is used.
+ * 
+ * Jets have been fully corrected and selected when the skim was written, and only their
+ * four-momenta and b-tagging discriminators for algorithms CSV and CMVA are available.
+ */
+class SkimJetMETReader: public JetMETReader
+{
+public:
+    /// Constructor
+    SkimJetMETReader(std::string const &name = "JetMET");
+    
+public:
+    /**
+     * \brief Saves pointer to the input plugin and finds the requested collection
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void BeginRun(Dataset const &) override;
+    
+    /**
+     * \brief Creates a newly configured clone
+     * 
+     * Implemented from Plugin.
+     */
+    virtual Plugin *Clone() const override;
+    
+    /**
+     * \brief Returns radius parameter used in the jet clustering algorithm
+     * 
+     * Implemented from JetMETReader.
+     */
+    virtual double GetJetRadius() const override;
+    
+    /**
+     * \brief Specifies name of the collection to be read
+     * 
+     * By default, the name of this plugin is used.
+     */
+    void SetCollection(std::string const &name);
+    
+private:
+    /**
+     * \brief Copies jets and MET from the input plugin
+     * 
+     * Implemented from ReaderPlugin.
+     */
+    virtual bool ProcessEvent() override;
+    
+private:
+    /// Name of the plugin that reads the skim
+    std::string inputDataPluginName;
+    
+    /// Non-owning pointer to the plugin that reads the skim
+    SkimInputData const *inputDataPlugin;
+    
+    /// Name of the collection to be read
+    std::string collectionName;
+    
+    /// Index of the collection in the current skim file
+    unsigned collectionIndex;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <mensura/core/LeptonReader.hpp>
+
+#include <string>
+
+
+class SkimInputData;
+
+
+/**
+ * \class SkimLeptonReader
+ * \brief Provides leptons read from a skim
+ * 
+ * Exposes leptons read by a SkimInputData plugin with the default name "InputData" through the
+ * standard interface of a LeptonReader.
+ */
+class SkimLeptonReader: public LeptonReader
+{
+public:
+    /// Constructor
+    SkimLeptonReader(std::string const &name = "Leptons");
+    
+public:
+    /**
+     * \brief Saves pointer to the input plugin
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void BeginRun(Dataset const &) override;
+    
+    /**
+     * \brief Creates a newly configured clone
+     * 
+     * Implemented from Plugin.
+     */
+    virtual Plugin *Clone() const override;
+    
+private:
+    /**
+     * \brief Copies leptons from the input plugin
+     * 
+     * Implemented from ReaderPlugin.
+     */
+    virtual bool ProcessEvent() override;
+    
+private:
+    /// Name of the plugin that reads the skim
+    std::string inputDataPluginName;
+    
+    /// Non-owning pointer to the plugin that reads the skim
+    SkimInputData const *inputDataPlugin;
+};
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <mensura/core/PileUpReader.hpp>
+
+#include <string>
+
+
+class SkimInputData;
+
+
+/**
+ * \class SkimPileUpReader
+ * \brief Provides pile-up information read from a skim
+ * 
+ * Exposes pile-up information read by a SkimInputData plugin with the default name "InputData"
+ * through the standard interface of a PileUpReader.
+ */
+class SkimPileUpReader: public PileUpReader
+{
+public:
+    /// Constructor
+    SkimPileUpReader(std::string const &name = "PileUp");
+    
+public:
+    /**
+     * \brief Saves pointer to the input plugin
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void BeginRun(Dataset const &) override;
+    
+    /**
+     * \brief Creates a newly configured clone
+     * 
+     * Implemented from Plugin.
+     */
+    virtual Plugin *Clone() const override;
+    
+private:
+    /**
+     * \brief Copies pile-up information from the input plugin
+     * 
+     * Implemented from ReaderPlugin.
+     */
+    virtual bool ProcessEvent() override;
+    
+private:
+    /// Name of the plugin that reads the skim
+    std::string inputDataPluginName;
+    
+    /// Non-owning pointer to the plugin that reads the skim
+    SkimInputData const *inputDataPlugin;
+};
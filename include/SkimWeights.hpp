@@ -0,0 +1,73 @@
+#pragma once
+
+#include <mensura/core/AnalysisPlugin.hpp>
+
+#include <Rtypes.h>
+
+#include <string>
+#include <vector>
+
+
+class SkimInputData;
+class TFileService;
+
+
+/**
+ * \class SkimWeights
+ * \brief Saves event weights read from a skim
+ * 
+ * This is the counterpart of DumpWeights for events read from skims with a SkimInputData plugin
+ * with the default name "InputData". Weights computed by DumpWeights when the skim was written are
+ * registered as columns "weight" and "systWeights" with an NtupleWriter with the default name
+ * "NtupleWriter", and their layout is saved in a TNamed object "SystWeightsLayout", as described
+ * in the documentation for DumpWeights.
+ */
+class SkimWeights: public AnalysisPlugin
+{
+public:
+    /// Constructor
+    SkimWeights(std::string const &name = "SkimWeights");
+    
+public:
+    /**
+     * \brief Saves pointers to dependencies and registers output columns
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void BeginRun(Dataset const &) override;
+    
+    /**
+     * \brief Creates a newly configured clone
+     * 
+     * Implemented from Plugin.
+     */
+    virtual Plugin *Clone() const override;
+    
+private:
+    /**
+     * \brief Copies event weights from the input plugin
+     * 
+     * Implemented from Plugin.
+     */
+    virtual bool ProcessEvent() override;
+    
+private:
+    /// Name of the plugin that writes output columns
+    std::string writerName;
+    
+    /// Name of TFileService
+    std::string fileServiceName;
+    
+    /// Non-owning pointer to TFileService
+    TFileService const *fileService;
+    
+    /// Name of the plugin that reads the skim
+    std::string inputDataPluginName;
+    
+    /// Non-owning pointer to the plugin that reads the skim
+    SkimInputData const *inputDataPlugin;
+    
+    // Output buffers
+    Float_t weight;
+    std::vector<Float_t> systWeights;
+};
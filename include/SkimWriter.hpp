@@ -0,0 +1,168 @@
+#pragma once
+
+#include <SkimFormat.hpp>
+
+#include <mensura/core/AnalysisPlugin.hpp>
+
+#include <cstdint>
+#include <fstream>
+#include <string>
+#include <vector>
+
+
+class DumpWeights;
+class JetMETReader;
+class LeptonReader;
+class PileUpReader;
+
+
+/**
+ * \class SkimWriter
+ * \brief Saves events that reach it into a compact binary file
+ * 
+ * This plugin is intended to be placed after the event selection. It saves leptons, pile-up
+ * information, and one or more collections of jets and MET in the format described in
+ * SkimFormat.hpp, so that later passes can read the surviving events with SkimInputData instead
+ * of the full input. If the name of a DumpWeights plugin is provided, event weights computed by it
+ * are saved as well.
+ * 
+ * A separate file is written for each (part of a) dataset. Its path is given by function
+ * GetSkimPath and depends on the dataset ID and names of the input files. The file is first
+ * written under a temporary name and only renamed when the dataset has been processed completely,
+ * so that an interrupted job does not leave an incomplete skim behind. The header of the file
+ * contains a hash of a text that summarizes the configuration of the job, which allows detecting
+ * skims produced with a different configuration.
+ * 
+ * Relies on a lepton reader and a pile-up reader with the default names "Leptons" and "PileUp".
+ */
+class SkimWriter: public AnalysisPlugin
+{
+public:
+    /**
+     * \brief Constructor
+     * 
+     * The files are written into the given directory, which is created if needed (but only one
+     * level of directories is created). The second argument is a text description of the
+     * configuration of the job, whose hash is saved in the files.
+     */
+    SkimWriter(std::string const &name, std::string const &directory,
+      std::string const &configuration);
+    
+    /// A short-cut for the above version with a default name "SkimWriter"
+    SkimWriter(std::string const &directory, std::string const &configuration);
+    
+    /// Default move constructor
+    SkimWriter(SkimWriter &&) = default;
+    
+    /// Assignment operator is deleted
+    SkimWriter &operator=(SkimWriter const &) = delete;
+    
+private:
+    /// Copy constructor that produces a newly initialized clone
+    SkimWriter(SkimWriter const &src);
+    
+public:
+    /**
+     * \brief Adds a collection of jets and MET to be saved
+     * 
+     * The collection is identified with the name of the plugin that produces it. The same name
+     * is used to read the collection back.
+     */
+    void AddJetMETCollection(std::string const &jetmetPluginName);
+    
+    /**
+     * \brief Opens the output file and saves pointers to dependencies
+     * 
+     * Throws an exception if no collections of jets and MET have been added.
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void BeginRun(Dataset const &dataset) override;
+    
+    /**
+     * \brief Creates a newly configured clone
+     * 
+     * Implemented from Plugin.
+     */
+    virtual Plugin *Clone() const override;
+    
+    /**
+     * \brief Finalizes the output file
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void EndRun() override;
+    
+    /**
+     * \brief Returns path to the skim file for the given dataset
+     * 
+     * The name of the file is built from the source dataset ID and a hash of names of the input
+     * files. It is thus unique for each part of a dataset processed in a single run.
+     */
+    static std::string GetSkimPath(std::string const &directory, Dataset const &dataset);
+    
+    /// Computes hash of the source dataset ID and names of the input files
+    static std::uint64_t GetInputHash(Dataset const &dataset);
+    
+    /**
+     * \brief Specifies the name of a DumpWeights plugin that provides event weights
+     * 
+     * If the name is empty (default), the weights are not saved, and unit nominal weights with
+     * no alternative weights are written instead.
+     */
+    void SetWeightPluginName(std::string const &name);
+    
+private:
+    /**
+     * \brief Saves the current event
+     * 
+     * Implemented from Plugin.
+     */
+    virtual bool ProcessEvent() override;
+    
+    /// Appends the given number of bytes to the buffer for the current event
+    void Append(void const *data, unsigned size);
+    
+private:
+    /// Directory in which files are written
+    std::string directory;
+    
+    /// Hash of the configuration
+    std::uint64_t configHash;
+    
+    /// Name of plugin that produces leptons
+    std::string leptonPluginName;
+    
+    /// Non-owning pointer to plugin that produces leptons
+    LeptonReader const *leptonPlugin;
+    
+    /// Name of plugin that provides pile-up information
+    std::string puPluginName;
+    
+    /// Non-owning pointer to plugin that provides pile-up information
+    PileUpReader const *puPlugin;
+    
+    /// Names of plugins that produce saved collections of jets and MET
+    std::vector<std::string> jetmetPluginNames;
+    
+    /// Non-owning pointers to plugins that produce saved collections of jets and MET
+    std::vector<JetMETReader const *> jetmetPlugins;
+    
+    /// Name of plugin that provides event weights
+    std::string weightPluginName;
+    
+    /// Non-owning pointer to plugin that provides event weights
+    DumpWeights const *weightPlugin;
+    
+    /// Final path to the current output file and its temporary version
+    std::string path, tmpPath;
+    
+    /// Current output file
+    std::ofstream file;
+    
+    /// Header of the current output file, updated when the file is closed
+    SkimFormat::Header header;
+    
+    /// Buffer in which the current event is assembled
+    std::vector<char> buffer;
+};
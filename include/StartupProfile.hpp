@@ -0,0 +1,46 @@
+#pragma once
+
+#include <chrono>
+#include <iosfwd>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+/**
+ * \class StartupProfile
+ * \brief Measures wall time spent in the initialization of a program
+ * 
+ * An object of this class records time elapsed between consecutive calls to method Mark, which
+ * delimit phases of the program, such as parsing of options or registration of services. In
+ * addition, classes that load heavy inputs lazily, on their first use, report the time it took
+ * with the static method RecordLazyLoad. Such loads normally happen in worker threads and are
+ * collected in a process-wide list. Both are printed with method Print.
+ */
+class StartupProfile
+{
+public:
+    /// Constructor that starts the first phase
+    StartupProfile();
+    
+public:
+    /// Closes the current phase and labels it with the given name
+    void Mark(std::string const &label);
+    
+    /// Prints durations of all phases and all lazy loads
+    void Print(std::ostream &out) const;
+    
+    /**
+     * \brief Records that an input with the given label has been loaded in the given time
+     * 
+     * The time is given in seconds. This method is thread-safe.
+     */
+    static void RecordLazyLoad(std::string const &label, double time);
+    
+private:
+    /// Start of the current phase
+    std::chrono::steady_clock::time_point phaseStart;
+    
+    /// Labels and durations, in seconds, of closed phases
+    std::vector<std::pair<std::string, double>> phases;
+};
@@ -0,0 +1,155 @@
+#pragma once
+
+#include <mensura/core/AnalysisPlugin.hpp>
+
+#include <mensura/core/BTagger.hpp>
+
+#include <Rtypes.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+
+class BTagWPService;
+class JetMETReader;
+class LeptonReader;
+
+
+/**
+ * \class SystVarSelection
+ * \brief Applies event selection on jets and MET simultaneously for several systematic variations
+ * 
+ * This plugin is intended for processing many systematic variations in a single pass over the
+ * input. Each variation is described by a label and the name of a dedicated jet reader. For each
+ * of them the event selection is evaluated, which requires a given minimal number of jets and
+ * b-tagged jets, and a minimal transverse mass of the W boson built from the leading lepton and
+ * MET. It reproduces the selection otherwise applied with JetFilter and MetFilter. An event is
+ * rejected only if it fails the selection for all variations.
+ * 
+ * Decisions for individual variations are available through method IsSelected and are also saved
+ * as boolean columns named "Selected_" followed by the label of the variation. The columns are
+ * registered with an NtupleWriter with the default name "NtupleWriter".
+ * 
+ * Relies on a lepton reader with the default name "Leptons" and on a service that provides
+ * b-tagging working points with the default name "BTagWP".
+ */
+class SystVarSelection: public AnalysisPlugin
+{
+public:
+    /**
+     * \brief Constructs plugin with the given name
+     * 
+     * Jets are considered only if their pt is larger than minPt. Their b-tagging is checked using
+     * the given algorithm and working point.
+     */
+    SystVarSelection(std::string const &name, BTagger const &bTagger, double minPt);
+    
+    /// A short-cut for the above version with a default name "SystVarSelection"
+    SystVarSelection(BTagger const &bTagger, double minPt);
+    
+    /// Default move constructor
+    SystVarSelection(SystVarSelection &&) = default;
+    
+    /// Assignment operator is deleted
+    SystVarSelection &operator=(SystVarSelection const &) = delete;
+    
+private:
+    /**
+     * \brief Copy constructor that produces a newly initialized clone
+     * 
+     * Can only be called before processing of the first dataset has started.
+     */
+    SystVarSelection(SystVarSelection const &src);
+    
+public:
+    /**
+     * \brief Adds a new variation
+     * 
+     * The label is used to build the name of the corresponding output column. The second
+     * argument is the name of the plugin that produces jets and MET for this variation.
+     */
+    void AddVariation(std::string const &label, std::string const &jetmetPluginName);
+    
+    /**
+     * \brief Saves pointers to dependencies and registers output columns
+     * 
+     * Throws an exception if no variations have been added.
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void BeginRun(Dataset const &) override;
+    
+    /**
+     * \brief Creates a newly configured clone
+     * 
+     * Implemented from Plugin.
+     */
+    virtual Plugin *Clone() const override;
+    
+    /**
+     * \brief Returns decision of the selection for the variation with the given index
+     * 
+     * Variations are indexed in the order in which they have been added.
+     */
+    bool IsSelected(unsigned index) const;
+    
+    /**
+     * \brief Specifies the selection
+     * 
+     * Default values are 4, 2, and 50 GeV.
+     */
+    void SetSelection(unsigned minNumJets, unsigned minNumBTags, double minMtW);
+    
+private:
+    /**
+     * \brief Evaluates the selection for all variations
+     * 
+     * Implemented from Plugin.
+     */
+    virtual bool ProcessEvent() override;
+    
+private:
+    /// Name of the plugin that writes output columns
+    std::string writerName;
+    
+    /// Name of the service that provides b-tagging working points
+    std::string bTagWPServiceName;
+    
+    /// Non-owning pointer to the service that provides b-tagging working points
+    BTagWPService const *bTagWPService;
+    
+    /// Name of the plugin that produces leptons
+    std::string leptonPluginName;
+    
+    /// Non-owning pointer to the plugin that produces leptons
+    LeptonReader const *leptonPlugin;
+    
+    /// Labels of the variations
+    std::vector<std::string> labels;
+    
+    /// Names of plugins that produce jets and MET for each variation
+    std::vector<std::string> jetmetPluginNames;
+    
+    /// Non-owning pointers to plugins that produce jets and MET for each variation
+    std::vector<JetMETReader const *> jetmetPlugins;
+    
+    /// Selected b-tagging algorithm and working point
+    BTagger bTagger;
+    
+    /// Minimal pt for jets to be considered
+    double minPt;
+    
+    /// Minimal numbers of jets and b-tagged jets
+    unsigned minNumJets, minNumBTags;
+    
+    /// Minimal transverse mass of the W boson
+    double minMtW;
+    
+    /**
+     * \brief Output buffers with decisions for each variation
+     * 
+     * Allocated in BeginRun.
+     */
+    std::unique_ptr<Bool_t[]> bfSelected;
+};
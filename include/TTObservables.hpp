@@ -2,18 +2,23 @@
 
 #include <mensura/core/AnalysisPlugin.hpp>
 
+#include <NtupleWriter.hpp>
 #include <TTSemilepRecoBase.hpp>
 
-#include <mensura/extensions/TFileService.hpp>
+#include <Rtypes.h>
 
-#include <TTree.h>
+#include <string>
 
 
 /**
  * \class TTObservables
  * \brief Saves some observables related to reconstructed top quarks
  * 
- * Relies on the presence of a reconstruction plugin with the default name "TTReco".
+ * The observables are registered as columns with an NtupleWriter with the default name
+ * "NtupleWriter". Relies on the presence of a reconstruction plugin with the default name "TTReco".
+ * 
+ * Optionally, observables for the second-best interpretation found by the reconstruction plugin
+ * are saved as well (see method SetAlternativeInterpretation).
  */
 class TTObservables: public AnalysisPlugin
 {
@@ -29,7 +34,7 @@ public:
     
 public:
     /**
-     * \brief Saves pointers to dependencies and sets up the output tree
+     * \brief Saves pointers to dependencies and registers output columns
      * 
      * Reimplemented from Plugin.
      */
@@ -42,23 +47,52 @@ public:
      */
     virtual Plugin *Clone() const override;
     
+    /**
+     * \brief Requests that observables for the second-best interpretation are saved
+     * 
+     * They include the difference between ranks of the best and second-best interpretations, and
+     * masses of the top quarks, the W boson, and the tt system in the second-best interpretation.
+     * The reconstruction plugin must be configured to store at least two interpretations (see
+     * TTSemilepRecoBase::SetMaxNumInterpretations). If there is no second interpretation in an
+     * event, the difference between ranks is set to -1 and the masses to zero. Disabled by
+     * default.
+     */
+    void SetAlternativeInterpretation(bool enable = true);
+    
+    /**
+     * \brief Specifies a prefix to be added to names of all output columns
+     * 
+     * By default, the prefix is empty.
+     */
+    void SetColumnPrefix(std::string const &prefix);
+    
+    /**
+     * \brief Specifies storage schema for output columns
+     * 
+     * By default, all columns are stored with full precision.
+     */
+    void SetStorageSchema(NtupleWriter::Schema const &schema);
+    
     /// Specifies name of the plugin that performs tt reconstruction
     void SetRecoPluginName(std::string const &pluginName);
     
 private:
     /**
-     * \brief Computes observables and fills the tree
+     * \brief Computes observables
      * 
      * Implemented from Plugin.
      */
     virtual bool ProcessEvent() override;
     
 private:
-    /// Name of TFileService
-    std::string fileServiceName;
+    /// Name of the plugin that writes output columns
+    std::string writerName;
+    
+    /// Prefix for names of output columns
+    std::string columnPrefix;
     
-    /// Non-owning pointer to TFileService
-    TFileService const *fileService;
+    /// Storage schema for output columns
+    NtupleWriter::Schema schema;
     
     /// Name of plugin that reconstructs event under the ttbar hypothesis
     std::string ttRecoPluginName;
@@ -66,8 +100,8 @@ private:
     /// Non-owning pointer to plugin that reconstructs event under the ttbar hypothesis
     TTSemilepRecoBase const *ttRecoPlugin;
     
-    /// Non-owning pointer to output tree
-    TTree *tree;
+    /// Flag showing if observables for the second-best interpretation are saved
+    bool saveAlternative;
     
     // Output buffers
     Float_t bfBestRank;
@@ -79,4 +113,8 @@ private:
     // The angle between momenta of the leptonically decaying top quark in the tt rest frame and
     //the tt system in the lab rest frame
     Float_t bfCosTopLepTT;
+    
+    // Observables for the second-best interpretation
+    Float_t bfRankGap;
+    Float_t bfAltMassTopLep, bfAltMassTopHad, bfAltMassWHad, bfAltMassTT;
 };
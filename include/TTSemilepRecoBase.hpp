@@ -2,14 +2,23 @@
 
 #include <mensura/core/AnalysisPlugin.hpp>
 
+#include <AllocationCheck.hpp>
+#include <RecoJetCache.hpp>
+
 #include <mensura/core/PhysicsObjects.hpp>
 
+#include <TLorentzVector.h>
+
+#include <array>
 #include <limits>
 #include <string>
+#include <utility>
 #include <vector>
 
 
 class JetMETReader;
+class TFileService;
+class TH2;
 
 
 /**
@@ -22,6 +31,52 @@ class JetMETReader;
  * implement method to compute the rank of an interpretation. The plugin accepts interpretation
  * that gets the highest rank.
  * 
+ * Jets that pass the selection are stored in a per-event cache (RecoJetCache), which also provides
+ * precomputed masses of pairs and triplets of jets. Interpretations are passed to the derived class
+ * as indices of jets in this cache.
+ * 
+ * If the rank is a sum of a term that only depends on the b-quark jet from t -> blv and a term
+ * that only depends on jets from t -> bqq, the derived class can declare this by reimplementing
+ * method IsRankSeparable. It must then also implement methods ComputeRankTopLep,
+ * ComputeRankTopHad, and optionally IsBPairAllowed and GetRankTopHadUpperBound. In this case each
+ * of the two terms is evaluated only once for every candidate, and the full N^4 loop over
+ * interpretations is replaced by a combination of the two sets of scores with upper-bound
+ * pruning. The accepted interpretation is the same as in the exhaustive search.
+ * 
+ * A derived class can restrict the jets that may play each role in the interpretation by
+ * reimplementing method IsJetAdmissible, for instance by requiring that b-quark jets are b-tagged.
+ * Lists of admissible jets for each role are built once per event, and only combinations of
+ * admissible jets are enumerated by all search algorithms. Several assignment passes with
+ * different restrictions can be requested with method GetNumAssignmentPasses, in which case the
+ * union of their interpretations is searched. This allows to express selections like "at least
+ * one of the two b-quark jets is b-tagged" without enumerating all interpretations.
+ * 
+ * For a separable rank, an alternative batch engine can be selected with method SetEngine. In this
+ * engine all triplets of jets from t -> bqq that need to be evaluated are first collected into
+ * index arrays, which are then ranked in a single call to ComputeRankTopHadBatch. A derived class
+ * can reimplement this method using SIMD kernels. The best interpretation is found with a
+ * vectorized search for the maximum. Both engines accept the same interpretation. The exhaustive
+ * search can be requested for a separable rank as well, which is useful as a reference.
+ * 
+ * With a separable rank, an early termination of the search can be requested with method
+ * SetEarlyTermination. If the derived class provides an upper bound for ComputeRankTopLep (method
+ * GetRankTopLepUpperBound), candidates for the b-quark jet from t -> blv are then evaluated in the
+ * order of decreasing upper bounds on the rank of interpretations they can enter, and the search
+ * stops once no remaining candidate can outperform the best interpretation found so far. This
+ * saves evaluation of ComputeRankTopLep, which is usually the most expensive part of the ranking,
+ * for the remaining candidates. The accepted interpretation does not change. Since all triplets of
+ * jets from t -> bqq are ranked before any candidate for the b-quark jet from t -> blv, the
+ * search is repeated without early termination in events in which no interpretation has been
+ * stored (see method BeginRepeatedSearch). A derived class that diagnoses a failure of the
+ * reconstruction based on which of its methods have been called thus reaches the same diagnosis
+ * as with the other algorithms.
+ * 
+ * In addition to the accepted interpretation, several next-best ones can be stored (see method
+ * SetMaxNumInterpretations), together with their neutrinos. This allows to compute observables
+ * for alternative interpretations without repeating the reconstruction. All search algorithms
+ * support this. The number of interpretations whose ranks have been evaluated in the current
+ * event is reported by method GetNumVisitedInterpretations.
+ * 
  * Reconstruction of the neutrino is delegated to the derived class. If multiple candidates can
  * be reconstructed in a single event, it must choose the most suitable one. It provides
  * reconstructed neutrino and also selected charged lepton by implementing pure virtual methods
@@ -30,6 +85,9 @@ class JetMETReader;
  * No reconstruction is performed if an event contains less than four jets satisfying the
  * selection. However, this plugin never rejects events.
  * 
+ * Optionally, the time spent in the jet assignment can be monitored (see method
+ * SetLatencyMonitoring).
+ * 
  * This plugin relies on a jet reader with the default name "JetMET".
  */
 class TTSemilepRecoBase: public AnalysisPlugin
@@ -44,6 +102,27 @@ public:
         q2TopHad   ///< Subleading light-flavour jet from hadronically decaying top quark
     };
     
+    /// Engines to search for the best interpretation of an event with a separable rank
+    enum class Engine
+    {
+        Scalar,     ///< Triplets of jets from t -> bqq are ranked one by one
+        Batch,      ///< Triplets of jets from t -> bqq are ranked in a batch
+        Exhaustive  ///< All interpretations are ranked with ComputeRank as for a non-separable rank
+    };
+    
+    /// Interpretation of an event stored by the plugin
+    struct Interpretation
+    {
+        /// Rank of the interpretation
+        double rank;
+        
+        /// Indices of jets in the jet cache, ordered according to DecayJet
+        std::array<unsigned, 4> jetIndices;
+        
+        /// Four-momentum of the neutrino reconstructed in this interpretation
+        TLorentzVector p4Nu;
+    };
+    
 public:
     /**
      * \brief Constructs a new plugin with the given name
@@ -84,12 +163,54 @@ public:
      */
     Jet const &GetJet(DecayJet type) const;
     
+    /**
+     * \brief Returns jet corresponding to the given quark in the stored interpretation with the
+     * given index
+     * 
+     * Consult documentation for method GetInterpretation for the meaning of the index.
+     */
+    Jet const &GetJet(DecayJet type, unsigned index) const;
+    
+    /**
+     * \brief Returns stored interpretation of the current event with the given index
+     * 
+     * Interpretations are ordered in decreasing rank, and the one with index 0 is the accepted
+     * interpretation. Throws an exception if the index is not smaller than the value returned by
+     * GetNumInterpretations.
+     */
+    Interpretation const &GetInterpretation(unsigned index) const;
+    
     /// A pure virtual method to return charged lepton from the t->blv decay
     virtual Lepton const &GetLepton() const = 0;
     
+    /**
+     * \brief Returns the maximal number of interpretations stored in each event
+     * 
+     * Consult documentation for method SetMaxNumInterpretations.
+     */
+    unsigned GetMaxNumInterpretations() const;
+    
     /// A pure virual method to return reconstructed neutrino from the t->blv decay
     virtual Candidate const &GetNeutrino() const = 0;
     
+    /**
+     * \brief Returns the number of interpretations stored in the current event
+     * 
+     * This is the number of interpretations with ranks larger than -infinity, but not more than
+     * the value given to SetMaxNumInterpretations. If reconstruction has failed, returns zero.
+     */
+    unsigned GetNumInterpretations() const;
+    
+    /**
+     * \brief Returns the number of interpretations whose ranks have been evaluated in the current
+     * event
+     * 
+     * With a separable rank, this is the number of combinations of ranks given by
+     * ComputeRankTopLep and ComputeRankTopHad (or ComputeRankTopHadBatch) that have been
+     * computed. Otherwise it is the number of calls to ComputeRank.
+     */
+    unsigned long GetNumVisitedInterpretations() const;
+    
     /**
      * \brief Returns rank of the accepted interpretation of the current event
      * 
@@ -110,9 +231,24 @@ public:
     /// Compute and return four-momentum of reconstructed leptonically decaying top quark
     TLorentzVector GetTopLepP4() const;
     
+    /**
+     * \brief Compute and return four-momentum of leptonically decaying top quark in the stored
+     * interpretation with the given index
+     */
+    TLorentzVector GetTopLepP4(unsigned index) const;
+    
     /// Compute and return four-momentum of reconstructed hadronically decaying top quark
     TLorentzVector GetTopHadP4() const;
     
+    /**
+     * \brief Compute and return four-momentum of hadronically decaying top quark in the stored
+     * interpretation with the given index
+     */
+    TLorentzVector GetTopHadP4(unsigned index) const;
+    
+    /// Specifies name of the plugin that produces jets and MET
+    void SetJetMETPluginName(std::string const &pluginName);
+    
     /**
      * \brief Sets jet selection
      * 
@@ -120,18 +256,67 @@ public:
      */
     void SetJetSelection(double minPt, double maxAbsEta = std::numeric_limits<double>::infinity());
     
+    /**
+     * \brief Selects engine to search for the best interpretation
+     * 
+     * Only has effect if the rank is separable. With the exhaustive engine, the rank is treated as
+     * non-separable, and early termination is not used. If the flag validate is true and the
+     * batch engine is chosen or the early termination is enabled, the search is repeated with the
+     * scalar engine without early termination in each event, and an exception is thrown if the
+     * two searches store different interpretations (compared by their ranks and jet indices).
+     * This is intended for validation only. By default, the scalar engine is used.
+     */
+    void SetEngine(Engine engine, bool validate = false);
+    
+    /**
+     * \brief Enables or disables early termination of the search
+     * 
+     * Only has effect if the rank is separable. Consult documentation of the class for details.
+     * Triplets of jets from t -> bqq are ranked with the selected engine. Disabled by default.
+     */
+    void SetEarlyTermination(bool enable = true);
+    
+    /**
+     * \brief Sets the maximal number of interpretations stored in each event
+     * 
+     * The given number of interpretations with the highest ranks are kept. The value must be
+     * positive. By default, only the accepted interpretation is stored.
+     */
+    void SetMaxNumInterpretations(unsigned n);
+    
+    /**
+     * \brief Enables or disables monitoring of time spent in jet assignment
+     * 
+     * If enabled, the wall time of each call to PerformJetAssignment is measured, including the
+     * time spent in the ranking implemented by the derived class. The times are written into a
+     * histogram "AssignmentLatency" versus the number of jets passing the selection, in a
+     * directory named after this plugin in the output file of TFileService. Disabled by default.
+     */
+    void SetLatencyMonitoring(bool enable = true);
+    
 protected:
     /**
      * \brief Performs jet assignment in the current event
      * 
      * Considers all possible ways to choose four reconsted jets and match them to decay products
-     * of a pair of top quarks. Jets must satisfy the selection on pt and |eta|. For each possible
-     * interpretation its rank is computed with method ComputeRank, and the interpretation with the
-     * highest rank is accepted.
+     * of a pair of top quarks. Jets must satisfy the selection on pt and |eta| and be admissible
+     * for their roles according to IsJetAdmissible in at least one assignment pass. For each
+     * possible interpretation its rank is computed with method ComputeRank, and the
+     * interpretation with the highest rank is accepted. In case of equal ranks, the
+     * interpretation with the lexicographically smallest indices of jets (ordered according to
+     * DecayJet) is preferred.
      * 
      * The outermost loop runs over possible ways to choose the b-quark jet from the
      * semileptonically decaying top quark.
      * 
+     * If the derived class declares the rank separable, the search is performed instead in two
+     * steps. First, ranks of all candidates for the b-quark jet from t -> blv are computed with
+     * method ComputeRankTopLep and sorted. Then, for each triplet of jets from t -> bqq, the
+     * best compatible candidate for the b-quark jet from t -> blv is found from the sorted list,
+     * and method ComputeRankTopHad is called unless the combination cannot outperform the best
+     * interpretation found so far. In case of equal ranks, the interpretation that comes first in
+     * the order of the exhaustive search is accepted.
+     * 
      * If the event contain less than for jets satisfying the selection, reconstruction is not
      * performed. In this case the highest rank is set to -infinity.
      * 
@@ -147,16 +332,208 @@ protected:
      */
     void SetRecoFailure(unsigned code);
     
+    /**
+     * \brief Returns cache with kinematics of jets that pass the selection in the current event
+     * 
+     * Indices of jets in the cache are the same as used in method ComputeRank.
+     */
+    RecoJetCache const &GetJetCache() const;
+    
+    /**
+     * \brief Returns selected jet with the given index
+     * 
+     * The index is the same as used in the jet cache and method ComputeRank.
+     */
+    Jet const &GetSelectedJet(unsigned index) const;
+    
+    /**
+     * \brief Returns index of the selected jet with the given index in the full collection
+     * 
+     * The argument is an index in the jet cache. The returned value indexes the collection given
+     * to PerformJetAssignment and thus also per-jet information computed for that collection by
+     * other plugins, such as flags from JetFlags.
+     */
+    unsigned GetSelectedJetSourceIndex(unsigned index) const;
+    
+    /**
+     * \brief Returns index of the jet identified as the given quark in the accepted interpretation
+     * 
+     * The index refers to the jet cache. Throws an exception if reconstruction has failed.
+     */
+    unsigned GetBestJetIndex(DecayJet type) const;
+    
+    /**
+     * \brief Checks if the search for a separable rank is used
+     * 
+     * This is the case if the rank is separable and the exhaustive engine has not been requested.
+     * Only then methods ComputeRankTopLep and ComputeRankTopHad are called instead of ComputeRank.
+     */
+    bool IsSearchSeparable() const;
+    
 private:
+    /**
+     * \brief Accepts the given interpretation as the best one found so far
+     * 
+     * Arguments are the rank and indices of jets in the jet cache.
+     */
+    void AcceptInterpretation(double rank, unsigned bTopLep, unsigned bTopHad, unsigned q1TopHad,
+      unsigned q2TopHad);
+    
+    /**
+     * \brief Stores the given interpretation if it is among the best ones found so far
+     * 
+     * Interpretations are ordered in decreasing rank. Interpretations with equal ranks are
+     * ordered according to jet indices, in the lexicographic order. This makes the result
+     * independent of the order in which interpretations are visited. If the interpretation
+     * precedes all stored ones, it is also accepted as the best one. Interpretations that have
+     * already been stored are ignored.
+     */
+    void ConsiderInterpretation(double rank, unsigned bTopLep, unsigned bTopHad,
+      unsigned q1TopHad, unsigned q2TopHad);
+    
+    /**
+     * \brief Fills the table of allowed pairs of b-quark jets used by the batch engine and the
+     * search with early termination
+     */
+    void FindAllowedBPairs(unsigned nSelectedJets);
+    
+    /**
+     * \brief Notifies that the search in the current event is about to be repeated
+     * 
+     * Called by the search with early termination when no interpretation has been stored, before
+     * the search is repeated with the selected engine without early termination. A derived class
+     * should reset here any information about the event that it accumulates in ComputeRankTopHad
+     * or ComputeRankTopHadBatch. The default implementation does nothing.
+     */
+    virtual void BeginRepeatedSearch();
+    
+    /**
+     * \brief Computes rank of the b-quark jet candidate from t -> blv for a separable rank
+     * 
+     * Must be reimplemented if IsRankSeparable returns true. The argument is the index of the jet
+     * in the jet cache. A value of -infinity means that the jet cannot be used.
+     * 
+     * The default implementation throws an exception.
+     */
+    virtual double ComputeRankTopLep(unsigned bTopLep);
+    
+    /**
+     * \brief Computes rank of the triplet of jets from t -> bqq for a separable rank
+     * 
+     * Must be reimplemented if IsRankSeparable returns true. Arguments are indices of jets in the
+     * jet cache, they differ and q1TopHad < q2TopHad. The full rank of an interpretation is the sum
+     * of this rank and the one returned by ComputeRankTopLep.
+     * 
+     * The default implementation throws an exception.
+     */
+    virtual double ComputeRankTopHad(unsigned bTopHad, unsigned q1TopHad, unsigned q2TopHad);
+    
+    /**
+     * \brief Computes ranks of a batch of n triplets of jets from t -> bqq for a separable rank
+     * 
+     * The triplets are described by arrays of indices of jets in the jet cache. Results must be
+     * written into array ranks and must be identical to what ComputeRankTopHad would return.
+     * Only used by the batch engine. The default implementation calls ComputeRankTopHad for each
+     * triplet.
+     */
+    virtual void ComputeRankTopHadBatch(unsigned n, unsigned const *bTopHad,
+      unsigned const *q1TopHad, unsigned const *q2TopHad, double *ranks);
+    
+    /**
+     * \brief Returns the number of assignment passes
+     * 
+     * Interpretations admissible in each pass according to IsJetAdmissible are evaluated. Passes
+     * should be mutually exclusive, otherwise some interpretations are evaluated more than once
+     * (which does not change the result). Called once per event. The default implementation
+     * returns 1.
+     */
+    virtual unsigned GetNumAssignmentPasses() const;
+    
+    /**
+     * \brief Returns an upper bound for values returned by ComputeRankTopHad
+     * 
+     * Used for pruning in the search with a separable rank. The default implementation returns
+     * +infinity, which disables the pruning.
+     */
+    virtual double GetRankTopHadUpperBound() const;
+    
+    /**
+     * \brief Returns an upper bound for values returned by ComputeRankTopLep
+     * 
+     * Used for early termination of the search with a separable rank. The default implementation
+     * returns +infinity, in which case the search is never terminated early.
+     */
+    virtual double GetRankTopLepUpperBound() const;
+    
+    /**
+     * \brief Returns the rank an interpretation must reach to be stored
+     * 
+     * If fewer interpretations than requested have been stored, returns -infinity. Otherwise
+     * returns the rank of the last stored interpretation. An interpretation with this rank can
+     * still be stored if it precedes the last one in the order of jet indices.
+     */
+    double GetRankThreshold() const;
+    
+    /**
+     * \brief Checks if given jets can be assigned to the two b quarks for a separable rank
+     * 
+     * Arguments are indices of jets in the jet cache. Interpretations with forbidden pairs are
+     * never evaluated. The default implementation allows all pairs.
+     */
+    virtual bool IsBPairAllowed(unsigned bTopLep, unsigned bTopHad);
+    
+    /**
+     * \brief Checks if the given jet can play the given role in the given assignment pass
+     * 
+     * The jet is identified by its index in the jet cache. Called once per event for each
+     * pass, role, and selected jet. The default implementation admits all jets.
+     */
+    virtual bool IsJetAdmissible(unsigned pass, DecayJet role, unsigned index) const;
+    
+    /**
+     * \brief Checks if the rank can be decomposed into a sum of terms for the two top quarks
+     * 
+     * Consult documentation of the class for details. The default implementation returns false.
+     */
+    virtual bool IsRankSeparable() const;
+    
+    /// Performs jet assignment as described in the documentation for PerformJetAssignment
+    void FindBestInterpretation(std::vector<Jet> const &jets);
+    
+    /// Performs exhaustive search over all admissible interpretations
+    void SearchExhaustive();
+    
+    /// Performs search with a separable rank using the scalar engine
+    void SearchSeparable();
+    
+    /// Performs search with a separable rank using the batch engine
+    void SearchSeparableBatch(unsigned n);
+    
+    /// Performs search with a separable rank with early termination
+    void SearchSeparableEarlyTermination(unsigned n);
+    
     /**
      * \brief Pure virtual method to calculate rank of a given interpretation of the current event
      * 
-     * When this method is called, the outermost loop runs over ways to choose the b-quark jet from
-     * the leptonically decaying top quark, which allows the derived class to implement a simple
-     * caching for reconstruction of the neutrino.
+     * The arguments are indices of jets in the cache returned by method GetJetCache. It is
+     * guaranteed that all four indices differ and q1TopHad < q2TopHad. When this method is called,
+     * the outermost loop runs over ways to choose the b-quark jet from the leptonically decaying
+     * top quark, which allows the derived class to implement a simple caching for reconstruction
+     * of the neutrino.
      */
-    virtual double ComputeRank(Jet const &bTopLep, Jet const &bTopHad, Jet const &q1TopHad,
-      Jet const &q2TopHad) = 0;
+    virtual double ComputeRank(unsigned bTopLep, unsigned bTopHad, unsigned q1TopHad,
+      unsigned q2TopHad) = 0;
+    
+    /**
+     * \brief Pure virtual method to return four-momentum of the neutrino in the given
+     * interpretation of the current event
+     * 
+     * The arguments are indices of jets in the jet cache. Called after the search for each
+     * stored interpretation. Its rank has been evaluated, and thus the neutrino has been
+     * reconstructed.
+     */
+    virtual TLorentzVector const &GetNeutrinoP4(unsigned bTopLep, unsigned bTopHad,
+      unsigned q1TopHad, unsigned q2TopHad) const = 0;
     
     /**
      * \brief Performs reconstruction of the current event by calling PerformJetAssignment
@@ -172,6 +549,15 @@ protected:
     /// Non-owning pointer to the plugin that produces MET
     JetMETReader const *jetmetPlugin;
     
+    /**
+     * \brief Checks that no memory is allocated in ProcessEvent in steady state
+     * 
+     * All per-event temporaries of the reconstruction are kept in member buffers that are reused
+     * from event to event. Derived classes enclose the body of ProcessEvent in calls to methods of
+     * this object.
+     */
+    AllocationCheck allocationCheck;
+    
 private:
     /// Selection on jet transverse momentum
     double minPt;
@@ -179,6 +565,34 @@ private:
     /// Selection on absolute value of jet pseudorapidity
     double maxAbsEta;
     
+    /// Engine to search for the best interpretation with a separable rank
+    Engine engine;
+    
+    /// Flag showing if the batch engine should be validated against the scalar one
+    bool validateEngine;
+    
+    /// Flag showing if the search with a separable rank can be terminated early
+    bool earlyTermination;
+    
+    /// Maximal number of interpretations stored in each event
+    unsigned maxNumInterpretations;
+    
+    /// Name of TFileService
+    std::string fileServiceName;
+    
+    /// Non-owning pointer to TFileService
+    TFileService const *fileService;
+    
+    /// Flag showing if the time spent in jet assignment should be monitored
+    bool monitorLatency;
+    
+    /**
+     * \brief Histogram of time spent in jet assignment versus number of selected jets
+     * 
+     * Null pointer if monitoring is disabled.
+     */
+    TH2 *latencyHist;
+    
     /**
      * \brief Indices of jets that pass the selection on pt and |eta|
      * 
@@ -187,6 +601,43 @@ private:
      */
     std::vector<unsigned> selectedJetIndices;
     
+    /**
+     * \brief Non-owning pointer to the collection of jets in the current event
+     * 
+     * Set in method PerformJetAssignment.
+     */
+    std::vector<Jet> const *jets;
+    
+    /// Kinematics of selected jets in the current event
+    RecoJetCache jetCache;
+    
+    /**
+     * \brief Indices of jets admissible for each role, for each assignment pass
+     * 
+     * The inner array is indexed with DecayJet. Indices refer to the jet cache and are sorted.
+     * Filled once per event in method FindBestInterpretation.
+     */
+    std::vector<std::array<std::vector<unsigned>, 4>> roleCandidates;
+    
+    /**
+     * \brief Ranks and indices of candidates for the b-quark jet from t -> blv
+     * 
+     * Only used in the search with a separable rank. Placed here to avoid reallocation of memory
+     * for each event.
+     */
+    std::vector<std::pair<double, unsigned>> topLepCandidates;
+    
+    /**
+     * \brief Buffers used by the batch engine and the search with early termination
+     * 
+     * They contain flags showing which pairs of b-quark jets are allowed, indices of jets in
+     * triplets to be evaluated and of matching b-quark jets from t -> blv, and ranks of the
+     * latter and of the triplets. Placed here to avoid reallocation of memory for each event.
+     */
+    std::vector<char> batchBPairAllowed;
+    std::vector<unsigned> batchBTopLep, batchBTopHad, batchQ1TopHad, batchQ2TopHad;
+    std::vector<double> batchRanksTopLep, batchRanks;
+    
     /**
      * \brief Status code indicating success of failure of reconstruction
      * 
@@ -210,4 +661,29 @@ private:
      * Pointers refer to jets in the collection provided by the jet reader.
      */
     Jet const *bTopLep, *bTopHad, *q1TopHad, *q2TopHad;
+    
+    /**
+     * \brief Indices of jets in the accepted interpretation
+     * 
+     * Indices refer to the jet cache and are ordered according to DecayJet.
+     */
+    std::array<unsigned, 4> bestJetIndices;
+    
+    /**
+     * \brief Best interpretations found so far in the current event
+     * 
+     * Ordered as described in the documentation for method ConsiderInterpretation. Contains at
+     * most maxNumInterpretations elements, and memory for them is reserved once.
+     */
+    std::vector<Interpretation> interpretations;
+    
+    /**
+     * \brief Interpretations stored by an optimized search, used in the validation of engines
+     * 
+     * Placed here to avoid reallocation of memory for each event.
+     */
+    std::vector<Interpretation> validatedInterpretations;
+    
+    /// Number of interpretations whose ranks have been evaluated in the current event
+    unsigned long numVisitedInterpretations;
 };
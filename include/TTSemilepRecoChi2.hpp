@@ -26,8 +26,23 @@ class NuRecoBase;
  * The semileptonically decaying top quark is reconstructed using the leading charged lepton, which
  * is provided by a lepton trigger with a default name "Leptons".
  * 
+ * Quantities that describe the semileptonically decaying top quark are computed only once for each
+ * pair of a b-quark jet and a neutrino candidate and cached for the current event. Quantities for
+ * the hadronically decaying top quark are computed once per interpretation, outside of the loop
+ * over neutrino candidates, with masses of jet pairs and triplets read from the jet cache.
+ * 
+ * If the chi^2 does not include a term for the transverse momentum of the tt system, it is a sum
+ * of terms that depend on only one of the two top quarks. In this case the rank is declared
+ * separable, and the faster search implemented in the base class is used. The best neutrino
+ * candidate is then chosen for each b-quark jet from t -> blv independently of jets from t -> bqq,
+ * which is equivalent to the full minimization. Both the scalar and the batch engines are
+ * supported.
+ * 
  * If the event contains no charged leptons or no neutrino candidates have been reconstructed,
  * reconstruction is aborted. However, events are never rejected.
+ * 
+ * This class evaluates an arbitrary list of chi^2 terms given at run time. When the list is known
+ * in advance, class template TTSemilepRecoChi2Fixed provides a faster implementation.
  */
 class TTSemilepRecoChi2: public TTSemilepRecoBase
 {
@@ -41,17 +56,19 @@ public:
         PtTT         ///< Transverse momentum of the tt system
     };
     
-private:
+protected:
     /// An auxiliary structure to combine information about a single summand in the chi^2
     struct Chi2Term
     {
-        /// Evaluates the chi^2 term
-        double Eval(Lepton const &l, Candidate const &nu, Jet const &bTopLep,
-          Jet const &bTopHad, Jet const &q1TopHad, Jet const &q2TopHad) const;
+        /// Evaluates the chi^2 term for the given value of the constrained quantity
+        double Eval(double x) const
+        {
+            double const d = (x - mean) / variance;
+            return d * d;
+        }
         
-        /// Pointer to the function to evaluate the chi^2 term
-        double (*expression)(Lepton const &l, Candidate const &nu, Jet const &bTopLep,
-          Jet const &bTopHad, Jet const &q1TopHad, Jet const &q2TopHad);
+        /// Type of the term
+        Expression type;
         
         /// Mean value to be used in evaluation of chi^2
         double mean;
@@ -77,7 +94,7 @@ public:
     /// Trivial destructor
     virtual ~TTSemilepRecoChi2() noexcept;
     
-private:
+protected:
     /**
      * \brief Copy constructor
      * 
@@ -128,6 +145,35 @@ public:
      */
     virtual Candidate const &GetNeutrino() const override;
     
+    /**
+     * \brief Performs reconstruction with the given lepton, neutrino candidates, and jets
+     * 
+     * This method is called from ProcessEvent with objects from the current event. A null pointer
+     * to the lepton signals that the event contains no leptons. The method does not depend on
+     * the framework and can also be used to run the reconstruction outside of it, e.g. in
+     * benchmarks. The provided objects must exist until results of the reconstruction have been
+     * read.
+     */
+    void ReconstructEvent(Lepton const *lepton, std::vector<Candidate> const &neutrinos,
+      std::vector<Jet> const &jets);
+    
+protected:
+    /**
+     * \brief Computes quantities for the semileptonically decaying top quark with the given
+     * b-quark jet
+     * 
+     * The quantities are computed for all neutrino candidates and stored in topLepChi2,
+     * topLepPx, and topLepPy. Nothing is done if they have already been computed in the current
+     * event.
+     */
+    void CacheTopLep(unsigned bTopLep);
+    
+    /// Returns index in the cache of quantities for t -> blv with the given jet and neutrino
+    unsigned GetTopLepIndex(unsigned bTopLep, unsigned iNu) const
+    {
+        return bTopLep * numNeutrinos + iNu;
+    }
+    
 private:
     /**
      * \brief Computes rank of the given event interpretation
@@ -137,19 +183,76 @@ private:
      * 
      * Implemented from TTSemilepRecoBase.
      */
-    virtual double ComputeRank(Jet const &bTopLep, Jet const &bTopHad, Jet const &q1TopHad,
-      Jet const &q2TopHad) override;
+    virtual double ComputeRank(unsigned bTopLep, unsigned bTopHad, unsigned q1TopHad,
+      unsigned q2TopHad) override;
+    
+    /**
+     * \brief Computes -chi^2 from terms for the semileptonically decaying top quark
+     * 
+     * All neutrino solutions are considered, and the one giving the smallest chi^2 is cached.
+     * 
+     * Reimplemented from TTSemilepRecoBase.
+     */
+    virtual double ComputeRankTopLep(unsigned bTopLep) override;
+    
+    /**
+     * \brief Computes -chi^2 from terms for the hadronically decaying top quark
+     * 
+     * Reimplemented from TTSemilepRecoBase.
+     */
+    virtual double ComputeRankTopHad(unsigned bTopHad, unsigned q1TopHad, unsigned q2TopHad)
+      override;
+    
+    /**
+     * \brief Computes -chi^2 from terms for the hadronically decaying top quark for a batch of
+     * triplets
+     * 
+     * Masses are read from the jet cache, and every chi^2 term is evaluated for the whole batch.
+     * 
+     * Reimplemented from TTSemilepRecoBase.
+     */
+    virtual void ComputeRankTopHadBatch(unsigned n, unsigned const *bTopHad,
+      unsigned const *q1TopHad, unsigned const *q2TopHad, double *ranks) override;
+    
+    /**
+     * \brief Returns the neutrino that gives the smallest chi^2 in the given interpretation
+     * 
+     * Implemented from TTSemilepRecoBase.
+     */
+    virtual TLorentzVector const &GetNeutrinoP4(unsigned bTopLep, unsigned bTopHad,
+      unsigned q1TopHad, unsigned q2TopHad) const override;
+    
+    /**
+     * \brief Returns zero since chi^2 is non-negative
+     * 
+     * Reimplemented from TTSemilepRecoBase.
+     */
+    virtual double GetRankTopHadUpperBound() const override;
+    
+    /**
+     * \brief Returns zero since chi^2 is non-negative
+     * 
+     * Reimplemented from TTSemilepRecoBase.
+     */
+    virtual double GetRankTopLepUpperBound() const override;
+    
+    /**
+     * \brief Checks if the chi^2 contains no terms that depend on both top quarks
+     * 
+     * Reimplemented from TTSemilepRecoBase.
+     */
+    virtual bool IsRankSeparable() const override;
     
     /**
      * \brief Performs reconstruction of the current event
      * 
-     * Calls PerformJetAssignment from the base class.
+     * Calls ReconstructEvent with objects from the current event.
      * 
      * Reimplemented from TTSemilepRecoBase.
      */
     virtual bool ProcessEvent() override;
     
-private:
+protected:
     /// Name of the plugin that produces leptons
     std::string leptonPluginName;
     
@@ -162,11 +265,17 @@ private:
     /// Non-owning pointer to the plugin that reconstructs neutrinos
     NuRecoBase const *nuRecoPlugin;
     
+    /// Non-owning pointer to the lepton used in the current event
+    Lepton const *lepton;
+    
+    /// Non-owning pointer to the collection of neutrino candidates in the current event
+    std::vector<Candidate> const *nuCandidates;
+    
     /**
      * \brief Neutrino solution that is used in the best interpretation found so far
      * 
-     * The pointer is non-owning and refers to the collection returned by the plugin for neutrino
-     * reconstruction.
+     * The pointer is non-owning and refers to the collection of neutrino candidates given to
+     * ReconstructEvent.
      */
     Candidate const *bestNu;
     
@@ -180,4 +289,33 @@ private:
      * of each event.
      */
     double minChi2;
+    
+    /**
+     * \brief Best neutrino solutions for each b-quark jet from t -> blv
+     * 
+     * Only used in the search for a separable rank. Indexed with indices of jets in the jet cache.
+     */
+    std::vector<Candidate const *> topLepNeutrinos;
+    
+    /// Number of neutrino candidates in the current event
+    unsigned numNeutrinos;
+    
+    /**
+     * \brief Sum of chi^2 terms for the semileptonically decaying top quark and transverse
+     * momentum of the lepton, the neutrino, and the b-quark jet
+     * 
+     * Filled by method CacheTopLep and indexed as given by GetTopLepIndex.
+     */
+    std::vector<double> topLepChi2, topLepPx, topLepPy;
+    
+    /// Flags showing for which b-quark jets the above quantities have been computed
+    std::vector<bool> topLepCached;
+    
+private:
+    /**
+     * \brief Buffers for masses used in method ComputeRankTopHadBatch
+     * 
+     * Placed here to avoid reallocation of memory for each event.
+     */
+    std::vector<double> batchMassW, batchMassTop;
 };
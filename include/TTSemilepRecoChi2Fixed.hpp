@@ -0,0 +1,347 @@
+#pragma once
+
+#include <TTSemilepRecoChi2.hpp>
+
+#include <NuRecoBase.hpp>
+
+#include <array>
+#include <cmath>
+#include <initializer_list>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+
+/**
+ * \class TTSemilepRecoChi2Fixed
+ * \brief A version of TTSemilepRecoChi2 with the list of chi^2 terms fixed at compile time
+ * 
+ * The types of chi^2 terms are given as template arguments, for instance
+ *   TTSemilepRecoChi2Fixed<Expression::MassTopLep, Expression::MassTopHad, Expression::MassWHad>
+ * where Expression is TTSemilepRecoChi2::Expression. Means and variances are provided to the
+ * constructor in the same order. The physics content is identical to that of TTSemilepRecoChi2
+ * with the same terms added with method AddChi2Term, but the evaluation of terms for the
+ * hadronically decaying top quark and the tt system is fully inlined, and only the quantities
+ * needed for the given terms are computed. Quantities for the semileptonically decaying top quark
+ * are taken from the per-event cache of the base class, which is filled once for each b-quark jet
+ * and neutrino candidate.
+ * 
+ * Method AddChi2Term must not be used with this class. An exception is thrown in BeginRun if it
+ * has been.
+ */
+template<TTSemilepRecoChi2::Expression... types>
+class TTSemilepRecoChi2Fixed: public TTSemilepRecoChi2
+{
+public:
+    /// Number of chi^2 terms
+    static constexpr unsigned numTerms = sizeof...(types);
+    
+    static_assert(numTerms > 0, "TTSemilepRecoChi2Fixed: At least one chi^2 term is needed.");
+    
+private:
+    /// Groups of chi^2 terms that are evaluated together
+    enum class Part
+    {
+        TopLep,  ///< Terms that depend only on the semileptonically decaying top quark
+        TopHad,  ///< Terms that depend only on the hadronically decaying top quark
+        Mixed    ///< Terms that depend on both top quarks
+    };
+    
+    /// Kinematic quantities from which chi^2 terms are computed
+    struct Kinematics
+    {
+        double massTopHad, massWHad, ptTT;
+    };
+    
+public:
+    /**
+     * \brief Constructs a new plugin with the given means and variances of chi^2 terms
+     * 
+     * The order of entries in the arrays follows the order of template arguments.
+     */
+    TTSemilepRecoChi2Fixed(std::array<double, numTerms> const &means,
+      std::array<double, numTerms> const &variances, std::string name = "TTReco");
+    
+    /// Default move constructor
+    TTSemilepRecoChi2Fixed(TTSemilepRecoChi2Fixed &&) = default;
+    
+    /// Assignment operator is deleted
+    TTSemilepRecoChi2Fixed &operator=(TTSemilepRecoChi2Fixed const &) = delete;
+    
+private:
+    /**
+     * \brief Copy constructor
+     * 
+     * Can only be called before processing of the first dataset has started.
+     */
+    TTSemilepRecoChi2Fixed(TTSemilepRecoChi2Fixed const &src) noexcept;
+    
+public:
+    /**
+     * \brief Saves pointers to reader plugins and checks the configuration
+     * 
+     * Throws an exception if additional chi^2 terms have been added with method AddChi2Term.
+     * 
+     * Reimplemented from TTSemilepRecoChi2.
+     */
+    void BeginRun(Dataset const &dataset) override;
+    
+    /**
+     * \brief Creates a newly configured clone
+     * 
+     * Reimplemented from TTSemilepRecoChi2.
+     */
+    virtual Plugin *Clone() const override;
+    
+private:
+    /// Checks if the chi^2 includes a term of the given type
+    static constexpr bool Contains(TTSemilepRecoChi2::Expression type);
+    
+    /// Returns the part to which the term of the given type belongs
+    static constexpr Part GetPart(TTSemilepRecoChi2::Expression type);
+    
+    /**
+     * \brief Returns the kinematic quantity used in the term of the given type
+     * 
+     * Must not be called for terms of type MassTopLep.
+     */
+    static double GetValue(TTSemilepRecoChi2::Expression type, Kinematics const &k);
+    
+    /**
+     * \brief Computes -chi^2 for the given event interpretation
+     * 
+     * Reimplemented from TTSemilepRecoChi2.
+     */
+    virtual double ComputeRank(unsigned bTopLep, unsigned bTopHad, unsigned q1TopHad,
+      unsigned q2TopHad) override;
+    
+    /**
+     * \brief Computes -chi^2 from terms for the hadronically decaying top quark
+     * 
+     * Reimplemented from TTSemilepRecoChi2.
+     */
+    virtual double ComputeRankTopHad(unsigned bTopHad, unsigned q1TopHad, unsigned q2TopHad)
+      override;
+    
+    /**
+     * \brief Checks if the chi^2 contains no terms that depend on both top quarks
+     * 
+     * Reimplemented from TTSemilepRecoChi2.
+     */
+    virtual bool IsRankSeparable() const override;
+    
+    /**
+     * \brief Evaluates the chi^2 term with the given type and index
+     * 
+     * Returns zero if the term does not belong to the given part. Both the type and the part are
+     * known at compile time at every call, so the check is optimized away.
+     */
+    double EvalTerm(TTSemilepRecoChi2::Expression type, Part part, unsigned index,
+      Kinematics const &k) const;
+    
+    /// Sums up chi^2 terms from the given part in the order of template arguments
+    template<Part part>
+    double SumTerms(Kinematics const &k) const;
+    
+private:
+    /// Means of chi^2 terms
+    std::array<double, numTerms> means;
+    
+    /// Variances of chi^2 terms
+    std::array<double, numTerms> variances;
+};
+
+
+template<TTSemilepRecoChi2::Expression... types>
+TTSemilepRecoChi2Fixed<types...>::TTSemilepRecoChi2Fixed(
+  std::array<double, numTerms> const &means_, std::array<double, numTerms> const &variances_,
+  std::string name /*= "TTReco"*/):
+    TTSemilepRecoChi2(name),
+    means(means_), variances(variances_)
+{
+    // Register the terms in the base class as well. They are used in the batch evaluation of
+    //terms for the hadronically decaying top quark, which is already vectorized there
+    unsigned i = 0;
+    
+    for (auto const type: {types...})
+    {
+        AddChi2Term(type, means[i], variances[i]);
+        ++i;
+    }
+}
+
+
+template<TTSemilepRecoChi2::Expression... types>
+TTSemilepRecoChi2Fixed<types...>::TTSemilepRecoChi2Fixed(TTSemilepRecoChi2Fixed const &src)
+  noexcept:
+    TTSemilepRecoChi2(src),
+    means(src.means), variances(src.variances)
+{}
+
+
+template<TTSemilepRecoChi2::Expression... types>
+void TTSemilepRecoChi2Fixed<types...>::BeginRun(Dataset const &dataset)
+{
+    TTSemilepRecoChi2::BeginRun(dataset);
+    
+    if (chi2Terms.size() != numTerms)
+    {
+        std::ostringstream message;
+        message << "TTSemilepRecoChi2Fixed[\"" << GetName() << "\"]::BeginRun: Expected " <<
+          numTerms << " chi^2 terms but found " << chi2Terms.size() << ". Method " <<
+          "AddChi2Term must not be used with this class.";
+        throw std::runtime_error(message.str());
+    }
+}
+
+
+template<TTSemilepRecoChi2::Expression... types>
+Plugin *TTSemilepRecoChi2Fixed<types...>::Clone() const
+{
+    return new TTSemilepRecoChi2Fixed(*this);
+}
+
+
+template<TTSemilepRecoChi2::Expression... types>
+constexpr bool TTSemilepRecoChi2Fixed<types...>::Contains(TTSemilepRecoChi2::Expression type)
+{
+    bool const matches[] = {(types == type)...};
+    
+    for (bool const match: matches)
+    {
+        if (match)
+            return true;
+    }
+    
+    return false;
+}
+
+
+template<TTSemilepRecoChi2::Expression... types>
+constexpr typename TTSemilepRecoChi2Fixed<types...>::Part
+  TTSemilepRecoChi2Fixed<types...>::GetPart(TTSemilepRecoChi2::Expression type)
+{
+    return (type == Expression::MassTopLep) ? Part::TopLep :
+      (type == Expression::PtTT) ? Part::Mixed : Part::TopHad;
+}
+
+
+template<TTSemilepRecoChi2::Expression... types>
+inline double TTSemilepRecoChi2Fixed<types...>::GetValue(TTSemilepRecoChi2::Expression type,
+  Kinematics const &k)
+{
+    switch (type)
+    {
+        case Expression::MassTopHad:
+            return k.massTopHad;
+        
+        case Expression::MassWHad:
+            return k.massWHad;
+        
+        default:
+            return k.ptTT;
+    }
+}
+
+
+template<TTSemilepRecoChi2::Expression... types>
+inline double TTSemilepRecoChi2Fixed<types...>::EvalTerm(TTSemilepRecoChi2::Expression type,
+  Part part, unsigned index, Kinematics const &k) const
+{
+    if (GetPart(type) != part)
+        return 0.;
+    
+    double const d = (GetValue(type, k) - means[index]) / variances[index];
+    return d * d;
+}
+
+
+template<TTSemilepRecoChi2::Expression... types>
+double TTSemilepRecoChi2Fixed<types...>::ComputeRank(unsigned bTopLep, unsigned bTopHad,
+  unsigned q1TopHad, unsigned q2TopHad)
+{
+    // Quantities that do not depend on the neutrino
+    CacheTopLep(bTopLep);
+    
+    auto const &jets = GetJetCache();
+    Kinematics k{};
+    
+    if (Contains(Expression::MassTopHad))
+        k.massTopHad = jets.GetMassTriplet(bTopHad, q1TopHad, q2TopHad);
+    
+    if (Contains(Expression::MassWHad))
+        k.massWHad = jets.GetMassPair(q1TopHad, q2TopHad);
+    
+    double const chi2TopHad = SumTerms<Part::TopHad>(k);
+    
+    double const pxTopHad = jets.Px(bTopHad) + jets.Px(q1TopHad) + jets.Px(q2TopHad);
+    double const pyTopHad = jets.Py(bTopHad) + jets.Py(q1TopHad) + jets.Py(q2TopHad);
+    
+    
+    // Find the neutrino candidate that gives the minimal chi^2
+    auto const &neutrinos = *nuCandidates;
+    double minChi2CurInterp = std::numeric_limits<double>::infinity();
+    
+    for (unsigned iNu = 0; iNu < numNeutrinos; ++iNu)
+    {
+        unsigned const index = GetTopLepIndex(bTopLep, iNu);
+        
+        if (Contains(Expression::PtTT))
+        {
+            double const px = topLepPx[index] + pxTopHad;
+            double const py = topLepPy[index] + pyTopHad;
+            k.ptTT = std::sqrt(px * px + py * py);
+        }
+        
+        double const chi2 = topLepChi2[index] + chi2TopHad + SumTerms<Part::Mixed>(k);
+        
+        if (chi2 < minChi2CurInterp)
+            minChi2CurInterp = chi2;
+        
+        if (chi2 < minChi2)
+        {
+            minChi2 = chi2;
+            bestNu = &neutrinos[iNu];
+        }
+    }
+    
+    return -minChi2CurInterp;
+}
+
+
+template<TTSemilepRecoChi2::Expression... types>
+double TTSemilepRecoChi2Fixed<types...>::ComputeRankTopHad(unsigned bTopHad, unsigned q1TopHad,
+  unsigned q2TopHad)
+{
+    auto const &jets = GetJetCache();
+    Kinematics k{};
+    
+    if (Contains(Expression::MassTopHad))
+        k.massTopHad = jets.GetMassTriplet(bTopHad, q1TopHad, q2TopHad);
+    
+    if (Contains(Expression::MassWHad))
+        k.massWHad = jets.GetMassPair(q1TopHad, q2TopHad);
+    
+    return -SumTerms<Part::TopHad>(k);
+}
+
+
+template<TTSemilepRecoChi2::Expression... types>
+bool TTSemilepRecoChi2Fixed<types...>::IsRankSeparable() const
+{
+    return not Contains(Expression::PtTT);
+}
+
+
+template<TTSemilepRecoChi2::Expression... types>
+template<typename TTSemilepRecoChi2Fixed<types...>::Part part>
+inline double TTSemilepRecoChi2Fixed<types...>::SumTerms(Kinematics const &k) const
+{
+    double chi2 = 0.;
+    unsigned index = 0;
+    
+    // Expand the parameter pack. Elements of a braced list are evaluated in order
+    (void) std::initializer_list<int>{(chi2 += EvalTerm(types, part, index++, k), 0)...};
+    
+    return chi2;
+}
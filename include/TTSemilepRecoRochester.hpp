@@ -2,16 +2,23 @@
 
 #include <TTSemilepRecoBase.hpp>
 
+#include <LogLikelihoodTable.hpp>
+#include <NuRecoRochester.hpp>
+
 #include <mensura/core/PhysicsObjects.hpp>
 
-#include <TH1.h>
-#include <TH2.h>
 #include <TLorentzVector.h>
 
+#include <cstdint>
 #include <memory>
+#include <string>
+#include <vector>
 
 
+class JetFlags;
 class LeptonReader;
+class TH1;
+class TH2;
 
 
 /**
@@ -25,7 +32,26 @@ class LeptonReader;
  * distribution of the two reconstructed masses.
  * 
  * By default, all possible jet assignments are considered. User can specify a selection on b tags
- * of jets matched to b quarks.
+ * of jets matched to b quarks and a veto on b tags of jets matched to light quarks. They are
+ * translated into lists of jets admissible for each role (see TTSemilepRecoBase::IsJetAdmissible),
+ * so that interpretations failing them are never enumerated. If the b-tag selection is only
+ * required for at least one of the b quarks, two assignment passes are performed: in the first
+ * one the b-quark jet from t -> blv is b-tagged, in the second one it is not, but the b-quark jet
+ * from t -> bqq is. The selection can be given either as a cut on the b-tagging discriminator or
+ * as a working point, in which case b-tagging decisions are read from a JetFlags plugin.
+ * 
+ * The log-likelihood is a sum of a term that only depends on the b-quark jet from t -> blv and a
+ * term that only depends on jets from t -> bqq, and the selection on b tags only involves the two
+ * b-quark jets. Thus the rank is declared separable, and the faster search implemented in the base
+ * class is used. Both the scalar and the batch engines are supported. In the batch engine, the
+ * lookup in the likelihood for masses is performed with SIMD instructions when available.
+ * 
+ * The solution ellipsis of the neutrino reconstruction only depends on the lepton and the b-quark
+ * jet. When the first one is needed in an event, ellipses for all jets in the jet cache are built
+ * with a single call to NuKernels::ComputeRochesterEllipses, before the minimization with respect
+ * to MET is performed for each jet on demand. Ellipses used in the current event are kept and can
+ * be reused by another instance of this plugin that processes a systematic variation affecting
+ * only MET (see method SetNuEllipseSource).
  * 
  * A version of this algorithm was used in TOP-16-008 (AN-16-020).
  */
@@ -60,6 +86,37 @@ public:
      */
     virtual Plugin *Clone() const override;
     
+    /**
+     * \brief Adds statistics of reuse of neutrino ellipses in the current dataset to the total
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void EndRun() override;
+    
+    /**
+     * \brief Returns neutrino ellipsis built for the given lepton and b-quark jet in current event
+     * 
+     * The four-momenta must coincide exactly with the ones used to build the ellipsis. Returns a
+     * null pointer if no matching ellipsis has been built.
+     */
+    NuRecoRochester const *FindNuEllipse(TLorentzVector const &p4Lep, TLorentzVector const &p4BJet)
+      const;
+    
+    /**
+     * \brief Performs reconstruction with the given lepton, MET, and jets
+     * 
+     * This method is called from ProcessEvent with objects from the current event. A null pointer
+     * to the lepton signals that the event contains no leptons. The method does not depend on
+     * the framework and can also be used to run the reconstruction outside of it, e.g. in
+     * benchmarks, provided that likelihoods have been set. The provided objects must exist until
+     * results of the reconstruction have been read.
+     * 
+     * The last argument gives flags of the jets computed by JetFlags. They are required, and only
+     * used, if the selection on b tags has been specified with a working point.
+     */
+    void ReconstructEvent(Lepton const *lepton, Candidate const &met, std::vector<Jet> const &jets,
+      std::vector<std::uint32_t> const *jetFlags = nullptr);
+    
     /**
      * \brief Returns charged lepton from the t->blv decay
      * 
@@ -87,35 +144,209 @@ public:
      */
     void SetBTagSelection(BTagger::Algorithm algorithm, double cut, bool atLeastOne = false);
     
+    /**
+     * \brief Sets a selection on b tags of jets assigned to the b quarks using a working point
+     * 
+     * Same as the above, but b-tagging decisions are read from the JetFlags plugin with the given
+     * name instead of being evaluated here. The working point must be registered in that plugin,
+     * and the plugin must compute flags from the same collection of jets as used by this one.
+     */
+    void SetBTagSelection(BTagger const &bTagger, bool atLeastOne = false,
+      std::string const &jetFlagsPluginName = "JetFlags");
+    
+    /**
+     * \brief Sets a veto on b tags of jets assigned to the light quarks
+     * 
+     * Jets whose b-tagging discriminators, as computed with the algorithm chosen in
+     * SetBTagSelection, are not smaller than the given cut are not assigned to the light quarks
+     * from t -> bqq. By default no veto is applied.
+     */
+    void SetLightJetBTagVeto(double maxBTag);
+    
     /**
      * \brief Provides likelihood function for reconstruction
      * 
-     * The path to a ROOT file is resolved using FileInPath. Throws exceptions if the file is not
-     * found or it does not contain one of the required histograms. The histograms do not need to
-     * be normalized.
+     * The path is resolved using FileInPath. If it has extension ".root", the file is read with
+     * ROOT. The histograms do not need to be normalized. They are converted into tables of
+     * log-likelihood, and the histograms themselves are not kept. Otherwise the file is expected
+     * to be a LikelihoodFile, e.g. produced with program convert-likelihood, and tables with the
+     * given names are read from it. Such a file is memory-mapped without ROOT I/O, and the mapping
+     * is shared by all plugins that use the same file. Throws exceptions if the file is not found
+     * or it does not contain one of the required histograms or tables.
      */
     void SetLikelihood(std::string const &path,
       std::string const histNeutrinoName = "nusolver_chi2_right",
       std::string const histMassName = "mWhad_vs_mtophad_right");
     
+    /**
+     * \brief Provides likelihood function for reconstruction from histograms
+     * 
+     * The histograms must already be normalized to describe probability density. They are
+     * converted into tables of log-likelihood and not kept.
+     */
+    void SetLikelihood(TH1 const &histNeutrino, TH2 const &histMass);
+    
+    /**
+     * \brief Selects algorithm used to find neutrino solution
+     * 
+     * Consult documentation for NuRecoRochester::SetMinimizer for the meaning of the first two
+     * arguments. If validationPrecision is positive, each neutrino is additionally reconstructed
+     * with the original step-halving algorithm, and an exception is thrown if the distance found
+     * with the selected algorithm exceeds the reference one by more than the given value (in GeV).
+     * This is intended for validation only as it makes the reconstruction slower. By default, the
+     * step-halving algorithm with a tolerance of 1e-5 is used.
+     */
+    void SetNuMinimizer(NuRecoRochester::Minimizer minimizer, double tolerance = 1e-5,
+      double validationPrecision = 0.);
+    
+    /**
+     * \brief Requests that neutrino ellipses are reused from another reconstruction plugin
+     * 
+     * The given plugin must be an instance of this class that is executed before this one. When
+     * the neutrino is reconstructed with a b-quark jet, the ellipsis built by that plugin for the
+     * same lepton and b-quark jet in the current event (compared by their four-momenta) is used,
+     * so that only the minimization with respect to MET is performed. If no ellipsis is found, it
+     * is built as usual. This is intended for systematic variations that only change MET.
+     * 
+     * If printStats is true, numbers of lookups and successful ones are accumulated over all
+     * clones of this plugin and all datasets, and the hit rate is printed to the standard output
+     * when the last clone is destroyed.
+     */
+    void SetNuEllipseSource(std::string const &pluginName, bool printStats = false);
+    
 private:
+    /// Neutrino ellipsis built for a lepton and a b-quark jet with given four-momenta
+    struct NuEllipse
+    {
+        TLorentzVector p4Lep, p4BJet;
+        NuRecoRochester nuBuilder;
+    };
+    
+    /// Statistics of lookups of neutrino ellipses, shared among clones
+    class NuEllipseStats;
+    
+private:
+    /**
+     * \brief Resets the flag that some masses have fallen within the range of the likelihood
+     * 
+     * Other flags used to diagnose a failure of the reconstruction are not affected since
+     * ComputeRankTopLep and IsBPairAllowed are called for the same jets in the repeated search.
+     * 
+     * Reimplemented from TTSemilepRecoBase.
+     */
+    virtual void BeginRepeatedSearch() override;
+    
     /**
      * \brief Computes rank of the given event interpretation
      * 
      * The rank is defined as the logarithm of the likelihood computed with the figure of merit for
-     * the neutrino reconstruction and masses of hadronically decaying t quark and W boson. A
-     * simple caching is implemented for the neutrino reconstruction.
+     * the neutrino reconstruction and masses of hadronically decaying t quark and W boson. It is
+     * evaluated as the sum of ranks given by ComputeRankTopLep and ComputeRankTopHad.
+     * 
+     * Implemented from TTSemilepRecoBase.
+     */
+    virtual double ComputeRank(unsigned bTopLep, unsigned bTopHad, unsigned q1TopHad,
+      unsigned q2TopHad) override;
+    
+    /**
+     * \brief Computes log-likelihood for the neutrino reconstructed with the given b-quark jet
+     * 
+     * The neutrino is reconstructed only once for each jet in an event, and the result is cached.
+     * Returns -infinity if the neutrino cannot be reconstructed or its figure of merit falls into
+     * the overflow bin.
+     * 
+     * Reimplemented from TTSemilepRecoBase.
+     */
+    virtual double ComputeRankTopLep(unsigned bTopLep) override;
+    
+    /// Builds neutrino ellipses for all jets in the jet cache
+    void ComputeNuEllipsesBatch();
+    
+    /**
+     * \brief Computes log-likelihood for masses of hadronically decaying t quark and W boson
+     * 
+     * Masses are read from the jet cache. Returns -infinity if they fall into overflow.
+     * 
+     * Reimplemented from TTSemilepRecoBase.
+     */
+    virtual double ComputeRankTopHad(unsigned bTopHad, unsigned q1TopHad, unsigned q2TopHad)
+      override;
+    
+    /**
+     * \brief Computes log-likelihood for masses for a batch of triplets of jets from t -> bqq
+     * 
+     * Reimplemented from TTSemilepRecoBase.
+     */
+    virtual void ComputeRankTopHadBatch(unsigned n, unsigned const *bTopHad,
+      unsigned const *q1TopHad, unsigned const *q2TopHad, double *ranks) override;
+    
+    /**
+     * \brief Returns the neutrino reconstructed with the given b-quark jet from t -> blv
      * 
      * Implemented from TTSemilepRecoBase.
      */
-    virtual double ComputeRank(Jet const &bTopLep, Jet const &bTopHad, Jet const &q1TopHad,
-      Jet const &q2TopHad) override;
+    virtual TLorentzVector const &GetNeutrinoP4(unsigned bTopLep, unsigned bTopHad,
+      unsigned q1TopHad, unsigned q2TopHad) const override;
+    
+    /**
+     * \brief Returns logarithm of the largest value in the likelihood for masses
+     * 
+     * Reimplemented from TTSemilepRecoBase.
+     */
+    virtual double GetRankTopHadUpperBound() const override;
+    
+    /**
+     * \brief Returns logarithm of the largest value in the likelihood for the neutrino
+     * 
+     * Reimplemented from TTSemilepRecoBase.
+     */
+    virtual double GetRankTopLepUpperBound() const override;
+    
+    /**
+     * \brief Returns two if the selection on b tags is required for at least one b quark, and one
+     * otherwise
+     * 
+     * Reimplemented from TTSemilepRecoBase.
+     */
+    virtual unsigned GetNumAssignmentPasses() const override;
+    
+    /// Checks if a selection on b tags of jets assigned to the b quarks has been specified
+    bool HasBTagSelection() const;
+    
+    /**
+     * \brief Checks if given jets satisfy the selection on b tags
+     * 
+     * Reimplemented from TTSemilepRecoBase.
+     */
+    virtual bool IsBPairAllowed(unsigned bTopLep, unsigned bTopHad) override;
+    
+    /**
+     * \brief Checks if the given jet satisfies the selection on b tags for the given role
+     * 
+     * Reimplemented from TTSemilepRecoBase.
+     */
+    virtual bool IsJetAdmissible(unsigned pass, DecayJet role, unsigned index) const override;
+    
+    /**
+     * \brief Returns true since the rank is separable
+     * 
+     * Reimplemented from TTSemilepRecoBase.
+     */
+    virtual bool IsRankSeparable() const override;
+    
+    /**
+     * \brief Checks if the selected jet with the given index passes the selection on b tags
+     * 
+     * Depending on how the selection has been specified, either compares the discriminator to
+     * the cut or checks a bit in flags of the jet.
+     */
+    bool IsTagged(unsigned index) const;
     
     /**
      * \brief Performs reconstruction of the current event
      * 
-     * Calls PerformJetAssignment from the base class. Identifies reason for reconstruction
-     * failure.
+     * Calls ReconstructEvent with objects from the current event. It calls PerformJetAssignment
+     * from the base class and identifies reason for reconstruction failure.
      * 
      * Reimplemented from TTSemilepRecoBase.
      */
@@ -139,19 +370,22 @@ private:
     Candidate const *met;
     
     /**
-     * \brief Histogram describing likelihood of neutrino solutions
+     * \brief Table with log-likelihood of neutrino solutions
      * 
-     * The histograms is shared among all clones of this.
+     * The table is shared among all clones of this.
      */
-    std::shared_ptr<TH1> likelihoodNeutrino;
+    std::shared_ptr<LogLikelihoodTable const> likelihoodNeutrino;
     
     /**
-     * \brief Histogram describing likelihood of reconstructed masses
+     * \brief Table with log-likelihood of reconstructed masses
      * 
      * Arguments are masses of hadronically decaying W boson and hadronically decaying top quark.
-     * The histograms is shared among all clones of this.
+     * The table is shared among all clones of this.
      */
-    std::shared_ptr<TH2> likelihoodMass;
+    std::shared_ptr<LogLikelihoodTable const> likelihoodMass;
+    
+    /// Largest values in tables likelihoodNeutrino and likelihoodMass
+    double maxLogLikelihoodNu, maxLogLikelihoodMass;
     
     /// Algorithm of b-tagging used to select jets to be matched to b quarks
     BTagger::Algorithm bTagAlgorithm;
@@ -159,25 +393,111 @@ private:
     /// Cut on b tags of jets that are matched to b quarks
     double bTagCut;
     
+    /**
+     * \brief Working point used to select jets that are matched to b quarks
+     * 
+     * Only used if the name of a JetFlags plugin is not empty. The algorithm is given by
+     * bTagAlgorithm.
+     */
+    BTagger::WorkingPoint bTagWorkingPoint;
+    
+    /**
+     * \brief Name of the plugin that provides b-tagging decisions for jets
+     * 
+     * Empty if the selection is specified with a cut on the discriminator.
+     */
+    std::string jetFlagsPluginName;
+    
+    /// Non-owning pointer to the plugin that provides b-tagging decisions for jets
+    JetFlags const *jetFlagsPlugin;
+    
+    /// Bit that shows in flags of jets whether they are b-tagged
+    std::uint32_t bTagMask;
+    
+    /// Flags of jets in the current event
+    std::vector<std::uint32_t> const *jetFlags;
+    
     /// Flag showing if the cut on b tags should be applied to at least one of both b quarks
     bool bTagSelAtLeastOne;
     
+    /// Veto on b tags of jets that are matched to light quarks
+    double maxBTagLight;
+    
+    /// Algorithm used to find neutrino solution and its tolerance
+    NuRecoRochester::Minimizer nuMinimizer;
+    double nuMinimizerTolerance;
+    
+    /**
+     * \brief Maximal allowed excess of neutrino distance with respect to the reference algorithm
+     * 
+     * Validation is disabled if this value is not positive.
+     */
+    double nuValidationPrecision;
+    
     /// Current best neutrino candidate
     Candidate neutrino;
     
     /**
-     * \brief Pointer to b-quark jet from t -> blv in the last considered interpretation
+     * \brief Cached four-momenta of neutrinos reconstructed with each b-quark jet from t -> blv
+     * 
+     * Indexed with indices of jets in the jet cache.
+     */
+    std::vector<TLorentzVector> cachedP4Nu;
+    
+    /**
+     * \brief Cached log-likelihoods corresponding to the neutrinos
+     * 
+     * Indexed with indices of jets in the jet cache. Reset to NaN, which denotes that the neutrino
+     * has not been reconstructed yet, at the start of processing of each new event.
+     */
+    std::vector<double> cachedLogLikelihoodNu;
+    
+    /**
+     * \brief Neutrino ellipses built in the current event
+     * 
+     * Includes ellipses that could not be used for reconstruction.
+     */
+    std::vector<NuEllipse> nuEllipses;
+    
+    /**
+     * \brief Name of the plugin from which neutrino ellipses are reused
+     * 
+     * Empty if no reuse has been requested.
+     */
+    std::string nuEllipseSourceName;
+    
+    /// Non-owning pointer to the plugin from which neutrino ellipses are reused
+    TTSemilepRecoRochester const *nuEllipseSource;
+    
+    /// Numbers of lookups of neutrino ellipses and successful ones in the current dataset
+    unsigned long nuEllipseLookups, nuEllipseHits;
+    
+    /// Statistics of lookups accumulated over all clones. Null if they are not reported
+    std::shared_ptr<NuEllipseStats> nuEllipseStats;
+    
+    /**
+     * \brief Neutrino ellipses for all jets in the jet cache
      * 
-     * It allows to implement caching of neutrino reconstruction. The pointer must be reset to null
-     * at the start of processing of each new event.
+     * Each ellipsis is described by NuKernels::ellipseSize consecutive values. They are computed by
+     * method ComputeNuEllipsesBatch.
      */
-    Jet const *cachedBTopLep;
+    std::vector<double> batchEllipses;
+    
+    /// Flags showing whether the neutrino can be reconstructed with each of the ellipses above
+    std::unique_ptr<bool[]> batchReconstructable;
     
-    /// Cached four-momentum of reconstructed neutrino
-    TLorentzVector cachedP4Nu;
+    /// Size of the buffer batchReconstructable
+    unsigned batchCapacity;
     
-    /// Cached log-likelihood corresponding to the neutrino
-    double cachedLogLikelihoodNu;
+    /// Flag showing whether ellipses in batchEllipses have been computed for the current event
+    bool batchEllipsesReady;
+    
+    /**
+     * \brief Buffers for masses used in method ComputeRankTopHadBatch
+     * 
+     * Placed here to avoid reallocation of memory for each event.
+     */
+    std::vector<double> batchMassW, batchMassTop;
     
     /// Flags that help to deduce reason of failed reconstruction
     bool bTaggedJetsFound, neutrinoReconstructed, neutrinoLikelihoodInRange, massLikelihoodInRange;
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <mensura/core/AnalysisPlugin.hpp>
+
+#include <PipelineTimer.hpp>
+
+#include <string>
+
+
+/**
+ * \class TimingProbe
+ * \brief Closes the time interval of the preceding plugin for PipelineTimer
+ * 
+ * Consult documentation for class PipelineTimer. This plugin must be registered right after the
+ * plugin to be monitored. It never rejects events.
+ */
+class TimingProbe: public AnalysisPlugin
+{
+public:
+    /**
+     * \brief Creates a probe with the given name
+     * 
+     * The label identifies the monitored plugin in the report. Normally, it is the name of that
+     * plugin.
+     */
+    TimingProbe(std::string const &name, std::string const &label,
+      std::string const &timerPluginName = "PipelineTimer");
+    
+public:
+    /**
+     * \brief Registers the monitored plugin in the record of PipelineTimer
+     * 
+     * Reimplemented from Plugin.
+     */
+    virtual void BeginRun(Dataset const &) override;
+    
+    /**
+     * \brief Creates a newly configured clone
+     * 
+     * Implemented from Plugin.
+     */
+    virtual Plugin *Clone() const override;
+    
+private:
+    /**
+     * \brief Attributes time elapsed since the previous probe to the monitored plugin
+     * 
+     * Implemented from Plugin.
+     */
+    virtual bool ProcessEvent() override;
+    
+private:
+    /// Label of the monitored plugin
+    std::string label;
+    
+    /// Name of the PipelineTimer plugin
+    std::string timerPluginName;
+    
+    /// Non-owning pointer to the PipelineTimer plugin
+    PipelineTimer const *timerPlugin;
+    
+    /// Index of this probe in the record of PipelineTimer
+    unsigned index;
+};
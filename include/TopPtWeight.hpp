@@ -2,12 +2,15 @@
 
 #include <mensura/extensions/EventWeightPlugin.hpp>
 
+#include <DatasetSelector.hpp>
+
 #include <array>
+#include <initializer_list>
+#include <memory>
 #include <string>
-#include <regex>
 
 
-class GenParticleReader;
+class GenTopDecay;
 
 
 /**
@@ -16,7 +19,8 @@ class GenParticleReader;
  * 
  * Computes nominal weight and two systematic variations for datasets whose source ID matches a
  * mask. The weights are normalized by their mean values before the event selection. Parameters for
- * the reweighting are hard-coded.
+ * the reweighting are hard-coded. Generator-level top quarks are obtained from a GenTopDecay plugin
+ * with the default name "GenTopDecay".
  */
 class TopPtWeight: public EventWeightPlugin
 {
@@ -49,7 +53,7 @@ public:
      * provided masks.
      */
     void SelectDatasets(std::initializer_list<std::string> const &masks);
-
+    
 private:
     /**
      * \brief Formula to compute per-event weight without normalization by mean weights
@@ -67,14 +71,14 @@ private:
     virtual bool ProcessEvent() override;
     
 private:
-    /// Name of plugin that provides generator-level particles
-    std::string genParticleReaderName;
+    /// Name of plugin that finds generator-level top quarks
+    std::string genTopDecayName;
     
-    /// Non-owning pointer to plugin that provides generator-level particles
-    GenParticleReader const *genParticleReader;
+    /// Non-owning pointer to plugin that finds generator-level top quarks
+    GenTopDecay const *genTopDecay;
     
-    /// Masks to choose in which datasets to compute weights
-    std::vector<std::regex> datasetMasks;
+    /// Selection of datasets in which to compute weights, shared among clones
+    std::shared_ptr<DatasetSelector const> datasetSelector;
     
     /// Flag showing whether weights should be computed for the current dataset
     bool processCurDataset;
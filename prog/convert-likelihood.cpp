@@ -0,0 +1,104 @@
+/**
+ * This program converts histograms with likelihoods for the tt reconstruction from a ROOT file
+ * into a binary LikelihoodFile, which can be given to TTSemilepRecoRochester::SetLikelihood. The
+ * histograms are normalized to describe probability density and converted into tables of
+ * log-likelihood in the same way as when they are read from the ROOT file directly. Each table is
+ * saved under the name of the source histogram.
+ */
+
+#include <LikelihoodFile.hpp>
+#include <LogLikelihoodTable.hpp>
+
+#include <TFile.h>
+#include <TH1.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/program_options.hpp>
+
+#include <iostream>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+
+using namespace std;
+namespace po = boost::program_options;
+
+
+int main(int argc, char **argv)
+{
+    // Parse arguments
+    po::options_description options("Allowed options");
+    options.add_options()
+      ("help,h", "Prints help message")
+      ("input", po::value<string>(), "Input ROOT file (required argument)")
+      ("output", po::value<string>(), "Output binary file (required argument)")
+      ("hists", po::value<string>()->default_value("nusolver_chi2_right,mWhad_vs_mtophad_right"),
+        "Comma-separated list of histograms to convert");
+    
+    po::positional_options_description positionalOptions;
+    positionalOptions.add("input", 1);
+    positionalOptions.add("output", 1);
+    
+    po::variables_map optionsMap;
+    po::store(
+      po::command_line_parser(argc, argv).options(options).positional(positionalOptions).run(),
+      optionsMap);
+    po::notify(optionsMap);
+    
+    if (optionsMap.count("help") or not optionsMap.count("input") or
+      not optionsMap.count("output"))
+    {
+        cerr << "Converts likelihoods for tt reconstruction into a binary format.\n";
+        cerr << "Usage: convert-likelihood input.root output [options]\n";
+        cerr << options << endl;
+        return EXIT_FAILURE;
+    }
+    
+    string const inputPath(optionsMap["input"].as<string>());
+    string const outputPath(optionsMap["output"].as<string>());
+    
+    vector<string> histNames;
+    boost::split(histNames, optionsMap["hists"].as<string>(), boost::is_any_of(","));
+    
+    
+    // Read the histograms and convert them into tables
+    TFile inputFile(inputPath.c_str());
+    
+    if (inputFile.IsZombie())
+    {
+        cerr << "File \"" << inputPath << "\" is not a valid ROOT file.\n";
+        return EXIT_FAILURE;
+    }
+    
+    vector<unique_ptr<LogLikelihoodTable>> tables;
+    vector<pair<string, LogLikelihoodTable const *>> namedTables;
+    
+    for (auto const &name: histNames)
+    {
+        unique_ptr<TH1> hist(dynamic_cast<TH1 *>(inputFile.Get(name.c_str())));
+        
+        if (not hist)
+        {
+            cerr << "File \"" << inputPath << "\" does not contain histogram \"" << name <<
+              "\".\n";
+            return EXIT_FAILURE;
+        }
+        
+        hist->SetDirectory(nullptr);
+        
+        // Same normalization as in TTSemilepRecoRochester::SetLikelihood
+        hist->Scale(1. / hist->Integral(), "width");
+        
+        tables.emplace_back(new LogLikelihoodTable(*hist));
+        namedTables.emplace_back(name, tables.back().get());
+    }
+    
+    
+    // Write the output file
+    LikelihoodFile::Write(outputPath, namedTables);
+    
+    
+    return EXIT_SUCCESS;
+}
@@ -1,11 +1,62 @@
 /**
  * This program produces ROOT trees with input variables for the H->tt analysis. Systematic
- * variations are supported.
+ * variations are supported. They can be processed either one per job (option --syst) or several
+ * of them in a single pass over the input (option --systs). In the latter case plugins that depend
+ * on the variation are instantiated once per variation, and their trees are written into
+ * directories named after the variations, while nominal trees stay in the root directory. Event
+ * selection is then written into a dedicated tree, and event weights are only evaluated once,
+ * with nominal jets.
+ * 
+ * With option --timing, time spent in each plugin is measured. A summary table is printed at the
+ * end, and a detailed report is saved in a JSON file. Statistics of the reuse of neutrino
+ * ellipses in tt reconstruction and of waits for the thread writing the output tree are printed as
+ * well. With option --startup-profile, time spent in the phases of the initialization is
+ * reported, together with heavy inputs (such as the PDF set and parameterizations of jet
+ * corrections), which are loaded lazily on their first use.
+ * 
+ * With option --skim-write, events that pass the selection are additionally saved into compact
+ * skim files, together with corrected jets and MET for all variations and event weights. A later
+ * job with the same channel, sample group, and systematic variations can read them with option
+ * --skim-read instead of the full input, which skips reading of the input files, the selection,
+ * jet corrections, and evaluation of event weights. Skims produced with a different
+ * configuration are detected and rejected.
+ * 
+ * With option --shard i/N, only the i-th of N disjoint subsets of chunks of the input datasets is
+ * processed, so that a configuration can be spread over several nodes. The assignment of chunks
+ * to shards only depends on names of their files. Completed chunks are recorded in a manifest
+ * in the output directory, and chunks found in it are skipped when the job is rerun, so that only
+ * the failed ones are reprocessed. Entries in the manifest are specific to the sample group and
+ * the options that affect the outputs, and chunks completed with other options are reprocessed.
+ * Outputs of all shards are combined with program merge-outputs.
+ * 
+ * With option --hists, histograms of selected observables, described in a JSON file (see
+ * HistogramFiller), are filled for each event weight and saved in the output files. Writing of
+ * trees can then be skipped with option --no-tuples.
+ * 
+ * With option --alt-interp, the tt reconstruction additionally stores the second-best
+ * interpretation of each event, and the difference between ranks of the two interpretations and
+ * masses reconstructed in the second one are saved (see TTObservables).
  */
 
 #include <BasicObservables.hpp>
+#include <CompletionManifest.hpp>
 #include <DumpWeights.hpp>
+#include <GenTopDecay.hpp>
+#include <HistogramFiller.hpp>
+#include <JetFlags.hpp>
+#include <JetMETCorrector.hpp>
 #include <LOSystWeights.hpp>
+#include <NtupleWriter.hpp>
+#include <PipelineTimer.hpp>
+#include <SkimInputData.hpp>
+#include <SkimJetMETReader.hpp>
+#include <SkimLeptonReader.hpp>
+#include <SkimPileUpReader.hpp>
+#include <SkimWeights.hpp>
+#include <SkimWriter.hpp>
+#include <StartupProfile.hpp>
+#include <SystVarSelection.hpp>
+#include <TimingProbe.hpp>
 #include <TopPtWeight.hpp>
 #include <TTObservables.hpp>
 #include <TTSemilepRecoRochester.hpp>
@@ -43,10 +94,18 @@
 #include <boost/algorithm/string.hpp>
 #include <boost/program_options.hpp>
 
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <fstream>
 #include <iostream>
 #include <list>
 #include <regex>
 #include <sstream>
+#include <thread>
+#include <utility>
+#include <vector>
 
 
 using namespace std;
@@ -67,15 +126,238 @@ enum class SampleGroup
 };
 
 
+/// Description of a systematic variation in jets or MET
+struct SystVariation
+{
+    /// Label used in names of output files, directories, and plugins
+    string GetLabel() const;
+    
+    /// Type of the variation, which is "JEC", "JER", "METUncl", or "None"
+    string type;
+    
+    /// Source of JEC uncertainty (only for type "JEC")
+    string jecSource;
+    
+    /// Direction of the variation
+    SystService::VarDirection direction;
+};
+
+
+string SystVariation::GetLabel() const
+{
+    if (type == "None")
+        return "Nominal";
+    
+    ostringstream label;
+    label << type << "_";
+    
+    if (not jecSource.empty())
+        label << jecSource << "_";
+    
+    label << ((direction == SystService::VarDirection::Up) ? "up" : "down");
+    return label.str();
+}
+
+
+/**
+ * \brief Parses text description of a systematic variation
+ * 
+ * Returns false if the text cannot be recognized.
+ */
+bool ParseSystVariation(string const &text, SystVariation &variation)
+{
+    std::regex systRegex("(JEC(:[A-Za-z0-9]+)?|JER|METUncl)[-_]?(Up|Down)",
+      std::regex::extended | std::regex::icase);
+    std::smatch matchResult;
+    
+    if (not std::regex_match(text, matchResult, systRegex))
+        return false;
+    
+    if (matchResult[2].length() > 0)
+    {
+        // Non-empty JEC source is provided. This must be a JEC variation.
+        variation.type = "JEC";
+        variation.jecSource = matchResult[2].str().substr(1);
+    }
+    else
+    {
+        string systTypeInput(matchResult[1]);
+        boost::to_lower(systTypeInput);
+        
+        if (systTypeInput == "jec")
+            variation.type = "JEC";
+        else if (systTypeInput == "jer")
+            variation.type = "JER";
+        else if (systTypeInput == "metuncl")
+            variation.type = "METUncl";
+        
+        variation.jecSource = "";
+    }
+    
+    
+    string systDirectionInput(matchResult[3]);
+    boost::to_lower(systDirectionInput);
+    
+    if (systDirectionInput == "up")
+        variation.direction = SystService::VarDirection::Up;
+    else if (systDirectionInput == "down")
+        variation.direction = SystService::VarDirection::Down;
+    
+    return true;
+}
+
+
+/**
+ * \brief Constructs plugin that corrects jets and MET in simulation
+ * 
+ * JEC, JER, or unclustered energy in MET are varied according to the given variation. A
+ * variation of type "None" leaves all corrections nominal. Seeding of the random number generator
+ * used for smearing does not depend on the variation, so variations of unclustered MET produce
+ * the same jets as the nominal corrector.
+ */
+JetMETCorrector *BuildMCJetMETCorrector(string const &name, SystVariation const &variation)
+{
+    JetMETCorrector *corrector = new JetMETCorrector(name);
+    corrector->SetJEC({"Summer16_23Sep2016V4_MC_L1FastJet_AK4PFchs.txt",
+      "Summer16_23Sep2016V4_MC_L2Relative_AK4PFchs.txt",
+      "Summer16_23Sep2016V4_MC_L3Absolute_AK4PFchs.txt"});
+    
+    if (variation.type == "JEC")
+        corrector->SetJECVariation("Summer16_23Sep2016V4_MC_UncertaintySources_AK4PFchs.txt",
+          variation.jecSource, variation.direction);
+    
+    corrector->SetJER("Spring16_25nsV10_MC_SF_AK4PFchs.txt",
+      "Spring16_25nsV10_MC_PtResolution_AK4PFchs.txt",
+      (variation.type == "JER") ? variation.direction : SystService::VarDirection::Undefined);
+    
+    if (variation.type == "METUncl")
+        corrector->SetMETUnclVariation(variation.direction);
+    
+    corrector->SetSelection(20., 2.4);
+    return corrector;
+}
+
+
+/**
+ * \brief Splits datasets into chunks of files to be distributed among threads
+ * 
+ * Each chunk contains at most the given number of consecutive files from a single dataset and
+ * inherits all other properties of the dataset. RunManager hands out datasets to threads from a
+ * shared queue in the order in which they are given, so the chunks are sorted by decreasing total
+ * size of their files on disk, which serves as an estimate of the processing time. Large chunks
+ * are thus started first, and small ones fill the idle threads at the end of the run instead
+ * of a single large dataset being processed last. Files whose size cannot be determined are
+ * treated as empty. The sorting is stable, so the order of the chunks is reproducible.
+ */
+list<Dataset> SplitDatasets(list<Dataset> const &datasets, unsigned maxFilesPerChunk)
+{
+    vector<pair<unsigned long long, Dataset>> chunks;
+    
+    for (auto const &dataset: datasets)
+    {
+        unsigned numFilesInChunk = maxFilesPerChunk;
+        
+        for (auto const &file: dataset.GetFiles())
+        {
+            if (numFilesInChunk == maxFilesPerChunk)
+            {
+                chunks.emplace_back(0, dataset.CloneWithoutFiles());
+                numFilesInChunk = 0;
+            }
+            
+            struct stat fileInfo;
+            
+            if (stat(file.name.c_str(), &fileInfo) == 0)
+                chunks.back().first += fileInfo.st_size;
+            
+            chunks.back().second.AddFile(file);
+            ++numFilesInChunk;
+        }
+    }
+    
+    stable_sort(chunks.begin(), chunks.end(),
+      [](pair<unsigned long long, Dataset> const &a, pair<unsigned long long, Dataset> const &b)
+      {return a.first > b.first;});
+    
+    list<Dataset> splitDatasets;
+    
+    for (auto &chunk: chunks)
+        splitDatasets.emplace_back(move(chunk.second));
+    
+    return splitDatasets;
+}
+
+
+/**
+ * \brief Constructs plugin for tt reconstruction
+ * 
+ * The plugin is given the provided name and reads jets and MET from the plugin with the given
+ * name. Decisions of the given b tagger are read from the JetFlags plugin with the given name.
+ * Likelihoods are read from the file with the given path. If monitorLatency is true, time spent
+ * in jet assignment is monitored. If the last argument is true, the second-best interpretation is
+ * stored in addition to the best one.
+ */
+TTSemilepRecoRochester *BuildTTReco(string const &name, string const &jetmetPluginName,
+  string const &jetFlagsPluginName, string const &likelihoodPath, BTagger const &bTagger,
+  bool monitorLatency, bool storeAlternative)
+{
+    TTSemilepRecoRochester *ttRecoPlugin = new TTSemilepRecoRochester(name);
+    ttRecoPlugin->SetJetMETPluginName(jetmetPluginName);
+    ttRecoPlugin->SetLikelihood(likelihoodPath);
+    ttRecoPlugin->SetNuMinimizer(NuRecoRochester::Minimizer::Analytic);
+    ttRecoPlugin->SetEngine(TTSemilepRecoBase::Engine::Batch);
+    ttRecoPlugin->SetEarlyTermination();
+    ttRecoPlugin->SetMaxNumInterpretations((storeAlternative) ? 2 : 1);
+    ttRecoPlugin->SetBTagSelection(bTagger, false /* both b-quark jets must be tagged */,
+      jetFlagsPluginName);
+    ttRecoPlugin->SetLatencyMonitoring(monitorLatency);
+    
+    return ttRecoPlugin;
+}
+
+
 int main(int argc, char **argv)
 {
+    StartupProfile startupProfile;
+    
+    
     // Parse arguments
     po::options_description options("Allowed options");
     options.add_options()
       ("help,h", "Prints help message")
       ("channel", po::value<string>(), "Lepton channel (required argument)")
       ("samples", po::value<string>(), "Group of input samples (required argument)")
-      ("syst,s", po::value<string>(), "Systematic shift");
+      ("syst,s", po::value<string>(), "Systematic shift")
+      ("systs", po::value<string>(),
+        "Comma-separated list of systematic shifts to be processed in a single pass, in addition "
+        "to the nominal configuration")
+      ("timing", po::value<string>()->implicit_value("timing.json"),
+        "Measure time spent in each plugin and save a report in the given JSON file")
+      ("startup-profile", "Report time spent in the initialization and in lazy loads of inputs")
+      ("compact", po::value<unsigned>()->implicit_value(12),
+        "Store kinematic observables with the given number of mantissa bits and counters as "
+        "short integers")
+      ("compression", po::value<string>(),
+        "Compression for the output tree in the form algorithm[:level], where the algorithm is "
+        "\"zlib\", \"lzma\", or \"lz4\"")
+      ("weight-ratios", "Store alternative event weights as ratios to the nominal weight")
+      ("hists", po::value<string>()->implicit_value("histograms.json"),
+        "Fill histograms described in the given JSON file")
+      ("no-tuples", "Do not write trees with observables, only histograms")
+      ("alt-interp", "Save observables for the second-best interpretation in tt reconstruction")
+      ("likelihood", po::value<string>()->default_value("TTRecoLikelihood_2016-pt20-v3.root"),
+        "File with likelihoods for tt reconstruction, either a ROOT file or a binary file "
+        "produced with convert-likelihood")
+      ("skim-write", po::value<string>(),
+        "Save events that pass the selection into skim files in the given directory")
+      ("skim-read", po::value<string>(),
+        "Read events from skim files in the given directory instead of the full input")
+      ("threads,j", po::value<unsigned>(),
+        "Number of threads (by default, the number of hardware threads)")
+      ("chunk-files", po::value<unsigned>()->default_value(1),
+        "Maximal number of input files in a chunk of a dataset processed by a single thread")
+      ("shard", po::value<string>(),
+        "Process only the given subset of chunks of the datasets, in the form i/N with 0 <= i < N");
     
     po::positional_options_description positionalOptions;
     positionalOptions.add("channel", 1);
@@ -97,6 +379,8 @@ int main(int argc, char **argv)
     
     
     bool const reapplyJEC = true;
+    string const timingReportPath((optionsMap.count("timing")) ?
+      optionsMap["timing"].as<string>() : "");
     
     if (not optionsMap.count("channel"))
     {
@@ -141,11 +425,10 @@ int main(int argc, char **argv)
     }
     
     
-    string systType("None");
-    string systJECSource;
-    SystService::VarDirection systDirection = SystService::VarDirection::Undefined;
+    SystVariation syst{"None", "", SystService::VarDirection::Undefined};
+    vector<SystVariation> multiSysts;
     
-    if (optionsMap.count("syst"))
+    if (optionsMap.count("syst") or optionsMap.count("systs"))
     {
         if (sampleGroup == SampleGroup::Data)
         {
@@ -153,50 +436,134 @@ int main(int argc, char **argv)
             return EXIT_FAILURE;
         }
         
-        
+        if (optionsMap.count("syst") and optionsMap.count("systs"))
+        {
+            cerr << "Options \e[1msyst\e[0m and \e[1msysts\e[0m cannot be used together.\n";
+            return EXIT_FAILURE;
+        }
+    }
+    
+    if (optionsMap.count("syst"))
+    {
         string systArg(optionsMap["syst"].as<string>());
         
-        std::regex systRegex("(JEC(:[A-Za-z0-9]+)?|JER|METUncl)[-_]?(Up|Down)",
-          std::regex::extended | std::regex::icase);
-        std::smatch matchResult;
-        
-        if (not std::regex_match(systArg, matchResult, systRegex))
+        if (not ParseSystVariation(systArg, syst))
         {
             cerr << "Cannot recognize systematic variation \"" << systArg << "\".\n";
             return EXIT_FAILURE;
         }
-        else
+    }
+    
+    if (optionsMap.count("systs"))
+    {
+        vector<string> systArgs;
+        boost::split(systArgs, optionsMap["systs"].as<string>(), boost::is_any_of(","));
+        
+        for (auto const &systArg: systArgs)
         {
-            if (matchResult[2].length() > 0)
-            {
-                // Non-empty JEC source is provided. This must be a JEC variation.
-                systType = "JEC";
-                systJECSource = matchResult[2].str().substr(1);
-            }
-            else
+            SystVariation variation;
+            
+            if (not ParseSystVariation(systArg, variation))
             {
-                string systTypeInput(matchResult[1]);
-                boost::to_lower(systTypeInput);
-                
-                if (systTypeInput == "jec")
-                    systType = "JEC";
-                else if (systTypeInput == "jer")
-                    systType = "JER";
-                else if (systTypeInput == "metuncl")
-                    systType = "METUncl";
+                cerr << "Cannot recognize systematic variation \"" << systArg << "\".\n";
+                return EXIT_FAILURE;
             }
             
-            
-            string systDirectionInput(matchResult[3]);
-            boost::to_lower(systDirectionInput);
-            
-            if (systDirectionInput == "up")
-                systDirection = SystService::VarDirection::Up;
-            else if (systDirectionInput == "down")
-                systDirection = SystService::VarDirection::Down;
+            multiSysts.emplace_back(variation);
+        }
+    }
+    
+    
+    // Storage schema for observables
+    NtupleWriter::Schema storageSchema{23, false};
+    
+    if (optionsMap.count("compact"))
+    {
+        storageSchema.mantissaBits = optionsMap["compact"].as<unsigned>();
+        storageSchema.compactIntegers = true;
+        
+        if (storageSchema.mantissaBits < 1 or storageSchema.mantissaBits > 23)
+        {
+            cerr << "Number of mantissa bits must be from 1 to 23.\n";
+            return EXIT_FAILURE;
         }
     }
     
+    NtupleWriter::Compression compression = NtupleWriter::Compression::Default;
+    int compressionLevel = 0;
+    
+    if (optionsMap.count("compression"))
+    {
+        std::regex compressionRegex("(zlib|lzma|lz4)(:([0-9]))?", std::regex::extended);
+        std::smatch matchResult;
+        string const compressionArg(optionsMap["compression"].as<string>());
+        
+        if (not std::regex_match(compressionArg, matchResult, compressionRegex))
+        {
+            cerr << "Cannot recognize compression \"" << compressionArg << "\".\n";
+            return EXIT_FAILURE;
+        }
+        
+        if (matchResult[1] == "zlib")
+            compression = NtupleWriter::Compression::ZLIB;
+        else if (matchResult[1] == "lzma")
+            compression = NtupleWriter::Compression::LZMA;
+        else
+            compression = NtupleWriter::Compression::LZ4;
+        
+        // Default levels are the ones recommended in ROOT
+        if (matchResult[3].length() > 0)
+            compressionLevel = stoi(matchResult[3]);
+        else
+            compressionLevel = (compression == NtupleWriter::Compression::LZ4) ? 4 : 1;
+    }
+    
+    
+    // Histograms are filled with absolute weights
+    if (optionsMap.count("hists") and optionsMap.count("weight-ratios"))
+    {
+        cerr << "Options \e[1mhists\e[0m and \e[1mweight-ratios\e[0m cannot be used "
+          "together.\n";
+        return EXIT_FAILURE;
+    }
+    
+    if (optionsMap.count("no-tuples") and not optionsMap.count("hists"))
+    {
+        cerr << "Option \e[1mno-tuples\e[0m requires option \e[1mhists\e[0m.\n";
+        return EXIT_FAILURE;
+    }
+    
+    
+    // Skims. The description of the configuration must include all options that affect the
+    //content of skims. It should also be updated whenever the event selection or corrections
+    //applied to physics objects change.
+    if (optionsMap.count("skim-write") and optionsMap.count("skim-read"))
+    {
+        cerr << "Options \e[1mskim-write\e[0m and \e[1mskim-read\e[0m cannot be used "
+          "together.\n";
+        return EXIT_FAILURE;
+    }
+    
+    string const skimWriteDirectory((optionsMap.count("skim-write")) ?
+      optionsMap["skim-write"].as<string>() : "");
+    string const skimReadDirectory((optionsMap.count("skim-read")) ?
+      optionsMap["skim-read"].as<string>() : "");
+    bool const readSkim = not skimReadDirectory.empty();
+    
+    ostringstream skimConfigurationStream;
+    skimConfigurationStream << "selection=v1;channel=" << channelText << ";samples=" <<
+      sampleGroupText << ";syst=" << syst.GetLabel() << ";systs=";
+    
+    for (auto const &variation: multiSysts)
+        skimConfigurationStream << variation.GetLabel() << ",";
+    
+    skimConfigurationStream << ";weights=" <<
+      ((optionsMap.count("weight-ratios")) ? "ratio" : "absolute");
+    string const skimConfiguration(skimConfigurationStream.str());
+    
+    
+    startupProfile.Mark("Parse options");
+    
     
     // Add a new search path
     string const installPath(getenv("TTRES_ANALYSIS_INSTALL"));
@@ -219,7 +586,7 @@ int main(int argc, char **argv)
     {
         datasets = datasetBuilder({"ttbar-pw_333_all"});
         
-        if (systType == "None")
+        if (syst.type == "None" and multiSysts.empty())
             datasets.splice(datasets.end(), datasetBuilder({
               "ttbar-pw-isrup_333_Jic", "ttbar-pw-isrdown_333_all",
               "ttbar-pw-fsrup_333_all", "ttbar-pw-fsrdown_333_all",
@@ -336,6 +703,123 @@ int main(int argc, char **argv)
     }
     
     
+    // Split the datasets into chunks that are distributed among threads
+    unsigned const maxFilesPerChunk = optionsMap["chunk-files"].as<unsigned>();
+    
+    if (maxFilesPerChunk == 0)
+    {
+        cerr << "Number of files in a chunk must be positive.\n";
+        return EXIT_FAILURE;
+    }
+    
+    datasets = SplitDatasets(datasets, maxFilesPerChunk);
+    
+    
+    // Select chunks that belong to the requested shard. Their assignment is determined by hashes
+    //of names of their files, so that it is stable across reruns and independent of their order
+    unsigned shardIndex = 0, numShards = 1;
+    
+    if (optionsMap.count("shard"))
+    {
+        std::smatch matchResult;
+        string const shardText(optionsMap["shard"].as<string>());
+        
+        bool valid = std::regex_match(shardText, matchResult, std::regex("([0-9]+)/([0-9]+)"));
+        
+        if (valid)
+        {
+            shardIndex = stoul(matchResult[1]);
+            numShards = stoul(matchResult[2]);
+            valid = (shardIndex < numShards);
+        }
+        
+        if (not valid)
+        {
+            cerr << "Cannot recognize shard \"" << shardText << "\". It must be given in the form "
+              "i/N with 0 <= i < N.\n";
+            return EXIT_FAILURE;
+        }
+    }
+    
+    datasets.remove_if([shardIndex, numShards](Dataset const &d)
+      {return SkimWriter::GetInputHash(d) % numShards != shardIndex;});
+    
+    
+    // Output directory, which also contains the list of chunks assigned to the current shard and
+    //the manifest of chunks that have been processed completely. Chunks that have been completed
+    //in previous runs are skipped.
+    ostringstream outputDirectoryStream;
+    outputDirectoryStream << "output/" << channelText;
+    
+    if (syst.type != "None")
+        outputDirectoryStream << "_" << syst.GetLabel();
+    else if (not multiSysts.empty())
+        outputDirectoryStream << "_multisyst";
+    
+    string const outputDirectory(outputDirectoryStream.str());
+    
+    // Several sample groups are written into the same directory, so the group is included in the
+    //names of the plan and the manifest
+    ostringstream shardLabelStream;
+    shardLabelStream << sampleGroupText << "_shard" << shardIndex << "of" << numShards;
+    string const manifestPath(outputDirectory + "/" + shardLabelStream.str() + ".done");
+    string const planPath(outputDirectory + "/" + shardLabelStream.str() + ".plan");
+    
+    // Options that affect the outputs. Their description is included in the keys of chunks in the
+    //plan and the manifest, so that chunks completed with a different configuration are
+    //reprocessed.
+    ostringstream jobConfigurationStream;
+    jobConfigurationStream << skimConfiguration << ";likelihood=" <<
+      optionsMap["likelihood"].as<string>() << ";compact=" <<
+      ((optionsMap.count("compact")) ? to_string(optionsMap["compact"].as<unsigned>()) : "") <<
+      ";compression=" <<
+      ((optionsMap.count("compression")) ? optionsMap["compression"].as<string>() : "") <<
+      ";hists=" << ((optionsMap.count("hists")) ? optionsMap["hists"].as<string>() : "") <<
+      ";tuples=" << ((optionsMap.count("no-tuples")) ? "no" : "yes") <<
+      ";altInterp=" << ((optionsMap.count("alt-interp")) ? "yes" : "no") <<
+      ";skimRead=" << skimReadDirectory << ";skimWrite=" << skimWriteDirectory;
+    string const jobConfiguration(jobConfigurationStream.str());
+    
+    // The plan is written into a temporary file, which then replaces the old plan, so that a
+    //complete plan is available at any time
+    mkdir("output", 0755);
+    mkdir(outputDirectory.c_str(), 0755);
+    string const planTmpPath(planPath + ".tmp");
+    ofstream planFile(planTmpPath, ios::trunc);
+    
+    for (auto const &d: datasets)
+        planFile << CompletionManifest::FormatEntry(d, jobConfiguration);
+    
+    planFile.close();
+    
+    if (not planFile or rename(planTmpPath.c_str(), planPath.c_str()) != 0)
+    {
+        cerr << "Failed to write file \"" << planPath << "\".\n";
+        return EXIT_FAILURE;
+    }
+    
+    auto const completedChunks = CompletionManifest::Read(manifestPath);
+    unsigned const numChunks = datasets.size();
+    
+    datasets.remove_if([&completedChunks, &jobConfiguration](Dataset const &d)
+      {return completedChunks.count(CompletionManifest::ComputeKey(d, jobConfiguration)) > 0;});
+    
+    cout << "Shard " << shardIndex << "/" << numShards << ": " << numChunks << " chunks, " <<
+      numChunks - datasets.size() << " of them skipped as completed in previous runs.\n";
+    
+    if (datasets.empty())
+        return EXIT_SUCCESS;
+    
+    unsigned numThreads = (optionsMap.count("threads")) ?
+      optionsMap["threads"].as<unsigned>() : thread::hardware_concurrency();
+    
+    if (numThreads == 0)
+        numThreads = 1;
+    
+    
+    startupProfile.Mark("Build datasets");
+    
+    
     // Triggers
     list<TriggerRange> triggerRanges;
     
@@ -345,7 +829,7 @@ int main(int argc, char **argv)
     else
         triggerRanges.emplace_back(0, -1, "Ele27_WPTight_Gsf", 35861.523,
           "Ele27_WPTight_Gsf");
-
+    
     
     // Common definition of b-tagging that will be used everywhere
     BTagger const bTagger(BTagger::Algorithm::CMVA, BTagger::WorkingPoint::Medium);
@@ -357,7 +841,15 @@ int main(int argc, char **argv)
     
     // Register services
     if (sampleGroup != SampleGroup::Data)
-        manager.RegisterService(new SystService(systType, systDirection));
+    {
+        manager.RegisterService(new SystService(syst.type, syst.direction));
+        
+        
+        // In the single-pass mode each variation is described by a dedicated service
+        for (auto const &variation: multiSysts)
+            manager.RegisterService(new SystService("Systematics_" + variation.GetLabel(),
+              variation.type, variation.direction));
+    }
     
     BTagWPService *bTagWPService = new BTagWPService("BTagWP_80Xv2.json");
     manager.RegisterService(bTagWPService);
@@ -372,57 +864,14 @@ int main(int argc, char **argv)
     bTagSFService->SetMeasurement(BTagSFService::Flavour::Light, "incl");
     manager.RegisterService(bTagSFService);
     
-    ostringstream outputNameStream;
-    outputNameStream << "output/" << channelText;
+    manager.RegisterService(new TFileService(outputDirectory + "/%"));
     
-    if (systType != "None")
+    // Jet corrections are not needed when reading skims since stored jets are already corrected
+    if (reapplyJEC and not readSkim)
     {
-        outputNameStream << "_" << systType << "_";
-        
-        if (not systJECSource.empty())
-            outputNameStream << systJECSource << "_";
-        
-        outputNameStream << ((systDirection == SystService::VarDirection::Up) ? "up" : "down");
-    }
-    
-    outputNameStream << "/%";
-    
-    manager.RegisterService(new TFileService(outputNameStream.str()));
-    
-    if (reapplyJEC)
-    {
-        if (sampleGroup != SampleGroup::Data)
-        {
-            JetCorrectorService *jetCorrFull = new JetCorrectorService("JetCorrFull");
-            jetCorrFull->SetJEC({"Summer16_23Sep2016V4_MC_L1FastJet_AK4PFchs.txt",
-              "Summer16_23Sep2016V4_MC_L2Relative_AK4PFchs.txt",
-              "Summer16_23Sep2016V4_MC_L3Absolute_AK4PFchs.txt"});
-            
-            if (systType == "JEC")
-                jetCorrFull->SetJECUncertainty(
-                  "Summer16_23Sep2016V4_MC_UncertaintySources_AK4PFchs.txt", {systJECSource});
-            
-            jetCorrFull->SetJER("Spring16_25nsV10_MC_SF_AK4PFchs.txt",
-              "Spring16_25nsV10_MC_PtResolution_AK4PFchs.txt");
-            manager.RegisterService(jetCorrFull);
-            
-            JetCorrectorService *jetCorrL1 = new JetCorrectorService("JetCorrL1");
-            jetCorrL1->SetJEC({"Summer16_23Sep2016V4_MC_L1FastJet_AK4PFchs.txt"});
-            manager.RegisterService(jetCorrL1);
-            
-            JetCorrectorService *jetCorrFullNoSmear =
-              new JetCorrectorService("JetCorrFullNoSmear");
-            jetCorrFullNoSmear->SetJEC({"Summer16_23Sep2016V4_MC_L1FastJet_AK4PFchs.txt",
-              "Summer16_23Sep2016V4_MC_L2Relative_AK4PFchs.txt",
-              "Summer16_23Sep2016V4_MC_L3Absolute_AK4PFchs.txt"});
-            
-            if (systType == "JEC")
-                jetCorrFullNoSmear->SetJECUncertainty(
-                  "Summer16_23Sep2016V4_MC_UncertaintySources_AK4PFchs.txt", {systJECSource});
-            
-            manager.RegisterService(jetCorrFullNoSmear);
-        }
-        else
+        // In simulation, jets are corrected with JetMETCorrector, which reads the parameterizations
+        //directly. Correctors from mensura are only needed for data
+        if (sampleGroup == SampleGroup::Data)
         {
             JetCorrectorService *jetCorrFull = new JetCorrectorService("JetCorrFull");
             jetCorrFull->RegisterIOV("BCD", 272007, 276811);
@@ -454,94 +903,167 @@ int main(int argc, char **argv)
     }
     
     
-    // Register plugins
-    manager.RegisterPlugin(new PECInputData);
-    manager.RegisterPlugin(
-      BuildPECTriggerFilter((sampleGroup == SampleGroup::Data), triggerRanges));
+    startupProfile.Mark("Register services");
     
-    manager.RegisterPlugin(new PECLeptonReader);
     
-    if (channel == Channel::Muon)
-        manager.RegisterPlugin(new LeptonFilter("LeptonFilter", Lepton::Flavour::Muon, 26., 2.4));
-    else
-        manager.RegisterPlugin(new LeptonFilter("LeptonFilter", Lepton::Flavour::Electron,
-          30., 2.5));
+    // Register plugins. If requested, the timer is registered before all other plugins, and every
+    //plugin is followed by a probe that measures its execution time
+    PipelineTimer *pipelineTimer = nullptr;
     
-    manager.RegisterPlugin(new PECPileUpReader);
+    if (not timingReportPath.empty())
+    {
+        pipelineTimer = new PipelineTimer;
+        manager.RegisterPlugin(pipelineTimer);
+    }
     
+    auto const registerPlugin = [&manager, pipelineTimer](Plugin *plugin)
+    {
+        manager.RegisterPlugin(plugin);
+        
+        if (pipelineTimer)
+            manager.RegisterPlugin(new TimingProbe("TimingProbe_" + plugin->GetName(),
+              plugin->GetName()));
+    };
     
-    if (not reapplyJEC)
+    if (readSkim)
     {
-        PECJetMETReader *jetmetReader = new PECJetMETReader;
-        jetmetReader->SetSelection(20., 2.4);
-        manager.RegisterPlugin(jetmetReader);
+        // Events that passed the selection are read from skims. Jets and MET come already
+        //corrected, and collections for all variations are read under their original names
+        registerPlugin(new SkimInputData(skimReadDirectory, skimConfiguration));
+        registerPlugin(new SkimLeptonReader);
+        registerPlugin(new SkimPileUpReader);
+        registerPlugin(new SkimJetMETReader);
+        
+        for (auto const &variation: multiSysts)
+            registerPlugin(new SkimJetMETReader("JetMET_" + variation.GetLabel()));
     }
     else
     {
-        if (sampleGroup != SampleGroup::Data)
+        registerPlugin(new PECInputData);
+        registerPlugin(
+          BuildPECTriggerFilter((sampleGroup == SampleGroup::Data), triggerRanges));
+        
+        registerPlugin(new PECLeptonReader);
+        
+        if (channel == Channel::Muon)
+            registerPlugin(new LeptonFilter("LeptonFilter", Lepton::Flavour::Muon, 26., 2.4));
+        else
+            registerPlugin(new LeptonFilter("LeptonFilter", Lepton::Flavour::Electron,
+              30., 2.5));
+        
+        registerPlugin(new PECPileUpReader);
+        
+        
+        if (not reapplyJEC)
         {
-            manager.RegisterPlugin(new PECGenJetMETReader);
-            
-            PECJetMETReader *jetmetReader = new PECJetMETReader("OrigJetMET");
-            jetmetReader->ReadRawMET();
-            jetmetReader->PropagateUnclVarToRaw();
-            jetmetReader->SetGenJetReader(); // Default one
-            jetmetReader->SetGenPtMatching("Spring16_25nsV10_MC_PtResolution_AK4PFchs.txt");
-            manager.RegisterPlugin(jetmetReader);
-            
-            JetMETUpdate *jetmetUpdater = new JetMETUpdate;
-            jetmetUpdater->SetJetCorrection("JetCorrFull");
-            jetmetUpdater->SetJetCorrectionForMET("JetCorrFullNoSmear", "JetCorrL1", "", "");
-            jetmetUpdater->SetSelection(20., 2.4);
-            jetmetUpdater->UseRawMET();
-            manager.RegisterPlugin(jetmetUpdater);
+            PECJetMETReader *jetmetReader = new PECJetMETReader;
+            jetmetReader->SetSelection(20., 2.4);
+            registerPlugin(jetmetReader);
         }
         else
         {
-            PECJetMETReader *jetmetReader = new PECJetMETReader("OrigJetMET");
-            jetmetReader->ReadRawMET();
-            manager.RegisterPlugin(jetmetReader);
-            
-            JetMETUpdate *jetmetUpdater = new JetMETUpdate;
-            jetmetUpdater->SetJetCorrection("JetCorrFull");
-            jetmetUpdater->SetJetCorrectionForMET("JetCorrFull", "JetCorrL1", "", "");
-            jetmetUpdater->SetSelection(20., 2.4);
-            jetmetUpdater->UseRawMET();
-            manager.RegisterPlugin(jetmetUpdater);
+            if (sampleGroup != SampleGroup::Data)
+            {
+                registerPlugin(new PECGenJetMETReader);
+                
+                PECJetMETReader *jetmetReader = new PECJetMETReader("OrigJetMET");
+                jetmetReader->ReadRawMET();
+                jetmetReader->PropagateUnclVarToRaw();
+                jetmetReader->SetGenJetReader(); // Default one
+                jetmetReader->SetGenPtMatching("Spring16_25nsV10_MC_PtResolution_AK4PFchs.txt");
+                registerPlugin(jetmetReader);
+                
+                // All variations, including the ones of unclustered MET, which are read from the
+                //source reader, are applied by instances of JetMETCorrector. In the single-pass
+                //mode, jets and MET are produced for each variation
+                registerPlugin(BuildMCJetMETCorrector("JetMET", syst));
+                
+                for (auto const &variation: multiSysts)
+                    registerPlugin(BuildMCJetMETCorrector("JetMET_" + variation.GetLabel(),
+                      variation));
+            }
+            else
+            {
+                PECJetMETReader *jetmetReader = new PECJetMETReader("OrigJetMET");
+                jetmetReader->ReadRawMET();
+                registerPlugin(jetmetReader);
+                
+                JetMETUpdate *jetmetUpdater = new JetMETUpdate;
+                jetmetUpdater->SetJetCorrection("JetCorrFull");
+                jetmetUpdater->SetJetCorrectionForMET("JetCorrFull", "JetCorrL1", "", "");
+                jetmetUpdater->SetSelection(20., 2.4);
+                jetmetUpdater->UseRawMET();
+                registerPlugin(jetmetUpdater);
+            }
         }
+    
+    
     }
     
     
-    JetFilter *jetFilter = new JetFilter(20., bTagger);
-    jetFilter->AddSelectionBin(4, -1, 2, -1);
-    manager.RegisterPlugin(jetFilter);
+    if (multiSysts.empty())
+    {
+        JetFilter *jetFilter = new JetFilter(20., bTagger);
+        jetFilter->AddSelectionBin(4, -1, 2, -1);
+        registerPlugin(jetFilter);
+        
+        registerPlugin(new MetFilter(MetFilter::Mode::MtW, 50.));
+    }
+    else
+    {
+        // The same selection as above, but an event is accepted if it passes it in at least one
+        //variation
+        SystVarSelection *systVarSelection = new SystVarSelection(bTagger, 20.);
+        systVarSelection->SetSelection(4, 2, 50.);
+        systVarSelection->AddVariation("Nominal", "JetMET");
+        
+        for (auto const &variation: multiSysts)
+            systVarSelection->AddVariation(variation.GetLabel(),
+              "JetMET_" + variation.GetLabel());
+        
+        registerPlugin(systVarSelection);
+    }
     
-    manager.RegisterPlugin(new MetFilter(MetFilter::Mode::MtW, 50.));
     
-    if (sampleGroup != SampleGroup::Data)
+    // Flags of jets, which are shared by observables and reconstruction
+    JetFlags *jetFlags = new JetFlags;
+    jetFlags->AddBTagger(bTagger);
+    registerPlugin(jetFlags);
+    
+    for (auto const &variation: multiSysts)
     {
-        manager.RegisterPlugin(new PileUpWeight((channel == Channel::Muon) ?
+        JetFlags *variedJetFlags = new JetFlags("JetFlags_" + variation.GetLabel());
+        variedJetFlags->SetJetMETPluginName("JetMET_" + variation.GetLabel());
+        variedJetFlags->AddBTagger(bTagger);
+        registerPlugin(variedJetFlags);
+    }
+    
+    // Event weights are read from skims together with events, and there is no need to compute
+    //them again
+    if (sampleGroup != SampleGroup::Data and not readSkim)
+    {
+        registerPlugin(new PileUpWeight((channel == Channel::Muon) ?
           "Run2016_SingleMuon_v1_finebin.root" : "Run2016_SingleElectron_v1_finebin.root",
           "simPUProfiles_80Xv2.root", 0.05));
         
         if (channel == Channel::Muon)
         {
-            manager.RegisterPlugin(new LeptonSFWeight("TriggerSFWeight", Lepton::Flavour::Muon,
+            registerPlugin(new LeptonSFWeight("TriggerSFWeight", Lepton::Flavour::Muon,
               "MuonSF_2016_80Xv2.root", {"IsoMu24_OR_IsoTkMu24"}));
-            manager.RegisterPlugin(new LeptonSFWeight("LeptonSFWeight", Lepton::Flavour::Muon,
+            registerPlugin(new LeptonSFWeight("LeptonSFWeight", Lepton::Flavour::Muon,
               "MuonSF_2016_80Xv2.root", {"Track", "ID_Tight", "Iso_Tight"}));
         }
         else
         {
-            manager.RegisterPlugin(new LeptonSFWeight("TriggerSFWeight", Lepton::Flavour::Electron,
+            registerPlugin(new LeptonSFWeight("TriggerSFWeight", Lepton::Flavour::Electron,
               "ElectronSF_2016_80Xv2.root", {"Ele27_WPTight_Gsf"}));
-            manager.RegisterPlugin(new LeptonSFWeight("LeptonSFWeight", Lepton::Flavour::Electron,
+            registerPlugin(new LeptonSFWeight("LeptonSFWeight", Lepton::Flavour::Electron,
               "ElectronSF_2016_80Xv2.root", {"Track", "CutBasedID_Tight"}));
         }
         
         BTagWeight *bTagReweighter = new BTagWeight(bTagger);
         bTagReweighter->RequestSystematics();
-        manager.RegisterPlugin(bTagReweighter);
+        registerPlugin(bTagReweighter);
         
         
         PECGeneratorReader *generatorReader = new PECGeneratorReader;
@@ -549,62 +1071,174 @@ int main(int argc, char **argv)
         if (sampleGroup == SampleGroup::TT)
             generatorReader->RequestAltWeights();
         
-        manager.RegisterPlugin(generatorReader);
+        registerPlugin(generatorReader);
         
         
         // Dedicated reweighting for signal
         LOSystWeights *scaleWeights = new LOSystWeights(2, "NNPDF30_lo_as_0130");
         scaleWeights->SelectDatasets({"A-.+", "H-.+"});
-        manager.RegisterPlugin(scaleWeights);
+        registerPlugin(scaleWeights);
         
         
         // For SM tt use additional weights
         if (sampleGroup == SampleGroup::TT)
         {
-            manager.RegisterPlugin(new PECGenParticleReader());
+            registerPlugin(new PECGenParticleReader());
+            registerPlugin(new GenTopDecay);
             
             GenWeightSyst *genWeightSyst = new GenWeightSyst("genWeightVars.json");
             genWeightSyst->NormalizeByMeanWeights(
               "/gridgroup/cms/popov/PECData/2016Delta/lheWeights_v1.json");
-            manager.RegisterPlugin(genWeightSyst);
+            registerPlugin(genWeightSyst);
             
             TopPtWeight *topPtWeights = new TopPtWeight();
             topPtWeights->SelectDatasets({"ttbar-pw[-_].*"});
-            manager.RegisterPlugin(topPtWeights);
+            registerPlugin(topPtWeights);
             
             
-            manager.RegisterPlugin(new WeightCollector({"TriggerSFWeight", "LeptonSFWeight",
+            registerPlugin(new WeightCollector({"TriggerSFWeight", "LeptonSFWeight",
               "PileUpWeight", "BTagWeight", "GenWeightSyst", "TopPtWeight"}));
         }
         else
-            manager.RegisterPlugin(new WeightCollector({"TriggerSFWeight", "LeptonSFWeight",
+            registerPlugin(new WeightCollector({"TriggerSFWeight", "LeptonSFWeight",
               "PileUpWeight", "BTagWeight", "LOSystWeights"}));
     }
     
     
     // Plugin to calculate observables
-    manager.RegisterPlugin(new BasicObservables(bTagger));
+    BasicObservables *basicObservables = new BasicObservables(bTagger);
+    basicObservables->SetJetFlagsPluginName("JetFlags");
+    basicObservables->SetStorageSchema(storageSchema);
+    registerPlugin(basicObservables);
     
     
     // High-level reconstruction
-    TTSemilepRecoRochester *ttRecoPlugin = new TTSemilepRecoRochester;
-    ttRecoPlugin->SetLikelihood("TTRecoLikelihood_2016-pt20-v3.root");
-    ttRecoPlugin->SetBTagSelection(BTagger::Algorithm::CMVA, bTagWPService->GetThreshold(bTagger),
-      false /* both b-quark jets must be tagged */);
-    manager.RegisterPlugin(ttRecoPlugin);
+    string const likelihoodPath(optionsMap["likelihood"].as<string>());
+    bool const saveAltInterp = optionsMap.count("alt-interp");
+    registerPlugin(BuildTTReco("TTReco", "JetMET", "JetFlags", likelihoodPath, bTagger,
+      (pipelineTimer != nullptr), saveAltInterp));
     
     
     // Observables exploiting reconstructed top quarks
-    manager.RegisterPlugin(new TTObservables);
+    TTObservables *ttObservables = new TTObservables;
+    ttObservables->SetStorageSchema(storageSchema);
+    ttObservables->SetAlternativeInterpretation(saveAltInterp);
+    registerPlugin(ttObservables);
+    
+    
+    // In the single-pass mode, repeat the above for each variation. Names of output columns are
+    //prefixed with labels of the variations
+    for (auto const &variation: multiSysts)
+    {
+        string const label(variation.GetLabel());
+        
+        BasicObservables *variedBasicObservables =
+          new BasicObservables(bTagger, "BasicObservables_" + label);
+        variedBasicObservables->SetJetMETPluginName("JetMET_" + label);
+        variedBasicObservables->SetJetFlagsPluginName("JetFlags_" + label);
+        variedBasicObservables->SetColumnPrefix(label + "_");
+        variedBasicObservables->SetStorageSchema(storageSchema);
+        registerPlugin(variedBasicObservables);
+        
+        TTSemilepRecoRochester *ttRecoPlugin =
+          BuildTTReco("TTReco_" + label, "JetMET_" + label, "JetFlags_" + label, likelihoodPath,
+          bTagger, (pipelineTimer != nullptr), saveAltInterp);
+        
+        // Variations that only affect MET do not change neutrino ellipses
+        if (variation.type == "METUncl")
+            ttRecoPlugin->SetNuEllipseSource("TTReco", (pipelineTimer != nullptr));
+        
+        registerPlugin(ttRecoPlugin);
+        
+        TTObservables *variedTTObservables = new TTObservables("TTVars_" + label);
+        variedTTObservables->SetRecoPluginName("TTReco_" + label);
+        variedTTObservables->SetColumnPrefix(label + "_");
+        variedTTObservables->SetStorageSchema(storageSchema);
+        variedTTObservables->SetAlternativeInterpretation(saveAltInterp);
+        registerPlugin(variedTTObservables);
+    }
     
     
     // Event weights
-    if (sampleGroup != SampleGroup::Data)
-        manager.RegisterPlugin(new DumpWeights("EventWeights"));
+    if (sampleGroup != SampleGroup::Data and readSkim)
+        registerPlugin(new SkimWeights("EventWeights"));
+    else if (sampleGroup != SampleGroup::Data)
+    {
+        DumpWeights *dumpWeights = new DumpWeights("EventWeights");
+        
+        if (optionsMap.count("weight-ratios"))
+            dumpWeights->SetEncoding(DumpWeights::Encoding::Ratio);
+        
+        registerPlugin(dumpWeights);
+    }
+    
+    
+    // Save selected events into skims, including all collections of jets and MET
+    if (not skimWriteDirectory.empty())
+    {
+        SkimWriter *skimWriter = new SkimWriter(skimWriteDirectory, skimConfiguration);
+        skimWriter->AddJetMETCollection("JetMET");
+        
+        for (auto const &variation: multiSysts)
+            skimWriter->AddJetMETCollection("JetMET_" + variation.GetLabel());
+        
+        if (sampleGroup != SampleGroup::Data)
+            skimWriter->SetWeightPluginName("EventWeights");
+        
+        registerPlugin(skimWriter);
+    }
+    
+    
+    // All observables are written into a single tree. This plugin must follow all plugins that
+    //register columns with it
+    NtupleWriter *ntupleWriter = new NtupleWriter;
+    ntupleWriter->SetCompression(compression, compressionLevel);
+    ntupleWriter->SetAsyncWriting(4, (pipelineTimer != nullptr));
+    ntupleWriter->SetTreeOutput(not optionsMap.count("no-tuples"));
+    registerPlugin(ntupleWriter);
+    
+    
+    // Histograms of observables read from columns of the above plugin
+    if (optionsMap.count("hists"))
+    {
+        HistogramFiller *histogramFiller = new HistogramFiller(optionsMap["hists"].as<string>());
+        
+        if (sampleGroup == SampleGroup::Data)
+            histogramFiller->SetUnweighted();
+        
+        registerPlugin(histogramFiller);
+    }
+    
+    
+    // Record completed chunks. This plugin is not timed
+    CompletionManifest *completionManifest = new CompletionManifest(manifestPath,
+      jobConfiguration);
+    manager.RegisterPlugin(completionManifest);
+    
+    
+    startupProfile.Mark("Register plugins");
     
     
     // Process the datasets
-    manager.Process(16);
+    manager.Process(numThreads);
+    startupProfile.Mark("Process datasets");
+    
+    // All output files have been closed, so the last chunks processed by each thread can be
+    //recorded as completed
+    completionManifest->WritePending();
+    
+    
+    // Report time spent in the initialization, including inputs loaded lazily during processing
+    if (optionsMap.count("startup-profile"))
+        startupProfile.Print(cout);
+    
+    
+    // Report time spent in plugins
+    if (pipelineTimer)
+    {
+        pipelineTimer->PrintSummary(cout);
+        pipelineTimer->WriteReport(timingReportPath);
+    }
     
     
     return EXIT_SUCCESS;
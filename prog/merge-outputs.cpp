@@ -0,0 +1,241 @@
+/**
+ * This program combines outputs of htt-tuples produced in several shards (option --shard). The
+ * given directory is expected to contain, for each shard, the list of chunks of datasets assigned
+ * to it (file with extension ".plan") and the manifest of completed chunks (extension ".done"),
+ * as well as ROOT files written by TFileService for all chunks. Unless requested otherwise, the
+ * program first checks that every planned chunk has been completed.
+ * 
+ * Every ROOT file in the directory is then opened, and the key of the chunk it has been written
+ * for is read from it (see CompletionManifest). Exactly one file is expected for every completed
+ * chunk. Files that cannot be opened, are zombies, or have been recovered by ROOT (which happens
+ * if a file has not been closed properly), as well as files whose keys are missing, do not belong
+ * to completed chunks, or duplicate keys of files earlier in the lexicographical order, are
+ * reported as extra files. They are typically left by jobs that have failed or have been run with
+ * a different configuration. Unless requested otherwise, the merging is not performed if extra
+ * files are found. If the file for a completed chunk is missing, the program fails.
+ * 
+ * For each source dataset, files for its completed chunks are merged into a single file named
+ * after the dataset. The files are merged in the lexicographical order of their names, which makes
+ * the result independent of the order in which the chunks have been processed.
+ */
+
+#include <CompletionManifest.hpp>
+
+#include <TFile.h>
+#include <TFileMerger.h>
+
+#include <boost/program_options.hpp>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <set>
+#include <string>
+#include <vector>
+
+
+using namespace std;
+namespace po = boost::program_options;
+
+
+/// Checks if the given string ends with the given suffix
+bool EndsWith(string const &text, string const &suffix)
+{
+    return (text.size() >= suffix.size() and
+      text.compare(text.size() - suffix.size(), suffix.size(), suffix) == 0);
+}
+
+
+int main(int argc, char **argv)
+{
+    // Parse arguments
+    po::options_description options("Allowed options");
+    options.add_options()
+      ("help,h", "Prints help message")
+      ("directory", po::value<string>(), "Directory with outputs of all shards (required argument)")
+      ("output,o", po::value<string>(),
+        "Directory for merged files (by default, subdirectory \"merged\" of the input one)")
+      ("allow-incomplete", "Merge available files even if some chunks have not been completed")
+      ("ignore-extra", "Merge files for completed chunks even if extra files are found");
+    
+    po::positional_options_description positionalOptions;
+    positionalOptions.add("directory", 1);
+    
+    po::variables_map optionsMap;
+    po::store(
+      po::command_line_parser(argc, argv).options(options).positional(positionalOptions).run(),
+      optionsMap);
+    po::notify(optionsMap);
+    
+    if (optionsMap.count("help") or not optionsMap.count("directory"))
+    {
+        cerr << "Merges outputs of htt-tuples produced in several shards.\n";
+        cerr << "Usage: merge-outputs directory [options]\n";
+        cerr << options << endl;
+        return EXIT_FAILURE;
+    }
+    
+    string const directory(optionsMap["directory"].as<string>());
+    string const outputDirectory((optionsMap.count("output")) ?
+      optionsMap["output"].as<string>() : directory + "/merged");
+    
+    
+    // List files in the directory
+    DIR *dir = opendir(directory.c_str());
+    
+    if (not dir)
+    {
+        cerr << "Failed to open directory \"" << directory << "\".\n";
+        return EXIT_FAILURE;
+    }
+    
+    vector<string> planFiles, rootFiles;
+    
+    while (dirent const *entry = readdir(dir))
+    {
+        string const name(entry->d_name);
+        
+        if (EndsWith(name, ".plan"))
+            planFiles.emplace_back(name);
+        else if (EndsWith(name, ".root"))
+            rootFiles.emplace_back(name);
+    }
+    
+    closedir(dir);
+    
+    if (planFiles.empty())
+    {
+        cerr << "Directory \"" << directory << "\" does not contain lists of chunks for any "
+          "shard.\n";
+        return EXIT_FAILURE;
+    }
+    
+    sort(rootFiles.begin(), rootFiles.end());
+    
+    
+    // Check that all planned chunks have been completed. Remember keys and dataset IDs of the
+    //completed ones
+    map<uint64_t, string> completedChunks;
+    unsigned numMissingChunks = 0;
+    
+    for (auto const &planFile: planFiles)
+    {
+        string const stem(planFile.substr(0, planFile.size() - string(".plan").size()));
+        auto const planned = CompletionManifest::Read(directory + "/" + planFile);
+        auto const completed = CompletionManifest::Read(directory + "/" + stem + ".done");
+        
+        for (auto const &chunk: planned)
+        {
+            if (completed.count(chunk.first) == 0)
+            {
+                cerr << "Chunk " << hex << chunk.first << dec << " of dataset \"" <<
+                  chunk.second << "\" in " << stem << " has not been completed.\n";
+                ++numMissingChunks;
+            }
+            else
+                completedChunks.insert(chunk);
+        }
+    }
+    
+    if (numMissingChunks > 0 and not optionsMap.count("allow-incomplete"))
+    {
+        cerr << numMissingChunks << " chunks have not been completed. Rerun the corresponding " <<
+          "shards or use option --allow-incomplete.\n";
+        return EXIT_FAILURE;
+    }
+    
+    
+    // Assign ROOT files to completed chunks based on keys saved in them. All other files are
+    //extra.
+    map<string, vector<string>> filesPerDataset;
+    set<uint64_t> foundChunks;
+    unsigned numExtraFiles = 0;
+    
+    for (auto const &file: rootFiles)
+    {
+        string const path(directory + "/" + file);
+        unique_ptr<TFile> rootFile(TFile::Open(path.c_str()));
+        uint64_t key;
+        
+        if (not rootFile or rootFile->IsZombie() or rootFile->TestBit(TFile::kRecovered))
+            cerr << "Extra file \"" << path << "\" cannot be opened or has not been closed " <<
+              "properly.\n";
+        else if (not CompletionManifest::ReadKey(*rootFile, key))
+            cerr << "Extra file \"" << path << "\" does not contain the key of a chunk.\n";
+        else if (completedChunks.count(key) == 0)
+            cerr << "Extra file \"" << path << "\" has been written for chunk " << hex << key <<
+              dec << ", which has not been completed.\n";
+        else if (not foundChunks.insert(key).second)
+            cerr << "Extra file \"" << path << "\" has been written for chunk " << hex << key <<
+              dec << ", for which another file has been found.\n";
+        else
+        {
+            filesPerDataset[completedChunks[key]].emplace_back(file);
+            continue;
+        }
+        
+        ++numExtraFiles;
+    }
+    
+    
+    // Check that all completed chunks have their files
+    unsigned numMissingFiles = 0;
+    
+    for (auto const &chunk: completedChunks)
+    {
+        if (foundChunks.count(chunk.first) == 0)
+        {
+            cerr << "No file found for completed chunk " << hex << chunk.first << dec <<
+              " of dataset \"" << chunk.second << "\".\n";
+            ++numMissingFiles;
+        }
+    }
+    
+    if (numMissingFiles > 0)
+    {
+        cerr << numMissingFiles << " completed chunks have no valid files. Their entries must " <<
+          "be removed from the manifests, and the chunks must be processed anew.\n";
+        return EXIT_FAILURE;
+    }
+    
+    if (numExtraFiles > 0 and not optionsMap.count("ignore-extra"))
+    {
+        cerr << numExtraFiles << " extra files found. Remove them or use option --ignore-extra.\n";
+        return EXIT_FAILURE;
+    }
+    
+    
+    // Merge the files
+    mkdir(outputDirectory.c_str(), 0755);
+    
+    for (auto const &entry: filesPerDataset)
+    {
+        string const outputPath(outputDirectory + "/" + entry.first + ".root");
+        TFileMerger merger(false);
+        
+        if (not merger.OutputFile(outputPath.c_str(), "RECREATE"))
+        {
+            cerr << "Failed to create file \"" << outputPath << "\".\n";
+            return EXIT_FAILURE;
+        }
+        
+        for (auto const &file: entry.second)
+            merger.AddFile((directory + "/" + file).c_str(), false);
+        
+        if (not merger.Merge())
+        {
+            cerr << "Failed to merge files for dataset \"" << entry.first << "\".\n";
+            return EXIT_FAILURE;
+        }
+        
+        cout << "Merged " << entry.second.size() << " files into \"" << outputPath << "\".\n";
+    }
+    
+    
+    return EXIT_SUCCESS;
+}
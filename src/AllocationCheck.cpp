@@ -0,0 +1,129 @@
+#include <AllocationCheck.hpp>
+
+#include <cstdlib>
+#include <new>
+#include <sstream>
+#include <stdexcept>
+
+
+#ifdef TTRES_CHECK_ALLOCATIONS
+
+/// Number of calls to global operators new in the current thread
+static thread_local unsigned long numAllocations = 0;
+
+
+/// Allocates memory with std::malloc and counts the allocation
+static void *CountedAllocate(std::size_t size)
+{
+    ++numAllocations;
+    
+    // Zero-size allocations must still return a unique pointer
+    void *p = std::malloc((size > 0) ? size : 1);
+    
+    if (not p)
+        throw std::bad_alloc();
+    
+    return p;
+}
+
+
+void *operator new(std::size_t size)
+{
+    return CountedAllocate(size);
+}
+
+
+void *operator new[](std::size_t size)
+{
+    return CountedAllocate(size);
+}
+
+
+void *operator new(std::size_t size, std::nothrow_t const &) noexcept
+{
+    ++numAllocations;
+    return std::malloc((size > 0) ? size : 1);
+}
+
+
+void *operator new[](std::size_t size, std::nothrow_t const &) noexcept
+{
+    ++numAllocations;
+    return std::malloc((size > 0) ? size : 1);
+}
+
+
+void operator delete(void *p) noexcept
+{
+    std::free(p);
+}
+
+
+void operator delete[](void *p) noexcept
+{
+    std::free(p);
+}
+
+
+void operator delete(void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+
+void operator delete[](void *p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+
+void operator delete(void *p, std::nothrow_t const &) noexcept
+{
+    std::free(p);
+}
+
+
+void operator delete[](void *p, std::nothrow_t const &) noexcept
+{
+    std::free(p);
+}
+
+#endif  // TTRES_CHECK_ALLOCATIONS
+
+
+AllocationCheck::AllocationCheck(unsigned numWarmUpEvents_ /*= 100*/):
+    numWarmUpEvents(numWarmUpEvents_), numEvents(0), startCount(0)
+{}
+
+
+unsigned long AllocationCheck::GetNumAllocations()
+{
+#ifdef TTRES_CHECK_ALLOCATIONS
+    return numAllocations;
+#else
+    return 0;
+#endif
+}
+
+
+bool AllocationCheck::IsEnabled()
+{
+#ifdef TTRES_CHECK_ALLOCATIONS
+    return true;
+#else
+    return false;
+#endif
+}
+
+
+void AllocationCheck::ReportFailure(std::string const &pluginName) const
+{
+    // The count is read before building the message, which allocates memory itself
+    unsigned long const numUnexpected = GetNumAllocations() - startCount;
+    
+    std::ostringstream message;
+    message << "AllocationCheck::End: Plugin \"" << pluginName << "\" has performed " <<
+      numUnexpected << " heap allocation(s) while processing an event after " << numWarmUpEvents <<
+      " warm-up events. Per-event temporaries must be kept in reused member buffers.";
+    throw std::runtime_error(message.str());
+}
@@ -1,22 +1,23 @@
 #include <BasicObservables.hpp>
 
+#include <JetFlags.hpp>
+
 #include <mensura/core/BTagWPService.hpp>
 #include <mensura/core/LeptonReader.hpp>
 #include <mensura/core/JetMETReader.hpp>
 #include <mensura/core/PileUpReader.hpp>
 #include <mensura/core/Processor.hpp>
 #include <mensura/core/PhysicsObjects.hpp>
-#include <mensura/core/ROOTLock.hpp>
-
-#include <mensura/extensions/TFileService.hpp>
 
 
-BasicObservables::BasicObservables(BTagger const &bTagger_):
-    AnalysisPlugin("BasicObservables"),
+BasicObservables::BasicObservables(BTagger const &bTagger_,
+  std::string const &name /*= "BasicObservables"*/):
+    AnalysisPlugin(name),
     bTagger(bTagger_),
-    fileServiceName("TFileService"), fileService(nullptr),
+    writerName("NtupleWriter"), columnPrefix(""), schema{23, false},
     bTagWPServiceName("BTagWP"), bTagWPService(nullptr),
     leptonPluginName("Leptons"), leptonPlugin(nullptr),
+    jetFlagsPluginName(""), jetFlagsPlugin(nullptr), bTagMask(0),
     jetmetPluginName("JetMET"), jetmetPlugin(nullptr),
     puPluginName("PileUp"), puPlugin(nullptr)
 {}
@@ -25,9 +26,10 @@ BasicObservables::BasicObservables(BTagger const &bTagger_):
 BasicObservables::BasicObservables(BasicObservables const &src):
     AnalysisPlugin(src),
     bTagger(src.bTagger),
-    fileServiceName(src.fileServiceName), fileService(nullptr),
+    writerName(src.writerName), columnPrefix(src.columnPrefix), schema(src.schema),
     bTagWPServiceName(src.bTagWPServiceName), bTagWPService(nullptr),
     leptonPluginName(src.leptonPluginName), leptonPlugin(nullptr),
+    jetFlagsPluginName(src.jetFlagsPluginName), jetFlagsPlugin(nullptr), bTagMask(0),
     jetmetPluginName(src.jetmetPluginName), jetmetPlugin(nullptr),
     puPluginName(src.puPluginName), puPlugin(nullptr)
 {}
@@ -36,53 +38,54 @@ BasicObservables::BasicObservables(BasicObservables const &src):
 void BasicObservables::BeginRun(Dataset const &)
 {
     // Save pointers to services and readers
-    fileService = dynamic_cast<TFileService const *>(GetMaster().GetService(fileServiceName));
     bTagWPService = dynamic_cast<BTagWPService const *>(GetMaster().GetService(bTagWPServiceName));
     
     leptonPlugin = dynamic_cast<LeptonReader const *>(GetDependencyPlugin(leptonPluginName));
     jetmetPlugin = dynamic_cast<JetMETReader const *>(GetDependencyPlugin(jetmetPluginName));
     puPlugin = dynamic_cast<PileUpReader const *>(GetDependencyPlugin(puPluginName));
     
+    if (not jetFlagsPluginName.empty())
+    {
+        jetFlagsPlugin = dynamic_cast<JetFlags const *>(GetDependencyPlugin(jetFlagsPluginName));
+        bTagMask = jetFlagsPlugin->GetBTagMask(bTagger);
+    }
     
-    // Create output tree
-    tree = fileService->Create<TTree>("", "BasicVars", "Basic observables");
-    
-    
-    // Assign branch addresses
-    ROOTLock::Lock();
-    
-    tree->Branch("nJet30", &nJet30);
-    tree->Branch("nJet20", &nJet20);
-    tree->Branch("nBJet30", &nBJet30);
-    tree->Branch("nBJet20", &nBJet20);
-    
-    tree->Branch("Pt_Lep", &Pt_Lep);
-    tree->Branch("Eta_Lep", &Eta_Lep);
-    
-    tree->Branch("Pt_J1", &Pt_J1);
-    tree->Branch("Eta_J1", &Eta_J1);
-    tree->Branch("Pt_J2", &Pt_J2);
-    tree->Branch("Eta_J2", &Eta_J2);
-    tree->Branch("Pt_J3", &Pt_J3);
-    tree->Branch("Pt_J4", &Pt_J4);
-    tree->Branch("Pt_BJ1", &Pt_BJ1);
-    
-    tree->Branch("bTag_J1", &bTag_J1);
-    tree->Branch("bTag_J2", &bTag_J2);
-    
-    tree->Branch("M_J1J2", &M_J1J2);
-    tree->Branch("DR_J1J2", &DR_J1J2);
-    tree->Branch("Ht", &Ht);
-    tree->Branch("St", &St);
-    
-    tree->Branch("MET", &MET);
-    tree->Branch("Phi_MET", &Phi_MET);
-    tree->Branch("DPhi_LepNu", &DPhi_LepNu);
-    tree->Branch("MtW", &MtW);
-    tree->Branch("nPV", &nPV);
-    tree->Branch("Rho", &Rho);
     
-    ROOTLock::Unlock();
+    // Register output columns. The writer is executed after this plugin and thus cannot be
+    //accessed as a dependency
+    auto const *writer = dynamic_cast<NtupleWriter const *>(GetMaster().GetPlugin(writerName));
+    using Kind = NtupleWriter::ColumnKind;
+    
+    writer->RegisterColumn(columnPrefix + "nJet30", &nJet30, Kind::Count, schema);
+    writer->RegisterColumn(columnPrefix + "nJet20", &nJet20, Kind::Count, schema);
+    writer->RegisterColumn(columnPrefix + "nBJet30", &nBJet30, Kind::Count, schema);
+    writer->RegisterColumn(columnPrefix + "nBJet20", &nBJet20, Kind::Count, schema);
+    
+    writer->RegisterColumn(columnPrefix + "Pt_Lep", &Pt_Lep, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "Eta_Lep", &Eta_Lep, Kind::Kinematic, schema);
+    
+    writer->RegisterColumn(columnPrefix + "Pt_J1", &Pt_J1, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "Eta_J1", &Eta_J1, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "Pt_J2", &Pt_J2, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "Eta_J2", &Eta_J2, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "Pt_J3", &Pt_J3, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "Pt_J4", &Pt_J4, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "Pt_BJ1", &Pt_BJ1, Kind::Kinematic, schema);
+    
+    writer->RegisterColumn(columnPrefix + "bTag_J1", &bTag_J1, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "bTag_J2", &bTag_J2, Kind::Kinematic, schema);
+    
+    writer->RegisterColumn(columnPrefix + "M_J1J2", &M_J1J2, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "DR_J1J2", &DR_J1J2, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "Ht", &Ht, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "St", &St, Kind::Kinematic, schema);
+    
+    writer->RegisterColumn(columnPrefix + "MET", &MET, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "Phi_MET", &Phi_MET, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "DPhi_LepNu", &DPhi_LepNu, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "MtW", &MtW, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "nPV", &nPV, Kind::Count, schema);
+    writer->RegisterColumn(columnPrefix + "Rho", &Rho, Kind::Kinematic, schema);
 }
 
 
@@ -92,8 +95,34 @@ Plugin *BasicObservables::Clone() const
 }
 
 
+void BasicObservables::SetStorageSchema(NtupleWriter::Schema const &schema_)
+{
+    schema = schema_;
+}
+
+
+void BasicObservables::SetJetFlagsPluginName(std::string const &pluginName)
+{
+    jetFlagsPluginName = pluginName;
+}
+
+
+void BasicObservables::SetJetMETPluginName(std::string const &pluginName)
+{
+    jetmetPluginName = pluginName;
+}
+
+
+void BasicObservables::SetColumnPrefix(std::string const &prefix)
+{
+    columnPrefix = prefix;
+}
+
+
 bool BasicObservables::ProcessEvent()
 {
+    allocationCheck.Begin();
+    
     auto const &leptons = leptonPlugin->GetLeptons();
     auto const &met = jetmetPlugin->GetMET();
     
@@ -140,37 +169,57 @@ bool BasicObservables::ProcessEvent()
     
     nJet30 = nBJet30 = 0;
     nJet20 = nBJet20 = 0;
-    Ht = 0.;
+    Pt_BJ1 = 0.;
     
-    for (auto const &j: jets)
+    if (jetFlagsPlugin)
     {
-        Ht += j.Pt();
+        auto const &flags = jetFlagsPlugin->GetFlags();
         
-        if (j.Pt() > 20.)
-        {        
-            ++nJet20;
+        for (unsigned i = 0; i < jets.size(); ++i)
+        {
+            std::uint32_t const f = flags[i];
+            bool const tagged = (f & bTagMask);
             
-            if (bTagWPService->IsTagged(bTagger, j))
-                ++nBJet20;
-        }
-        
-        if (j.Pt() > 30.)
-        {        
-            ++nJet30;
+            nJet20 += bool(f & JetFlags::Pt20);
+            nJet30 += bool(f & JetFlags::Pt30);
+            nBJet20 += (tagged and (f & JetFlags::Pt20));
+            nBJet30 += (tagged and (f & JetFlags::Pt30));
             
-            if (bTagWPService->IsTagged(bTagger, j))
-                ++nBJet30;
+            if (tagged and Pt_BJ1 == 0.)
+                Pt_BJ1 = jets[i].Pt();
         }
+        
+        Ht = jetFlagsPlugin->GetHt();
     }
-    
-    Pt_BJ1 = 0.;
-    
-    for (auto const &j: jets)
-        if (bTagWPService->IsTagged(bTagger, j))
+    else
+    {
+        Ht = 0.;
+        
+        for (auto const &j: jets)
         {
-            Pt_BJ1 = j.Pt();
-            break;
+            Ht += j.Pt();
+            bool const tagged = bTagWPService->IsTagged(bTagger, j);
+            
+            if (j.Pt() > 20.)
+            {
+                ++nJet20;
+                
+                if (tagged)
+                    ++nBJet20;
+            }
+            
+            if (j.Pt() > 30.)
+            {
+                ++nJet30;
+                
+                if (tagged)
+                    ++nBJet30;
+            }
+            
+            if (tagged and Pt_BJ1 == 0.)
+                Pt_BJ1 = j.Pt();
         }
+    }
     
     
     MET = met.Pt();
@@ -181,7 +230,6 @@ bool BasicObservables::ProcessEvent()
     
     St = Ht + Pt_Lep + MET;
     
-    
-    tree->Fill();
+    allocationCheck.End(GetName());
     return true;
 }
@@ -0,0 +1,214 @@
+#include <CompletionManifest.hpp>
+
+#include <SkimFormat.hpp>
+#include <SkimWriter.hpp>
+
+#include <mensura/core/Processor.hpp>
+
+#include <mensura/extensions/TFileService.hpp>
+
+#include <TFile.h>
+#include <TNamed.h>
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <vector>
+
+
+class CompletionManifest::PendingEntries
+{
+public:
+    /// Adds an entry
+    void Add(std::string const &entry);
+    
+    /**
+     * \brief Removes the given entry
+     * 
+     * Returns false if the entry is not found.
+     */
+    bool Remove(std::string const &entry);
+    
+    /// Removes and returns all entries
+    std::vector<std::string> TakeAll();
+    
+private:
+    std::mutex mutex;
+    std::vector<std::string> entries;
+};
+
+
+void CompletionManifest::PendingEntries::Add(std::string const &entry)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    entries.emplace_back(entry);
+}
+
+
+bool CompletionManifest::PendingEntries::Remove(std::string const &entry)
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    auto const it = std::find(entries.begin(), entries.end(), entry);
+    
+    if (it == entries.end())
+        return false;
+    
+    entries.erase(it);
+    return true;
+}
+
+
+std::vector<std::string> CompletionManifest::PendingEntries::TakeAll()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    std::vector<std::string> allEntries;
+    allEntries.swap(entries);
+    return allEntries;
+}
+
+
+
+CompletionManifest::CompletionManifest(std::string const &path_,
+  std::string const &configuration_, std::string const &name /*= "CompletionManifest"*/):
+    AnalysisPlugin(name),
+    path(path_), configuration(configuration_),
+    fileServiceName("TFileService"), fileService(nullptr),
+    pendingEntries(new PendingEntries)
+{}
+
+
+CompletionManifest::CompletionManifest(CompletionManifest const &src):
+    AnalysisPlugin(src),
+    path(src.path), configuration(src.configuration),
+    fileServiceName(src.fileServiceName), fileService(nullptr),
+    pendingEntries(src.pendingEntries)
+{}
+
+
+void CompletionManifest::BeginRun(Dataset const &dataset)
+{
+    // Output files for the dataset processed previously by this clone have been closed by now.
+    //The entry might have been recorded already by WritePending.
+    if (not finishedEntry.empty() and pendingEntries->Remove(finishedEntry))
+        Append(finishedEntry);
+    
+    finishedEntry.clear();
+    entry = FormatEntry(dataset, configuration);
+    
+    
+    // Save the key in the output file for the current dataset
+    fileService = dynamic_cast<TFileService const *>(GetMaster().GetService(fileServiceName));
+    fileService->Create<TNamed>("", "ChunkKey",
+      FormatKey(ComputeKey(dataset, configuration)).c_str());
+}
+
+
+Plugin *CompletionManifest::Clone() const
+{
+    return new CompletionManifest(*this);
+}
+
+
+void CompletionManifest::EndRun()
+{
+    finishedEntry = entry;
+    pendingEntries->Add(finishedEntry);
+}
+
+
+std::uint64_t CompletionManifest::ComputeKey(Dataset const &dataset,
+  std::string const &configuration)
+{
+    // Extend the hash of the inputs with the configuration, using the same separator as between
+    //names of files
+    return SkimFormat::Hash("\n" + configuration, SkimWriter::GetInputHash(dataset));
+}
+
+
+std::string CompletionManifest::FormatEntry(Dataset const &dataset,
+  std::string const &configuration)
+{
+    return FormatKey(ComputeKey(dataset, configuration)) + " " + dataset.GetSourceDatasetID() +
+      "\n";
+}
+
+
+std::map<std::uint64_t, std::string> CompletionManifest::Read(std::string const &path)
+{
+    std::map<std::uint64_t, std::string> entries;
+    std::ifstream file(path);
+    std::string line;
+    
+    while (std::getline(file, line))
+    {
+        std::istringstream lineStream(line);
+        std::uint64_t hash;
+        std::string datasetID;
+        
+        if (lineStream >> std::hex >> hash >> datasetID)
+            entries[hash] = datasetID;
+    }
+    
+    return entries;
+}
+
+
+bool CompletionManifest::ReadKey(TFile &file, std::uint64_t &key)
+{
+    auto const *keyObject = dynamic_cast<TNamed const *>(file.Get("ChunkKey"));
+    
+    if (not keyObject)
+        return false;
+    
+    std::istringstream keyStream(keyObject->GetTitle());
+    return bool(keyStream >> std::hex >> key);
+}
+
+
+void CompletionManifest::WritePending()
+{
+    for (auto const &pendingEntry: pendingEntries->TakeAll())
+        Append(pendingEntry);
+}
+
+
+bool CompletionManifest::ProcessEvent()
+{
+    return true;
+}
+
+
+std::string CompletionManifest::FormatKey(std::uint64_t key)
+{
+    std::ostringstream keyStream;
+    keyStream << std::hex << std::setw(16) << std::setfill('0') << key;
+    return keyStream.str();
+}
+
+
+void CompletionManifest::Append(std::string const &entry) const
+{
+    int const fd = open(path.c_str(), O_WRONLY | O_APPEND | O_CREAT, 0644);
+    bool success = (fd >= 0);
+    
+    if (success)
+    {
+        success = (write(fd, entry.data(), entry.size()) == ssize_t(entry.size()));
+        success = (fsync(fd) == 0) and success;
+        success = (close(fd) == 0) and success;
+    }
+    
+    if (not success)
+    {
+        std::ostringstream message;
+        message << "CompletionManifest[\"" << GetName() << "\"]::Append: Failed to write to " <<
+          "file \"" << path << "\".";
+        throw std::runtime_error(message.str());
+    }
+}
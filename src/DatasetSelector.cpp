@@ -0,0 +1,41 @@
+#include <DatasetSelector.hpp>
+
+
+DatasetSelector::DatasetSelector():
+    selectAll(true)
+{}
+
+
+DatasetSelector::DatasetSelector(std::initializer_list<std::string> const &masks_):
+    selectAll(false)
+{
+    for (auto const &mask: masks_)
+        masks.emplace_back(mask);
+}
+
+
+bool DatasetSelector::IsSelected(std::string const &datasetID) const
+{
+    if (selectAll)
+        return true;
+    
+    std::lock_guard<std::mutex> lock(mutex);
+    auto const res = decisions.find(datasetID);
+    
+    if (res != decisions.end())
+        return res->second;
+    
+    bool selected = false;
+    
+    for (auto const &mask: masks)
+    {
+        if (std::regex_match(datasetID, mask))
+        {
+            selected = true;
+            break;
+        }
+    }
+    
+    decisions[datasetID] = selected;
+    return selected;
+}
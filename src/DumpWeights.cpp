@@ -1,12 +1,13 @@
 #include <DumpWeights.hpp>
 
+#include <NtupleWriter.hpp>
+
 #include <mensura/core/BTagWPService.hpp>
 #include <mensura/core/LeptonReader.hpp>
 #include <mensura/core/JetMETReader.hpp>
 #include <mensura/core/PileUpReader.hpp>
 #include <mensura/core/Processor.hpp>
 #include <mensura/core/PhysicsObjects.hpp>
-#include <mensura/core/ROOTLock.hpp>
 
 #include <mensura/extensions/TFileService.hpp>
 #include <mensura/extensions/WeightCollector.hpp>
@@ -14,19 +15,20 @@
 #include <mensura/PECReader/PECGeneratorReader.hpp>
 #include <mensura/PECReader/PECTriggerFilter.hpp>
 
+#include <TNamed.h>
+
 #include <sstream>
 #include <stdexcept>
 
 
-using namespace std::string_literals;
-
-
 DumpWeights::DumpWeights(std::string const &name, std::string const &weightCollectorName):
     AnalysisPlugin(name),
+    writerName("NtupleWriter"),
     fileServiceName("TFileService"), fileService(nullptr),
     triggerFilterName("TriggerFilter"), triggerFilter(nullptr),
     generatorPluginName("Generator"), generatorPlugin(nullptr),
-    weightCollectorName(weightCollectorName), weightCollector(nullptr)
+    weightCollectorName(weightCollectorName), weightCollector(nullptr),
+    encoding(Encoding::Absolute)
 {}
 
 
@@ -37,10 +39,12 @@ DumpWeights::DumpWeights(std::string const &weightCollectorName):
 
 DumpWeights::DumpWeights(DumpWeights const &src):
     AnalysisPlugin(src),
+    writerName(src.writerName),
     fileServiceName(src.fileServiceName), fileService(nullptr),
     triggerFilterName(src.triggerFilterName), triggerFilter(nullptr),
     generatorPluginName(src.generatorPluginName), generatorPlugin(nullptr),
     weightCollectorName(src.weightCollectorName), weightCollector(nullptr),
+    encoding(src.encoding),
     systWeights(src.systWeights)
 {}
 
@@ -67,28 +71,39 @@ void DumpWeights::BeginRun(Dataset const &dataset)
           dynamic_cast<WeightCollector const *>(GetDependencyPlugin(weightCollectorName));
     
     
-    // Adjust the size of the array to store alternative weights
+    // Adjust the size of the array to store alternative weights and describe its layout
     unsigned nSystWeights = 0;
+    std::ostringstream layoutStream;
+    layoutStream << "encoding=" << ((encoding == Encoding::Ratio) ? "ratio" : "absolute") <<
+      ";variations=";
     
     if (weightCollectorName != "")
         for (unsigned iPlugin = 0; iPlugin < weightCollector->GetNumPlugins(); ++iPlugin)
-            nSystWeights += 2 * weightCollector->GetPlugin(iPlugin)->GetNumVariations();
+        {
+            EventWeightPlugin const *plugin = weightCollector->GetPlugin(iPlugin);
+            
+            for (unsigned iVar = 0; iVar < plugin->GetNumVariations(); ++iVar)
+                for (char const *direction: {"up", "down"})
+                    layoutStream << ((nSystWeights++ > 0) ? "," : "") << plugin->GetName() << ":" <<
+                      iVar << ":" << direction;
+        }
     
     systWeights.resize(nSystWeights);
+    layout = layoutStream.str();
     
     
-    // Create output tree
-    tree = fileService->Create<TTree>("", "Weights", "Nominal and alternative weights");
-    
+    // Save the layout. All clones create identical objects, and only one of them is kept when
+    //partial output files are merged.
+    fileService->Create<TNamed>("", "SystWeightsLayout", layout.c_str());
     
-    // Assign branch addresses
-    ROOTLock::Lock();
     
-    tree->Branch("weight", &weight);
-    tree->Branch("systWeights", systWeights.data(),
-      ("systWeights["s + std::to_string(systWeights.size()) + "]/F").c_str());
+    // Register output columns. The writer is executed after this plugin and thus cannot be
+    //accessed as a dependency
+    auto const *writer = dynamic_cast<NtupleWriter const *>(GetMaster().GetPlugin(writerName));
+    writer->RegisterColumn("weight", &weight);
     
-    ROOTLock::Unlock();
+    if (nSystWeights > 0)
+        writer->RegisterColumn("systWeights", systWeights.data(), nSystWeights);
     
     
     // Common event weight in this dataset
@@ -103,6 +118,30 @@ Plugin *DumpWeights::Clone() const
 }
 
 
+std::string const &DumpWeights::GetLayout() const
+{
+    return layout;
+}
+
+
+std::vector<Float_t> const &DumpWeights::GetSystWeights() const
+{
+    return systWeights;
+}
+
+
+Float_t DumpWeights::GetWeight() const
+{
+    return weight;
+}
+
+
+void DumpWeights::SetEncoding(Encoding encoding_)
+{
+    encoding = encoding_;
+}
+
+
 bool DumpWeights::ProcessEvent()
 {
     double const w = weightDataset * triggerFilter->GetWeight() *
@@ -111,7 +150,20 @@ bool DumpWeights::ProcessEvent()
     
     if (weightCollector)
     {
-        weight = w * weightCollector->GetWeight();
+        double const nominalWeight = weightCollector->GetWeight();
+        weight = w * nominalWeight;
+        
+        // Alternative weights are either multiplied by the common factor or divided by the
+        //nominal weight, in which case the common factor cancels out. The division makes sure
+        //that variations coinciding with the nominal weight give exact unity.
+        auto const encode = [this, w, nominalWeight](double altWeight) -> Float_t
+        {
+            if (encoding == Encoding::Absolute)
+                return w * altWeight;
+            else
+                return (nominalWeight != 0.) ? altWeight / nominalWeight : 0.;
+        };
+        
         unsigned curWeightIndex = 0;
         
         for (unsigned iPlugin = 0; iPlugin < weightCollector->GetNumPlugins(); ++iPlugin)
@@ -120,9 +172,10 @@ bool DumpWeights::ProcessEvent()
             
             for (unsigned iVar = 0; iVar < plugin->GetNumVariations(); ++iVar)
             {
-                systWeights.at(curWeightIndex) = w * weightCollector->GetWeightUp(iPlugin, iVar);
+                systWeights.at(curWeightIndex) =
+                  encode(weightCollector->GetWeightUp(iPlugin, iVar));
                 systWeights.at(curWeightIndex + 1) =
-                  w * weightCollector->GetWeightDown(iPlugin, iVar);
+                  encode(weightCollector->GetWeightDown(iPlugin, iVar));
                 curWeightIndex += 2;
             }
         }
@@ -130,6 +183,5 @@ bool DumpWeights::ProcessEvent()
     else
         weight = w;
     
-    tree->Fill();
     return true;
 }
@@ -0,0 +1,155 @@
+#include <GenTopDecay.hpp>
+
+#include <mensura/core/GenParticleReader.hpp>
+
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+
+GenTopDecay::GenTopDecay(std::string const &name /*= "GenTopDecay"*/):
+    AnalysisPlugin(name),
+    genParticleReaderName("GenParticles"), genParticleReader(nullptr),
+    numTops(0)
+{}
+
+
+void GenTopDecay::BeginRun(Dataset const &)
+{
+    genParticleReader =
+      dynamic_cast<GenParticleReader const *>(GetDependencyPlugin(genParticleReaderName));
+}
+
+
+Plugin *GenTopDecay::Clone() const
+{
+    return new GenTopDecay(*this);
+}
+
+
+GenTopDecay::Decay const &GenTopDecay::GetDecay(unsigned index) const
+{
+    if (index >= numTops)
+    {
+        std::ostringstream message;
+        message << "GenTopDecay[\"" << GetName() << "\"]::GetDecay: Requested top quark with "
+          "index " << index << " while only " << numTops << " top quarks have been found in the "
+          "current event.";
+        throw std::runtime_error(message.str());
+    }
+    
+    return decays[index];
+}
+
+
+unsigned GenTopDecay::GetNumTops() const
+{
+    return numTops;
+}
+
+
+GenParticle const &GenTopDecay::GetParticle(int index) const
+{
+    return genParticleReader->GetParticles().at(index);
+}
+
+
+bool GenTopDecay::ProcessEvent()
+{
+    auto const &particles = genParticleReader->GetParticles();
+    numTops = 0;
+    
+    // Daughters are given by pointers into the same collection
+    auto const indexOf = [&particles](GenParticle const *p)
+    {
+        return int(p - particles.data());
+    };
+    
+    
+    for (unsigned i = 0; i < particles.size(); ++i)
+    {
+        auto const &p = particles[i];
+        
+        if (std::abs(p.GetPdgId()) != 6)
+            continue;
+        
+        
+        if (numTops == 2)
+        {
+            std::ostringstream message;
+            message << "GenTopDecay[\"" << GetName() << "\"]::ProcessEvent: Found more than "
+              "two top quarks in an event.";
+            throw std::runtime_error(message.str());
+        }
+        
+        Decay &decay = decays[numTops];
+        ++numTops;
+        
+        decay.top = i;
+        decay.b = decay.w = -1;
+        decay.wDaughters = {{-1, -1}};
+        decay.p4.SetPxPyPzE(0., 0., 0., 0.);
+        
+        
+        // Collect decay products. Daughters of the top quark other than the W boson are put first,
+        //so that normally the b quark is the first product and the remaining two are daughters
+        //of the W boson.
+        std::array<int, 3> products;
+        unsigned nProducts = 0, nDirectProducts = 0, nW = 0, nWDaughters = 0;
+        int w = -1;
+        
+        for (auto const &d: p.GetDaughters())
+        {
+            if (std::abs(d->GetPdgId()) == 24)
+                continue;
+            
+            if (nProducts < 3)
+                products[nProducts] = indexOf(d);
+            
+            decay.p4 += d->P4();
+            ++nProducts;
+            ++nDirectProducts;
+        }
+        
+        for (auto const &d: p.GetDaughters())
+        {
+            if (std::abs(d->GetPdgId()) != 24)
+                continue;
+            
+            w = indexOf(d);
+            ++nW;
+            
+            for (auto const &dW: d->GetDaughters())  // There are no chains like W->W->...
+            {
+                if (nProducts < 3)
+                    products[nProducts] = indexOf(dW);
+                
+                decay.p4 += dW->P4();
+                ++nProducts;
+                ++nWDaughters;
+            }
+        }
+        
+        if (nProducts != 3)
+        {
+            std::ostringstream message;
+            message << "GenTopDecay[\"" << GetName() << "\"]::ProcessEvent: Found a top quark "
+              "with " << nProducts << " daughters.";
+            throw std::runtime_error(message.str());
+        }
+        
+        
+        // Identify the b quark and the W boson only for the regular decay t -> bW with two
+        //daughters of the W boson. With any other topology the roles of the products would have
+        //to be guessed, so they are left unset.
+        if (nDirectProducts == 1 and nW == 1 and nWDaughters == 2)
+        {
+            decay.b = products[0];
+            decay.w = w;
+            decay.wDaughters = {{products[1], products[2]}};
+        }
+    }
+    
+    
+    return true;
+}
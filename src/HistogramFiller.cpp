@@ -0,0 +1,341 @@
+#include <HistogramFiller.hpp>
+
+#include <mensura/core/FileInPath.hpp>
+#include <mensura/core/Processor.hpp>
+#include <mensura/core/ROOTLock.hpp>
+
+#include <mensura/extensions/TFileService.hpp>
+
+#include <TH1.h>
+
+#include <boost/property_tree/json_parser.hpp>
+#include <boost/property_tree/ptree.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+
+HistogramFiller::HistogramFiller(std::string const &configPath,
+  std::string const &name /*= "HistogramFiller"*/):
+    AnalysisPlugin(name),
+    fileServiceName("TFileService"), fileService(nullptr),
+    writerName("NtupleWriter")
+{
+    namespace pt = boost::property_tree;
+    std::string const resolvedPath(FileInPath::Resolve(configPath));
+    pt::ptree config;
+    
+    try
+    {
+        pt::read_json(resolvedPath, config);
+    }
+    catch (pt::json_parser_error const &error)
+    {
+        std::ostringstream message;
+        message << "HistogramFiller[\"" << GetName() << "\"]::HistogramFiller: Failed to parse " <<
+          "file \"" << resolvedPath << "\": " << error.what();
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Read the list of weights
+    if (auto const weightsNode = config.get_child_optional("weights"))
+    {
+        for (auto const &entry: *weightsNode)
+            weightColumns.emplace_back(entry.second.get_value<std::string>());
+    }
+    
+    
+    // Read descriptions of histograms
+    auto const histogramsNode = config.get_child_optional("histograms");
+    
+    if (not histogramsNode or histogramsNode->empty())
+    {
+        std::ostringstream message;
+        message << "HistogramFiller[\"" << GetName() << "\"]::HistogramFiller: File \"" <<
+          resolvedPath << "\" does not describe any histograms.";
+        throw std::runtime_error(message.str());
+    }
+    
+    for (auto const &entry: *histogramsNode)
+    {
+        auto const &node = entry.second;
+        Histogram histogram;
+        
+        histogram.observable = node.get<std::string>("observable", "");
+        histogram.name = node.get<std::string>("name", histogram.observable);
+        
+        if (histogram.observable.empty())
+        {
+            std::ostringstream message;
+            message << "HistogramFiller[\"" << GetName() << "\"]::HistogramFiller: A " <<
+              "histogram in file \"" << resolvedPath << "\" does not specify the observable.";
+            throw std::runtime_error(message.str());
+        }
+        
+        
+        // Binning is given either by the number of bins and the range or by explicit edges
+        if (auto const edgesNode = node.get_child_optional("binEdges"))
+        {
+            for (auto const &edge: *edgesNode)
+                histogram.binEdges.emplace_back(edge.second.get_value<double>());
+            
+            histogram.uniform = false;
+        }
+        else if (auto const rangeNode = node.get_child_optional("range"))
+        {
+            unsigned const numBins = node.get<unsigned>("bins", 0);
+            std::vector<double> range;
+            
+            for (auto const &bound: *rangeNode)
+                range.emplace_back(bound.second.get_value<double>());
+            
+            if (numBins > 0 and range.size() == 2)
+            {
+                for (unsigned i = 0; i <= numBins; ++i)
+                    histogram.binEdges.emplace_back(
+                      range[0] + (range[1] - range[0]) * i / numBins);
+            }
+            
+            histogram.uniform = true;
+        }
+        
+        // Edges must be strictly increasing
+        if (histogram.binEdges.size() < 2 or
+          std::adjacent_find(histogram.binEdges.begin(), histogram.binEdges.end(),
+          [](double a, double b){return a >= b;}) != histogram.binEdges.end())
+        {
+            std::ostringstream message;
+            message << "HistogramFiller[\"" << GetName() << "\"]::HistogramFiller: Binning " <<
+              "of histogram \"" << histogram.name << "\" in file \"" << resolvedPath <<
+              "\" is not valid.";
+            throw std::runtime_error(message.str());
+        }
+        
+        histograms.emplace_back(std::move(histogram));
+    }
+}
+
+
+HistogramFiller::HistogramFiller(HistogramFiller const &src):
+    AnalysisPlugin(src),
+    fileServiceName(src.fileServiceName), fileService(nullptr),
+    writerName(src.writerName),
+    weightColumns(src.weightColumns),
+    histograms(src.histograms)
+{}
+
+
+void HistogramFiller::BeginRun(Dataset const &)
+{
+    fileService = dynamic_cast<TFileService const *>(GetMaster().GetService(fileServiceName));
+    
+    
+    // Find source buffers of all columns. The writer is executed before this plugin, but it is
+    //not a dependency in the sense of the processing path
+    auto const *writer = dynamic_cast<NtupleWriter const *>(GetMaster().GetPlugin(writerName));
+    
+    weightSources.clear();
+    weightLabels.clear();
+    
+    for (unsigned iColumn = 0; iColumn < weightColumns.size(); ++iColumn)
+    {
+        auto const &column = weightColumns[iColumn];
+        
+        // Alternative weights are not available for some datasets
+        if (iColumn > 0 and not writer->HasColumn(column))
+            continue;
+        
+        auto const source = writer->GetColumnSource(column);
+        weightSources.emplace_back(source);
+        
+        for (unsigned i = 0; i < source.length; ++i)
+        {
+            if (weightLabels.empty())
+                weightLabels.emplace_back("");
+            else
+                weightLabels.emplace_back("_" + column +
+                  ((source.length > 1) ? std::to_string(i) : ""));
+        }
+    }
+    
+    // Without weights, histograms are filled with unit weights
+    if (weightLabels.empty())
+        weightLabels.emplace_back("");
+    
+    weights.assign(weightLabels.size(), 1.);
+    
+    
+    for (auto &histogram: histograms)
+    {
+        histogram.source = writer->GetColumnSource(histogram.observable);
+        
+        if (histogram.source.length != 1)
+        {
+            std::ostringstream message;
+            message << "HistogramFiller[\"" << GetName() << "\"]::BeginRun: Observable \"" <<
+              histogram.observable << "\" for histogram \"" << histogram.name << "\" is not " <<
+              "a scalar.";
+            throw std::runtime_error(message.str());
+        }
+        
+        // Number of bins including the underflow and the overflow
+        unsigned const numBins = histogram.binEdges.size() + 1;
+        histogram.sumW.assign(numBins * weights.size(), 0.);
+        histogram.sumW2.assign(numBins * weights.size(), 0.);
+        histogram.numEntries = 0;
+    }
+}
+
+
+Plugin *HistogramFiller::Clone() const
+{
+    return new HistogramFiller(*this);
+}
+
+
+void HistogramFiller::EndRun()
+{
+    unsigned const numWeights = weights.size();
+    
+    for (auto const &histogram: histograms)
+    {
+        // Create all histograms first since TFileService takes the ROOT lock on its own
+        int const numBins = histogram.binEdges.size() - 1;
+        std::vector<TH1D *> outHists;
+        
+        for (auto const &label: weightLabels)
+            outHists.emplace_back(fileService->Create<TH1D>("", (histogram.name + label).c_str(),
+              histogram.observable.c_str(), numBins, histogram.binEdges.data()));
+        
+        ROOTLock::Lock();
+        
+        for (unsigned iWeight = 0; iWeight < numWeights; ++iWeight)
+        {
+            TH1D *hist = outHists[iWeight];
+            
+            for (int bin = 0; bin <= numBins + 1; ++bin)
+            {
+                unsigned const index = bin * numWeights + iWeight;
+                hist->SetBinContent(bin, histogram.sumW[index]);
+                hist->SetBinError(bin, std::sqrt(histogram.sumW2[index]));
+            }
+            
+            hist->SetEntries(histogram.numEntries);
+        }
+        
+        ROOTLock::Unlock();
+    }
+}
+
+
+void HistogramFiller::SetUnweighted()
+{
+    weightColumns.clear();
+}
+
+
+unsigned HistogramFiller::FindBin(Histogram const &histogram, double value)
+{
+    auto const &edges = histogram.binEdges;
+    
+    if (value < edges.front())
+        return 0;
+    
+    if (value >= edges.back())
+        return edges.size();
+    
+    if (histogram.uniform)
+    {
+        unsigned const numBins = edges.size() - 1;
+        unsigned const bin = (value - edges.front()) / (edges.back() - edges.front()) * numBins;
+        
+        // Protect against rounding at the upper edge
+        return std::min(bin, numBins - 1) + 1;
+    }
+    else
+        return std::upper_bound(edges.begin(), edges.end(), value) - edges.begin();
+}
+
+
+double HistogramFiller::ReadValue(NtupleWriter::ColumnSource const &source, unsigned index)
+{
+    switch (source.typeCode)
+    {
+        case 'B':
+            return static_cast<Char_t const *>(source.buffer)[index];
+        
+        case 'b':
+            return static_cast<UChar_t const *>(source.buffer)[index];
+        
+        case 'S':
+            return static_cast<Short_t const *>(source.buffer)[index];
+        
+        case 's':
+            return static_cast<UShort_t const *>(source.buffer)[index];
+        
+        case 'I':
+            return static_cast<Int_t const *>(source.buffer)[index];
+        
+        case 'i':
+            return static_cast<UInt_t const *>(source.buffer)[index];
+        
+        case 'L':
+            return static_cast<Long64_t const *>(source.buffer)[index];
+        
+        case 'l':
+            return static_cast<ULong64_t const *>(source.buffer)[index];
+        
+        case 'F':
+            return static_cast<Float_t const *>(source.buffer)[index];
+        
+        case 'D':
+            return static_cast<Double_t const *>(source.buffer)[index];
+        
+        case 'O':
+            return static_cast<Bool_t const *>(source.buffer)[index];
+    }
+    
+    return 0.;
+}
+
+
+bool HistogramFiller::ProcessEvent()
+{
+    // Collect all weights for the current event
+    unsigned iWeight = 0;
+    
+    for (auto const &source: weightSources)
+        for (unsigned i = 0; i < source.length; ++i)
+            weights[iWeight++] = ReadValue(source, i);
+    
+    
+    unsigned const numWeights = weights.size();
+    
+    for (auto &histogram: histograms)
+    {
+        double const value = ReadValue(histogram.source, 0);
+        
+        // Undefined values are not counted
+        if (std::isnan(value))
+            continue;
+        
+        ++histogram.numEntries;
+        
+        unsigned const offset = FindBin(histogram, value) * numWeights;
+        double *sumW = histogram.sumW.data() + offset;
+        double *sumW2 = histogram.sumW2.data() + offset;
+        
+        for (unsigned i = 0; i < numWeights; ++i)
+        {
+            sumW[i] += weights[i];
+            sumW2[i] += weights[i] * weights[i];
+        }
+    }
+    
+    
+    // Always return true since this plugin does not perform event filtering
+    return true;
+}
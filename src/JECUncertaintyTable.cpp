@@ -0,0 +1,177 @@
+#include <JECUncertaintyTable.hpp>
+
+#include <StartupProfile.hpp>
+
+#include <mensura/core/FileInPath.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+
+JECUncertaintyTable::JECUncertaintyTable(std::string const &path_):
+    path(path_)
+{
+    std::ifstream file(path);
+    
+    if (not file)
+    {
+        std::ostringstream message;
+        message << "JECUncertaintyTable::JECUncertaintyTable: Failed to open file \"" << path <<
+          "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    std::string line;
+    
+    while (std::getline(file, line))
+    {
+        auto const firstChar = line.find_first_not_of(" \t");
+        
+        // Skip empty lines, comments, and headers that describe the format of each section
+        if (firstChar == std::string::npos or line[firstChar] == '#' or line[firstChar] == '{')
+            continue;
+        
+        if (line[firstChar] == '[')
+        {
+            auto const closeBracket = line.find(']', firstChar);
+            
+            if (closeBracket == std::string::npos)
+            {
+                std::ostringstream message;
+                message << "JECUncertaintyTable::JECUncertaintyTable: Failed to parse line \"" <<
+                  line << "\" in file \"" << path << "\".";
+                throw std::runtime_error(message.str());
+            }
+            
+            sources.emplace_back();
+            sources.back().name = line.substr(firstChar + 1, closeBracket - firstChar - 1);
+            continue;
+        }
+        
+        
+        // This is a bin in eta. The file may contain a single unnamed source
+        if (sources.empty())
+            sources.emplace_back();
+        
+        std::istringstream lineStream(line);
+        Bin bin;
+        unsigned numValues = 0;
+        lineStream >> bin.etaMin >> bin.etaMax >> numValues;
+        
+        // Values are read with strtod since some files contain NaN, which streams do not accept.
+        //Undefined uncertainties are replaced with ones from the previous node
+        for (unsigned i = 0; i < numValues / 3; ++i)
+        {
+            std::string text[3];
+            lineStream >> text[0] >> text[1] >> text[2];
+            double const pt = std::strtod(text[0].c_str(), nullptr);
+            double up = std::strtod(text[1].c_str(), nullptr);
+            double down = std::strtod(text[2].c_str(), nullptr);
+            
+            if (std::isnan(up) or std::isnan(down))
+            {
+                up = (bin.up.empty()) ? 0. : bin.up.back();
+                down = (bin.down.empty()) ? 0. : bin.down.back();
+            }
+            
+            bin.pt.emplace_back(pt);
+            bin.up.emplace_back(up);
+            bin.down.emplace_back(down);
+        }
+        
+        if (not lineStream or numValues == 0 or numValues % 3 != 0 or
+          not std::is_sorted(bin.pt.begin(), bin.pt.end()))
+        {
+            std::ostringstream message;
+            message << "JECUncertaintyTable::JECUncertaintyTable: Failed to parse line \"" <<
+              line << "\" in file \"" << path << "\".";
+            throw std::runtime_error(message.str());
+        }
+        
+        sources.back().bins.emplace_back(std::move(bin));
+    }
+    
+    for (auto const &source: sources)
+    {
+        if (source.bins.empty())
+        {
+            std::ostringstream message;
+            message << "JECUncertaintyTable::JECUncertaintyTable: Source \"" << source.name <<
+              "\" in file \"" << path << "\" does not contain any bins.";
+            throw std::runtime_error(message.str());
+        }
+    }
+}
+
+
+double JECUncertaintyTable::Eval(unsigned sourceIndex, double eta, double pt, bool up) const
+{
+    auto const &bins = sources[sourceIndex].bins;
+    
+    
+    // Find the bin in eta. Values outside of the range are assigned to the closest bin
+    auto binIt = std::upper_bound(bins.begin(), bins.end(), eta,
+      [](double value, Bin const &bin){return value < bin.etaMax;});
+    
+    if (binIt == bins.end())
+        --binIt;
+    
+    Bin const &bin = *binIt;
+    auto const &unc = (up) ? bin.up : bin.down;
+    
+    
+    // Interpolate in pt
+    if (pt <= bin.pt.front())
+        return unc.front();
+    
+    if (pt >= bin.pt.back())
+        return unc.back();
+    
+    unsigned const i = std::upper_bound(bin.pt.begin(), bin.pt.end(), pt) - bin.pt.begin();
+    double const t = (pt - bin.pt[i - 1]) / (bin.pt[i] - bin.pt[i - 1]);
+    
+    return unc[i - 1] + t * (unc[i] - unc[i - 1]);
+}
+
+
+std::shared_ptr<JECUncertaintyTable const> JECUncertaintyTable::Get(std::string const &path)
+{
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_ptr<JECUncertaintyTable const>> tables;
+    
+    std::string const resolvedPath(FileInPath::Resolve("JERC/", path));
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &table = tables[resolvedPath];
+    
+    if (not table)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        table.reset(new JECUncertaintyTable(resolvedPath));
+        StartupProfile::RecordLazyLoad("JEC uncertainties " + path,
+          std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    
+    return table;
+}
+
+
+unsigned JECUncertaintyTable::GetSourceIndex(std::string const &name) const
+{
+    for (unsigned i = 0; i < sources.size(); ++i)
+    {
+        if (sources[i].name == name)
+            return i;
+    }
+    
+    std::ostringstream message;
+    message << "JECUncertaintyTable::GetSourceIndex: Source \"" << name << "\" is not found " <<
+      "in file \"" << path << "\".";
+    throw std::runtime_error(message.str());
+}
@@ -0,0 +1,374 @@
+#include <JERCFormula.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdlib>
+#include <sstream>
+#include <stdexcept>
+
+
+JERCFormula::JERCFormula(std::string const &expression_):
+    expression(expression_), position(0),
+    stackDepth(0), maxDepth(0),
+    numVariables(0), numParameters(0)
+{
+    ParseExpression();
+    
+    if (not Peek('\0'))
+        Fail("Unexpected character");
+    
+    if (maxDepth > maxStackDepth)
+        Fail("Expression is too deeply nested");
+}
+
+
+double JERCFormula::Eval(double const *variables, double const *parameters) const
+{
+    double stack[maxStackDepth];
+    unsigned top = 0;
+    
+    for (auto const &instr: program)
+    {
+        switch (instr.op)
+        {
+            case Op::Constant:
+                stack[top++] = instr.value;
+                break;
+            
+            case Op::Variable:
+                stack[top++] = variables[instr.index];
+                break;
+            
+            case Op::Parameter:
+                stack[top++] = parameters[instr.index];
+                break;
+            
+            case Op::Add:
+                --top;
+                stack[top - 1] += stack[top];
+                break;
+            
+            case Op::Subtract:
+                --top;
+                stack[top - 1] -= stack[top];
+                break;
+            
+            case Op::Multiply:
+                --top;
+                stack[top - 1] *= stack[top];
+                break;
+            
+            case Op::Divide:
+                --top;
+                stack[top - 1] /= stack[top];
+                break;
+            
+            case Op::Power:
+                --top;
+                stack[top - 1] = std::pow(stack[top - 1], stack[top]);
+                break;
+            
+            case Op::Max:
+                --top;
+                stack[top - 1] = std::max(stack[top - 1], stack[top]);
+                break;
+            
+            case Op::Min:
+                --top;
+                stack[top - 1] = std::min(stack[top - 1], stack[top]);
+                break;
+            
+            case Op::Negate:
+                stack[top - 1] = -stack[top - 1];
+                break;
+            
+            case Op::Abs:
+                stack[top - 1] = std::abs(stack[top - 1]);
+                break;
+            
+            case Op::Exp:
+                stack[top - 1] = std::exp(stack[top - 1]);
+                break;
+            
+            case Op::Log:
+                stack[top - 1] = std::log(stack[top - 1]);
+                break;
+            
+            case Op::Log10:
+                stack[top - 1] = std::log10(stack[top - 1]);
+                break;
+            
+            case Op::Sqrt:
+                stack[top - 1] = std::sqrt(stack[top - 1]);
+                break;
+        }
+    }
+    
+    return stack[0];
+}
+
+
+unsigned JERCFormula::GetNumParameters() const
+{
+    return numParameters;
+}
+
+
+unsigned JERCFormula::GetNumVariables() const
+{
+    return numVariables;
+}
+
+
+void JERCFormula::Emit(Op op, unsigned index /*= 0*/, double value /*= 0.*/)
+{
+    program.emplace_back(Instruction{op, index, value});
+    
+    switch (op)
+    {
+        case Op::Constant:
+        case Op::Variable:
+        case Op::Parameter:
+            ++stackDepth;
+            maxDepth = std::max(maxDepth, stackDepth);
+            break;
+        
+        case Op::Add:
+        case Op::Subtract:
+        case Op::Multiply:
+        case Op::Divide:
+        case Op::Power:
+        case Op::Max:
+        case Op::Min:
+            --stackDepth;
+            break;
+        
+        default:
+            break;
+    }
+}
+
+
+void JERCFormula::ParseExpression()
+{
+    ParseTerm();
+    
+    while (true)
+    {
+        if (Peek('+'))
+        {
+            ++position;
+            ParseTerm();
+            Emit(Op::Add);
+        }
+        else if (Peek('-'))
+        {
+            ++position;
+            ParseTerm();
+            Emit(Op::Subtract);
+        }
+        else
+            break;
+    }
+}
+
+
+void JERCFormula::ParseTerm()
+{
+    ParseFactor();
+    
+    while (true)
+    {
+        if (Peek('*'))
+        {
+            ++position;
+            ParseFactor();
+            Emit(Op::Multiply);
+        }
+        else if (Peek('/'))
+        {
+            ++position;
+            ParseFactor();
+            Emit(Op::Divide);
+        }
+        else
+            break;
+    }
+}
+
+
+void JERCFormula::ParseFactor()
+{
+    if (Peek('-'))
+    {
+        ++position;
+        ParseFactor();
+        Emit(Op::Negate);
+        return;
+    }
+    
+    if (Peek('+'))
+    {
+        ++position;
+        ParseFactor();
+        return;
+    }
+    
+    ParsePrimary();
+    
+    // Exponentiation is right-associative
+    if (Peek('^'))
+    {
+        ++position;
+        ParseFactor();
+        Emit(Op::Power);
+    }
+}
+
+
+void JERCFormula::ParsePrimary()
+{
+    if (Peek('('))
+    {
+        ++position;
+        ParseExpression();
+        Expect(')');
+        return;
+    }
+    
+    
+    // Parameter
+    if (Peek('['))
+    {
+        ++position;
+        char const *begin = expression.c_str() + position;
+        char *end;
+        unsigned long const index = std::strtoul(begin, &end, 10);
+        
+        if (end == begin)
+            Fail("Index of parameter expected");
+        
+        position += end - begin;
+        Expect(']');
+        
+        Emit(Op::Parameter, index);
+        numParameters = std::max<unsigned>(numParameters, index + 1);
+        return;
+    }
+    
+    
+    // Number
+    if (position < expression.size() and
+      (std::isdigit(expression[position]) or expression[position] == '.'))
+    {
+        char const *begin = expression.c_str() + position;
+        char *end;
+        double const value = std::strtod(begin, &end);
+        position += end - begin;
+        
+        Emit(Op::Constant, 0, value);
+        return;
+    }
+    
+    
+    // Variable or function. Names may include a namespace qualifier
+    std::string::size_type const begin = position;
+    
+    while (position < expression.size() and (std::isalnum(expression[position]) or
+      expression[position] == '_' or expression[position] == ':'))
+        ++position;
+    
+    std::string name(expression.substr(begin, position - begin));
+    
+    if (name.empty())
+        Fail("Operand expected");
+    
+    if (name.compare(0, 7, "TMath::") == 0)
+        name = name.substr(7);
+    
+    std::string const variableNames("xyzt");
+    
+    if (name.size() == 1 and variableNames.find(name[0]) != std::string::npos)
+    {
+        unsigned const index = variableNames.find(name[0]);
+        Emit(Op::Variable, index);
+        numVariables = std::max(numVariables, index + 1);
+        return;
+    }
+    
+    
+    // Function calls
+    Op op;
+    unsigned numArgs = 1;
+    
+    if (name == "abs" or name == "fabs" or name == "Abs")
+        op = Op::Abs;
+    else if (name == "exp" or name == "Exp")
+        op = Op::Exp;
+    else if (name == "log" or name == "Log")
+        op = Op::Log;
+    else if (name == "log10" or name == "Log10")
+        op = Op::Log10;
+    else if (name == "sqrt" or name == "Sqrt")
+        op = Op::Sqrt;
+    else if (name == "pow" or name == "Power")
+    {
+        op = Op::Power;
+        numArgs = 2;
+    }
+    else if (name == "max" or name == "Max")
+    {
+        op = Op::Max;
+        numArgs = 2;
+    }
+    else if (name == "min" or name == "Min")
+    {
+        op = Op::Min;
+        numArgs = 2;
+    }
+    else
+        Fail("Unknown function \"" + name + "\"");
+    
+    Expect('(');
+    ParseExpression();
+    
+    for (unsigned i = 1; i < numArgs; ++i)
+    {
+        Expect(',');
+        ParseExpression();
+    }
+    
+    Expect(')');
+    Emit(op);
+}
+
+
+bool JERCFormula::Peek(char c)
+{
+    while (position < expression.size() and std::isspace(expression[position]))
+        ++position;
+    
+    if (position == expression.size())
+        return (c == '\0');
+    
+    return (expression[position] == c);
+}
+
+
+void JERCFormula::Expect(char c)
+{
+    if (not Peek(c))
+        Fail(std::string("Character '") + c + "' expected");
+    
+    ++position;
+}
+
+
+void JERCFormula::Fail(std::string const &what) const
+{
+    std::ostringstream message;
+    message << "JERCFormula::JERCFormula: " << what << " at position " << position <<
+      " in expression \"" << expression << "\".";
+    throw std::runtime_error(message.str());
+}
@@ -0,0 +1,231 @@
+#include <JERCTable.hpp>
+
+#include <StartupProfile.hpp>
+
+#include <mensura/core/FileInPath.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+
+
+JERCTable::JERCTable(std::string const &path)
+{
+    std::ifstream file(path);
+    
+    if (not file)
+    {
+        std::ostringstream message;
+        message << "JERCTable::JERCTable: Failed to open file \"" << path << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Parse the header, which is enclosed in braces
+    std::string line;
+    std::getline(file, line);
+    auto const openBrace = line.find('{'), closeBrace = line.rfind('}');
+    
+    if (openBrace == std::string::npos or closeBrace == std::string::npos or
+      closeBrace < openBrace)
+    {
+        std::ostringstream message;
+        message << "JERCTable::JERCTable: File \"" << path << "\" does not start with a valid " <<
+          "header.";
+        throw std::runtime_error(message.str());
+    }
+    
+    std::istringstream header(line.substr(openBrace + 1, closeBrace - openBrace - 1));
+    unsigned numBinVariables = 0, numFormulaVariables = 0;
+    std::string name;
+    
+    header >> numBinVariables;
+    
+    for (unsigned i = 0; i < numBinVariables and header >> name; ++i)
+        binVariables.emplace_back(ParseVariable(name, path));
+    
+    header >> numFormulaVariables;
+    
+    // A table without formula variables names a single dummy one
+    if (numFormulaVariables == 0)
+        header >> name;
+    
+    for (unsigned i = 0; i < numFormulaVariables and header >> name; ++i)
+        formulaVariables.emplace_back(ParseVariable(name, path));
+    
+    std::string expression;
+    
+    if (numFormulaVariables > 0)
+        header >> expression;
+    
+    if (not header or numBinVariables == 0 or binVariables.size() != numBinVariables or
+      formulaVariables.size() != numFormulaVariables or numFormulaVariables > numVariables)
+    {
+        std::ostringstream message;
+        message << "JERCTable::JERCTable: Failed to parse header in file \"" << path << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    if (not expression.empty())
+    {
+        formula.reset(new JERCFormula(expression));
+        
+        if (formula->GetNumVariables() > numFormulaVariables)
+        {
+            std::ostringstream message;
+            message << "JERCTable::JERCTable: Formula in file \"" << path << "\" uses more " <<
+              "variables than declared.";
+            throw std::runtime_error(message.str());
+        }
+    }
+    
+    
+    // Read the bins
+    while (std::getline(file, line))
+    {
+        std::istringstream lineStream(line);
+        Bin bin;
+        bin.lower.resize(numBinVariables);
+        bin.upper.resize(numBinVariables);
+        
+        for (unsigned i = 0; i < numBinVariables; ++i)
+            lineStream >> bin.lower[i] >> bin.upper[i];
+        
+        unsigned numValues = 0;
+        lineStream >> numValues;
+        
+        // Skip empty lines
+        if (not lineStream)
+            continue;
+        
+        bin.values.resize(numValues);
+        
+        for (auto &value: bin.values)
+            lineStream >> value;
+        
+        if (not lineStream or numValues < 2 * numFormulaVariables or (formula and
+          numValues < 2 * numFormulaVariables + formula->GetNumParameters()))
+        {
+            std::ostringstream message;
+            message << "JERCTable::JERCTable: Failed to parse line \"" << line << "\" in file \"" <<
+              path << "\".";
+            throw std::runtime_error(message.str());
+        }
+        
+        if (bins.empty() or bin.lower[0] != bins.back().lower[0])
+        {
+            groupStarts.emplace_back(bins.size());
+            groupLowerEdges.emplace_back(bin.lower[0]);
+        }
+        
+        bins.emplace_back(std::move(bin));
+    }
+    
+    groupStarts.emplace_back(bins.size());
+    
+    if (bins.empty() or not std::is_sorted(groupLowerEdges.begin(), groupLowerEdges.end()))
+    {
+        std::ostringstream message;
+        message << "JERCTable::JERCTable: File \"" << path << "\" does not contain valid bins.";
+        throw std::runtime_error(message.str());
+    }
+}
+
+
+double JERCTable::Eval(double const *variables, double fallback, unsigned paramIndex /*= 0*/)
+  const
+{
+    Bin const *bin = FindBin(variables);
+    
+    if (not bin)
+        return fallback;
+    
+    if (not formula)
+        return bin->values[paramIndex];
+    
+    
+    // Clamp values of formula variables to their ranges
+    double x[numVariables];
+    unsigned const numFormulaVariables = formulaVariables.size();
+    
+    for (unsigned i = 0; i < numFormulaVariables; ++i)
+        x[i] = std::min(std::max(variables[formulaVariables[i]], bin->values[2 * i]),
+          bin->values[2 * i + 1]);
+    
+    return formula->Eval(x, bin->values.data() + 2 * numFormulaVariables);
+}
+
+
+std::shared_ptr<JERCTable const> JERCTable::Get(std::string const &path)
+{
+    static std::mutex mutex;
+    static std::map<std::string, std::shared_ptr<JERCTable const>> tables;
+    
+    std::string const resolvedPath(FileInPath::Resolve("JERC/", path));
+    std::lock_guard<std::mutex> lock(mutex);
+    auto &table = tables[resolvedPath];
+    
+    if (not table)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        table.reset(new JERCTable(resolvedPath));
+        StartupProfile::RecordLazyLoad("JERC table " + path,
+          std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+    }
+    
+    return table;
+}
+
+
+JERCTable::Bin const *JERCTable::FindBin(double const *variables) const
+{
+    // Find the group of bins in the first variable with a binary search
+    double const value = variables[binVariables[0]];
+    auto const groupIt = std::upper_bound(groupLowerEdges.begin(), groupLowerEdges.end(), value);
+    
+    if (groupIt == groupLowerEdges.begin())
+        return nullptr;
+    
+    unsigned const group = groupIt - groupLowerEdges.begin() - 1;
+    
+    
+    // Within the group, check the remaining variables
+    for (unsigned iBin = groupStarts[group]; iBin < groupStarts[group + 1]; ++iBin)
+    {
+        Bin const &bin = bins[iBin];
+        bool inside = true;
+        
+        for (unsigned i = 0; i < binVariables.size() and inside; ++i)
+        {
+            double const v = variables[binVariables[i]];
+            inside = (v >= bin.lower[i] and v < bin.upper[i]);
+        }
+        
+        if (inside)
+            return &bin;
+    }
+    
+    return nullptr;
+}
+
+
+JERCTable::Variable JERCTable::ParseVariable(std::string const &name, std::string const &path)
+{
+    if (name == "JetEta")
+        return JetEta;
+    else if (name == "JetPt")
+        return JetPt;
+    else if (name == "JetA")
+        return JetA;
+    else if (name == "Rho")
+        return Rho;
+    
+    std::ostringstream message;
+    message << "JERCTable::ParseVariable: Variable \"" << name << "\" used in file \"" << path <<
+      "\" is not supported.";
+    throw std::runtime_error(message.str());
+}
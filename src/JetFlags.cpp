@@ -0,0 +1,148 @@
+#include <JetFlags.hpp>
+
+#include <mensura/core/BTagWPService.hpp>
+#include <mensura/core/JetMETReader.hpp>
+#include <mensura/core/PhysicsObjects.hpp>
+#include <mensura/core/Processor.hpp>
+
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+
+/// Checks if the two b-tagging working points are the same
+static bool SameBTagger(BTagger const &a, BTagger const &b)
+{
+    return (a.GetAlgorithm() == b.GetAlgorithm() and a.GetWorkingPoint() == b.GetWorkingPoint());
+}
+
+
+JetFlags::JetFlags(std::string const &name /*= "JetFlags"*/):
+    AnalysisPlugin(name),
+    bTagWPServiceName("BTagWP"), bTagWPService(nullptr),
+    jetmetPluginName("JetMET"), jetmetPlugin(nullptr),
+    maxAbsEtaReco(2.4),
+    ht(0.)
+{}
+
+
+JetFlags::JetFlags(JetFlags const &src):
+    AnalysisPlugin(src),
+    bTaggers(src.bTaggers),
+    bTagWPServiceName(src.bTagWPServiceName), bTagWPService(nullptr),
+    jetmetPluginName(src.jetmetPluginName), jetmetPlugin(nullptr),
+    maxAbsEtaReco(src.maxAbsEtaReco),
+    ht(0.)
+{}
+
+
+void JetFlags::AddBTagger(BTagger const &bTagger)
+{
+    for (auto const &b: bTaggers)
+    {
+        if (SameBTagger(b, bTagger))
+            return;
+    }
+    
+    if (bTaggers.size() == maxBTaggers)
+    {
+        std::ostringstream message;
+        message << "JetFlags[\"" << GetName() << "\"]::AddBTagger: Cannot register more than " <<
+          maxBTaggers << " b-tagging working points.";
+        throw std::runtime_error(message.str());
+    }
+    
+    bTaggers.emplace_back(bTagger);
+}
+
+
+void JetFlags::BeginRun(Dataset const &)
+{
+    bTagWPService = dynamic_cast<BTagWPService const *>(GetMaster().GetService(bTagWPServiceName));
+    jetmetPlugin = dynamic_cast<JetMETReader const *>(GetDependencyPlugin(jetmetPluginName));
+}
+
+
+Plugin *JetFlags::Clone() const
+{
+    return new JetFlags(*this);
+}
+
+
+std::uint32_t JetFlags::GetBTagMask(BTagger const &bTagger) const
+{
+    for (unsigned i = 0; i < bTaggers.size(); ++i)
+    {
+        if (SameBTagger(bTaggers[i], bTagger))
+            return std::uint32_t(1) << (firstBTagBit + i);
+    }
+    
+    std::ostringstream message;
+    message << "JetFlags[\"" << GetName() << "\"]::GetBTagMask: Requested b-tagging working " <<
+      "point has not been registered.";
+    throw std::runtime_error(message.str());
+}
+
+
+std::vector<std::uint32_t> const &JetFlags::GetFlags() const
+{
+    return flags;
+}
+
+
+double JetFlags::GetHt() const
+{
+    return ht;
+}
+
+
+void JetFlags::SetJetMETPluginName(std::string const &pluginName)
+{
+    jetmetPluginName = pluginName;
+}
+
+
+void JetFlags::SetRecoEtaRange(double maxAbsEta)
+{
+    maxAbsEtaReco = maxAbsEta;
+}
+
+
+bool JetFlags::ProcessEvent()
+{
+    allocationCheck.Begin();
+    
+    auto const &jets = jetmetPlugin->GetJets();
+    flags.resize(jets.size());
+    ht = 0.;
+    
+    for (unsigned i = 0; i < jets.size(); ++i)
+    {
+        auto const &jet = jets[i];
+        double const pt = jet.Pt();
+        std::uint32_t f = 0;
+        
+        if (pt > 20.)
+            f |= Pt20;
+        
+        if (pt > 30.)
+            f |= Pt30;
+        
+        if (std::abs(jet.Eta()) <= maxAbsEtaReco)
+            f |= RecoEta;
+        
+        for (unsigned iTagger = 0; iTagger < bTaggers.size(); ++iTagger)
+        {
+            if (bTagWPService->IsTagged(bTaggers[iTagger], jet))
+                f |= std::uint32_t(1) << (firstBTagBit + iTagger);
+        }
+        
+        flags[i] = f;
+        ht += pt;
+    }
+    
+    allocationCheck.End(GetName());
+    
+    // Always return true since this plugin does not perform event filtering
+    return true;
+}
@@ -0,0 +1,277 @@
+#include <JetMETCorrector.hpp>
+
+#include <JECUncertaintyTable.hpp>
+#include <JERCTable.hpp>
+#include <SkimWriter.hpp>
+
+#include <mensura/core/PileUpReader.hpp>
+#include <mensura/core/Processor.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+
+JetMETCorrector::JetMETCorrector(std::string const &name /*= "JetMET"*/):
+    JetMETReader(name),
+    jetmetPluginName("OrigJetMET"), jetmetPlugin(nullptr),
+    puPluginName("PileUp"), puPlugin(nullptr),
+    jecSourceIndex(0), jecDirection(SystService::VarDirection::Undefined),
+    jerSFIndex(0),
+    minPt(0.), maxAbsEta(std::numeric_limits<double>::infinity()),
+    metJetPtThreshold(15.), metUnclDirection(SystService::VarDirection::Undefined)
+{}
+
+
+JetMETCorrector::JetMETCorrector(JetMETCorrector const &src):
+    JetMETReader(src),
+    jetmetPluginName(src.jetmetPluginName), jetmetPlugin(nullptr),
+    puPluginName(src.puPluginName), puPlugin(nullptr),
+    jecPaths(src.jecPaths),
+    jecUncertaintyPath(src.jecUncertaintyPath), jecSource(src.jecSource),
+    jerSFPath(src.jerSFPath), jerResolutionPath(src.jerResolutionPath),
+    jecLevels(src.jecLevels),
+    jecUncertainty(src.jecUncertainty), jecSourceIndex(src.jecSourceIndex),
+    jecDirection(src.jecDirection),
+    jerSF(src.jerSF), jerResolution(src.jerResolution), jerSFIndex(src.jerSFIndex),
+    minPt(src.minPt), maxAbsEta(src.maxAbsEta),
+    metJetPtThreshold(src.metJetPtThreshold), metUnclDirection(src.metUnclDirection)
+{}
+
+
+void JetMETCorrector::BeginRun(Dataset const &dataset)
+{
+    if (jecPaths.empty())
+    {
+        std::ostringstream message;
+        message << "JetMETCorrector[\"" << GetName() << "\"]::BeginRun: No jet energy " <<
+          "corrections have been specified.";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Obtain parameterizations when the first dataset is processed. They are parsed by the first
+    //plugin that requests them and then shared
+    if (jecLevels.empty())
+    {
+        for (auto const &path: jecPaths)
+            jecLevels.emplace_back(JERCTable::Get(path));
+        
+        if (not jecUncertaintyPath.empty())
+        {
+            jecUncertainty = JECUncertaintyTable::Get(jecUncertaintyPath);
+            jecSourceIndex = jecUncertainty->GetSourceIndex(jecSource);
+        }
+        
+        if (not jerSFPath.empty())
+        {
+            jerSF = JERCTable::Get(jerSFPath);
+            jerResolution = JERCTable::Get(jerResolutionPath);
+        }
+    }
+    
+    
+    jetmetPlugin = dynamic_cast<JetMETReader const *>(GetDependencyPlugin(jetmetPluginName));
+    puPlugin = dynamic_cast<PileUpReader const *>(GetDependencyPlugin(puPluginName));
+    
+    randomEngine.seed(SkimWriter::GetInputHash(dataset));
+}
+
+
+Plugin *JetMETCorrector::Clone() const
+{
+    return new JetMETCorrector(*this);
+}
+
+
+std::vector<JetMETCorrector::Corrections> const &JetMETCorrector::GetCorrections() const
+{
+    return corrections;
+}
+
+
+double JetMETCorrector::GetJetRadius() const
+{
+    return jetmetPlugin->GetJetRadius();
+}
+
+
+void JetMETCorrector::SetJEC(std::vector<std::string> const &paths)
+{
+    jecPaths = paths;
+    jecLevels.clear();
+}
+
+
+void JetMETCorrector::SetJECVariation(std::string const &path, std::string const &source,
+  SystService::VarDirection direction)
+{
+    jecUncertaintyPath = path;
+    jecSource = (source.empty()) ? "Total" : source;
+    jecDirection = direction;
+    jecLevels.clear();
+}
+
+
+void JetMETCorrector::SetJER(std::string const &sfPath, std::string const &resolutionPath,
+  SystService::VarDirection direction /*= SystService::VarDirection::Undefined*/)
+{
+    jerSFPath = sfPath;
+    jerResolutionPath = resolutionPath;
+    jecLevels.clear();
+    
+    // Columns in files with scale factors are nominal, down, and up
+    if (direction == SystService::VarDirection::Down)
+        jerSFIndex = 1;
+    else if (direction == SystService::VarDirection::Up)
+        jerSFIndex = 2;
+    else
+        jerSFIndex = 0;
+}
+
+
+void JetMETCorrector::SetMETUnclVariation(SystService::VarDirection direction)
+{
+    metUnclDirection = direction;
+}
+
+
+void JetMETCorrector::SetJetMETReaderName(std::string const &pluginName)
+{
+    jetmetPluginName = pluginName;
+}
+
+
+void JetMETCorrector::SetPileUpReaderName(std::string const &pluginName)
+{
+    puPluginName = pluginName;
+}
+
+
+void JetMETCorrector::SetSelection(double minPt_, double maxAbsEta_)
+{
+    minPt = minPt_;
+    maxAbsEta = maxAbsEta_;
+}
+
+
+bool JetMETCorrector::ProcessEvent()
+{
+    unsortedJets.clear();
+    unsortedCorrections.clear();
+    
+    double variables[JERCTable::numVariables];
+    variables[JERCTable::Rho] = puPlugin->GetRho();
+    
+    // Shift of MET due to corrections of jets
+    double metShiftX = 0., metShiftY = 0.;
+    
+    for (auto const &srcJet: jetmetPlugin->GetJets())
+    {
+        TLorentzVector const rawP4(srcJet.RawP4());
+        double const rawPt = rawP4.Pt();
+        
+        variables[JERCTable::JetEta] = rawP4.Eta();
+        variables[JERCTable::JetA] = srcJet.GetArea();
+        variables[JERCTable::JetPt] = rawPt;
+        
+        
+        // Apply levels of JEC one after another. Each level is evaluated at pt corrected with
+        //the preceding ones
+        Corrections corr;
+        corr.l1 = jecLevels.front()->Eval(variables, 1.);
+        corr.full = corr.l1;
+        
+        for (unsigned i = 1; i < jecLevels.size(); ++i)
+        {
+            variables[JERCTable::JetPt] = rawPt * corr.full;
+            corr.full *= jecLevels[i]->Eval(variables, 1.);
+        }
+        
+        if (jecUncertainty)
+        {
+            bool const up = (jecDirection == SystService::VarDirection::Up);
+            double const unc = jecUncertainty->Eval(jecSourceIndex, variables[JERCTable::JetEta],
+              rawPt * corr.full, up);
+            corr.full *= (up) ? 1. + unc : 1. - unc;
+        }
+        
+        double const ptNoSmear = rawPt * corr.full;
+        variables[JERCTable::JetPt] = ptNoSmear;
+        
+        
+        // Propagate the corrections into MET
+        if (ptNoSmear > metJetPtThreshold)
+        {
+            metShiftX += (corr.full - corr.l1) * rawP4.Px();
+            metShiftY += (corr.full - corr.l1) * rawP4.Py();
+        }
+        
+        
+        // JER smearing
+        corr.jer = 1.;
+        
+        if (jerSF)
+        {
+            double const sf = jerSF->Eval(variables, 1., jerSFIndex);
+            GenJet const *genJet = srcJet.MatchedGenJet();
+            
+            if (genJet)
+                corr.jer = 1. + (sf - 1.) * (ptNoSmear - genJet->Pt()) / ptNoSmear;
+            else if (sf > 1.)
+            {
+                double const resolution = jerResolution->Eval(variables, 0.);
+                std::normal_distribution<double> gaus(0., resolution * std::sqrt(sf * sf - 1.));
+                corr.jer = 1. + gaus(randomEngine);
+            }
+            
+            corr.jer = std::max(corr.jer, 0.);
+        }
+        
+        
+        // Apply the kinematic selection
+        double const factor = corr.full * corr.jer;
+        TLorentzVector const p4(rawP4 * factor);
+        
+        if (p4.Pt() < minPt or std::abs(p4.Eta()) > maxAbsEta)
+            continue;
+        
+        unsortedJets.emplace_back(srcJet);
+        unsortedJets.back().SetCorrectedP4(p4, 1. / factor);
+        unsortedCorrections.emplace_back(corr);
+    }
+    
+    
+    // Sort jets in pt. Ties are resolved with the original order to make the result reproducible
+    order.resize(unsortedJets.size());
+    
+    for (unsigned i = 0; i < order.size(); ++i)
+        order[i] = i;
+    
+    std::sort(order.begin(), order.end(), [this](unsigned a, unsigned b)
+      {
+          double const ptA = unsortedJets[a].Pt(), ptB = unsortedJets[b].Pt();
+          return (ptA > ptB or (ptA == ptB and a < b));
+      });
+    
+    jets.clear();
+    corrections.clear();
+    
+    for (unsigned i: order)
+    {
+        jets.emplace_back(unsortedJets[i]);
+        corrections.emplace_back(unsortedCorrections[i]);
+    }
+    
+    
+    // Corrected MET. If requested, start from raw MET with varied unclustered energy
+    MET const &srcMET = jetmetPlugin->GetMET();
+    TLorentzVector const &rawMET = (metUnclDirection == SystService::VarDirection::Undefined) ?
+      srcMET.P4() : srcMET.P4(MET::SystType::UnclEnergy, metUnclDirection);
+    double const metX = rawMET.Px() - metShiftX, metY = rawMET.Py() - metShiftY;
+    met.SetPxPyPzE(metX, metY, 0., std::hypot(metX, metY));
+    
+    return true;
+}
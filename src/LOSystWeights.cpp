@@ -4,19 +4,26 @@
 #include <mensura/core/FileInPath.hpp>
 #include <mensura/core/GeneratorReader.hpp>
 
+#include <StartupProfile.hpp>
+
 #include <LHAPDF/LHAPDF.h>
 
+#include <chrono>
 #include <cmath>
+#include <sstream>
+#include <stdexcept>
 
 
 LOSystWeights::LOSystWeights(std::string const &name, unsigned nQCDVert_,
-  std::string const &pdfSetName):
+  std::string const &pdfSetName_):
     EventWeightPlugin(name),
     generatorReaderName("Generator"), generatorReader(nullptr),
-    datasetMasks({std::regex(".*")}), processCurDataset(false),
-    scaleVarFactor(2.),
+    datasetSelector(new DatasetSelector), processCurDataset(false),
+    scaleVarFactor(2.), logScaleVarFactor(std::log(scaleVarFactor)),
     nQCDVert(nQCDVert_),
-    pdfSet(LHAPDF::mkPDF(pdfSetName, 0))
+    pdfSetName(pdfSetName_),
+    sharedGrid(new SharedGrid),
+    checkTolerance(0.)
 {}
 
 
@@ -28,29 +35,19 @@ LOSystWeights::LOSystWeights(unsigned nQCDVert, std::string const &pdfSetName):
 LOSystWeights::LOSystWeights(LOSystWeights const &src):
     EventWeightPlugin(src),
     generatorReaderName(src.generatorReaderName), generatorReader(nullptr),
-    datasetMasks(src.datasetMasks), processCurDataset(src.processCurDataset),
-    scaleVarFactor(src.scaleVarFactor),
+    datasetSelector(src.datasetSelector), processCurDataset(src.processCurDataset),
+    scaleVarFactor(src.scaleVarFactor), logScaleVarFactor(src.logScaleVarFactor),
     nQCDVert(src.nQCDVert),
-    pdfSet(src.pdfSet)
+    pdfSetName(src.pdfSetName),
+    sharedGrid(src.sharedGrid),
+    checkTolerance(src.checkTolerance)
 {}
 
 
 void LOSystWeights::BeginRun(Dataset const &dataset)
 {
-    std::string const &datasetID = dataset.GetSourceDatasetID();
-    
-    
     // Check if weights need to be computed for the current dataset
-    processCurDataset = false;
-    
-    for (auto const &mask: datasetMasks)
-    {
-        if (std::regex_match(datasetID, mask))
-        {
-            processCurDataset = true;
-            break;
-        }
-    }
+    processCurDataset = datasetSelector->IsSelected(dataset.GetSourceDatasetID());
     
     
     if (processCurDataset)
@@ -59,6 +56,17 @@ void LOSystWeights::BeginRun(Dataset const &dataset)
         generatorReader =
           dynamic_cast<GeneratorReader const *>(GetDependencyPlugin(generatorReaderName));
         
+        // Load the PDF set and build the interpolation grid if this has not been done yet by any
+        //clone. The lower boundary in Q is chosen above the threshold of b quarks.
+        std::call_once(sharedGrid->built, [this]()
+        {
+            auto const start = std::chrono::steady_clock::now();
+            sharedGrid->pdfSet.reset(LHAPDF::mkPDF(pdfSetName, 0));
+            sharedGrid->grid.reset(new PdfGrid(sharedGrid->pdfSet, 10., 1e4));
+            StartupProfile::RecordLazyLoad("PDF set " + pdfSetName + " and its PdfGrid",
+              std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count());
+        });
+        
         weights.resize(5);
         weights[0] = 1.;
     }
@@ -78,21 +86,23 @@ Plugin *LOSystWeights::Clone() const
 
 void LOSystWeights::SelectDatasets(std::initializer_list<std::string> const &masks)
 {
-    datasetMasks.clear();
-    
-    for (auto const &mask: masks)
-        datasetMasks.emplace_back(mask);
+    datasetSelector.reset(new DatasetSelector(masks));
 }
 
 
-double LOSystWeights::AlphaS(double scale)
+void LOSystWeights::SetAccuracyCheck(double tolerance)
+{
+    checkTolerance = tolerance;
+}
+
+
+double LOSystWeights::AlphaS(double logScale)
 {
     double const alpha0 = 0.1184;
-    double const mZ = 91.1876;
     unsigned const nf = 4;
     
     double const b0 = (33 - 2 * nf) / (12 * M_PI);
-    return alpha0 / (1 + alpha0 * b0 * 2 * std::log(scale / mZ));
+    return alpha0 / (1 + alpha0 * b0 * 2 * logScale);
 }
 
 
@@ -107,24 +117,57 @@ bool LOSystWeights::ProcessEvent()
     unsigned iVar;
     
     
-    // Variation of renormalization scale
+    // Variation of renormalization scale. The logarithm of the scale is only computed once
     iVar = 0;
-    double const alphaSNominal = AlphaS(scale);
-    weights.at(1 + 2 * iVar) = std::pow(AlphaS(scale * scaleVarFactor) / alphaSNominal, 2);
-    weights.at(2 + 2 * iVar) = std::pow(AlphaS(scale / scaleVarFactor) / alphaSNominal, 2);
+    double const mZ = 91.1876;
+    double const logScale = std::log(scale / mZ);
+    double const alphaSNominal = AlphaS(logScale);
+    weights.at(1 + 2 * iVar) =
+      std::pow(AlphaS(logScale + logScaleVarFactor) / alphaSNominal, 2);
+    weights.at(2 + 2 * iVar) =
+      std::pow(AlphaS(logScale - logScaleVarFactor) / alphaSNominal, 2);
     
     
-    // Variation of factorization scale
+    // Variation of factorization scale. For each parton, the three scales are evaluated together
+    //so that the interpolation along x is only done once.
     iVar = 1;
     int const id1 = generatorReader->GetPdfPart().first;
     int const id2 = generatorReader->GetPdfPart().second;
     double const &x1 = generatorReader->GetPdfX().first, x2 = generatorReader->GetPdfX().second;
     
-    double const pdfNominal = pdfSet->xfxQ(id1, x1, scale) * pdfSet->xfxQ(id2, x2, scale);
-    weights.at(1 + 2 * iVar) = pdfSet->xfxQ(id1, x1, scale * scaleVarFactor) * \
-      pdfSet->xfxQ(id2, x2, scale * scaleVarFactor) / pdfNominal;
-    weights.at(2 + 2 * iVar) = pdfSet->xfxQ(id1, x1, scale / scaleVarFactor) * \
-      pdfSet->xfxQ(id2, x2, scale / scaleVarFactor) / pdfNominal;
+    double const scales[3] = {scale, scale * scaleVarFactor, scale / scaleVarFactor};
+    double pdf1[3], pdf2[3];
+    sharedGrid->grid->Evaluate(id1, x1, 3, scales, pdf1);
+    sharedGrid->grid->Evaluate(id2, x2, 3, scales, pdf2);
+    
+    double const pdfNominal = pdf1[0] * pdf2[0];
+    weights.at(1 + 2 * iVar) = pdf1[1] * pdf2[1] / pdfNominal;
+    weights.at(2 + 2 * iVar) = pdf1[2] * pdf2[2] / pdfNominal;
+    
+    
+    // Compare to direct evaluation if requested
+    if (checkTolerance > 0.)
+    {
+        LHAPDF::PDF const &pdfSet = *sharedGrid->pdfSet;
+        double const pdfNominalDirect = pdfSet.xfxQ(id1, x1, scale) * pdfSet.xfxQ(id2, x2, scale);
+        
+        for (unsigned iScale = 1; iScale < 3; ++iScale)
+        {
+            double const weightDirect = pdfSet.xfxQ(id1, x1, scales[iScale]) *
+              pdfSet.xfxQ(id2, x2, scales[iScale]) / pdfNominalDirect;
+            double const weightGrid = weights.at(iScale + 2 * iVar);
+            
+            if (std::abs(weightGrid - weightDirect) > checkTolerance * std::abs(weightDirect))
+            {
+                std::ostringstream message;
+                message << "LOSystWeights[\"" << GetName() << "\"]::ProcessEvent: Weight " <<
+                  weightGrid << " computed with PdfGrid differs from weight " << weightDirect <<
+                  " obtained with LHAPDF directly for partons " << id1 << " and " << id2 <<
+                  " with x = " << x1 << " and " << x2 << " at scale " << scales[iScale] << ".";
+                throw std::runtime_error(message.str());
+            }
+        }
+    }
     
     
     return true;
@@ -0,0 +1,198 @@
+#include <LikelihoodFile.hpp>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <tuple>
+
+
+char const LikelihoodFile::magic[8] = {'T', 'T', 'R', 'L', 'L', 'H', '\0', '\0'};
+
+
+LikelihoodFile::LikelihoodFile(std::string const &path_):
+    path(path_)
+{
+    mapping = Map(path, size);
+    char const *data = static_cast<char const *>(mapping.get());
+    
+    
+    // Check the header
+    Header header;
+    
+    if (size >= sizeof(header))
+        std::memcpy(&header, data, sizeof(header));
+    
+    if (size < sizeof(header) or std::memcmp(header.magic, magic, sizeof(magic)) != 0 or
+      header.version != version or size < sizeof(header) + header.numTables * sizeof(Entry))
+    {
+        std::ostringstream message;
+        message << "LikelihoodFile::LikelihoodFile: File \"" << path << "\" is not a valid " <<
+          "likelihood file or has been written with an unsupported version of the format.";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Read the directory
+    for (unsigned i = 0; i < header.numTables; ++i)
+    {
+        Entry entry;
+        std::memcpy(&entry, data + sizeof(header) + i * sizeof(Entry), sizeof(Entry));
+        
+        if (entry.offset % 8 != 0 or entry.offset + entry.size > size)
+        {
+            std::ostringstream message;
+            message << "LikelihoodFile::LikelihoodFile: Directory of tables in file \"" << path <<
+              "\" is corrupted.";
+            throw std::runtime_error(message.str());
+        }
+        
+        entry.name[sizeof(entry.name) - 1] = '\0';
+        tables[entry.name] = {entry.offset, entry.size};
+    }
+}
+
+
+std::shared_ptr<LogLikelihoodTable const> LikelihoodFile::GetTable(std::string const &name) const
+{
+    auto const res = tables.find(name);
+    
+    if (res == tables.end())
+    {
+        std::ostringstream message;
+        message << "LikelihoodFile::GetTable: File \"" << path << "\" does not contain table \"" <<
+          name << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    char const *data = static_cast<char const *>(mapping.get());
+    return std::make_shared<LogLikelihoodTable const>(mapping, data + res->second.first,
+      res->second.second);
+}
+
+
+void LikelihoodFile::Write(std::string const &path,
+  std::vector<std::pair<std::string, LogLikelihoodTable const *>> const &tables)
+{
+    // The file is written under a temporary name and then renamed, so that existing mappings of
+    //an older version of the file remain valid
+    std::string const tmpPath(path + ".tmp");
+    std::ofstream out(tmpPath, std::ios::binary | std::ios::trunc);
+    
+    if (not out)
+    {
+        std::ostringstream message;
+        message << "LikelihoodFile::Write: Failed to open file \"" << tmpPath << "\" for " <<
+          "writing.";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Write the header and reserve space for the directory, which will be written when the sizes
+    //of all tables are known. Serialized tables have sizes multiple of 8 bytes, and so their
+    //offsets are aligned properly.
+    Header header;
+    std::memcpy(header.magic, magic, sizeof(magic));
+    header.version = version;
+    header.numTables = tables.size();
+    out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    
+    std::vector<Entry> directory(tables.size());
+    out.write(reinterpret_cast<char const *>(directory.data()), directory.size() * sizeof(Entry));
+    std::uint64_t offset = sizeof(header) + directory.size() * sizeof(Entry);
+    
+    for (unsigned i = 0; i < tables.size(); ++i)
+    {
+        std::string const &name = tables[i].first;
+        
+        if (name.size() >= sizeof(Entry::name))
+        {
+            std::ostringstream message;
+            message << "LikelihoodFile::Write: Name of table \"" << name << "\" is too long.";
+            throw std::runtime_error(message.str());
+        }
+        
+        Entry &entry = directory[i];
+        std::memset(entry.name, 0, sizeof(entry.name));
+        std::memcpy(entry.name, name.data(), name.size());
+        entry.offset = offset;
+        entry.size = tables[i].second->Serialize(out);
+        offset += entry.size;
+    }
+    
+    out.seekp(sizeof(header));
+    out.write(reinterpret_cast<char const *>(directory.data()), directory.size() * sizeof(Entry));
+    out.close();
+    
+    if (not out or std::rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        std::ostringstream message;
+        message << "LikelihoodFile::Write: Failed to write file \"" << path << "\".";
+        throw std::runtime_error(message.str());
+    }
+}
+
+
+std::shared_ptr<void const> LikelihoodFile::Map(std::string const &path, std::size_t &size)
+{
+    // Open the file and identify it. A mapping is only reused if the path still refers to the
+    //same file with the same modification time and size, so that a file that has been replaced
+    //or modified since it was mapped is mapped anew
+    int const fd = open(path.c_str(), O_RDONLY);
+    struct stat fileInfo;
+    
+    if (fd < 0 or fstat(fd, &fileInfo) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        
+        std::ostringstream message;
+        message << "LikelihoodFile::Map: Failed to open file \"" << path << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    using Key = std::tuple<std::string, dev_t, ino_t, time_t, off_t>;
+    Key const key(path, fileInfo.st_dev, fileInfo.st_ino, fileInfo.st_mtime, fileInfo.st_size);
+    
+    
+    // Existing mappings are tracked with weak pointers so that they are released as soon as all
+    //tables that use them are destroyed
+    static std::mutex registryMutex;
+    static std::map<Key, std::weak_ptr<void const>> registry;
+    
+    std::lock_guard<std::mutex> lock(registryMutex);
+    auto &record = registry[key];
+    std::shared_ptr<void const> mapping = record.lock();
+    size = fileInfo.st_size;
+    
+    if (mapping)
+    {
+        close(fd);
+        return mapping;
+    }
+    
+    
+    // Map the file
+    void *data = (size > 0) ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    
+    if (data == MAP_FAILED)
+    {
+        std::ostringstream message;
+        message << "LikelihoodFile::Map: Failed to map file \"" << path << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    std::size_t const mappedSize = size;
+    mapping.reset(data, [mappedSize](void const *p){munmap(const_cast<void *>(p), mappedSize);});
+    record = mapping;
+    
+    return mapping;
+}
@@ -0,0 +1,265 @@
+#include <LogLikelihoodTable.hpp>
+
+#include <SimdSupport.hpp>
+
+#include <TAxis.h>
+#include <TH1.h>
+
+#include <ostream>
+#include <stdexcept>
+#include <vector>
+
+#ifdef TTRES_AVX2_DISPATCH
+    #include <immintrin.h>
+#endif
+
+
+LogLikelihoodTable::Axis::Axis(TAxis const &axis):
+    nBins(axis.GetNbins()),
+    min(axis.GetXmin()), max(axis.GetXmax()),
+    uniform(axis.GetXbins()->GetSize() == 0), edges(nullptr)
+{}
+
+
+LogLikelihoodTable::Axis::Axis(AxisRecord const &record):
+    nBins(record.nBins),
+    min(record.min), max(record.max),
+    uniform(record.uniform != 0), edges(nullptr)
+{}
+
+
+LogLikelihoodTable::LogLikelihoodTable(TH1 const &hist):
+    dimension(hist.GetDimension()),
+    xAxis(*hist.GetXaxis()), yAxis(*hist.GetYaxis())
+{
+    if (dimension != 1 and dimension != 2)
+        throw std::runtime_error("LogLikelihoodTable::LogLikelihoodTable: Only one- and "
+          "two-dimensional histograms are supported.");
+    
+    
+    // A one-dimensional histogram only contains a single row of bins. Its y axis is never used
+    //in the lookup
+    unsigned const nCellsY = (dimension == 1) ? 1 : yAxis.nBins + 2;
+    
+    
+    // Bin edges of non-uniform axes and values are stored in a single array, in the same order
+    //as in a serialized table
+    std::shared_ptr<std::vector<double>> data(new std::vector<double>);
+    TAxis const *srcAxes[] = {hist.GetXaxis(), hist.GetYaxis()};
+    Axis const *axes[] = {&xAxis, &yAxis};
+    
+    for (unsigned i = 0; i < 2; ++i)
+    {
+        if (not axes[i]->uniform)
+            for (unsigned bin = 1; bin <= axes[i]->nBins + 1; ++bin)
+                data->push_back(srcAxes[i]->GetBinLowEdge(bin));
+    }
+    
+    
+    // Copy logarithms of bin contents. Overflow bins are replaced by the sentinel
+    numValues = (xAxis.nBins + 2) * nCellsY;
+    
+    for (unsigned binY = 0; binY < nCellsY; ++binY)
+        for (unsigned binX = 0; binX < xAxis.nBins + 2; ++binX)
+        {
+            unsigned const bin = binX + (xAxis.nBins + 2) * binY;
+            
+            if (binX == xAxis.nBins + 1 or (dimension == 2 and binY == yAxis.nBins + 1))
+                data->push_back(std::numeric_limits<double>::quiet_NaN());
+            else
+                data->push_back(std::log(hist.GetBinContent(bin)));
+        }
+    
+    SetPointers(data->data());
+    storage = data;
+}
+
+
+LogLikelihoodTable::LogLikelihoodTable(std::shared_ptr<void const> const &storage_,
+  char const *block, std::size_t size):
+    xAxis(ReadHeader(block, size).xAxis), yAxis(ReadHeader(block, size).yAxis),
+    storage(storage_)
+{
+    auto const &header = ReadHeader(block, size);
+    dimension = header.dimension;
+    numValues = header.numValues;
+    
+    
+    // Make sure the description of the binning is consistent with the size of the block
+    unsigned const nCellsY = (dimension == 1) ? 1 : yAxis.nBins + 2;
+    std::size_t numWords = numValues;
+    
+    for (Axis const *axis: {&xAxis, &yAxis})
+    {
+        if (not axis->uniform)
+            numWords += axis->nBins + 1;
+    }
+    
+    if ((dimension != 1 and dimension != 2) or numValues != (xAxis.nBins + 2) * nCellsY or
+      size != sizeof(TableRecord) + numWords * sizeof(double))
+        throw std::runtime_error("LogLikelihoodTable::LogLikelihoodTable: Serialized table is "
+          "corrupted.");
+    
+    SetPointers(reinterpret_cast<double const *>(block + sizeof(TableRecord)));
+}
+
+
+double LogLikelihoodTable::GetMaxValue() const
+{
+    double maxValue = -std::numeric_limits<double>::infinity();
+    
+    for (double const *value = values; value != values + numValues; ++value)
+    {
+        if (not IsOverflow(*value) and *value > maxValue)
+            maxValue = *value;
+    }
+    
+    return maxValue;
+}
+
+
+std::size_t LogLikelihoodTable::Serialize(std::ostream &out) const
+{
+    TableRecord header;
+    header.dimension = dimension;
+    header.numValues = numValues;
+    header.xAxis = AxisRecord{xAxis.nBins, xAxis.uniform, xAxis.min, xAxis.max};
+    header.yAxis = AxisRecord{yAxis.nBins, yAxis.uniform, yAxis.min, yAxis.max};
+    
+    out.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    std::size_t size = sizeof(header);
+    
+    for (Axis const *axis: {&xAxis, &yAxis})
+    {
+        if (not axis->uniform)
+        {
+            out.write(reinterpret_cast<char const *>(axis->edges),
+              (axis->nBins + 1) * sizeof(double));
+            size += (axis->nBins + 1) * sizeof(double);
+        }
+    }
+    
+    out.write(reinterpret_cast<char const *>(values), numValues * sizeof(double));
+    size += numValues * sizeof(double);
+    
+    return size;
+}
+
+
+LogLikelihoodTable::TableRecord const &LogLikelihoodTable::ReadHeader(char const *block,
+  std::size_t size)
+{
+    if (size < sizeof(TableRecord) or reinterpret_cast<std::uintptr_t>(block) % 8 != 0)
+        throw std::runtime_error("LogLikelihoodTable::ReadHeader: Serialized table is too short "
+          "or not aligned to 8 bytes.");
+    
+    return *reinterpret_cast<TableRecord const *>(block);
+}
+
+
+void LogLikelihoodTable::SetPointers(double const *data)
+{
+    for (Axis *axis: {&xAxis, &yAxis})
+    {
+        if (not axis->uniform)
+        {
+            axis->edges = data;
+            data += axis->nBins + 1;
+        }
+    }
+    
+    values = data;
+}
+
+
+#ifdef TTRES_AVX2_DISPATCH
+/**
+ * \brief Finds bins for four values along a uniform axis using AVX2 instructions
+ * 
+ * Reproduces LogLikelihoodTable::Axis::FindBin. Bin indices are returned as doubles.
+ */
+__attribute__((target("avx2")))
+static __m256d FindBinAVX2(__m256d x, double min, double max, unsigned nBins)
+{
+    // Index of a regular bin, computed in the same way as in the scalar version. Clamping only
+    //affects lanes with underflow, overflow, or NaN, which are overwritten below
+    __m256d t = _mm256_div_pd(_mm256_mul_pd(_mm256_set1_pd(nBins),
+      _mm256_sub_pd(x, _mm256_set1_pd(min))), _mm256_set1_pd(max - min));
+    t = _mm256_min_pd(_mm256_max_pd(t, _mm256_setzero_pd()), _mm256_set1_pd(nBins));
+    __m256d bin = _mm256_add_pd(_mm256_round_pd(t, _MM_FROUND_TO_ZERO | _MM_FROUND_NO_EXC),
+      _mm256_set1_pd(1.));
+    
+    // Underflow and overflow. NaN is treated as overflow, same as in ROOT
+    __m256d const underflow = _mm256_cmp_pd(x, _mm256_set1_pd(min), _CMP_LT_OQ);
+    __m256d const overflow = _mm256_cmp_pd(x, _mm256_set1_pd(max), _CMP_NLT_UQ);
+    bin = _mm256_blendv_pd(bin, _mm256_setzero_pd(), underflow);
+    bin = _mm256_blendv_pd(bin, _mm256_set1_pd(nBins + 1.), overflow);
+    
+    return bin;
+}
+
+
+/// AVX2 version of a two-dimensional lookup
+__attribute__((target("avx2")))
+static void EvalBatchAVX2(unsigned n, double const *x, double const *y, double *out,
+  double const *values, double xMin, double xMax, unsigned xNBins, double yMin, double yMax,
+  unsigned yNBins)
+{
+    __m256d const rowLength = _mm256_set1_pd(xNBins + 2.);
+    for (unsigned i = 0; i + 4 <= n; i += 4)
+    {
+        __m256d const binX = FindBinAVX2(_mm256_loadu_pd(x + i), xMin, xMax, xNBins);
+        __m256d index = binX;
+        
+        if (y)
+        {
+            __m256d const binY = FindBinAVX2(_mm256_loadu_pd(y + i), yMin, yMax, yNBins);
+            index = _mm256_add_pd(binX, _mm256_mul_pd(rowLength, binY));
+        }
+        
+        // Use the masked version of the gather with the full mask since the unmasked one triggers
+        //a spurious warning in some versions of GCC
+        __m256d const all = _mm256_castsi256_pd(_mm256_set1_epi64x(-1));
+        _mm256_storeu_pd(out + i, _mm256_mask_i32gather_pd(_mm256_setzero_pd(), values,
+          _mm256_cvttpd_epi32(index), all, 8));
+    }
+    
+    // Remaining points are processed by the caller
+}
+#endif
+
+
+void LogLikelihoodTable::EvalBatch(unsigned n, double const *x, double *out) const
+{
+    unsigned nDone = 0;
+
+#ifdef TTRES_AVX2_DISPATCH
+    if (not xAxis.edges and IsAVX2Supported())
+    {
+        EvalBatchAVX2(n, x, nullptr, out, values, xAxis.min, xAxis.max, xAxis.nBins, 0., 0., 0);
+        nDone = n - n % 4;
+    }
+#endif
+
+    for (unsigned i = nDone; i < n; ++i)
+        out[i] = Eval(x[i]);
+}
+
+
+void LogLikelihoodTable::EvalBatch(unsigned n, double const *x, double const *y, double *out)
+  const
+{
+    unsigned nDone = 0;
+
+#ifdef TTRES_AVX2_DISPATCH
+    if (not xAxis.edges and not yAxis.edges and IsAVX2Supported())
+    {
+        EvalBatchAVX2(n, x, y, out, values, xAxis.min, xAxis.max, xAxis.nBins, yAxis.min,
+          yAxis.max, yAxis.nBins);
+        nDone = n - n % 4;
+    }
+#endif
+
+    for (unsigned i = nDone; i < n; ++i)
+        out[i] = Eval(x[i], y[i]);
+}
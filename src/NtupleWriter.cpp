@@ -0,0 +1,671 @@
+#include <NtupleWriter.hpp>
+
+#include <mensura/core/Processor.hpp>
+#include <mensura/core/ROOTLock.hpp>
+
+#include <mensura/extensions/TFileService.hpp>
+
+#include <TTree.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <stdexcept>
+
+
+/**
+ * \brief Accumulates statistics of waits for free blocks over clones of a plugin
+ * 
+ * The statistics are printed when the object is destroyed, i.e. when the last clone sharing it is
+ * destroyed.
+ */
+class NtupleWriter::AsyncStats
+{
+public:
+    AsyncStats(std::string const &pluginName);
+    
+    ~AsyncStats();
+    
+public:
+    /// Records that a block has been queued for writing
+    void AddBlock();
+    
+    /// Records a wait for a free block that lasted for the given time
+    void AddStall(std::chrono::nanoseconds duration);
+    
+private:
+    /// Name of the plugin
+    std::string pluginName;
+    
+    /// Numbers of queued blocks and waits for a free block
+    std::atomic<unsigned long> numBlocks, numStalls;
+    
+    /// Total time spent waiting for free blocks, in nanoseconds
+    std::atomic<unsigned long long> stallTime;
+};
+
+
+NtupleWriter::AsyncStats::AsyncStats(std::string const &pluginName_):
+    pluginName(pluginName_),
+    numBlocks(0), numStalls(0), stallTime(0)
+{}
+
+
+NtupleWriter::AsyncStats::~AsyncStats()
+{
+    if (numBlocks == 0)
+        return;
+    
+    std::ostringstream message;
+    message << "NtupleWriter[\"" << pluginName << "\"]: " << numBlocks << " blocks written " <<
+      "asynchronously. Event processing has waited for a free block " << numStalls <<
+      " times (" << std::fixed << std::setprecision(1) << 100. * numStalls / numBlocks <<
+      "% of blocks), for " << std::setprecision(3) << stallTime * 1e-9 << " s in total.\n";
+    std::cout << message.str() << std::flush;
+}
+
+
+void NtupleWriter::AsyncStats::AddBlock()
+{
+    ++numBlocks;
+}
+
+
+void NtupleWriter::AsyncStats::AddStall(std::chrono::nanoseconds duration)
+{
+    ++numStalls;
+    stallTime += duration.count();
+}
+
+
+NtupleWriter::NtupleWriter(std::string const &name /*= "NtupleWriter"*/,
+  std::string const &treeName_ /*= "Vars"*/):
+    AnalysisPlugin(name),
+    fileServiceName("TFileService"), fileService(nullptr),
+    treeName(treeName_),
+    basketSize(64000), autoFlush(-20000000), compressionSettings(-1),
+    blockSize(1024), writeTree(true),
+    numAsyncBlocks(0), currentBlock(0),
+    inRun(false), tree(nullptr), numBuffered(0)
+{}
+
+
+NtupleWriter::NtupleWriter(NtupleWriter const &src):
+    AnalysisPlugin(src),
+    fileServiceName(src.fileServiceName), fileService(nullptr),
+    treeName(src.treeName),
+    basketSize(src.basketSize), autoFlush(src.autoFlush),
+    compressionSettings(src.compressionSettings),
+    blockSize(src.blockSize), writeTree(src.writeTree),
+    numAsyncBlocks(src.numAsyncBlocks), currentBlock(0),
+    asyncStats(src.asyncStats),
+    inRun(false), tree(nullptr), numBuffered(0)
+{}
+
+
+NtupleWriter::~NtupleWriter() noexcept
+{
+    // The writing thread can still be running if processing has been aborted by an exception
+    if (asyncQueue and asyncQueue->thread.joinable())
+    {
+        {
+            std::lock_guard<std::mutex> lock(asyncQueue->mutex);
+            asyncQueue->stop = true;
+        }
+        
+        asyncQueue->condition.notify_all();
+        asyncQueue->thread.join();
+    }
+}
+
+
+void NtupleWriter::BeginRun(Dataset const &)
+{
+    fileService = dynamic_cast<TFileService const *>(GetMaster().GetService(fileServiceName));
+    inRun = true;
+    
+    if (not writeTree)
+        return;
+    
+    
+    // Allocate buffers for all columns
+    unsigned const numBlocks = std::max(numAsyncBlocks, 1u);
+    
+    for (auto &column: columns)
+    {
+        column.block.resize(numBlocks * blockSize * column.size);
+        column.row.resize(column.size);
+    }
+    
+    currentBlock = 0;
+    numBuffered = 0;
+    
+    
+    // Create the output tree
+    tree = fileService->Create<TTree>("", treeName.c_str(), "Event observables");
+    
+    ROOTLock::Lock();
+    
+    for (auto &column: columns)
+    {
+        TBranch *branch = tree->Branch(column.name.c_str(), column.row.data(),
+          column.leafList.c_str(), basketSize);
+        
+        if (compressionSettings >= 0)
+            branch->SetCompressionSettings(compressionSettings);
+    }
+    
+    tree->SetAutoFlush(autoFlush);
+    
+    ROOTLock::Unlock();
+    
+    
+    // Start the writing thread. It only accesses the tree after this point
+    if (numAsyncBlocks > 0)
+    {
+        asyncQueue.reset(new AsyncQueue);
+        asyncQueue->numEvents.assign(numAsyncBlocks, 0);
+        asyncQueue->numQueued = 0;
+        asyncQueue->nextToWrite = 0;
+        asyncQueue->stop = false;
+        asyncQueue->thread = std::thread(&NtupleWriter::WriteQueuedBlocks, this);
+    }
+}
+
+
+Plugin *NtupleWriter::Clone() const
+{
+    return new NtupleWriter(*this);
+}
+
+
+void NtupleWriter::EndRun()
+{
+    if (asyncQueue)
+    {
+        if (numBuffered > 0)
+            SubmitBlock();
+        
+        {
+            std::lock_guard<std::mutex> lock(asyncQueue->mutex);
+            asyncQueue->stop = true;
+        }
+        
+        asyncQueue->condition.notify_all();
+        asyncQueue->thread.join();
+        asyncQueue.reset();
+    }
+    else if (tree)
+        Flush();
+    
+    columns.clear();
+    inRun = false;
+    tree = nullptr;
+}
+
+
+NtupleWriter::ColumnSource NtupleWriter::GetColumnSource(std::string const &name) const
+{
+    for (auto const &column: columns)
+        if (column.name == name)
+            return ColumnSource{column.source, column.sourceType, column.length};
+    
+    std::ostringstream message;
+    message << "NtupleWriter[\"" << GetName() << "\"]::GetColumnSource: No column with name \"" <<
+      name << "\" has been registered.";
+    throw std::runtime_error(message.str());
+}
+
+
+bool NtupleWriter::HasColumn(std::string const &name) const
+{
+    for (auto const &column: columns)
+        if (column.name == name)
+            return true;
+    
+    return false;
+}
+
+
+void NtupleWriter::SetAsyncWriting(unsigned numBlocks, bool printStats /*= false*/)
+{
+    if (numBlocks == 1)
+    {
+        std::ostringstream message;
+        message << "NtupleWriter[\"" << GetName() << "\"]::SetAsyncWriting: At least two " <<
+          "blocks are needed for asynchronous writing.";
+        throw std::runtime_error(message.str());
+    }
+    
+    numAsyncBlocks = numBlocks;
+    
+    if (numAsyncBlocks > 0 and printStats)
+        asyncStats.reset(new AsyncStats(GetName()));
+    else
+        asyncStats.reset();
+}
+
+
+void NtupleWriter::SetBlockSize(unsigned blockSize_)
+{
+    if (blockSize_ == 0)
+    {
+        std::ostringstream message;
+        message << "NtupleWriter[\"" << GetName() << "\"]::SetBlockSize: Block size must be "
+          "positive.";
+        throw std::runtime_error(message.str());
+    }
+    
+    blockSize = blockSize_;
+}
+
+
+void NtupleWriter::SetCompression(Compression algorithm, int level)
+{
+    if (algorithm == Compression::Default)
+    {
+        compressionSettings = -1;
+        return;
+    }
+    
+    if (level < 0 or level > 9)
+    {
+        std::ostringstream message;
+        message << "NtupleWriter[\"" << GetName() << "\"]::SetCompression: Compression level " <<
+          level << " is outside of the allowed range from 0 to 9.";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Codes of the algorithms as defined in ROOT::ECompressionAlgorithm
+    int code = 0;
+    
+    switch (algorithm)
+    {
+        case Compression::ZLIB:
+            code = 1;
+            break;
+        
+        case Compression::LZMA:
+            code = 2;
+            break;
+        
+        case Compression::LZ4:
+            code = 4;
+            break;
+        
+        default:
+            break;
+    }
+    
+    compressionSettings = 100 * code + level;
+}
+
+
+void NtupleWriter::SetTreeParameters(int basketSize_, Long64_t autoFlush_)
+{
+    basketSize = basketSize_;
+    autoFlush = autoFlush_;
+}
+
+
+void NtupleWriter::SetTreeOutput(bool enable)
+{
+    writeTree = enable;
+}
+
+
+void NtupleWriter::Flush()
+{
+    WriteBlock(0, numBuffered);
+    numBuffered = 0;
+}
+
+
+void NtupleWriter::SubmitBlock()
+{
+    if (asyncStats)
+        asyncStats->AddBlock();
+    
+    std::unique_lock<std::mutex> lock(asyncQueue->mutex);
+    
+    asyncQueue->numEvents[currentBlock] = numBuffered;
+    ++asyncQueue->numQueued;
+    asyncQueue->condition.notify_all();
+    
+    currentBlock = (currentBlock + 1) % numAsyncBlocks;
+    numBuffered = 0;
+    
+    
+    // The next block is still queued if all blocks are. Wait until it has been written
+    if (asyncQueue->numQueued == numAsyncBlocks)
+    {
+        auto const start = std::chrono::steady_clock::now();
+        asyncQueue->condition.wait(lock,
+          [this](){return asyncQueue->numQueued < numAsyncBlocks;});
+        
+        if (asyncStats)
+            asyncStats->AddStall(std::chrono::steady_clock::now() - start);
+    }
+}
+
+
+void NtupleWriter::WriteBlock(unsigned blockIndex, unsigned numEvents)
+{
+    if (numEvents == 0)
+        return;
+    
+    ROOTLock::Lock();
+    
+    for (unsigned iEvent = blockIndex * blockSize; iEvent < blockIndex * blockSize + numEvents;
+      ++iEvent)
+    {
+        for (auto &column: columns)
+            std::memcpy(column.row.data(), column.block.data() + iEvent * column.size,
+              column.size);
+        
+        tree->Fill();
+    }
+    
+    ROOTLock::Unlock();
+}
+
+
+void NtupleWriter::WriteQueuedBlocks()
+{
+    std::unique_lock<std::mutex> lock(asyncQueue->mutex);
+    
+    while (true)
+    {
+        asyncQueue->condition.wait(lock,
+          [this](){return asyncQueue->numQueued > 0 or asyncQueue->stop;});
+        
+        // Stop only when all queued blocks have been written
+        if (asyncQueue->numQueued == 0)
+            break;
+        
+        unsigned const blockIndex = asyncQueue->nextToWrite;
+        unsigned const numEvents = asyncQueue->numEvents[blockIndex];
+        
+        lock.unlock();
+        WriteBlock(blockIndex, numEvents);
+        lock.lock();
+        
+        --asyncQueue->numQueued;
+        asyncQueue->nextToWrite = (blockIndex + 1) % numAsyncBlocks;
+        asyncQueue->condition.notify_all();
+    }
+}
+
+
+bool NtupleWriter::ProcessEvent()
+{
+    if (not tree)
+        return true;
+    
+    unsigned const offset = currentBlock * blockSize + numBuffered;
+    
+    for (auto &column: columns)
+        StoreValues(column, column.block.data() + offset * column.size);
+    
+    ++numBuffered;
+    
+    if (numBuffered == blockSize)
+    {
+        if (asyncQueue)
+            SubmitBlock();
+        else
+            Flush();
+    }
+    
+    return true;
+}
+
+
+void NtupleWriter::RegisterColumnImpl(std::string const &name, void const *source,
+  unsigned typeSize, char typeCode, unsigned length, ColumnKind kind, Schema const &schema) const
+{
+    if (inRun)
+    {
+        std::ostringstream message;
+        message << "NtupleWriter[\"" << GetName() << "\"]::RegisterColumn: Column \"" << name <<
+          "\" is registered after the output tree has been created. Make sure that this plugin "
+          "is executed after all plugins that register columns.";
+        throw std::runtime_error(message.str());
+    }
+    
+    for (auto const &column: columns)
+        if (column.name == name)
+        {
+            std::ostringstream message;
+            message << "NtupleWriter[\"" << GetName() << "\"]::RegisterColumn: Column \"" <<
+              name << "\" has already been registered.";
+            throw std::runtime_error(message.str());
+        }
+    
+    if (length == 0)
+    {
+        std::ostringstream message;
+        message << "NtupleWriter[\"" << GetName() << "\"]::RegisterColumn: Column \"" << name <<
+          "\" has zero length.";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    Column column;
+    column.name = name;
+    column.source = source;
+    column.sourceType = column.storedType = typeCode;
+    column.length = length;
+    column.mantissaMask = ~std::uint32_t(0);
+    unsigned storedTypeSize = typeSize;
+    
+    if (kind == ColumnKind::Kinematic)
+    {
+        if (typeCode != 'F')
+        {
+            std::ostringstream message;
+            message << "NtupleWriter[\"" << GetName() << "\"]::RegisterColumn: Kinematic " <<
+              "column \"" << name << "\" must be of type Float_t.";
+            throw std::runtime_error(message.str());
+        }
+        
+        if (schema.mantissaBits < 1 or schema.mantissaBits > 23)
+        {
+            std::ostringstream message;
+            message << "NtupleWriter[\"" << GetName() << "\"]::RegisterColumn: Cannot keep " <<
+              schema.mantissaBits << " mantissa bits in column \"" << name << "\". Allowed " <<
+              "values are from 1 to 23.";
+            throw std::runtime_error(message.str());
+        }
+        
+        column.mantissaMask <<= 23 - schema.mantissaBits;
+    }
+    else if (kind == ColumnKind::Count or kind == ColumnKind::Status)
+    {
+        if (std::string("bBsSiIlL").find(typeCode) == std::string::npos)
+        {
+            std::ostringstream message;
+            message << "NtupleWriter[\"" << GetName() << "\"]::RegisterColumn: Column \"" <<
+              name << "\" holds a counter or a status code and must be of an integer type.";
+            throw std::runtime_error(message.str());
+        }
+        
+        // Use a narrower type if requested, unless the source type is already narrow enough
+        unsigned const compactSize = (kind == ColumnKind::Count) ? 1 : 2;
+        
+        if (schema.compactIntegers and typeSize > compactSize)
+        {
+            column.storedType = (kind == ColumnKind::Count) ? 'b' : 's';
+            storedTypeSize = compactSize;
+        }
+    }
+    
+    column.size = storedTypeSize * length;
+    column.leafList = name + ((length > 1) ? "[" + std::to_string(length) + "]" : "") + "/" +
+      column.storedType;
+    
+    columns.emplace_back(std::move(column));
+}
+
+
+void NtupleWriter::StoreValues(Column const &column, char *destination)
+{
+    if (column.storedType == column.sourceType and column.mantissaMask == ~std::uint32_t(0))
+    {
+        std::memcpy(destination, column.source, column.size);
+        return;
+    }
+    
+    
+    if (column.storedType == 'F')
+    {
+        // This is a kinematic column with a truncated mantissa. Round to the nearest
+        //representable value, leaving infinities and NaN intact. If rounding overflows the
+        //mantissa, the carry correctly propagates into the exponent.
+        auto const *source = static_cast<Float_t const *>(column.source);
+        std::uint32_t const roundingBit = (~column.mantissaMask + 1) >> 1;
+        
+        for (unsigned i = 0; i < column.length; ++i)
+        {
+            std::uint32_t bits;
+            std::memcpy(&bits, source + i, sizeof(bits));
+            
+            if ((bits & 0x7F800000) != 0x7F800000)
+                bits = (bits + roundingBit) & column.mantissaMask;
+            
+            std::memcpy(destination + i * sizeof(bits), &bits, sizeof(bits));
+        }
+        
+        return;
+    }
+    
+    
+    // Otherwise this is an integer column stored with a narrower type. Values outside of the
+    //representable range are saturated.
+    long long const maxValue = (column.storedType == 'b') ? 0xFF : 0xFFFF;
+    
+    for (unsigned i = 0; i < column.length; ++i)
+    {
+        long long value = 0;
+        
+        switch (column.sourceType)
+        {
+            case 'S':
+                value = static_cast<Short_t const *>(column.source)[i];
+                break;
+            
+            case 's':
+                value = static_cast<UShort_t const *>(column.source)[i];
+                break;
+            
+            case 'I':
+                value = static_cast<Int_t const *>(column.source)[i];
+                break;
+            
+            case 'i':
+                value = static_cast<UInt_t const *>(column.source)[i];
+                break;
+            
+            case 'L':
+                value = static_cast<Long64_t const *>(column.source)[i];
+                break;
+            
+            case 'l':
+                value = std::min<ULong64_t>(static_cast<ULong64_t const *>(column.source)[i],
+                  maxValue);
+                break;
+        }
+        
+        value = std::max(std::min(value, maxValue), 0LL);
+        
+        if (column.storedType == 'b')
+            destination[i] = static_cast<UChar_t>(value);
+        else
+        {
+            UShort_t const storedValue = value;
+            std::memcpy(destination + i * sizeof(storedValue), &storedValue, sizeof(storedValue));
+        }
+    }
+}
+
+
+template<>
+char NtupleWriter::GetTypeCode<Char_t>()
+{
+    return 'B';
+}
+
+
+template<>
+char NtupleWriter::GetTypeCode<UChar_t>()
+{
+    return 'b';
+}
+
+
+template<>
+char NtupleWriter::GetTypeCode<Short_t>()
+{
+    return 'S';
+}
+
+
+template<>
+char NtupleWriter::GetTypeCode<UShort_t>()
+{
+    return 's';
+}
+
+
+template<>
+char NtupleWriter::GetTypeCode<Int_t>()
+{
+    return 'I';
+}
+
+
+template<>
+char NtupleWriter::GetTypeCode<UInt_t>()
+{
+    return 'i';
+}
+
+
+template<>
+char NtupleWriter::GetTypeCode<Long64_t>()
+{
+    return 'L';
+}
+
+
+template<>
+char NtupleWriter::GetTypeCode<ULong64_t>()
+{
+    return 'l';
+}
+
+
+template<>
+char NtupleWriter::GetTypeCode<Float_t>()
+{
+    return 'F';
+}
+
+
+template<>
+char NtupleWriter::GetTypeCode<Double_t>()
+{
+    return 'D';
+}
+
+
+template<>
+char NtupleWriter::GetTypeCode<Bool_t>()
+{
+    return 'O';
+}
@@ -1,7 +1,11 @@
 #include <NuRecoRochester.hpp>
 
-#include <TVector3.h>
+#include <NuKernels.hpp>
 
+#include <TMath.h>
+
+#include <algorithm>
+#include <array>
 #include <iostream>
 
 
@@ -11,109 +15,28 @@ using namespace TMath;
 
 NuRecoRochester::NuRecoRochester(TLorentzVector const *lep, TLorentzVector const *bjet,
   double MW, double MT):
+    Mn(0.),
     ERROR(false),
-    H(3, 3), T(3,1), MET(2, 1), VM(2, 2)
+    metX(0.), metY(0.),
+    vmXX(1.), vmXY(0.), vmYY(1.),
+    minimizer(Minimizer::StepHalving), tolerance(1e-5)
 {
-    Mt = MT;
-    Mw = MW;
-    Ml = lep->M();
-    Mb = bjet->M();
-    Mn = 0.;
-    TVector3 l(lep->Vect());
-    TVector3 b(bjet->Vect());
-
-    double pl = l.Mag();
-    double pb = b.Mag();
-    double El = Sqrt(Ml*Ml + pl*pl);
-    double Eb = Sqrt(Mb*Mb + pb*pb);
-
-    double cosbl = (l*b)/(pl*pb);
-    double sinbl = Sqrt(1.-cosbl*cosbl);
-
-    double betal = pl/El;
-    double betab = pb/Eb;
-    double gammali = Ml/El;
-    //double gammab = Eb/Mb;
-
-    double x0 = -0.5/El*(Mw*Mw - Ml*Ml - Mn*Mn);
-    double x0p = -0.5/Eb*(Mt*Mt - Mw*Mw - Mb*Mb);
-    double epsilon = (Mw*Mw - Mn*Mn)*gammali*gammali;
-    double Sx = (x0*betal - pl*gammali*gammali)/(betal*betal);
-    double Sy = 1./sinbl*(x0p/betab - cosbl*Sx);
-
-
-    double omega = 1./sinbl*(betal/betab - cosbl);
-    //double omega = -1./sinbl*(betal/betab + cosbl);
-
-    double OmegaS = omega*omega - gammali*gammali;
-    double Omega = Sqrt(OmegaS);
-
-    double x1 = Sx - (Sx + omega*Sy)/OmegaS;
-    double y1 = Sy - (Sx + omega*Sy)*omega/OmegaS;
-    double ZS = x1*x1*OmegaS - (Sy - omega*Sx)*(Sy - omega*Sx) - Mw*Mw + x0*x0 + epsilon*epsilon;
-
-
-    if(ZS < 0)
-    {
-        ERROR = true;
-        //omega = -1./sinbl*(betal/betab + cosbl);
-
-        //OmegaS = omega*omega - gammali*gammali;
-        //Omega = Sqrt(OmegaS);
-        //x1 = Sx - (Sx + omega*Sy)/OmegaS;
-        //y1 = Sy - (Sx + omega*Sy)*omega/OmegaS;
-        //ZS = x1*x1*OmegaS - (Sy - omega*Sx)*(Sy - omega*Sx) - Mw*Mw + x0*x0 + epsilon*epsilon;
-    }
-
-    double Z = Sqrt(ZS);
-
-    TMatrixD Ht(3, 3);
-    Ht(0, 0) = Z/Omega; 
-    Ht(1, 0) = Z*omega/Omega; 
-    Ht(2, 0) = 0.; 
-    Ht(0, 1) = 0.; 
-    Ht(1, 1) = 0.; 
-    Ht(2, 1) = Z; 
-    Ht(0, 2) = x1-pl; 
-    Ht(1, 2) = y1; 
-    Ht(2, 2) = 0.;
-
-    TVector3 bn(b);
-    TVector3 ln(l);
-    double w1 = ATan2(ln.Y(), ln.X());
-
-    //cout << "A" << endl;
-    //cout << bn.X() << " " << bn.Y() << " " << bn.Z() << endl;
-    //cout << ln.X() << " " << ln.Y() << " " << ln.Z() << endl;
-
-    bn.RotateZ(-1.*w1);
-    ln.RotateZ(-1.*w1);
-
-    //cout << "B" << endl;
-    //cout << bn.X() << " " << bn.Y() << " " << bn.Z() << endl;
-    //cout << ln.X() << " " << ln.Y() << " " << ln.Z() << endl;
-
-    double w2 = ATan2(ln.Z(), ln.X());
-
-    bn.RotateY(w2);
-    ln.RotateY(w2);
-    //cout << "C" << endl;
-    //cout << bn.X() << " " << bn.Y() << " " << bn.Z() << endl;
-    //cout << ln.X() << " " << ln.Y() << " " << ln.Z() << endl;
-    double w3 = ATan2(bn.Z(), bn.Y());
-
-    bn.RotateX(-1.*w3);
-    ln.RotateX(-1.*w3);
-
-    //cout << "D" << endl;
-    //cout << bn.X() << " " << bn.Y() << " " << bn.Z() << endl;
-    //cout << ln.X() << " " << ln.Y() << " " << ln.Z() << endl;
+    double const bPx = bjet->Px(), bPy = bjet->Py(), bPz = bjet->Pz(), bE = bjet->E();
+    bool reconstructable;
+    NuKernels::ComputeRochesterEllipses(lep->Px(), lep->Py(), lep->Pz(), lep->E(), 1,
+      &bPx, &bPy, &bPz, &bE, H.data(), &reconstructable, MW, MT);
+    ERROR = not reconstructable;
+}
 
-    TMatrixD R1(RotationZ(w1));
-    TMatrixD R2(RotationY(-1.*w2));
-    TMatrixD R3(RotationX(w3));
 
-    H=R1*R2*R3*Ht;
+NuRecoRochester::NuRecoRochester(double const *ellipse, bool reconstructable):
+    Mn(0.),
+    ERROR(not reconstructable),
+    metX(0.), metY(0.),
+    vmXX(1.), vmXY(0.), vmYY(1.),
+    minimizer(Minimizer::StepHalving), tolerance(1e-5)
+{
+    std::copy(ellipse, ellipse + NuKernels::ellipseSize, H.begin());
 }
 
 
@@ -121,17 +44,20 @@ TLorentzVector NuRecoRochester::GetBest(double metx, double mety, double metxerr
   double metxyrho, double &test, bool INFO)
 {
     if(ERROR){ test = -1; return(TLorentzVector(0.,0.,0.,0.));}
-
-    MET(0,0) = metx;
-    MET(1,0) = mety;
-
-    VM(0,0) = metxerr*metxerr;
-    VM(1,1) = metyerr*metyerr;
-    VM(1,0) = metxerr*metyerr*metxyrho;
-    VM(0,1) = metxerr*metyerr*metxyrho;
-        
-    VM.Invert();
-
+    
+    metX = metx;
+    metY = mety;
+    
+    // Invert the MET error matrix in a closed form
+    double const vXX = metxerr*metxerr;
+    double const vYY = metyerr*metyerr;
+    double const vXY = metxerr*metyerr*metxyrho;
+    double const det = vXX*vYY - vXY*vXY;
+    
+    vmXX = vYY/det;
+    vmYY = vXX/det;
+    vmXY = -vXY/det;
+    
     if(INFO)
     {
     for(double tb = 0 ; tb < 6.4 ; tb+=0.1)
@@ -142,11 +68,24 @@ TLorentzVector NuRecoRochester::GetBest(double metx, double mety, double metxerr
         cout << tb << " " << test << " " << tv.Px() << " " << tv.Py()  << " " << tv.Pz() << endl;
     }
     }
-
+    
+    if (minimizer == Minimizer::Analytic)
+    {
+        pair<double, double> const minimum = MinimizeAnalytic();
+        
+        if (minimum.second >= 0.)
+        {
+            test = minimum.second;
+            return(GetSolution(minimum.first));
+        }
+        
+        // Otherwise fall back to the step-halving algorithm below
+    }
+    
     pair<double, double> maximum = Extrem(0., false);
     pair<double, double> minimuma = Extrem(maximum.first+0.1, true);
     pair<double, double> minimumb = Extrem(maximum.first-0.1, true);
-
+    
     if(minimuma.second > minimumb.second)
     {
         test = minimumb.second;
@@ -166,104 +105,57 @@ bool NuRecoRochester::IsReconstructable() const
 }
 
 
-TMatrixD NuRecoRochester::RotationX(double a)
-{
-    double ca = Cos(a);
-    double sa = Sin(a);
-    TMatrixD D(3, 3);
-    D(0, 0) = 1.; 
-    D(1, 0) = 0.; 
-    D(2, 0) = 0.; 
-    D(0, 1) = 0.; 
-    D(1, 1) = ca; 
-    D(2, 1) = sa; 
-    D(0, 2) = 0.; 
-    D(1, 2) = -sa; 
-    D(2, 2) = ca;
-    return(D);
-}
-
-
-TMatrixD NuRecoRochester::RotationY(double a)
-{
-    double ca = Cos(a);
-    double sa = Sin(a);
-    TMatrixD D(3, 3);
-    D(0, 0) = ca; 
-    D(1, 0) = 0.; 
-    D(2, 0) = -sa; 
-    D(0, 1) = 0.; 
-    D(1, 1) = 1.; 
-    D(2, 1) = 0.; 
-    D(0, 2) = sa; 
-    D(1, 2) = 0.; 
-    D(2, 2) = ca;
-    return(D);
-}
-
-
-TMatrixD NuRecoRochester::RotationZ(double a)
+void NuRecoRochester::SetMinimizer(Minimizer minimizer_, double tolerance_)
 {
-    double ca = Cos(a);
-    double sa = Sin(a);
-    TMatrixD D(3, 3);
-    D(0, 0) = ca; 
-    D(1, 0) = sa; 
-    D(2, 0) = 0.; 
-    D(0, 1) = -sa; 
-    D(1, 1) = ca; 
-    D(2, 1) = 0.; 
-    D(0, 2) = 0; 
-    D(1, 2) = 0.; 
-    D(2, 2) = 1.;
-    return(D);
+    minimizer = minimizer_;
+    tolerance = tolerance_;
 }
 
 
-void NuRecoRochester::Solve(double t)
+void NuRecoRochester::GetPtSolution(double t, double &px, double &py) const
 {
-    T(0, 0) = Cos(t);
-    T(1, 0) = Sin(t);
-    T(2, 0) = 1.;
-
-    T = H*T;
+    double const ct = Cos(t);
+    double const st = Sin(t);
+    
+    px = H[0]*ct + H[1]*st + H[2];
+    py = H[3]*ct + H[4]*st + H[5];
 }
 
 
-TLorentzVector NuRecoRochester::GetSolution(double t)
+TLorentzVector NuRecoRochester::GetSolution(double t) const
 {
-    Solve(t);
-    return TLorentzVector(T(0,0), T(1,0), T(2,0), Sqrt(T(0,0)*T(0,0) + T(1,0)*T(1,0) + T(2,0)*T(2,0) + Mn*Mn));
+    double const ct = Cos(t);
+    double const st = Sin(t);
+    
+    double const px = H[0]*ct + H[1]*st + H[2];
+    double const py = H[3]*ct + H[4]*st + H[5];
+    double const pz = H[6]*ct + H[7]*st + H[8];
+    
+    return TLorentzVector(px, py, pz, Sqrt(px*px + py*py + pz*pz + Mn*Mn));
     //^ Arguments are px, py, pz, E
 }
 
 
-TMatrixD NuRecoRochester::GetPtSolution(double t)
-{
-    Solve(t);
-    TMatrixD res(2,1);
-    res(0,0) = T(0,0);
-    res(1,0) = T(1,0);
-
-    return(res);
-}
-
-
-double NuRecoRochester::Chi2(double t)
+double NuRecoRochester::Chi2(double t) const
 {
-    TMatrixD SOL(GetPtSolution(t));
-    return(((MET-SOL).T()*VM*(MET-SOL))(0,0));
+    double px, py;
+    GetPtSolution(t, px, py);
+    
+    double const dx = metX - px;
+    double const dy = metY - py;
+    
+    return vmXX*dx*dx + 2.*vmXY*dx*dy + vmYY*dy*dy;
 }
 
 
-pair<double, double> NuRecoRochester::Extrem(double t, bool MIN)
+pair<double, double> NuRecoRochester::Extrem(double t, bool MIN) const
 {
     double sign = -1.;
     if(MIN){sign = 1.;}
     double step = 0.05;
     double old = sign*Chi2(t);
     bool right = true;
-    while(Abs(step) > 0.00001)
+    while(Abs(step) > tolerance)
     {
         double n = sign*Chi2(t+step);
         //cout << old << " " << n << " " << t << " " << step << endl;
@@ -288,3 +180,146 @@ pair<double, double> NuRecoRochester::Extrem(double t, bool MIN)
     }
     return pair<double, double>(t, old);
 }
+
+
+pair<double, double> NuRecoRochester::MinimizeAnalytic() const
+{
+    // Represent the neutrino solution in the transverse plane as A cos(t) + B sin(t) + C and
+    //expand Chi2(t) = (D - A cos(t) - B sin(t))^T VM (D - A cos(t) - B sin(t)), with D = MET - C,
+    //into a trigonometric polynomial
+    //  Chi2(t) = k0 + a1 cos(t) + b1 sin(t) + a2 cos(2t) + b2 sin(2t).
+    double const dx = metX - H[2], dy = metY - H[5];
+    auto const vm = [this](double x1, double y1, double x2, double y2)
+    {
+        return vmXX*x1*x2 + vmXY*(x1*y2 + y1*x2) + vmYY*y1*y2;
+    };
+    
+    double const a1 = -2.*vm(H[0], H[3], dx, dy);
+    double const b1 = -2.*vm(H[1], H[4], dx, dy);
+    double const a2 = 0.5*(vm(H[0], H[3], H[0], H[3]) - vm(H[1], H[4], H[1], H[4]));
+    double const b2 = vm(H[0], H[3], H[1], H[4]);
+    
+    if (a1 == 0. and b1 == 0. and a2 == 0. and b2 == 0.)
+    {
+        // Chi2 does not depend on t
+        return pair<double, double>(0., Chi2(0.));
+    }
+    
+    
+    // First and second derivatives of Chi2 expressed through cos(t) and sin(t)
+    auto const derivative = [=](double ct, double st)
+    {
+        return -a1*st + b1*ct - 4.*a2*st*ct + 2.*b2*(ct*ct - st*st);
+    };
+    
+    auto const secondDerivative = [=](double ct, double st)
+    {
+        return -a1*ct - b1*st - 4.*a2*(ct*ct - st*st) - 8.*b2*st*ct;
+    };
+    
+    
+    // The derivative is a trigonometric polynomial of degree 2 and thus has at most four zeros.
+    //Bracket them by probing the sign of the derivative on a uniform grid. Values of cos(t) and
+    //sin(t) at nodes of the grid are computed only once.
+    unsigned const nNodes = 16;
+    static array<array<double, 2>, nNodes + 1> const nodes = []()
+    {
+        array<array<double, 2>, nNodes + 1> res;
+        
+        for (unsigned i = 0; i <= nNodes; ++i)
+            res[i] = {{Cos(2 * Pi() * i / nNodes), Sin(2 * Pi() * i / nNodes)}};
+        
+        return res;
+    }();
+    
+    
+    // A segment of the grid might contain two zeros of the derivative and still show the same sign
+    //at its ends. Since the absolute values of the second and third derivatives are bounded by
+    //maxD2 and maxD3, this is only possible if |d(lo)| + |d(hi)| <= maxD2 * (hi - lo) and, at the
+    //same time, the second derivative can turn zero within the segment, i.e. it changes sign or
+    //|d2(lo)| + |d2(hi)| <= maxD3 * (hi - lo). Segments for which both conditions hold are split
+    //in halves. A stack of segments is used for this purpose.
+    double const amp1 = sqrt(a1*a1 + b1*b1), amp2 = sqrt(a2*a2 + b2*b2);
+    double const maxD2 = amp1 + 4.*amp2, maxD3 = amp1 + 8.*amp2;
+    
+    struct Segment
+    {
+        double lo, hi;
+        double dLo, dHi;
+        double d2Lo, d2Hi;
+    };
+    
+    array<Segment, 64> segments;
+    unsigned nSegments = 0;
+    
+    for (unsigned iNode = nNodes; iNode > 0; --iNode)
+    {
+        double const cLo = nodes[iNode - 1][0], sLo = nodes[iNode - 1][1];
+        double const cHi = nodes[iNode][0], sHi = nodes[iNode][1];
+        segments[nSegments++] = Segment{2 * Pi() * (iNode - 1) / nNodes, 2 * Pi() * iNode / nNodes,
+          derivative(cLo, sLo), derivative(cHi, sHi),
+          secondDerivative(cLo, sLo), secondDerivative(cHi, sHi)};
+    }
+    
+    pair<double, double> best(0., -1.);
+    
+    while (nSegments > 0)
+    {
+        Segment const segment = segments[--nSegments];
+        double const h = segment.hi - segment.lo;
+        
+        bool const d2CanVanish = (segment.d2Lo * segment.d2Hi <= 0.) or
+          (Abs(segment.d2Lo) + Abs(segment.d2Hi) <= maxD3 * h);
+        
+        if (Abs(segment.dLo) + Abs(segment.dHi) <= maxD2 * h and d2CanVanish and
+          h > tolerance and nSegments + 2 <= segments.size())
+        {
+            double const mid = 0.5 * (segment.lo + segment.hi);
+            double const cMid = Cos(mid), sMid = Sin(mid);
+            double const dMid = derivative(cMid, sMid), d2Mid = secondDerivative(cMid, sMid);
+            segments[nSegments++] = Segment{mid, segment.hi, dMid, segment.dHi, d2Mid,
+              segment.d2Hi};
+            segments[nSegments++] = Segment{segment.lo, mid, segment.dLo, dMid, segment.d2Lo,
+              d2Mid};
+            continue;
+        }
+        
+        if (not (segment.dLo < 0. and segment.dHi >= 0.))
+            continue;
+        
+        
+        // The segment contains a minimum. Find it with Newton's method safeguarded by bisection.
+        double lo = segment.lo, hi = segment.hi;
+        double t = 0.5 * (lo + hi);
+        
+        for (unsigned iter = 0; iter < 50; ++iter)
+        {
+            double const ct = Cos(t), st = Sin(t);
+            double const d1 = derivative(ct, st);
+            
+            if (d1 < 0.)
+                lo = t;
+            else
+                hi = t;
+            
+            double const d2 = secondDerivative(ct, st);
+            double tNew = (d2 > 0.) ? t - d1 / d2 : lo - 1.;
+            
+            if (not (tNew > lo and tNew < hi))
+                tNew = 0.5 * (lo + hi);
+            
+            double const correction = tNew - t;
+            t = tNew;
+            
+            if (Abs(correction) < tolerance)
+                break;
+        }
+        
+        double const chi2 = Chi2(t);
+        
+        if (best.second < 0. or chi2 < best.second)
+            best = pair<double, double>(t, chi2);
+    }
+    
+    return best;
+}
@@ -0,0 +1,132 @@
+#include <PdfGrid.hpp>
+
+#include <LHAPDF/LHAPDF.h>
+
+#include <algorithm>
+#include <cmath>
+
+
+PdfGrid::PdfGrid(std::shared_ptr<LHAPDF::PDF const> const &pdf_, double qMin, double qMax,
+  unsigned numNodesX_ /*= 400*/, unsigned numNodesQ_ /*= 80*/):
+    pdf(pdf_),
+    numNodesX(numNodesX_), numNodesQ(numNodesQ_)
+{
+    double const xMin = pdf->xMin(), xMax = 0.99;
+    uMin = std::log(xMin / (1. - xMin));
+    stepU = (std::log(xMax / (1. - xMax)) - uMin) / (numNodesX - 1);
+    
+    logQMin = std::log(qMin);
+    stepLogQ = (std::log(qMax) - logQMin) / (numNodesQ - 1);
+    
+    
+    // Fill the table. PDG IDs of flavours are ordered to match FlavourIndex
+    table.resize(numFlavours * numNodesQ * numNodesX);
+    std::vector<double> xNodes(numNodesX);
+    
+    for (unsigned iX = 0; iX < numNodesX; ++iX)
+        xNodes[iX] = 1. / (1. + std::exp(-(uMin + iX * stepU)));
+    
+    // Protect against rounding at the boundary of the PDF set
+    xNodes.front() = std::max(xNodes.front(), xMin);
+    
+    for (unsigned iFlavour = 0; iFlavour < numFlavours; ++iFlavour)
+    {
+        int const flavour = (iFlavour == 5) ? 21 : int(iFlavour) - 5;
+        
+        for (unsigned iQ = 0; iQ < numNodesQ; ++iQ)
+        {
+            double const q = std::exp(logQMin + iQ * stepLogQ);
+            double *row = table.data() + (iFlavour * numNodesQ + iQ) * numNodesX;
+            
+            for (unsigned iX = 0; iX < numNodesX; ++iX)
+                row[iX] = pdf->xfxQ(flavour, xNodes[iX], q);
+        }
+    }
+}
+
+
+void PdfGrid::Evaluate(int flavour, double x, unsigned numScales, double const *scales,
+  double *results) const
+{
+    int const iFlavour = FlavourIndex(flavour);
+    unsigned iX;
+    std::array<double, 4> weightsX;
+    
+    if (iFlavour < 0 or x <= 0. or x >= 1. or
+      not Locate(std::log(x / (1. - x)), uMin, stepU, numNodesX, iX, weightsX))
+    {
+        for (unsigned iScale = 0; iScale < numScales; ++iScale)
+            results[iScale] = pdf->xfxQ(flavour, x, scales[iScale]);
+        
+        return;
+    }
+    
+    
+    for (unsigned iScale = 0; iScale < numScales; ++iScale)
+    {
+        unsigned iQ;
+        std::array<double, 4> weightsQ;
+        
+        if (not Locate(std::log(scales[iScale]), logQMin, stepLogQ, numNodesQ, iQ, weightsQ))
+        {
+            results[iScale] = pdf->xfxQ(flavour, x, scales[iScale]);
+            continue;
+        }
+        
+        double res = 0.;
+        
+        for (unsigned j = 0; j < 4; ++j)
+        {
+            double const *row = table.data() + (iFlavour * numNodesQ + iQ + j) * numNodesX + iX;
+            res += weightsQ[j] * (weightsX[0] * row[0] + weightsX[1] * row[1] +
+              weightsX[2] * row[2] + weightsX[3] * row[3]);
+        }
+        
+        results[iScale] = res;
+    }
+}
+
+
+double PdfGrid::Evaluate(int flavour, double x, double scale) const
+{
+    double res;
+    Evaluate(flavour, x, 1, &scale, &res);
+    return res;
+}
+
+
+int PdfGrid::FlavourIndex(int flavour)
+{
+    if (flavour == 0 or flavour == 21)
+        return 5;
+    else if (flavour >= -5 and flavour <= 5)
+        return flavour + 5;
+    else
+        return -1;
+}
+
+
+bool PdfGrid::Locate(double u, double uMin, double step, unsigned numNodes, unsigned &index,
+  std::array<double, 4> &weights)
+{
+    double const pos = (u - uMin) / step;
+    
+    if (not (pos >= 0.) or pos > numNodes - 1)
+        return false;
+    
+    
+    // Choose four nodes around the point, shifting them at the boundaries of the grid
+    int i = int(pos) - 1;
+    i = std::max(0, std::min(i, int(numNodes) - 4));
+    index = i;
+    
+    
+    // Weights of cubic Lagrange interpolation through the four nodes
+    double const t = pos - i;
+    weights[0] = -(t - 1.) * (t - 2.) * (t - 3.) / 6.;
+    weights[1] = t * (t - 2.) * (t - 3.) / 2.;
+    weights[2] = -t * (t - 1.) * (t - 3.) / 2.;
+    weights[3] = t * (t - 1.) * (t - 2.) / 6.;
+    
+    return true;
+}
@@ -0,0 +1,247 @@
+#include <PipelineTimer.hpp>
+
+#include <mensura/core/Dataset.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <ctime>
+#include <fstream>
+#include <iomanip>
+#include <ostream>
+#include <sstream>
+#include <stdexcept>
+
+
+PipelineTimer::PipelineTimer(std::string const &name /*= "PipelineTimer"*/):
+    AnalysisPlugin(name),
+    worker(0),
+    report(new Report)
+{
+    report->nextWorker = 0;
+}
+
+
+PipelineTimer::PipelineTimer(PipelineTimer const &src):
+    AnalysisPlugin(src),
+    report(src.report)
+{
+    std::lock_guard<std::mutex> lock(report->mutex);
+    worker = report->nextWorker++;
+}
+
+
+void PipelineTimer::BeginRun(Dataset const &dataset)
+{
+    record.reset(new Record);
+    record->worker = worker;
+    record->datasetID = dataset.GetSourceDatasetID();
+    record->numEvents = 0;
+    record->lastProbe = -1;
+    record->lastWallTime = record->lastCPUTime = 0.;
+}
+
+
+Plugin *PipelineTimer::Clone() const
+{
+    return new PipelineTimer(*this);
+}
+
+
+void PipelineTimer::EndRun()
+{
+    // This plugin is also executed in the final call, in which the input plugin finds that there
+    //are no more events. This call must not be counted
+    if (record->numEvents > 0 and record->lastProbe == -1)
+        --record->numEvents;
+    
+    
+    std::lock_guard<std::mutex> lock(report->mutex);
+    report->records.emplace_back(std::move(*record));
+    record.reset();
+}
+
+
+PipelineTimer::Record &PipelineTimer::GetRecord() const
+{
+    return *record;
+}
+
+
+void PipelineTimer::GetTime(double &wallTime, double &cpuTime)
+{
+    wallTime = std::chrono::duration<double>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+    
+    timespec cpuTimeSpec;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &cpuTimeSpec);
+    cpuTime = cpuTimeSpec.tv_sec + 1e-9 * cpuTimeSpec.tv_nsec;
+}
+
+
+void PipelineTimer::PrintSummary(std::ostream &out) const
+{
+    unsigned long numEvents;
+    auto const segments = SumSegments(numEvents);
+    
+    double totalWallTime = 0.;
+    
+    for (auto const &segment: segments)
+        totalWallTime += segment.wallTime;
+    
+    
+    std::ostringstream table;
+    table << std::left << std::setw(40) << "Plugin" << std::right << std::setw(12) << "Calls" <<
+      std::setw(12) << "Rejected" << std::setw(12) << "Wall [s]" << std::setw(12) << "CPU [s]" <<
+      std::setw(12) << "us/call" << std::setw(8) << "Share" << '\n';
+    table << std::fixed;
+    
+    for (auto const &segment: segments)
+    {
+        table << std::left << std::setw(40) << segment.label << std::right <<
+          std::setw(12) << segment.calls << std::setw(12) << segment.rejections <<
+          std::setprecision(2) << std::setw(12) << segment.wallTime <<
+          std::setw(12) << segment.cpuTime << std::setprecision(1) << std::setw(12) <<
+          ((segment.calls > 0) ? 1e6 * segment.wallTime / segment.calls : 0.) <<
+          std::setw(7) << ((totalWallTime > 0.) ? 100. * segment.wallTime / totalWallTime : 0.) <<
+          "%\n";
+    }
+    
+    table << "Events processed: " << numEvents << ", total wall time in monitored plugins: " <<
+      std::setprecision(2) << totalWallTime << " s summed over threads";
+    
+    if (totalWallTime > 0.)
+        table << ", " << std::setprecision(1) << numEvents / totalWallTime <<
+          " events/s per thread";
+    
+    out << table.str() << std::endl;
+}
+
+
+void PipelineTimer::WriteReport(std::string const &path) const
+{
+    std::ofstream file(path);
+    
+    if (not file)
+    {
+        std::ostringstream message;
+        message << "PipelineTimer[\"" << GetName() << "\"]::WriteReport: Failed to create file "
+          "\"" << path << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Labels of plugins and dataset IDs are not expected to contain characters that would need
+    //escaping, apart from quotes and backslashes
+    auto const quote = [](std::string const &text)
+    {
+        std::string res("\"");
+        
+        for (char const c: text)
+        {
+            if (c == '"' or c == '\\')
+                res += '\\';
+            
+            res += c;
+        }
+        
+        return res + "\"";
+    };
+    
+    auto const writeSegments = [&file, &quote](std::vector<Segment> const &segments)
+    {
+        file << "[";
+        
+        for (unsigned i = 0; i < segments.size(); ++i)
+        {
+            auto const &segment = segments[i];
+            file << ((i > 0) ? "," : "") << "\n      {\"plugin\": " << quote(segment.label) <<
+              ", \"calls\": " << segment.calls << ", \"rejections\": " << segment.rejections <<
+              ", \"wallTime\": " << segment.wallTime << ", \"cpuTime\": " << segment.cpuTime <<
+              "}";
+        }
+        
+        file << "\n    ]";
+    };
+    
+    
+    unsigned long numEvents;
+    auto const totalSegments = SumSegments(numEvents);
+    
+    file << std::setprecision(9);
+    file << "{\n  \"total\": {\n    \"events\": " << numEvents << ",\n    \"plugins\": ";
+    writeSegments(totalSegments);
+    file << "\n  },\n  \"records\": [";
+    
+    for (unsigned i = 0; i < report->records.size(); ++i)
+    {
+        auto const &r = report->records[i];
+        file << ((i > 0) ? "," : "") << "\n  {\n    \"worker\": " << r.worker <<
+          ",\n    \"dataset\": " << quote(r.datasetID) << ",\n    \"events\": " << r.numEvents <<
+          ",\n    \"plugins\": ";
+        writeSegments(r.segments);
+        file << "\n  }";
+    }
+    
+    file << "\n  ]\n}\n";
+}
+
+
+bool PipelineTimer::ProcessEvent()
+{
+    double wallTime, cpuTime;
+    GetTime(wallTime, cpuTime);
+    
+    
+    // If the previous event has been rejected, the probe following the last executed one has not
+    //run. Attribute the time to the plugin preceding that probe.
+    if (record->numEvents > 0 and record->lastProbe + 1 < int(record->segments.size()))
+    {
+        auto &segment = record->segments[record->lastProbe + 1];
+        ++segment.calls;
+        ++segment.rejections;
+        segment.wallTime += wallTime - record->lastWallTime;
+        segment.cpuTime += cpuTime - record->lastCPUTime;
+    }
+    
+    
+    // Start a new event
+    ++record->numEvents;
+    record->lastProbe = -1;
+    record->lastWallTime = wallTime;
+    record->lastCPUTime = cpuTime;
+    
+    return true;
+}
+
+
+std::vector<PipelineTimer::Segment> PipelineTimer::SumSegments(unsigned long &numEvents) const
+{
+    std::vector<Segment> sums;
+    numEvents = 0;
+    
+    for (auto const &r: report->records)
+    {
+        numEvents += r.numEvents;
+        
+        for (auto const &segment: r.segments)
+        {
+            // The number of plugins is small, so a linear search is sufficient
+            auto res = std::find_if(sums.begin(), sums.end(),
+              [&segment](Segment const &s){return s.label == segment.label;});
+            
+            if (res == sums.end())
+            {
+                sums.emplace_back(Segment{segment.label, 0, 0, 0., 0.});
+                res = sums.end() - 1;
+            }
+            
+            Segment &sum = *res;
+            sum.calls += segment.calls;
+            sum.rejections += segment.rejections;
+            sum.wallTime += segment.wallTime;
+            sum.cpuTime += segment.cpuTime;
+        }
+    }
+    
+    return sums;
+}
@@ -0,0 +1,77 @@
+#include <RecoJetCache.hpp>
+
+#include <cmath>
+
+
+RecoJetCache::RecoJetCache():
+    nJets(0)
+{}
+
+
+void RecoJetCache::Fill(std::vector<Jet> const &jets, std::vector<unsigned> const &indices)
+{
+    nJets = indices.size();
+    
+    px.resize(nJets);
+    py.resize(nJets);
+    pz.resize(nJets);
+    e.resize(nJets);
+    
+    for (unsigned i = 0; i < nJets; ++i)
+    {
+        TLorentzVector const &p4 = jets[indices[i]].P4();
+        px[i] = p4.Px();
+        py[i] = p4.Py();
+        pz[i] = p4.Pz();
+        e[i] = p4.E();
+    }
+    
+    
+    // Masses of pairs of jets. The matrix is symmetric
+    massPair.resize(nJets * nJets);
+    
+    for (unsigned i = 0; i < nJets; ++i)
+        for (unsigned j = i + 1; j < nJets; ++j)
+        {
+            double const m = Mass(px[i] + px[j], py[i] + py[j], pz[i] + pz[j], e[i] + e[j]);
+            massPair[i * nJets + j] = massPair[j * nJets + i] = m;
+        }
+    
+    
+    // Masses of triplets (b, q1, q2) with q1 < q2
+    massTriplet.resize(nJets * nJets * nJets);
+    
+    for (unsigned q1 = 0; q1 < nJets; ++q1)
+        for (unsigned q2 = q1 + 1; q2 < nJets; ++q2)
+        {
+            double const pxW = px[q1] + px[q2], pyW = py[q1] + py[q2], pzW = pz[q1] + pz[q2],
+              eW = e[q1] + e[q2];
+            
+            for (unsigned b = 0; b < nJets; ++b)
+            {
+                if (b == q1 or b == q2)
+                    continue;
+                
+                massTriplet[(b * nJets + q1) * nJets + q2] =
+                  Mass(pxW + px[b], pyW + py[b], pzW + pz[b], eW + e[b]);
+            }
+        }
+}
+
+
+void RecoJetCache::GetMassesBatch(unsigned n, unsigned const *b, unsigned const *q1,
+  unsigned const *q2, double *massPairs, double *massTriplets) const
+{
+    for (unsigned i = 0; i < n; ++i)
+    {
+        massPairs[i] = massPair[q1[i] * nJets + q2[i]];
+        massTriplets[i] = massTriplet[(b[i] * nJets + q1[i]) * nJets + q2[i]];
+    }
+}
+
+
+double RecoJetCache::Mass(double px, double py, double pz, double e)
+{
+    double const m2 = e * e - (px * px + py * py + pz * pz);
+    return (m2 < 0.) ? -std::sqrt(-m2) : std::sqrt(m2);
+}
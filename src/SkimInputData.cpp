@@ -0,0 +1,287 @@
+#include <SkimInputData.hpp>
+
+#include <SkimWriter.hpp>
+
+#include <TLorentzVector.h>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+#include <sstream>
+#include <stdexcept>
+
+
+SkimInputData::SkimInputData(std::string const &name, std::string const &directory_,
+  std::string const &configuration):
+    ReaderPlugin(name),
+    directory(directory_), configHash(SkimFormat::Hash(configuration)),
+    data(nullptr), size(0), position(0),
+    nextEvent(0)
+{}
+
+
+SkimInputData::SkimInputData(std::string const &directory_, std::string const &configuration):
+    SkimInputData("InputData", directory_, configuration)
+{}
+
+
+SkimInputData::SkimInputData(SkimInputData const &src):
+    ReaderPlugin(src),
+    directory(src.directory), configHash(src.configHash),
+    data(nullptr), size(0), position(0),
+    nextEvent(0)
+{}
+
+
+SkimInputData::~SkimInputData() noexcept
+{
+    Unmap();
+}
+
+
+void SkimInputData::BeginRun(Dataset const &dataset)
+{
+    // Map the file
+    path = SkimWriter::GetSkimPath(directory, dataset);
+    int const fd = open(path.c_str(), O_RDONLY);
+    struct stat fileInfo;
+    
+    if (fd < 0 or fstat(fd, &fileInfo) != 0)
+    {
+        if (fd >= 0)
+            close(fd);
+        
+        std::ostringstream message;
+        message << "SkimInputData[\"" << GetName() << "\"]::BeginRun: Failed to open skim " <<
+          "file \"" << path << "\" for dataset \"" << dataset.GetSourceDatasetID() << "\". " <<
+          "Make sure that the skim has been produced with the same definition of datasets.";
+        throw std::runtime_error(message.str());
+    }
+    
+    size = fileInfo.st_size;
+    void *mapping = (size > 0) ? mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED;
+    close(fd);
+    
+    if (mapping == MAP_FAILED)
+    {
+        size = 0;
+        
+        std::ostringstream message;
+        message << "SkimInputData[\"" << GetName() << "\"]::BeginRun: Failed to map file \"" <<
+          path << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    data = static_cast<char const *>(mapping);
+    madvise(mapping, size, MADV_SEQUENTIAL);
+    position = 0;
+    
+    
+    // Check the header
+    Read(&header, sizeof(header));
+    
+    if (std::memcmp(header.magic, SkimFormat::magic, sizeof(header.magic)) != 0 or
+      header.version != SkimFormat::version)
+    {
+        std::ostringstream message;
+        message << "SkimInputData[\"" << GetName() << "\"]::BeginRun: File \"" << path <<
+          "\" is not a skim file or has been written with an unsupported version of the " <<
+          "format.";
+        throw std::runtime_error(message.str());
+    }
+    
+    if (header.configHash != configHash or header.inputHash != SkimWriter::GetInputHash(dataset))
+    {
+        std::ostringstream message;
+        message << "SkimInputData[\"" << GetName() << "\"]::BeginRun: Skim file \"" << path <<
+          "\" is stale: it has been produced with a different " <<
+          ((header.configHash != configHash) ? "configuration" : "set of input files") <<
+          ". The skim needs to be regenerated.";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Read descriptions of the content
+    weightLayout.resize(header.layoutLength);
+    Read(&weightLayout[0], header.layoutLength);
+    
+    collectionNames.clear();
+    
+    for (unsigned i = 0; i < header.numCollections; ++i)
+    {
+        std::uint32_t length;
+        Read(&length, sizeof(length));
+        
+        std::string name(length, '\0');
+        Read(&name[0], length);
+        collectionNames.emplace_back(name);
+    }
+    
+    systWeights.resize(header.numSystWeights);
+    mets.resize(header.numCollections);
+    jets.resize(header.numCollections);
+    nextEvent = 0;
+}
+
+
+Plugin *SkimInputData::Clone() const
+{
+    return new SkimInputData(*this);
+}
+
+
+void SkimInputData::EndRun()
+{
+    Unmap();
+}
+
+
+unsigned SkimInputData::FindCollection(std::string const &name) const
+{
+    for (unsigned i = 0; i < collectionNames.size(); ++i)
+        if (collectionNames[i] == name)
+            return i;
+    
+    std::ostringstream message;
+    message << "SkimInputData[\"" << GetName() << "\"]::FindCollection: Skim file \"" << path <<
+      "\" does not contain collection of jets and MET \"" << name << "\".";
+    throw std::runtime_error(message.str());
+}
+
+
+double SkimInputData::GetExpectedPileUp() const
+{
+    return event.expectedPileUp;
+}
+
+
+std::vector<Jet> const &SkimInputData::GetJets(unsigned collection) const
+{
+    return jets.at(collection);
+}
+
+
+std::vector<Lepton> const &SkimInputData::GetLeptons() const
+{
+    return leptons;
+}
+
+
+Candidate const &SkimInputData::GetMET(unsigned collection) const
+{
+    return mets.at(collection);
+}
+
+
+unsigned SkimInputData::GetNumVertices() const
+{
+    return event.numVertices;
+}
+
+
+double SkimInputData::GetRho() const
+{
+    return event.rho;
+}
+
+
+std::vector<Float_t> const &SkimInputData::GetSystWeights() const
+{
+    return systWeights;
+}
+
+
+std::string const &SkimInputData::GetWeightLayout() const
+{
+    return weightLayout;
+}
+
+
+Float_t SkimInputData::GetWeight() const
+{
+    return event.weight;
+}
+
+
+bool SkimInputData::ProcessEvent()
+{
+    if (nextEvent == header.numEvents)
+        return false;
+    
+    ++nextEvent;
+    
+    
+    // Event-level information and leptons
+    Read(&event, sizeof(event));
+    leptons.clear();
+    TLorentzVector p4;
+    
+    for (unsigned i = 0; i < event.numLeptons; ++i)
+    {
+        SkimFormat::LeptonRecord record;
+        Read(&record, sizeof(record));
+        
+        p4.SetPtEtaPhiM(record.pt, record.eta, record.phi, record.mass);
+        leptons.emplace_back(static_cast<Lepton::Flavour>(record.flavour), p4);
+        leptons.back().SetCharge(record.charge);
+    }
+    
+    Read(systWeights.data(), header.numSystWeights * sizeof(float));
+    
+    
+    // Jets and MET
+    for (unsigned iCollection = 0; iCollection < header.numCollections; ++iCollection)
+    {
+        SkimFormat::CollectionRecord collection;
+        Read(&collection, sizeof(collection));
+        
+        p4.SetPtEtaPhiM(collection.metPt, 0., collection.metPhi, 0.);
+        mets[iCollection].SetP4(p4);
+        
+        auto &curJets = jets[iCollection];
+        curJets.resize(collection.numJets);
+        
+        for (auto &jet: curJets)
+        {
+            SkimFormat::JetRecord record;
+            Read(&record, sizeof(record));
+            
+            p4.SetPtEtaPhiM(record.pt, record.eta, record.phi, record.mass);
+            jet.SetP4(p4);
+            jet.SetBTag(BTagger::Algorithm::CSV, record.bTagCSV);
+            jet.SetBTag(BTagger::Algorithm::CMVA, record.bTagCMVA);
+        }
+    }
+    
+    
+    return true;
+}
+
+
+void SkimInputData::Read(void *destination, std::size_t numBytes)
+{
+    if (position + numBytes > size)
+    {
+        std::ostringstream message;
+        message << "SkimInputData[\"" << GetName() << "\"]::Read: Skim file \"" << path <<
+          "\" is truncated.";
+        throw std::runtime_error(message.str());
+    }
+    
+    std::memcpy(destination, data + position, numBytes);
+    position += numBytes;
+}
+
+
+void SkimInputData::Unmap()
+{
+    if (data)
+    {
+        munmap(const_cast<char *>(data), size);
+        data = nullptr;
+        size = position = 0;
+    }
+}
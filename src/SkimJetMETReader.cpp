@@ -0,0 +1,45 @@
+#include <SkimJetMETReader.hpp>
+
+#include <SkimInputData.hpp>
+
+
+SkimJetMETReader::SkimJetMETReader(std::string const &name /*= "JetMET"*/):
+    JetMETReader(name),
+    inputDataPluginName("InputData"), inputDataPlugin(nullptr),
+    collectionName(name), collectionIndex(0)
+{}
+
+
+void SkimJetMETReader::BeginRun(Dataset const &)
+{
+    inputDataPlugin =
+      dynamic_cast<SkimInputData const *>(GetDependencyPlugin(inputDataPluginName));
+    collectionIndex = inputDataPlugin->FindCollection(collectionName);
+}
+
+
+Plugin *SkimJetMETReader::Clone() const
+{
+    return new SkimJetMETReader(*this);
+}
+
+
+double SkimJetMETReader::GetJetRadius() const
+{
+    // Only AK4 jets are written in skims
+    return 0.4;
+}
+
+
+void SkimJetMETReader::SetCollection(std::string const &name)
+{
+    collectionName = name;
+}
+
+
+bool SkimJetMETReader::ProcessEvent()
+{
+    jets = inputDataPlugin->GetJets(collectionIndex);
+    met = inputDataPlugin->GetMET(collectionIndex);
+    return true;
+}
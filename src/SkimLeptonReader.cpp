@@ -0,0 +1,29 @@
+#include <SkimLeptonReader.hpp>
+
+#include <SkimInputData.hpp>
+
+
+SkimLeptonReader::SkimLeptonReader(std::string const &name /*= "Leptons"*/):
+    LeptonReader(name),
+    inputDataPluginName("InputData"), inputDataPlugin(nullptr)
+{}
+
+
+void SkimLeptonReader::BeginRun(Dataset const &)
+{
+    inputDataPlugin =
+      dynamic_cast<SkimInputData const *>(GetDependencyPlugin(inputDataPluginName));
+}
+
+
+Plugin *SkimLeptonReader::Clone() const
+{
+    return new SkimLeptonReader(*this);
+}
+
+
+bool SkimLeptonReader::ProcessEvent()
+{
+    leptons = inputDataPlugin->GetLeptons();
+    return true;
+}
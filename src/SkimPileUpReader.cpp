@@ -0,0 +1,31 @@
+#include <SkimPileUpReader.hpp>
+
+#include <SkimInputData.hpp>
+
+
+SkimPileUpReader::SkimPileUpReader(std::string const &name /*= "PileUp"*/):
+    PileUpReader(name),
+    inputDataPluginName("InputData"), inputDataPlugin(nullptr)
+{}
+
+
+void SkimPileUpReader::BeginRun(Dataset const &)
+{
+    inputDataPlugin =
+      dynamic_cast<SkimInputData const *>(GetDependencyPlugin(inputDataPluginName));
+}
+
+
+Plugin *SkimPileUpReader::Clone() const
+{
+    return new SkimPileUpReader(*this);
+}
+
+
+bool SkimPileUpReader::ProcessEvent()
+{
+    expectedPileUp = inputDataPlugin->GetExpectedPileUp();
+    numVertices = inputDataPlugin->GetNumVertices();
+    rho = inputDataPlugin->GetRho();
+    return true;
+}
@@ -0,0 +1,59 @@
+#include <SkimWeights.hpp>
+
+#include <NtupleWriter.hpp>
+#include <SkimInputData.hpp>
+
+#include <mensura/core/Processor.hpp>
+
+#include <mensura/extensions/TFileService.hpp>
+
+#include <TNamed.h>
+
+#include <algorithm>
+
+
+SkimWeights::SkimWeights(std::string const &name /*= "SkimWeights"*/):
+    AnalysisPlugin(name),
+    writerName("NtupleWriter"),
+    fileServiceName("TFileService"), fileService(nullptr),
+    inputDataPluginName("InputData"), inputDataPlugin(nullptr)
+{}
+
+
+void SkimWeights::BeginRun(Dataset const &)
+{
+    fileService = dynamic_cast<TFileService const *>(GetMaster().GetService(fileServiceName));
+    inputDataPlugin =
+      dynamic_cast<SkimInputData const *>(GetDependencyPlugin(inputDataPluginName));
+    
+    
+    // Save the layout of alternative weights in the same way as DumpWeights does
+    fileService->Create<TNamed>("", "SystWeightsLayout",
+      inputDataPlugin->GetWeightLayout().c_str());
+    
+    
+    // Register output columns
+    systWeights.resize(inputDataPlugin->GetSystWeights().size());
+    auto const *writer = dynamic_cast<NtupleWriter const *>(GetMaster().GetPlugin(writerName));
+    writer->RegisterColumn("weight", &weight);
+    
+    if (systWeights.size() > 0)
+        writer->RegisterColumn("systWeights", systWeights.data(), systWeights.size());
+}
+
+
+Plugin *SkimWeights::Clone() const
+{
+    return new SkimWeights(*this);
+}
+
+
+bool SkimWeights::ProcessEvent()
+{
+    weight = inputDataPlugin->GetWeight();
+    
+    auto const &srcSystWeights = inputDataPlugin->GetSystWeights();
+    std::copy(srcSystWeights.begin(), srcSystWeights.end(), systWeights.begin());
+    
+    return true;
+}
@@ -0,0 +1,244 @@
+#include <SkimWriter.hpp>
+
+#include <DumpWeights.hpp>
+
+#include <mensura/core/JetMETReader.hpp>
+#include <mensura/core/LeptonReader.hpp>
+#include <mensura/core/PileUpReader.hpp>
+#include <mensura/core/PhysicsObjects.hpp>
+
+#include <sys/stat.h>
+
+#include <cstdio>
+#include <cstring>
+#include <iomanip>
+#include <sstream>
+#include <stdexcept>
+
+
+SkimWriter::SkimWriter(std::string const &name, std::string const &directory_,
+  std::string const &configuration):
+    AnalysisPlugin(name),
+    directory(directory_), configHash(SkimFormat::Hash(configuration)),
+    leptonPluginName("Leptons"), leptonPlugin(nullptr),
+    puPluginName("PileUp"), puPlugin(nullptr),
+    weightPluginName(""), weightPlugin(nullptr)
+{}
+
+
+SkimWriter::SkimWriter(std::string const &directory_, std::string const &configuration):
+    SkimWriter("SkimWriter", directory_, configuration)
+{}
+
+
+SkimWriter::SkimWriter(SkimWriter const &src):
+    AnalysisPlugin(src),
+    directory(src.directory), configHash(src.configHash),
+    leptonPluginName(src.leptonPluginName), leptonPlugin(nullptr),
+    puPluginName(src.puPluginName), puPlugin(nullptr),
+    jetmetPluginNames(src.jetmetPluginNames),
+    weightPluginName(src.weightPluginName), weightPlugin(nullptr)
+{}
+
+
+void SkimWriter::AddJetMETCollection(std::string const &jetmetPluginName)
+{
+    jetmetPluginNames.emplace_back(jetmetPluginName);
+}
+
+
+void SkimWriter::BeginRun(Dataset const &dataset)
+{
+    if (jetmetPluginNames.empty())
+    {
+        std::ostringstream message;
+        message << "SkimWriter[\"" << GetName() << "\"]::BeginRun: No collections of jets and "
+          "MET have been specified.";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Save pointers to other plugins
+    leptonPlugin = dynamic_cast<LeptonReader const *>(GetDependencyPlugin(leptonPluginName));
+    puPlugin = dynamic_cast<PileUpReader const *>(GetDependencyPlugin(puPluginName));
+    
+    jetmetPlugins.clear();
+    
+    for (auto const &name: jetmetPluginNames)
+        jetmetPlugins.emplace_back(dynamic_cast<JetMETReader const *>(GetDependencyPlugin(name)));
+    
+    if (weightPluginName != "")
+        weightPlugin = dynamic_cast<DumpWeights const *>(GetDependencyPlugin(weightPluginName));
+    
+    
+    // Open the output file. Failure to create the directory for a reason other than that it
+    //already exists will be reported when the file is opened.
+    mkdir(directory.c_str(), 0755);
+    path = GetSkimPath(directory, dataset);
+    tmpPath = path + ".tmp";
+    file.open(tmpPath, std::ios::binary | std::ios::trunc);
+    
+    if (not file)
+    {
+        std::ostringstream message;
+        message << "SkimWriter[\"" << GetName() << "\"]::BeginRun: Failed to open file \"" <<
+          tmpPath << "\" for writing.";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Write the header. The number of events is not known yet and will be updated at the end.
+    //The layout of alternative weights is provided by DumpWeights, which has been initialized
+    //before this plugin.
+    std::string const layout((weightPlugin) ? weightPlugin->GetLayout() : "");
+    
+    std::memcpy(header.magic, SkimFormat::magic, sizeof(header.magic));
+    header.version = SkimFormat::version;
+    header.numCollections = jetmetPluginNames.size();
+    header.configHash = configHash;
+    header.inputHash = GetInputHash(dataset);
+    header.numEvents = 0;
+    header.numSystWeights = (weightPlugin) ? weightPlugin->GetSystWeights().size() : 0;
+    header.layoutLength = layout.size();
+    
+    file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    file.write(layout.data(), layout.size());
+    
+    for (auto const &name: jetmetPluginNames)
+    {
+        std::uint32_t const length = name.size();
+        file.write(reinterpret_cast<char const *>(&length), sizeof(length));
+        file.write(name.data(), length);
+    }
+}
+
+
+Plugin *SkimWriter::Clone() const
+{
+    return new SkimWriter(*this);
+}
+
+
+void SkimWriter::EndRun()
+{
+    // Update the number of events in the header
+    file.seekp(0);
+    file.write(reinterpret_cast<char const *>(&header), sizeof(header));
+    file.close();
+    
+    if (not file)
+    {
+        std::ostringstream message;
+        message << "SkimWriter[\"" << GetName() << "\"]::EndRun: Failed to write file \"" <<
+          tmpPath << "\".";
+        throw std::runtime_error(message.str());
+    }
+    
+    if (std::rename(tmpPath.c_str(), path.c_str()) != 0)
+    {
+        std::ostringstream message;
+        message << "SkimWriter[\"" << GetName() << "\"]::EndRun: Failed to rename file \"" <<
+          tmpPath << "\" into \"" << path << "\".";
+        throw std::runtime_error(message.str());
+    }
+}
+
+
+std::string SkimWriter::GetSkimPath(std::string const &directory, Dataset const &dataset)
+{
+    std::ostringstream path;
+    path << directory << "/" << dataset.GetSourceDatasetID() << "_" << std::hex <<
+      std::setw(16) << std::setfill('0') << GetInputHash(dataset) << ".skim";
+    return path.str();
+}
+
+
+std::uint64_t SkimWriter::GetInputHash(Dataset const &dataset)
+{
+    std::uint64_t hash = SkimFormat::Hash(dataset.GetSourceDatasetID());
+    
+    // File names are separated with a character that cannot appear in them
+    for (auto const &file: dataset.GetFiles())
+        hash = SkimFormat::Hash("\n" + file.name, hash);
+    
+    return hash;
+}
+
+
+void SkimWriter::SetWeightPluginName(std::string const &name)
+{
+    weightPluginName = name;
+}
+
+
+void SkimWriter::Append(void const *data, unsigned size)
+{
+    auto const *bytes = static_cast<char const *>(data);
+    buffer.insert(buffer.end(), bytes, bytes + size);
+}
+
+
+bool SkimWriter::ProcessEvent()
+{
+    buffer.clear();
+    
+    
+    // Event-level information and leptons
+    auto const &leptons = leptonPlugin->GetLeptons();
+    
+    SkimFormat::EventRecord event;
+    event.weight = (weightPlugin) ? weightPlugin->GetWeight() : 1.f;
+    event.rho = puPlugin->GetRho();
+    event.expectedPileUp = puPlugin->GetExpectedPileUp();
+    event.numVertices = puPlugin->GetNumVertices();
+    event.numLeptons = leptons.size();
+    Append(&event, sizeof(event));
+    
+    for (auto const &lepton: leptons)
+    {
+        SkimFormat::LeptonRecord record;
+        record.pt = lepton.Pt();
+        record.eta = lepton.Eta();
+        record.phi = lepton.Phi();
+        record.mass = lepton.M();
+        record.flavour = static_cast<std::int8_t>(lepton.GetFlavour());
+        record.charge = lepton.GetCharge();
+        record.padding = 0;
+        Append(&record, sizeof(record));
+    }
+    
+    if (weightPlugin)
+        Append(weightPlugin->GetSystWeights().data(), header.numSystWeights * sizeof(float));
+    
+    
+    // Jets and MET
+    for (auto const *jetmetPlugin: jetmetPlugins)
+    {
+        auto const &jets = jetmetPlugin->GetJets();
+        auto const &met = jetmetPlugin->GetMET();
+        
+        SkimFormat::CollectionRecord collection;
+        collection.metPt = met.Pt();
+        collection.metPhi = met.Phi();
+        collection.numJets = jets.size();
+        Append(&collection, sizeof(collection));
+        
+        for (auto const &jet: jets)
+        {
+            SkimFormat::JetRecord record;
+            record.pt = jet.Pt();
+            record.eta = jet.Eta();
+            record.phi = jet.Phi();
+            record.mass = jet.M();
+            record.bTagCSV = jet.BTag(BTagger::Algorithm::CSV);
+            record.bTagCMVA = jet.BTag(BTagger::Algorithm::CMVA);
+            Append(&record, sizeof(record));
+        }
+    }
+    
+    
+    file.write(buffer.data(), buffer.size());
+    ++header.numEvents;
+    
+    return true;
+}
@@ -0,0 +1,79 @@
+#include <StartupProfile.hpp>
+
+#include <iomanip>
+#include <mutex>
+#include <ostream>
+#include <sstream>
+
+
+/// Process-wide list of lazy loads with a mutex that protects it
+struct LazyLoads
+{
+    std::mutex mutex;
+    std::vector<std::pair<std::string, double>> loads;
+};
+
+
+static LazyLoads &GetLazyLoads()
+{
+    static LazyLoads lazyLoads;
+    return lazyLoads;
+}
+
+
+StartupProfile::StartupProfile():
+    phaseStart(std::chrono::steady_clock::now())
+{}
+
+
+void StartupProfile::Mark(std::string const &label)
+{
+    auto const now = std::chrono::steady_clock::now();
+    phases.emplace_back(label, std::chrono::duration<double>(now - phaseStart).count());
+    phaseStart = now;
+}
+
+
+void StartupProfile::Print(std::ostream &out) const
+{
+    std::ostringstream table;
+    table << std::left << std::setw(52) << "Startup phase" << std::right << std::setw(12) <<
+      "Wall [s]" << '\n';
+    table << std::fixed << std::setprecision(3);
+    
+    double totalTime = 0.;
+    
+    for (auto const &phase: phases)
+    {
+        table << std::left << std::setw(52) << phase.first << std::right << std::setw(12) <<
+          phase.second << '\n';
+        totalTime += phase.second;
+    }
+    
+    table << std::left << std::setw(52) << "Total" << std::right << std::setw(12) << totalTime <<
+      '\n';
+    
+    
+    LazyLoads &lazyLoads = GetLazyLoads();
+    std::lock_guard<std::mutex> lock(lazyLoads.mutex);
+    
+    if (not lazyLoads.loads.empty())
+    {
+        table << std::left << std::setw(52) << "Lazily loaded input" << std::right <<
+          std::setw(12) << "Wall [s]" << '\n';
+        
+        for (auto const &load: lazyLoads.loads)
+            table << std::left << std::setw(52) << load.first << std::right << std::setw(12) <<
+              load.second << '\n';
+    }
+    
+    out << table.str() << std::flush;
+}
+
+
+void StartupProfile::RecordLazyLoad(std::string const &label, double time)
+{
+    LazyLoads &lazyLoads = GetLazyLoads();
+    std::lock_guard<std::mutex> lock(lazyLoads.mutex);
+    lazyLoads.loads.emplace_back(label, time);
+}
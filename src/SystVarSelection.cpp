@@ -0,0 +1,146 @@
+#include <SystVarSelection.hpp>
+
+#include <NtupleWriter.hpp>
+
+#include <mensura/core/BTagWPService.hpp>
+#include <mensura/core/JetMETReader.hpp>
+#include <mensura/core/LeptonReader.hpp>
+#include <mensura/core/Processor.hpp>
+
+#include <cmath>
+#include <sstream>
+#include <stdexcept>
+
+
+SystVarSelection::SystVarSelection(std::string const &name, BTagger const &bTagger_,
+  double minPt_):
+    AnalysisPlugin(name),
+    writerName("NtupleWriter"),
+    bTagWPServiceName("BTagWP"), bTagWPService(nullptr),
+    leptonPluginName("Leptons"), leptonPlugin(nullptr),
+    bTagger(bTagger_), minPt(minPt_),
+    minNumJets(4), minNumBTags(2), minMtW(50.)
+{}
+
+
+SystVarSelection::SystVarSelection(BTagger const &bTagger_, double minPt_):
+    SystVarSelection("SystVarSelection", bTagger_, minPt_)
+{}
+
+
+SystVarSelection::SystVarSelection(SystVarSelection const &src):
+    AnalysisPlugin(src),
+    writerName(src.writerName),
+    bTagWPServiceName(src.bTagWPServiceName), bTagWPService(nullptr),
+    leptonPluginName(src.leptonPluginName), leptonPlugin(nullptr),
+    labels(src.labels), jetmetPluginNames(src.jetmetPluginNames),
+    bTagger(src.bTagger), minPt(src.minPt),
+    minNumJets(src.minNumJets), minNumBTags(src.minNumBTags), minMtW(src.minMtW)
+{}
+
+
+void SystVarSelection::AddVariation(std::string const &label, std::string const &jetmetPluginName)
+{
+    labels.emplace_back(label);
+    jetmetPluginNames.emplace_back(jetmetPluginName);
+}
+
+
+void SystVarSelection::BeginRun(Dataset const &)
+{
+    if (labels.empty())
+    {
+        std::ostringstream message;
+        message << "SystVarSelection[\"" << GetName() << "\"]::BeginRun: No variations have been "
+          "specified.";
+        throw std::runtime_error(message.str());
+    }
+    
+    
+    // Save pointers to services and readers
+    bTagWPService = dynamic_cast<BTagWPService const *>(GetMaster().GetService(bTagWPServiceName));
+    leptonPlugin = dynamic_cast<LeptonReader const *>(GetDependencyPlugin(leptonPluginName));
+    
+    jetmetPlugins.clear();
+    
+    for (auto const &name: jetmetPluginNames)
+        jetmetPlugins.emplace_back(dynamic_cast<JetMETReader const *>(GetDependencyPlugin(name)));
+    
+    
+    // Register output columns. The writer is executed after this plugin and thus cannot be
+    //accessed as a dependency
+    bfSelected.reset(new Bool_t[labels.size()]);
+    auto const *writer = dynamic_cast<NtupleWriter const *>(GetMaster().GetPlugin(writerName));
+    
+    for (unsigned i = 0; i < labels.size(); ++i)
+        writer->RegisterColumn("Selected_" + labels[i], &bfSelected[i]);
+}
+
+
+Plugin *SystVarSelection::Clone() const
+{
+    return new SystVarSelection(*this);
+}
+
+
+bool SystVarSelection::IsSelected(unsigned index) const
+{
+    return bfSelected[index];
+}
+
+
+void SystVarSelection::SetSelection(unsigned minNumJets_, unsigned minNumBTags_, double minMtW_)
+{
+    minNumJets = minNumJets_;
+    minNumBTags = minNumBTags_;
+    minMtW = minMtW_;
+}
+
+
+bool SystVarSelection::ProcessEvent()
+{
+    auto const &leptons = leptonPlugin->GetLeptons();
+    bool anySelected = false;
+    
+    for (unsigned i = 0; i < jetmetPlugins.size(); ++i)
+    {
+        bfSelected[i] = false;
+        
+        if (leptons.size() == 0)
+            continue;
+        
+        
+        // Count jets and b-tagged jets. The collection is ordered in pt
+        unsigned nJets = 0, nBTags = 0;
+        
+        for (auto const &jet: jetmetPlugins[i]->GetJets())
+        {
+            if (jet.Pt() < minPt)
+                break;
+            
+            ++nJets;
+            
+            if (bTagWPService->IsTagged(bTagger, jet))
+                ++nBTags;
+        }
+        
+        if (nJets < minNumJets or nBTags < minNumBTags)
+            continue;
+        
+        
+        // Compute transverse mass of the W boson
+        auto const &lep = leptons.front();
+        auto const &met = jetmetPlugins[i]->GetMET();
+        double const mtW = std::sqrt(std::pow(lep.Pt() + met.Pt(), 2) -
+          std::pow(lep.P4().Px() + met.P4().Px(), 2) - std::pow(lep.P4().Py() + met.P4().Py(), 2));
+        
+        if (not (mtW > minMtW))
+            continue;
+        
+        
+        bfSelected[i] = true;
+        anySelected = true;
+    }
+    
+    return anySelected;
+}
@@ -1,47 +1,67 @@
 #include <TTObservables.hpp>
 
 #include <mensura/core/Processor.hpp>
-#include <mensura/core/ROOTLock.hpp>
+
+#include <sstream>
+#include <stdexcept>
 
 
 TTObservables::TTObservables(std::string const name /*= "TTVars"*/):
     AnalysisPlugin(name),
-    fileServiceName("TFileService"), fileService(nullptr),
-    ttRecoPluginName("TTReco"), ttRecoPlugin(nullptr)
+    writerName("NtupleWriter"), columnPrefix(""), schema{23, false},
+    ttRecoPluginName("TTReco"), ttRecoPlugin(nullptr),
+    saveAlternative(false)
 {}
 
 
 void TTObservables::BeginRun(Dataset const &)
 {
-    // Save pointers to services and plugins
-    fileService = dynamic_cast<TFileService const *>(GetMaster().GetService(fileServiceName));
+    // Save pointers to plugins
     ttRecoPlugin = dynamic_cast<TTSemilepRecoBase const *>(GetDependencyPlugin(ttRecoPluginName));
     
+    if (saveAlternative and ttRecoPlugin->GetMaxNumInterpretations() < 2)
+    {
+        std::ostringstream message;
+        message << "TTObservables[\"" << GetName() << "\"]::BeginRun: Observables for the " <<
+          "second-best interpretation are requested, but plugin \"" << ttRecoPluginName <<
+          "\" only stores " << ttRecoPlugin->GetMaxNumInterpretations() << " interpretation.";
+        throw std::runtime_error(message.str());
+    }
     
-    // Set up the output tree
-    tree = fileService->Create<TTree>("", GetName().c_str(),
-      "Observables relying on tt reconstruction");
     
-    ROOTLock::Lock();
+    // Register output columns. The writer is executed after this plugin and thus cannot be
+    //accessed as a dependency
+    auto const *writer = dynamic_cast<NtupleWriter const *>(GetMaster().GetPlugin(writerName));
+    using Kind = NtupleWriter::ColumnKind;
     
-    tree->Branch("BestRank", &bfBestRank);
-    tree->Branch("RecoStatus", &bfRecoStatus);
+    writer->RegisterColumn(columnPrefix + "BestRank", &bfBestRank, Kind::Generic, schema);
+    writer->RegisterColumn(columnPrefix + "RecoStatus", &bfRecoStatus, Kind::Status, schema);
     
-    tree->Branch("MassTopLep", &bfMassTopLep);
-    tree->Branch("MassTopHad", &bfMassTopHad);
-    tree->Branch("MassWHad", &bfMassWHad);
+    writer->RegisterColumn(columnPrefix + "MassTopLep", &bfMassTopLep, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "MassTopHad", &bfMassTopHad, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "MassWHad", &bfMassWHad, Kind::Kinematic, schema);
     
-    tree->Branch("PtTopLep", &bfPtTopLep);
-    tree->Branch("PtTopHad", &bfPtTopHad);
+    writer->RegisterColumn(columnPrefix + "PtTopLep", &bfPtTopLep, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "PtTopHad", &bfPtTopHad, Kind::Kinematic, schema);
     
-    tree->Branch("MassTT", &bfMassTT);
-    tree->Branch("PtTT", &bfPtTT);
-    tree->Branch("RapidityTT", &bfRapidityTT);
-    tree->Branch("DRTT", &bfDRTT);
+    writer->RegisterColumn(columnPrefix + "MassTT", &bfMassTT, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "PtTT", &bfPtTT, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "RapidityTT", &bfRapidityTT, Kind::Kinematic, schema);
+    writer->RegisterColumn(columnPrefix + "DRTT", &bfDRTT, Kind::Kinematic, schema);
     
-    tree->Branch("CosTopLepTT", &bfCosTopLepTT);
+    writer->RegisterColumn(columnPrefix + "CosTopLepTT", &bfCosTopLepTT, Kind::Kinematic, schema);
     
-    ROOTLock::Unlock();
+    if (saveAlternative)
+    {
+        writer->RegisterColumn(columnPrefix + "RankGap", &bfRankGap, Kind::Generic, schema);
+        writer->RegisterColumn(columnPrefix + "AltMassTopLep", &bfAltMassTopLep, Kind::Kinematic,
+          schema);
+        writer->RegisterColumn(columnPrefix + "AltMassTopHad", &bfAltMassTopHad, Kind::Kinematic,
+          schema);
+        writer->RegisterColumn(columnPrefix + "AltMassWHad", &bfAltMassWHad, Kind::Kinematic,
+          schema);
+        writer->RegisterColumn(columnPrefix + "AltMassTT", &bfAltMassTT, Kind::Kinematic, schema);
+    }
 }
 
 
@@ -51,6 +71,24 @@ Plugin *TTObservables::Clone() const
 }
 
 
+void TTObservables::SetAlternativeInterpretation(bool enable /*= true*/)
+{
+    saveAlternative = enable;
+}
+
+
+void TTObservables::SetColumnPrefix(std::string const &prefix)
+{
+    columnPrefix = prefix;
+}
+
+
+void TTObservables::SetStorageSchema(NtupleWriter::Schema const &schema_)
+{
+    schema = schema_;
+}
+
+
 void TTObservables::SetRecoPluginName(std::string const &pluginName)
 {
     ttRecoPluginName = pluginName;
@@ -99,6 +137,29 @@ bool TTObservables::ProcessEvent()
     }
     
     
-    tree->Fill();
+    // Observables for the second-best interpretation, which are read from the reconstruction
+    //plugin without repeating the reconstruction
+    if (saveAlternative)
+    {
+        if (ttRecoPlugin->GetNumInterpretations() > 1)
+        {
+            bfRankGap = ttRecoPlugin->GetRank() - ttRecoPlugin->GetInterpretation(1).rank;
+            
+            TLorentzVector const p4TopLep = ttRecoPlugin->GetTopLepP4(1);
+            TLorentzVector const p4TopHad = ttRecoPlugin->GetTopHadP4(1);
+            
+            bfAltMassTopLep = p4TopLep.M();
+            bfAltMassTopHad = p4TopHad.M();
+            bfAltMassWHad = (ttRecoPlugin->GetJet(TTSemilepRecoBase::DecayJet::q1TopHad, 1).P4() +
+              ttRecoPlugin->GetJet(TTSemilepRecoBase::DecayJet::q2TopHad, 1).P4()).M();
+            bfAltMassTT = (p4TopLep + p4TopHad).M();
+        }
+        else
+        {
+            bfRankGap = -1.;
+            bfAltMassTopLep = bfAltMassTopHad = bfAltMassWHad = bfAltMassTT = 0.;
+        }
+    }
+    
     return true;
 }
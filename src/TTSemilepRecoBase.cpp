@@ -1,23 +1,112 @@
 #include <TTSemilepRecoBase.hpp>
 
+#include <SimdSupport.hpp>
+
 #include <mensura/core/JetMETReader.hpp>
 #include <mensura/core/Processor.hpp>
 
+#include <mensura/extensions/TFileService.hpp>
+
+#include <TH2.h>
+
+#include <algorithm>
+#include <chrono>
 #include <cmath>
+#include <sstream>
 #include <stdexcept>
 
+#ifdef TTRES_AVX2_DISPATCH
+    #include <immintrin.h>
+#endif
+
+
+#ifdef TTRES_AVX2_DISPATCH
+/// AVX2 version of function FindMaximum
+__attribute__((target("avx2")))
+static double FindMaximumAVX2(unsigned n, double const *x)
+{
+    __m256d maxValues = _mm256_set1_pd(-std::numeric_limits<double>::infinity());
+    unsigned i = 0;
+    
+    // NaN in the first operand results in the second operand being returned
+    for (; i + 4 <= n; i += 4)
+        maxValues = _mm256_max_pd(_mm256_loadu_pd(x + i), maxValues);
+    
+    double buffer[4];
+    _mm256_storeu_pd(buffer, maxValues);
+    double maxValue = std::max(std::max(buffer[0], buffer[1]), std::max(buffer[2], buffer[3]));
+    
+    for (; i < n; ++i)
+    {
+        if (x[i] > maxValue)
+            maxValue = x[i];
+    }
+    
+    return maxValue;
+}
+#endif
+
+
+/**
+ * \brief Finds the largest value in the given array
+ * 
+ * NaN values are ignored. If the array is empty or contains only NaN, returns -infinity.
+ */
+static double FindMaximum(unsigned n, double const *x)
+{
+#ifdef TTRES_AVX2_DISPATCH
+    if (IsAVX2Supported())
+        return FindMaximumAVX2(n, x);
+#endif
+
+    double maxValue = -std::numeric_limits<double>::infinity();
+    
+    for (unsigned i = 0; i < n; ++i)
+    {
+        if (x[i] > maxValue)
+            maxValue = x[i];
+    }
+    
+    return maxValue;
+}
+
+
+/**
+ * \brief Orders candidates for the b-quark jet from t -> blv in decreasing rank
+ * 
+ * Candidates with equal ranks are ordered in jet index. Since candidates are collected in the order
+ * of increasing index, this reproduces the result of std::stable_sort, which, however, requests a
+ * temporary buffer from the heap on every call.
+ */
+static bool CompareTopLepCandidates(std::pair<double, unsigned> const &a,
+  std::pair<double, unsigned> const &b)
+{
+    return (a.first > b.first or (a.first == b.first and a.second < b.second));
+}
+
+
 
 TTSemilepRecoBase::TTSemilepRecoBase(std::string name /*= "TTReco"*/):
     AnalysisPlugin(name),
     jetmetPluginName("JetMET"), jetmetPlugin(nullptr),
-    minPt(0.), maxAbsEta(std::numeric_limits<double>::infinity())
+    minPt(0.), maxAbsEta(std::numeric_limits<double>::infinity()),
+    engine(Engine::Scalar), validateEngine(false),
+    earlyTermination(false), maxNumInterpretations(1),
+    fileServiceName("TFileService"), fileService(nullptr),
+    monitorLatency(false), latencyHist(nullptr),
+    jets(nullptr)
 {}
 
 
 TTSemilepRecoBase::TTSemilepRecoBase(TTSemilepRecoBase const &src) noexcept:
     AnalysisPlugin(src),
     jetmetPluginName(src.jetmetPluginName), jetmetPlugin(nullptr),
-    minPt(src.minPt), maxAbsEta(src.maxAbsEta)
+    minPt(src.minPt), maxAbsEta(src.maxAbsEta),
+    engine(src.engine), validateEngine(src.validateEngine),
+    earlyTermination(src.earlyTermination), maxNumInterpretations(src.maxNumInterpretations),
+    fileServiceName(src.fileServiceName), fileService(nullptr),
+    monitorLatency(src.monitorLatency), latencyHist(nullptr),
+    jets(nullptr)
 {}
 
 
@@ -25,6 +114,16 @@ void TTSemilepRecoBase::BeginRun(Dataset const &)
 {
     // Save pointer to jet reader
     jetmetPlugin = dynamic_cast<JetMETReader const *>(GetDependencyPlugin(jetmetPluginName));
+    
+    
+    // Book the histogram to monitor time spent in jet assignment
+    if (monitorLatency)
+    {
+        fileService = dynamic_cast<TFileService const *>(GetMaster().GetService(fileServiceName));
+        latencyHist = fileService->Create<TH2D>(GetName(), "AssignmentLatency",
+          "Time spent in jet assignment;Number of selected jets;log_{10}(time / s)",
+          17, 3.5, 20.5, 60, -7., -1.);
+    }
 }
 
 
@@ -64,6 +163,46 @@ Jet const &TTSemilepRecoBase::GetJet(DecayJet type) const
 }
 
 
+Jet const &TTSemilepRecoBase::GetJet(DecayJet type, unsigned index) const
+{
+    return GetSelectedJet(GetInterpretation(index).jetIndices[int(type)]);
+}
+
+
+TTSemilepRecoBase::Interpretation const &TTSemilepRecoBase::GetInterpretation(unsigned index)
+  const
+{
+    if (index >= GetNumInterpretations())
+    {
+        std::ostringstream message;
+        message << "TTSemilepRecoBase[\"" << GetName() << "\"]::GetInterpretation: " <<
+          "Interpretation with index " << index << " is requested, but only " <<
+          GetNumInterpretations() << " interpretations are available in the current event.";
+        throw std::runtime_error(message.str());
+    }
+    
+    return interpretations[index];
+}
+
+
+unsigned TTSemilepRecoBase::GetMaxNumInterpretations() const
+{
+    return maxNumInterpretations;
+}
+
+
+unsigned TTSemilepRecoBase::GetNumInterpretations() const
+{
+    return (recoStatus == 0) ? interpretations.size() : 0;
+}
+
+
+unsigned long TTSemilepRecoBase::GetNumVisitedInterpretations() const
+{
+    return numVisitedInterpretations;
+}
+
+
 double TTSemilepRecoBase::GetRank() const
 {
     return highestRank;
@@ -82,6 +221,13 @@ TLorentzVector TTSemilepRecoBase::GetTopLepP4() const
 }
 
 
+TLorentzVector TTSemilepRecoBase::GetTopLepP4(unsigned index) const
+{
+    return GetLepton().P4() + GetInterpretation(index).p4Nu +
+      GetJet(DecayJet::bTopLep, index).P4();
+}
+
+
 TLorentzVector TTSemilepRecoBase::GetTopHadP4() const
 {
     return GetJet(DecayJet::bTopHad).P4() + GetJet(DecayJet::q1TopHad).P4() +
@@ -89,6 +235,19 @@ TLorentzVector TTSemilepRecoBase::GetTopHadP4() const
 }
 
 
+TLorentzVector TTSemilepRecoBase::GetTopHadP4(unsigned index) const
+{
+    return GetJet(DecayJet::bTopHad, index).P4() + GetJet(DecayJet::q1TopHad, index).P4() +
+      GetJet(DecayJet::q2TopHad, index).P4();
+}
+
+
+void TTSemilepRecoBase::SetJetMETPluginName(std::string const &pluginName)
+{
+    jetmetPluginName = pluginName;
+}
+
+
 void TTSemilepRecoBase::SetJetSelection(double minPt_,
   double maxAbsEta_ /*= std::numeric_limits<double>::infinity()*/)
 {
@@ -97,22 +256,76 @@ void TTSemilepRecoBase::SetJetSelection(double minPt_,
 }
 
 
-void TTSemilepRecoBase::PerformJetAssignment(std::vector<Jet> const &jets)
+void TTSemilepRecoBase::SetEngine(Engine engine_, bool validate /*= false*/)
+{
+    engine = engine_;
+    validateEngine = validate;
+}
+
+
+void TTSemilepRecoBase::SetEarlyTermination(bool enable /*= true*/)
+{
+    earlyTermination = enable;
+}
+
+
+void TTSemilepRecoBase::SetMaxNumInterpretations(unsigned n)
+{
+    if (n == 0)
+    {
+        std::ostringstream message;
+        message << "TTSemilepRecoBase[\"" << GetName() << "\"]::SetMaxNumInterpretations: " <<
+          "At least one interpretation must be stored.";
+        throw std::runtime_error(message.str());
+    }
+    
+    maxNumInterpretations = n;
+}
+
+
+void TTSemilepRecoBase::SetLatencyMonitoring(bool enable /*= true*/)
+{
+    monitorLatency = enable;
+}
+
+
+void TTSemilepRecoBase::PerformJetAssignment(std::vector<Jet> const &jets_)
+{
+    if (not latencyHist)
+    {
+        FindBestInterpretation(jets_);
+        return;
+    }
+    
+    auto const start = std::chrono::steady_clock::now();
+    FindBestInterpretation(jets_);
+    double const latency = std::chrono::duration<double>(
+      std::chrono::steady_clock::now() - start).count();
+    
+    latencyHist->Fill(selectedJetIndices.size(), std::log10(latency));
+}
+
+
+void TTSemilepRecoBase::FindBestInterpretation(std::vector<Jet> const &jets_)
 {
     // Reset data describing the current-best interpretation
     highestRank = -std::numeric_limits<double>::infinity();
     bTopLep = bTopHad = q1TopHad = q2TopHad = nullptr;
+    interpretations.clear();
+    interpretations.reserve(maxNumInterpretations);
+    numVisitedInterpretations = 0;
     
     
     // Save a pointer to the collection of jets and apply the selection to it
+    jets = &jets_;
     selectedJetIndices.clear();
     
-    for (unsigned i = 0; i < jets.size(); ++i)
+    for (unsigned i = 0; i < jets_.size(); ++i)
     {
-        if (std::abs(jets.at(i).Eta()) > maxAbsEta)
+        if (std::abs(jets_.at(i).Eta()) > maxAbsEta)
             continue;
         
-        if (jets.at(i).Pt() < minPt)
+        if (jets_.at(i).Pt() < minPt)
             break;  // The jet collection is ordered in pt
         
         selectedJetIndices.push_back(i);
@@ -129,47 +342,509 @@ void TTSemilepRecoBase::PerformJetAssignment(std::vector<Jet> const &jets)
     }
     
     
-    // Loop over all possible ways of jet assignment to find the best one
-    for (unsigned iiBTopLepCand = 0; iiBTopLepCand < nSelectedJets; ++iiBTopLepCand)
-        for (unsigned iiBTopHadCand = 0; iiBTopHadCand < nSelectedJets; ++iiBTopHadCand)
+    // Precompute kinematics of the selected jets
+    jetCache.Fill(jets_, selectedJetIndices);
+    
+    
+    // Build lists of jets that can play each role in every assignment pass
+    roleCandidates.resize(GetNumAssignmentPasses());
+    
+    for (unsigned pass = 0; pass < roleCandidates.size(); ++pass)
+        for (unsigned role = 0; role < 4; ++role)
+        {
+            auto &candidates = roleCandidates[pass][role];
+            candidates.clear();
+            
+            for (unsigned i = 0; i < nSelectedJets; ++i)
+            {
+                if (IsJetAdmissible(pass, DecayJet(role), i))
+                    candidates.push_back(i);
+            }
+        }
+    
+    
+    // Find the best interpretation with the appropriate algorithm
+    if (not IsSearchSeparable())
+        SearchExhaustive();
+    else if (earlyTermination)
+        SearchSeparableEarlyTermination(nSelectedJets);
+    else if (engine == Engine::Scalar)
+        SearchSeparable();
+    else
+        SearchSeparableBatch(nSelectedJets);
+    
+    
+    // If requested, repeat the search with the scalar engine without early termination and
+    //compare all stored interpretations. The number of visited interpretations refers to the
+    //original search
+    if (IsSearchSeparable() and validateEngine and (engine == Engine::Batch or earlyTermination))
+    {
+        double const optimizedRank = highestRank;
+        std::array<unsigned, 4> const optimizedJetIndices = bestJetIndices;
+        bool const optimizedAccepted = (bTopLep != nullptr);
+        unsigned long const optimizedNumVisited = numVisitedInterpretations;
+        validatedInterpretations.swap(interpretations);
+        
+        highestRank = -std::numeric_limits<double>::infinity();
+        bTopLep = bTopHad = q1TopHad = q2TopHad = nullptr;
+        interpretations.clear();
+        interpretations.reserve(maxNumInterpretations);
+        SearchSeparable();
+        numVisitedInterpretations = optimizedNumVisited;
+        
+        bool match = (highestRank == optimizedRank and
+          (bTopLep != nullptr) == optimizedAccepted and
+          (not optimizedAccepted or bestJetIndices == optimizedJetIndices) and
+          interpretations.size() == validatedInterpretations.size());
+        
+        for (unsigned i = 0; match and i < interpretations.size(); ++i)
+            match = (interpretations[i].rank == validatedInterpretations[i].rank and
+              interpretations[i].jetIndices == validatedInterpretations[i].jetIndices);
+        
+        if (not match)
+        {
+            std::ostringstream message;
+            message << "TTSemilepRecoBase[\"" << GetName() << "\"]::FindBestInterpretation: " <<
+              "Optimized search has stored different interpretations than the scalar engine. " <<
+              "Ranks of the accepted interpretations are " << optimizedRank << " and " <<
+              highestRank << ".";
+            throw std::runtime_error(message.str());
+        }
+    }
+    
+    
+    // Save neutrinos of the stored interpretations
+    for (auto &interpretation: interpretations)
+    {
+        auto const &indices = interpretation.jetIndices;
+        interpretation.p4Nu = GetNeutrinoP4(indices[0], indices[1], indices[2], indices[3]);
+    }
+    
+    recoStatus = 0;
+}
+
+
+void TTSemilepRecoBase::SearchExhaustive()
+{
+    // Loop over all admissible ways of jet assignment to find the best one. Within a pass,
+    //interpretations are visited in the lexicographic order of jet indices
+    for (auto const &candidates: roleCandidates)
+    {
+        auto const &bTopLepCands = candidates[int(DecayJet::bTopLep)];
+        auto const &bTopHadCands = candidates[int(DecayJet::bTopHad)];
+        auto const &q1TopHadCands = candidates[int(DecayJet::q1TopHad)];
+        auto const &q2TopHadCands = candidates[int(DecayJet::q2TopHad)];
+        
+        for (unsigned const iiBTopLepCand: bTopLepCands)
+            for (unsigned const iiBTopHadCand: bTopHadCands)
+            {
+                if (iiBTopLepCand == iiBTopHadCand)
+                    continue;
+                
+                for (unsigned const iiQ1TopHadCand: q1TopHadCands)
+                {
+                    if (iiQ1TopHadCand == iiBTopLepCand or iiQ1TopHadCand == iiBTopHadCand)
+                        continue;
+                    
+                    // When looping for the subleading light-flavour jet, take into account that
+                    //the collection is still ordered in jet pt
+                    for (auto q2It = std::upper_bound(q2TopHadCands.begin(),
+                      q2TopHadCands.end(), iiQ1TopHadCand); q2It != q2TopHadCands.end(); ++q2It)
+                    {
+                        unsigned const iiQ2TopHadCand = *q2It;
+                        
+                        if (iiQ2TopHadCand == iiBTopLepCand or iiQ2TopHadCand == iiBTopHadCand)
+                            continue;
+                        
+                        // An interpretation has been constructed. Evaluate it
+                        double const rank = ComputeRank(iiBTopLepCand, iiBTopHadCand,
+                          iiQ1TopHadCand, iiQ2TopHadCand);
+                        ++numVisitedInterpretations;
+                        
+                        ConsiderInterpretation(rank, iiBTopLepCand, iiBTopHadCand,
+                          iiQ1TopHadCand, iiQ2TopHadCand);
+                    }
+                }
+            }
+    }
+}
+
+
+void TTSemilepRecoBase::SearchSeparable()
+{
+    double const maxRankTopHad = GetRankTopHadUpperBound();
+    
+    for (auto const &candidates: roleCandidates)
+    {
+        auto const &bTopLepCands = candidates[int(DecayJet::bTopLep)];
+        auto const &bTopHadCands = candidates[int(DecayJet::bTopHad)];
+        auto const &q1TopHadCands = candidates[int(DecayJet::q1TopHad)];
+        auto const &q2TopHadCands = candidates[int(DecayJet::q2TopHad)];
+        
+        
+        // Compute ranks of all candidates for the b-quark jet from t -> blv. Only consider jets
+        //that can be paired with at least one candidate for the b-quark jet from t -> bqq
+        topLepCandidates.clear();
+        
+        for (unsigned const iiBTopLepCand: bTopLepCands)
+        {
+            bool pairFound = false;
+            
+            for (unsigned const iiBTopHadCand: bTopHadCands)
+            {
+                if (iiBTopHadCand != iiBTopLepCand and
+                  IsBPairAllowed(iiBTopLepCand, iiBTopHadCand))
+                {
+                    pairFound = true;
+                    break;
+                }
+            }
+            
+            if (not pairFound)
+                continue;
+            
+            double const rank = ComputeRankTopLep(iiBTopLepCand);
+            
+            if (rank > -std::numeric_limits<double>::infinity())
+                topLepCandidates.emplace_back(rank, iiBTopLepCand);
+        }
+        
+        
+        // Sort the candidates in the order of decreasing rank. Candidates with equal ranks are
+        //ordered in jet index, as they would be with a stable sort
+        std::sort(topLepCandidates.begin(), topLepCandidates.end(), CompareTopLepCandidates);
+        
+        
+        // Loop over all admissible triplets of jets from t -> bqq and combine each of them with
+        //the best compatible candidates for the b-quark jet from t -> blv
+        for (unsigned const iiBTopHadCand: bTopHadCands)
+            for (unsigned const iiQ1TopHadCand: q1TopHadCands)
+            {
+                if (iiQ1TopHadCand == iiBTopHadCand)
+                    continue;
+                
+                for (auto q2It = std::upper_bound(q2TopHadCands.begin(), q2TopHadCands.end(),
+                  iiQ1TopHadCand); q2It != q2TopHadCands.end(); ++q2It)
+                {
+                    unsigned const iiQ2TopHadCand = *q2It;
+                    
+                    if (iiQ2TopHadCand == iiBTopHadCand)
+                        continue;
+                    
+                    
+                    // Find the best candidate for the b-quark jet from t -> blv that does not
+                    //overlap with the triplet
+                    auto const isCompatible = [&](std::pair<double, unsigned> const &cand)
+                      {
+                          return (cand.second != iiBTopHadCand and
+                            cand.second != iiQ1TopHadCand and cand.second != iiQ2TopHadCand and
+                            IsBPairAllowed(cand.second, iiBTopHadCand));
+                      };
+                    auto topLepIt = std::find_if(topLepCandidates.begin(),
+                      topLepCandidates.end(), isCompatible);
+                    
+                    if (topLepIt == topLepCandidates.end())
+                        continue;
+                    
+                    
+                    // Skip the triplet if the resulting interpretation cannot be stored
+                    if (topLepIt->first + maxRankTopHad < GetRankThreshold())
+                        continue;
+                    
+                    double const rankTopHad =
+                      ComputeRankTopHad(iiBTopHadCand, iiQ1TopHadCand, iiQ2TopHadCand);
+                    
+                    
+                    // Combine the triplet with compatible candidates in the order of decreasing
+                    //rank. At most maxNumInterpretations of them can be stored
+                    for (unsigned nCombined = 0; nCombined < maxNumInterpretations and
+                      topLepIt != topLepCandidates.end(); ++nCombined)
+                    {
+                        double const rank = topLepIt->first + rankTopHad;
+                        ++numVisitedInterpretations;
+                        
+                        if (not (rank > -std::numeric_limits<double>::infinity()) or
+                          rank < GetRankThreshold())
+                            break;
+                        
+                        ConsiderInterpretation(rank, topLepIt->second, iiBTopHadCand,
+                          iiQ1TopHadCand, iiQ2TopHadCand);
+                        topLepIt = std::find_if(topLepIt + 1, topLepCandidates.end(),
+                          isCompatible);
+                    }
+                }
+            }
+    }
+}
+
+
+void TTSemilepRecoBase::SearchSeparableBatch(unsigned nSelectedJets)
+{
+    FindAllowedBPairs(nSelectedJets);
+    
+    
+    // Collect triplets of jets from t -> bqq from all passes
+    batchBTopLep.clear();
+    batchRanksTopLep.clear();
+    batchBTopHad.clear();
+    batchQ1TopHad.clear();
+    batchQ2TopHad.clear();
+    
+    for (auto const &candidates: roleCandidates)
+    {
+        auto const &bTopLepCands = candidates[int(DecayJet::bTopLep)];
+        auto const &bTopHadCands = candidates[int(DecayJet::bTopHad)];
+        auto const &q1TopHadCands = candidates[int(DecayJet::q1TopHad)];
+        auto const &q2TopHadCands = candidates[int(DecayJet::q2TopHad)];
+        
+        
+        // Compute and sort ranks of candidates for the b-quark jet from t -> blv in the same way
+        //as in the scalar engine
+        topLepCandidates.clear();
+        
+        for (unsigned const iiBTopLepCand: bTopLepCands)
         {
-            if (iiBTopLepCand == iiBTopHadCand)
+            bool pairFound = false;
+            
+            for (unsigned const iiBTopHadCand: bTopHadCands)
+            {
+                if (batchBPairAllowed[iiBTopLepCand * nSelectedJets + iiBTopHadCand])
+                {
+                    pairFound = true;
+                    break;
+                }
+            }
+            
+            if (not pairFound)
                 continue;
             
-            for (unsigned iiQ1TopHadCand = 0; iiQ1TopHadCand < nSelectedJets; ++iiQ1TopHadCand)
+            double const rank = ComputeRankTopLep(iiBTopLepCand);
+            
+            if (rank > -std::numeric_limits<double>::infinity())
+                topLepCandidates.emplace_back(rank, iiBTopLepCand);
+        }
+        
+        std::sort(topLepCandidates.begin(), topLepCandidates.end(), CompareTopLepCandidates);
+        
+        
+        // Collect admissible triplets that can be combined with at least one candidate for the
+        //b-quark jet from t -> blv, together with the best such candidate. If several
+        //interpretations are stored, a triplet is repeated for each of up to
+        //maxNumInterpretations best compatible candidates
+        for (unsigned const iiBTopHadCand: bTopHadCands)
+            for (unsigned const iiQ1TopHadCand: q1TopHadCands)
             {
-                if (iiQ1TopHadCand == iiBTopLepCand or iiQ1TopHadCand == iiBTopHadCand)
+                if (iiQ1TopHadCand == iiBTopHadCand)
                     continue;
                 
-                // When looping for the subleading light-flavour jet, take into account that the
-                //collection is still ordered in jet pt
-                for (unsigned iiQ2TopHadCand = iiQ1TopHadCand + 1; iiQ2TopHadCand < nSelectedJets;
-                  ++iiQ2TopHadCand)
+                for (auto q2It = std::upper_bound(q2TopHadCands.begin(), q2TopHadCands.end(),
+                  iiQ1TopHadCand); q2It != q2TopHadCands.end(); ++q2It)
                 {
-                    if (iiQ2TopHadCand == iiBTopLepCand or iiQ2TopHadCand == iiBTopHadCand)
+                    unsigned const iiQ2TopHadCand = *q2It;
+                    
+                    if (iiQ2TopHadCand == iiBTopHadCand)
                         continue;
                     
-                    // An interpretation has been constructed. Evaluate it
-                    double const rank = ComputeRank(jets.at(selectedJetIndices.at(iiBTopLepCand)),
-                      jets.at(selectedJetIndices.at(iiBTopHadCand)),
-                      jets.at(selectedJetIndices.at(iiQ1TopHadCand)),
-                      jets.at(selectedJetIndices.at(iiQ2TopHadCand)));
+                    unsigned nCombined = 0;
                     
-                    if (rank > highestRank)
+                    for (auto const &cand: topLepCandidates)
                     {
-                        highestRank = rank;
+                        if (cand.second == iiBTopHadCand or cand.second == iiQ1TopHadCand or
+                          cand.second == iiQ2TopHadCand)
+                            continue;
                         
-                        bTopLep = &jets.at(selectedJetIndices.at(iiBTopLepCand));
-                        bTopHad = &jets.at(selectedJetIndices.at(iiBTopHadCand));
-                        q1TopHad = &jets.at(selectedJetIndices.at(iiQ1TopHadCand));
-                        q2TopHad = &jets.at(selectedJetIndices.at(iiQ2TopHadCand));
+                        if (batchBPairAllowed[cand.second * nSelectedJets + iiBTopHadCand])
+                        {
+                            batchBTopLep.push_back(cand.second);
+                            batchRanksTopLep.push_back(cand.first);
+                            batchBTopHad.push_back(iiBTopHadCand);
+                            batchQ1TopHad.push_back(iiQ1TopHadCand);
+                            batchQ2TopHad.push_back(iiQ2TopHadCand);
+                            
+                            if (++nCombined == maxNumInterpretations)
+                                break;
+                        }
                     }
                 }
             }
+    }
+    
+    unsigned const nBatch = batchBTopLep.size();
+    
+    if (nBatch == 0)
+        return;
+    
+    
+    // Rank all triplets at once and add ranks of the matching b-quark jets from t -> blv
+    batchRanks.resize(nBatch);
+    ComputeRankTopHadBatch(nBatch, batchBTopHad.data(), batchQ1TopHad.data(),
+      batchQ2TopHad.data(), batchRanks.data());
+    
+    for (unsigned i = 0; i < nBatch; ++i)
+        batchRanks[i] += batchRanksTopLep[i];
+    
+    numVisitedInterpretations += nBatch;
+    
+    
+    // If several interpretations are stored, consider all of them
+    if (maxNumInterpretations > 1)
+    {
+        for (unsigned i = 0; i < nBatch; ++i)
+            ConsiderInterpretation(batchRanks[i], batchBTopLep[i], batchBTopHad[i],
+              batchQ1TopHad[i], batchQ2TopHad[i]);
+        
+        return;
+    }
+    
+    
+    // Otherwise find the highest rank. Among interpretations with this rank, choose the one that
+    //would have been visited first in the exhaustive search
+    double const maxRank = FindMaximum(nBatch, batchRanks.data());
+    
+    if (not (maxRank > -std::numeric_limits<double>::infinity()))
+        return;
+    
+    for (unsigned i = 0; i < nBatch; ++i)
+    {
+        if (batchRanks[i] == maxRank)
+            ConsiderInterpretation(maxRank, batchBTopLep[i], batchBTopHad[i], batchQ1TopHad[i],
+              batchQ2TopHad[i]);
+    }
+}
+
+
+void TTSemilepRecoBase::SearchSeparableEarlyTermination(unsigned nSelectedJets)
+{
+    double const maxRankTopLep = GetRankTopLepUpperBound();
+    FindAllowedBPairs(nSelectedJets);
+    
+    for (auto const &candidates: roleCandidates)
+    {
+        auto const &bTopLepCands = candidates[int(DecayJet::bTopLep)];
+        auto const &bTopHadCands = candidates[int(DecayJet::bTopHad)];
+        auto const &q1TopHadCands = candidates[int(DecayJet::q1TopHad)];
+        auto const &q2TopHadCands = candidates[int(DecayJet::q2TopHad)];
+        
+        
+        // Collect and rank all admissible triplets of jets from t -> bqq
+        batchBTopHad.clear();
+        batchQ1TopHad.clear();
+        batchQ2TopHad.clear();
+        
+        for (unsigned const iiBTopHadCand: bTopHadCands)
+            for (unsigned const iiQ1TopHadCand: q1TopHadCands)
+            {
+                if (iiQ1TopHadCand == iiBTopHadCand)
+                    continue;
+                
+                for (auto q2It = std::upper_bound(q2TopHadCands.begin(), q2TopHadCands.end(),
+                  iiQ1TopHadCand); q2It != q2TopHadCands.end(); ++q2It)
+                {
+                    if (*q2It == iiBTopHadCand)
+                        continue;
+                    
+                    batchBTopHad.push_back(iiBTopHadCand);
+                    batchQ1TopHad.push_back(iiQ1TopHadCand);
+                    batchQ2TopHad.push_back(*q2It);
+                }
+            }
+        
+        unsigned const nTriplets = batchBTopHad.size();
+        batchRanks.resize(nTriplets);
+        
+        if (engine == Engine::Batch)
+            ComputeRankTopHadBatch(nTriplets, batchBTopHad.data(), batchQ1TopHad.data(),
+              batchQ2TopHad.data(), batchRanks.data());
+        else
+        {
+            for (unsigned i = 0; i < nTriplets; ++i)
+                batchRanks[i] = ComputeRankTopHad(batchBTopHad[i], batchQ1TopHad[i],
+                  batchQ2TopHad[i]);
+        }
+        
+        auto const isCompatible = [&](unsigned iiBTopLepCand, unsigned i)
+          {
+              return (batchQ1TopHad[i] != iiBTopLepCand and batchQ2TopHad[i] != iiBTopLepCand and
+                batchBPairAllowed[iiBTopLepCand * nSelectedJets + batchBTopHad[i]]);
+          };
+        
+        
+        // For each candidate for the b-quark jet from t -> blv, find the highest rank among
+        //compatible triplets. The same candidates as in the scalar engine are considered. They
+        //are sorted in this rank, which, together with the upper bound for ComputeRankTopLep,
+        //gives an upper bound for the rank of any interpretation that includes the candidate
+        topLepCandidates.clear();
+        
+        for (unsigned const iiBTopLepCand: bTopLepCands)
+        {
+            bool pairFound = false;
+            
+            for (unsigned const iiBTopHadCand: bTopHadCands)
+            {
+                if (batchBPairAllowed[iiBTopLepCand * nSelectedJets + iiBTopHadCand])
+                {
+                    pairFound = true;
+                    break;
+                }
+            }
+            
+            if (not pairFound)
+                continue;
+            
+            double maxRankTopHad = -std::numeric_limits<double>::infinity();
+            
+            for (unsigned i = 0; i < nTriplets; ++i)
+            {
+                if (isCompatible(iiBTopLepCand, i) and batchRanks[i] > maxRankTopHad)
+                    maxRankTopHad = batchRanks[i];
+            }
+            
+            topLepCandidates.emplace_back(maxRankTopHad, iiBTopLepCand);
+        }
+        
+        std::sort(topLepCandidates.begin(), topLepCandidates.end(), CompareTopLepCandidates);
+        
+        
+        // Evaluate the candidates and combine them with all compatible triplets. Stop as soon as
+        //the upper bound for the current candidate, and thus for all the remaining ones, is
+        //below the rank needed to store an interpretation
+        for (auto const &cand: topLepCandidates)
+        {
+            if (cand.first + maxRankTopLep < GetRankThreshold())
+                break;
+            
+            double const rankTopLep = ComputeRankTopLep(cand.second);
+            
+            if (not (rankTopLep > -std::numeric_limits<double>::infinity()))
+                continue;
+            
+            for (unsigned i = 0; i < nTriplets; ++i)
+            {
+                if (not isCompatible(cand.second, i))
+                    continue;
+                
+                ++numVisitedInterpretations;
+                ConsiderInterpretation(rankTopLep + batchRanks[i], cand.second, batchBTopHad[i],
+                  batchQ1TopHad[i], batchQ2TopHad[i]);
+            }
         }
+    }
     
     
-    recoStatus = 0;
+    // If no interpretation has been stored, no candidate has been skipped, but triplets have been
+    //ranked regardless of whether they can form a valid interpretation. Repeat the search so that
+    //the derived class observes the same calls as without early termination. This is only done
+    //in events in which the reconstruction fails, and ranks of candidates for the b-quark jet
+    //from t -> blv are usually cached by the derived class.
+    if (interpretations.empty())
+    {
+        BeginRepeatedSearch();
+        
+        if (engine == Engine::Scalar)
+            SearchSeparable();
+        else
+            SearchSeparableBatch(nSelectedJets);
+    }
 }
 
 
@@ -179,6 +854,172 @@ void TTSemilepRecoBase::SetRecoFailure(unsigned code)
 }
 
 
+RecoJetCache const &TTSemilepRecoBase::GetJetCache() const
+{
+    return jetCache;
+}
+
+
+Jet const &TTSemilepRecoBase::GetSelectedJet(unsigned index) const
+{
+    return (*jets)[selectedJetIndices[index]];
+}
+
+
+unsigned TTSemilepRecoBase::GetSelectedJetSourceIndex(unsigned index) const
+{
+    return selectedJetIndices[index];
+}
+
+
+unsigned TTSemilepRecoBase::GetBestJetIndex(DecayJet type) const
+{
+    if (not bTopLep)
+        throw std::runtime_error("TTSemilepRecoBase::GetBestJetIndex: No interpretation has been "
+          "accepted in the current event.");
+    
+    return bestJetIndices[int(type)];
+}
+
+
+bool TTSemilepRecoBase::IsSearchSeparable() const
+{
+    return IsRankSeparable() and engine != Engine::Exhaustive;
+}
+
+
+void TTSemilepRecoBase::AcceptInterpretation(double rank, unsigned bTopLep_, unsigned bTopHad_,
+  unsigned q1TopHad_, unsigned q2TopHad_)
+{
+    highestRank = rank;
+    bestJetIndices = {{bTopLep_, bTopHad_, q1TopHad_, q2TopHad_}};
+    
+    bTopLep = &GetSelectedJet(bTopLep_);
+    bTopHad = &GetSelectedJet(bTopHad_);
+    q1TopHad = &GetSelectedJet(q1TopHad_);
+    q2TopHad = &GetSelectedJet(q2TopHad_);
+}
+
+
+void TTSemilepRecoBase::ConsiderInterpretation(double rank, unsigned bTopLep_, unsigned bTopHad_,
+  unsigned q1TopHad_, unsigned q2TopHad_)
+{
+    if (not (rank > -std::numeric_limits<double>::infinity()))
+        return;
+    
+    
+    // Interpretations are not necessarily visited in the same order as in a plain exhaustive
+    //search over all jets. In case of equal ranks, prefer the one that would have been visited
+    //first there
+    std::array<unsigned, 4> const jetIndices{{bTopLep_, bTopHad_, q1TopHad_, q2TopHad_}};
+    unsigned pos = interpretations.size();
+    
+    while (pos > 0 and (rank > interpretations[pos - 1].rank or
+      (rank == interpretations[pos - 1].rank and jetIndices < interpretations[pos - 1].jetIndices)))
+        --pos;
+    
+    if (pos == maxNumInterpretations or
+      (pos > 0 and interpretations[pos - 1].jetIndices == jetIndices))
+        return;
+    
+    
+    // Insert the interpretation. Memory has been reserved, and no reallocation takes place
+    if (interpretations.size() == maxNumInterpretations)
+        interpretations.pop_back();
+    
+    interpretations.insert(interpretations.begin() + pos,
+      Interpretation{rank, jetIndices, TLorentzVector()});
+    
+    if (pos == 0)
+        AcceptInterpretation(rank, bTopLep_, bTopHad_, q1TopHad_, q2TopHad_);
+}
+
+
+void TTSemilepRecoBase::FindAllowedBPairs(unsigned nSelectedJets)
+{
+    batchBPairAllowed.assign(nSelectedJets * nSelectedJets, false);
+    
+    for (unsigned iiBTopLepCand = 0; iiBTopLepCand < nSelectedJets; ++iiBTopLepCand)
+        for (unsigned iiBTopHadCand = 0; iiBTopHadCand < nSelectedJets; ++iiBTopHadCand)
+        {
+            if (iiBTopHadCand != iiBTopLepCand)
+                batchBPairAllowed[iiBTopLepCand * nSelectedJets + iiBTopHadCand] =
+                  IsBPairAllowed(iiBTopLepCand, iiBTopHadCand);
+        }
+}
+
+
+void TTSemilepRecoBase::BeginRepeatedSearch()
+{}
+
+
+double TTSemilepRecoBase::ComputeRankTopLep(unsigned)
+{
+    throw std::runtime_error("TTSemilepRecoBase::ComputeRankTopLep: The method must be "
+      "reimplemented in a derived class that declares a separable rank.");
+}
+
+
+double TTSemilepRecoBase::ComputeRankTopHad(unsigned, unsigned, unsigned)
+{
+    throw std::runtime_error("TTSemilepRecoBase::ComputeRankTopHad: The method must be "
+      "reimplemented in a derived class that declares a separable rank.");
+}
+
+
+void TTSemilepRecoBase::ComputeRankTopHadBatch(unsigned n, unsigned const *bTopHad_,
+  unsigned const *q1TopHad_, unsigned const *q2TopHad_, double *ranks)
+{
+    for (unsigned i = 0; i < n; ++i)
+        ranks[i] = ComputeRankTopHad(bTopHad_[i], q1TopHad_[i], q2TopHad_[i]);
+}
+
+
+unsigned TTSemilepRecoBase::GetNumAssignmentPasses() const
+{
+    return 1;
+}
+
+
+double TTSemilepRecoBase::GetRankTopHadUpperBound() const
+{
+    return std::numeric_limits<double>::infinity();
+}
+
+
+double TTSemilepRecoBase::GetRankTopLepUpperBound() const
+{
+    return std::numeric_limits<double>::infinity();
+}
+
+
+double TTSemilepRecoBase::GetRankThreshold() const
+{
+    if (interpretations.size() < maxNumInterpretations)
+        return -std::numeric_limits<double>::infinity();
+    else
+        return interpretations.back().rank;
+}
+
+
+bool TTSemilepRecoBase::IsBPairAllowed(unsigned, unsigned)
+{
+    return true;
+}
+
+
+bool TTSemilepRecoBase::IsJetAdmissible(unsigned, DecayJet, unsigned) const
+{
+    return true;
+}
+
+
+bool TTSemilepRecoBase::IsRankSeparable() const
+{
+    return false;
+}
+
+
 bool TTSemilepRecoBase::ProcessEvent()
 {
     PerformJetAssignment(jetmetPlugin->GetJets());
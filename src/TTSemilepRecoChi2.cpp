@@ -6,55 +6,18 @@
 #include <mensura/core/JetMETReader.hpp>
 #include <mensura/core/Processor.hpp>
 
+#include <algorithm>
 #include <cmath>
 #include <limits>
 #include <stdexcept>
 
 
-
-// Functions defining various types of chi2 terms
-double exprMassTopLep(Lepton const &l, Candidate const &nu, Jet const &bTopLep,  Jet const &,
-  Jet const &, Jet const &)
-{
-    return (l.P4() + nu.P4() + bTopLep.P4()).M();
-}
-
-
-double exprMassTopHad(Lepton const &, Candidate const &, Jet const &, Jet const &bTopHad,
-  Jet const &q1TopHad, Jet const &q2TopHad)
-{
-    return (bTopHad.P4() + q1TopHad.P4() + q2TopHad.P4()).M();
-}
-
-
-double exprMassWHad(Lepton const &, Candidate const &, Jet const &, Jet const &,
-  Jet const &q1TopHad, Jet const &q2TopHad)
-{
-    return (q1TopHad.P4() + q2TopHad.P4()).M();
-}
-
-
-double exprPtTT(Lepton const &l, Candidate const &nu, Jet const &bTopLep, Jet const &bTopHad,
-  Jet const &q1TopHad, Jet const &q2TopHad)
-{
-    return (l.P4() + nu.P4() + bTopLep.P4() + bTopHad.P4() + q1TopHad.P4() + q2TopHad.P4()).Pt();
-}
-
-
-
-double TTSemilepRecoChi2::Chi2Term::Eval(Lepton const &l, Candidate const &nu, Jet const &bTopLep,
-  Jet const &bTopHad, Jet const &q1TopHad, Jet const &q2TopHad) const
-{
-    double const x = expression(l, nu, bTopLep, bTopHad, q1TopHad, q2TopHad);
-    return std::pow((x - mean) / variance, 2);
-}
-
-
-
 TTSemilepRecoChi2::TTSemilepRecoChi2(std::string name /*= "TTReco"*/):
     TTSemilepRecoBase(name),
     leptonPluginName("Leptons"), leptonPlugin(nullptr),
-    nuRecoPluginName("NuReco"), nuRecoPlugin(nullptr)
+    nuRecoPluginName("NuReco"), nuRecoPlugin(nullptr),
+    lepton(nullptr), nuCandidates(nullptr),
+    numNeutrinos(0)
 {}
 
 
@@ -66,7 +29,9 @@ TTSemilepRecoChi2::TTSemilepRecoChi2(TTSemilepRecoChi2 const &src) noexcept:
     TTSemilepRecoBase(src),
     leptonPluginName(src.leptonPluginName), leptonPlugin(nullptr),
     nuRecoPluginName(src.nuRecoPluginName), nuRecoPlugin(nullptr),
-    chi2Terms(src.chi2Terms)
+    lepton(nullptr), nuCandidates(nullptr),
+    chi2Terms(src.chi2Terms),
+    numNeutrinos(0)
 {}
 
 
@@ -75,19 +40,10 @@ void TTSemilepRecoChi2::AddChi2Term(Expression expression, double mean, double v
     switch (expression)
     {
         case Expression::MassTopLep:
-            chi2Terms.emplace_back(Chi2Term{exprMassTopLep, mean, variance});
-            break;
-        
         case Expression::MassTopHad:
-            chi2Terms.emplace_back(Chi2Term{exprMassTopHad, mean, variance});
-            break;
-        
         case Expression::MassWHad:
-            chi2Terms.emplace_back(Chi2Term{exprMassWHad, mean, variance});
-            break;
-        
         case Expression::PtTT:
-            chi2Terms.emplace_back(Chi2Term{exprPtTT, mean, variance});
+            chi2Terms.emplace_back(Chi2Term{expression, mean, variance});
             break;
         
         default:
@@ -116,13 +72,11 @@ Plugin *TTSemilepRecoChi2::Clone() const
 
 Lepton const &TTSemilepRecoChi2::GetLepton() const
 {
-    auto const &leptons = leptonPlugin->GetLeptons();
-    
-    if (leptons.size() == 0)
+    if (not lepton)
         throw std::runtime_error("TTSemilepRecoChi2::GetLepton: Current event contains no "
           "leptons.");
     
-    return leptons.front();
+    return *lepton;
 }
 
 
@@ -136,21 +90,102 @@ Candidate const &TTSemilepRecoChi2::GetNeutrino() const
 }
 
 
-double TTSemilepRecoChi2::ComputeRank(Jet const &bTopLep, Jet const &bTopHad, Jet const &q1TopHad,
-  Jet const &q2TopHad)
+void TTSemilepRecoChi2::CacheTopLep(unsigned bTopLep)
+{
+    if (topLepCached[bTopLep])
+        return;
+    
+    
+    // Sum up the four-momenta of the lepton and the b-quark jet. Only the first lepton is used
+    auto const &jets = GetJetCache();
+    auto const &p4Lep = lepton->P4();
+    
+    double const pxLepB = p4Lep.Px() + jets.Px(bTopLep);
+    double const pyLepB = p4Lep.Py() + jets.Py(bTopLep);
+    double const pzLepB = p4Lep.Pz() + jets.Pz(bTopLep);
+    double const eLepB = p4Lep.E() + jets.E(bTopLep);
+    
+    
+    // Add each neutrino candidate and evaluate the relevant chi^2 terms
+    auto const &neutrinos = *nuCandidates;
+    
+    for (unsigned iNu = 0; iNu < numNeutrinos; ++iNu)
+    {
+        auto const &p4Nu = neutrinos[iNu].P4();
+        unsigned const index = GetTopLepIndex(bTopLep, iNu);
+        
+        topLepPx[index] = pxLepB + p4Nu.Px();
+        topLepPy[index] = pyLepB + p4Nu.Py();
+        
+        double const pz = pzLepB + p4Nu.Pz();
+        double const e = eLepB + p4Nu.E();
+        double const mass2 = e * e - (topLepPx[index] * topLepPx[index] +
+          topLepPy[index] * topLepPy[index] + pz * pz);
+        
+        // Follow the convention of TLorentzVector::M for negative squared masses
+        double const mass = (mass2 < 0.) ? -std::sqrt(-mass2) : std::sqrt(mass2);
+        
+        double chi2 = 0.;
+        
+        for (auto const &term: chi2Terms)
+        {
+            if (term.type == Expression::MassTopLep)
+                chi2 += term.Eval(mass);
+        }
+        
+        topLepChi2[index] = chi2;
+    }
+    
+    topLepCached[bTopLep] = true;
+}
+
+
+double TTSemilepRecoChi2::ComputeRank(unsigned bTopLep, unsigned bTopHad, unsigned q1TopHad,
+  unsigned q2TopHad)
 {
+    // Evaluate terms that do not depend on the neutrino
+    CacheTopLep(bTopLep);
+    
+    auto const &jets = GetJetCache();
+    double chi2TopHad = 0.;
+    bool ptTTNeeded = false;
+    
+    for (auto const &term: chi2Terms)
+    {
+        if (term.type == Expression::MassTopHad)
+            chi2TopHad += term.Eval(jets.GetMassTriplet(bTopHad, q1TopHad, q2TopHad));
+        else if (term.type == Expression::MassWHad)
+            chi2TopHad += term.Eval(jets.GetMassPair(q1TopHad, q2TopHad));
+        else if (term.type == Expression::PtTT)
+            ptTTNeeded = true;
+    }
+    
+    double const pxTopHad = jets.Px(bTopHad) + jets.Px(q1TopHad) + jets.Px(q2TopHad);
+    double const pyTopHad = jets.Py(bTopHad) + jets.Py(q1TopHad) + jets.Py(q2TopHad);
+    
+    
     // There might be several solutions for neutrino. Loop over all of them and find the minimal
     //chi^2 for the probed jet assignment
+    auto const &neutrinos = *nuCandidates;
     double minChi2CurInterp = std::numeric_limits<double>::infinity();
     
-    for (auto const &nu: nuRecoPlugin->GetNeutrinos())
+    for (unsigned iNu = 0; iNu < numNeutrinos; ++iNu)
     {
-        // Calculate the chi^2 for the current neutrino solution. Only the first lepton is used
-        double chi2 = 0.;
+        unsigned const index = GetTopLepIndex(bTopLep, iNu);
+        double chi2 = topLepChi2[index] + chi2TopHad;
         
-        for (auto const &term: chi2Terms)
-            chi2 += term.Eval(leptonPlugin->GetLeptons().front(), nu, bTopLep, bTopHad, q1TopHad,
-              q2TopHad);
+        if (ptTTNeeded)
+        {
+            double const px = topLepPx[index] + pxTopHad;
+            double const py = topLepPy[index] + pyTopHad;
+            double const ptTT = std::sqrt(px * px + py * py);
+            
+            for (auto const &term: chi2Terms)
+            {
+                if (term.type == Expression::PtTT)
+                    chi2 += term.Eval(ptTT);
+            }
+        }
         
         
         // Update the minimal chi^2 in the current interpretation
@@ -162,7 +197,7 @@ double TTSemilepRecoChi2::ComputeRank(Jet const &bTopLep, Jet const &bTopHad, Je
         if (chi2 < minChi2)
         {
             minChi2 = chi2;
-            bestNu = &nu;
+            bestNu = &neutrinos[iNu];
         }
     }
     
@@ -173,26 +208,208 @@ double TTSemilepRecoChi2::ComputeRank(Jet const &bTopLep, Jet const &bTopHad, Je
 }
 
 
+double TTSemilepRecoChi2::ComputeRankTopLep(unsigned bTopLep)
+{
+    // Find the neutrino solution that gives the minimal chi^2. Terms for the semileptonically
+    //decaying top quark do not depend on jets from t -> bqq
+    CacheTopLep(bTopLep);
+    
+    auto const &neutrinos = *nuCandidates;
+    double minChi2TopLep = std::numeric_limits<double>::infinity();
+    topLepNeutrinos[bTopLep] = nullptr;
+    
+    for (unsigned iNu = 0; iNu < numNeutrinos; ++iNu)
+    {
+        double const chi2 = topLepChi2[GetTopLepIndex(bTopLep, iNu)];
+        
+        if (chi2 < minChi2TopLep)
+        {
+            minChi2TopLep = chi2;
+            topLepNeutrinos[bTopLep] = &neutrinos[iNu];
+        }
+    }
+    
+    return -minChi2TopLep;
+}
+
+
+double TTSemilepRecoChi2::ComputeRankTopHad(unsigned bTopHad, unsigned q1TopHad,
+  unsigned q2TopHad)
+{
+    // Terms for the hadronically decaying top quark do not depend on the lepton, the neutrino,
+    //and the b-quark jet from t -> blv
+    auto const &jets = GetJetCache();
+    double chi2 = 0.;
+    
+    for (auto const &term: chi2Terms)
+    {
+        if (term.type == Expression::MassTopHad)
+            chi2 += term.Eval(jets.GetMassTriplet(bTopHad, q1TopHad, q2TopHad));
+        else if (term.type == Expression::MassWHad)
+            chi2 += term.Eval(jets.GetMassPair(q1TopHad, q2TopHad));
+    }
+    
+    return -chi2;
+}
+
+
+void TTSemilepRecoChi2::ComputeRankTopHadBatch(unsigned n, unsigned const *bTopHad,
+  unsigned const *q1TopHad, unsigned const *q2TopHad, double *ranks)
+{
+    // Read masses from the cache
+    batchMassW.resize(n);
+    batchMassTop.resize(n);
+    GetJetCache().GetMassesBatch(n, bTopHad, q1TopHad, q2TopHad, batchMassW.data(),
+      batchMassTop.data());
+    
+    
+    // Sum up the chi^2 terms. They are added in the same order as in ComputeRankTopHad, which
+    //guarantees identical results. The inner loops are simple enough to be vectorized by the
+    //compiler
+    std::fill(ranks, ranks + n, 0.);
+    
+    for (auto const &term: chi2Terms)
+    {
+        double const *masses;
+        
+        if (term.type == Expression::MassTopHad)
+            masses = batchMassTop.data();
+        else if (term.type == Expression::MassWHad)
+            masses = batchMassW.data();
+        else
+            continue;
+        
+        for (unsigned i = 0; i < n; ++i)
+        {
+            double const d = (masses[i] - term.mean) / term.variance;
+            ranks[i] += d * d;
+        }
+    }
+    
+    for (unsigned i = 0; i < n; ++i)
+        ranks[i] = -ranks[i];
+}
+
+
+TLorentzVector const &TTSemilepRecoChi2::GetNeutrinoP4(unsigned bTopLep, unsigned bTopHad,
+  unsigned q1TopHad, unsigned q2TopHad) const
+{
+    // In the search for a separable rank, the best neutrino is cached for each b-quark jet from
+    //t -> blv
+    if (IsSearchSeparable())
+        return topLepNeutrinos[bTopLep]->P4();
+    
+    
+    // Otherwise repeat the minimization over neutrino solutions performed in ComputeRank. Terms
+    //that do not depend on the neutrino are omitted
+    auto const &jets = GetJetCache();
+    double const pxTopHad = jets.Px(bTopHad) + jets.Px(q1TopHad) + jets.Px(q2TopHad);
+    double const pyTopHad = jets.Py(bTopHad) + jets.Py(q1TopHad) + jets.Py(q2TopHad);
+    
+    auto const &neutrinos = *nuCandidates;
+    unsigned bestIndex = 0;
+    double minChi2Nu = std::numeric_limits<double>::infinity();
+    
+    for (unsigned iNu = 0; iNu < numNeutrinos; ++iNu)
+    {
+        unsigned const index = GetTopLepIndex(bTopLep, iNu);
+        double const px = topLepPx[index] + pxTopHad;
+        double const py = topLepPy[index] + pyTopHad;
+        double const ptTT = std::sqrt(px * px + py * py);
+        double chi2 = topLepChi2[index];
+        
+        for (auto const &term: chi2Terms)
+        {
+            if (term.type == Expression::PtTT)
+                chi2 += term.Eval(ptTT);
+        }
+        
+        if (chi2 < minChi2Nu)
+        {
+            minChi2Nu = chi2;
+            bestIndex = iNu;
+        }
+    }
+    
+    return neutrinos[bestIndex].P4();
+}
+
+
+double TTSemilepRecoChi2::GetRankTopHadUpperBound() const
+{
+    return 0.;
+}
+
+
+double TTSemilepRecoChi2::GetRankTopLepUpperBound() const
+{
+    return 0.;
+}
+
+
+bool TTSemilepRecoChi2::IsRankSeparable() const
+{
+    for (auto const &term: chi2Terms)
+    {
+        if (term.type == Expression::PtTT)
+            return false;
+    }
+    
+    return true;
+}
+
+
 bool TTSemilepRecoChi2::ProcessEvent()
+{
+    allocationCheck.Begin();
+    
+    auto const &leptons = leptonPlugin->GetLeptons();
+    ReconstructEvent((leptons.size() > 0) ? &leptons.front() : nullptr,
+      nuRecoPlugin->GetNeutrinos(), jetmetPlugin->GetJets());
+    
+    allocationCheck.End(GetName());
+    
+    
+    // Always return true since this plugin does not filter events
+    return true;
+}
+
+
+void TTSemilepRecoChi2::ReconstructEvent(Lepton const *lepton_,
+  std::vector<Candidate> const &neutrinos, std::vector<Jet> const &jets)
 {
     // Reset data describing best solution for neutrino
     minChi2 = std::numeric_limits<double>::infinity();
     bestNu = nullptr;
+    lepton = lepton_;
+    nuCandidates = &neutrinos;
     
     
     // Do not attempt reconstruction if the current event contains no leptons or no reconstructed
-    // neutrinos. However, do not reject the event
-    if (leptonPlugin->GetLeptons().size() == 0 or nuRecoPlugin->GetNeutrinos().size() == 0)
+    // neutrinos
+    if (not lepton or neutrinos.size() == 0)
     {
         SetRecoFailure(1);
-        return true;
+        return;
     }
     
     
+    // Reset the cache for the semileptonically decaying top quark. Its size is set to the total
+    //number of jets, which is not smaller than the number of jets passing the selection
+    numNeutrinos = neutrinos.size();
+    topLepNeutrinos.resize(jets.size());
+    topLepCached.assign(jets.size(), false);
+    topLepChi2.resize(jets.size() * numNeutrinos);
+    topLepPx.resize(jets.size() * numNeutrinos);
+    topLepPy.resize(jets.size() * numNeutrinos);
+    
+    
     // Perform jet assigment calling dedicated method from the base class
-    PerformJetAssignment(jetmetPlugin->GetJets());
+    PerformJetAssignment(jets);
     
     
-    // Always return true since this plugin does not filter events
-    return true;
+    // In the search for a separable rank, the best neutrino is cached for each b-quark jet from
+    //t -> blv
+    if (IsSearchSeparable() and GetRank() > -std::numeric_limits<double>::infinity())
+        bestNu = topLepNeutrinos[GetBestJetIndex(DecayJet::bTopLep)];
 }
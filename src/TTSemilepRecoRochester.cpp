@@ -1,6 +1,8 @@
 #include <TTSemilepRecoRochester.hpp>
 
-#include <NuRecoRochester.hpp>
+#include <JetFlags.hpp>
+#include <LikelihoodFile.hpp>
+#include <NuKernels.hpp>
 
 #include <mensura/core/FileInPath.hpp>
 #include <mensura/core/JetMETReader.hpp>
@@ -9,18 +11,85 @@
 #include <mensura/core/ROOTLock.hpp>
 
 #include <TFile.h>
+#include <TH1.h>
+#include <TH2.h>
 
+#include <atomic>
 #include <cmath>
+#include <iomanip>
+#include <iostream>
 #include <limits>
 #include <sstream>
 #include <stdexcept>
 
 
+/**
+ * \brief Accumulates numbers of lookups of neutrino ellipses over clones of a plugin
+ * 
+ * The hit rate is printed when the object is destroyed, i.e. when the last clone sharing it is
+ * destroyed.
+ */
+class TTSemilepRecoRochester::NuEllipseStats
+{
+public:
+    NuEllipseStats(std::string const &pluginName, std::string const &sourceName);
+    
+    ~NuEllipseStats();
+    
+public:
+    /// Adds numbers of lookups and successful ones
+    void Add(unsigned long lookups, unsigned long hits);
+    
+private:
+    /// Names of the plugin and the source of ellipses
+    std::string pluginName, sourceName;
+    
+    /// Total numbers of lookups and successful ones
+    std::atomic<unsigned long> lookups, hits;
+};
+
+
+TTSemilepRecoRochester::NuEllipseStats::NuEllipseStats(std::string const &pluginName_,
+  std::string const &sourceName_):
+    pluginName(pluginName_), sourceName(sourceName_),
+    lookups(0), hits(0)
+{}
+
+
+TTSemilepRecoRochester::NuEllipseStats::~NuEllipseStats()
+{
+    if (lookups == 0)
+        return;
+    
+    std::ostringstream message;
+    message << "TTSemilepRecoRochester[\"" << pluginName << "\"]: Neutrino ellipses reused from "
+      "plugin \"" << sourceName << "\" in " << hits << " of " << lookups << " lookups (" <<
+      std::fixed << std::setprecision(1) << 100. * hits / lookups << "%).\n";
+    std::cout << message.str() << std::flush;
+}
+
+
+void TTSemilepRecoRochester::NuEllipseStats::Add(unsigned long lookups_, unsigned long hits_)
+{
+    lookups += lookups_;
+    hits += hits_;
+}
+
+
 TTSemilepRecoRochester::TTSemilepRecoRochester(std::string name /*= "TTReco"*/):
     TTSemilepRecoBase(name),
     leptonPluginName("Leptons"), leptonPlugin(nullptr),
+    maxLogLikelihoodNu(std::numeric_limits<double>::infinity()),
+    maxLogLikelihoodMass(std::numeric_limits<double>::infinity()),
     bTagAlgorithm(BTagger::Algorithm::CSV), bTagCut(-std::numeric_limits<double>::infinity()),
-    bTagSelAtLeastOne(false)
+    bTagWorkingPoint(BTagger::WorkingPoint::Medium),
+    jetFlagsPluginName(""), jetFlagsPlugin(nullptr), bTagMask(0), jetFlags(nullptr),
+    bTagSelAtLeastOne(false), maxBTagLight(std::numeric_limits<double>::infinity()),
+    nuMinimizer(NuRecoRochester::Minimizer::StepHalving), nuMinimizerTolerance(1e-5),
+    nuValidationPrecision(0.),
+    nuEllipseSource(nullptr),
+    nuEllipseLookups(0), nuEllipseHits(0),
+    batchCapacity(0), batchEllipsesReady(false)
 {}
 
 
@@ -28,8 +97,18 @@ TTSemilepRecoRochester::TTSemilepRecoRochester(TTSemilepRecoRochester const &src
     TTSemilepRecoBase(src),
     leptonPluginName(src.leptonPluginName), leptonPlugin(nullptr),
     likelihoodNeutrino(src.likelihoodNeutrino), likelihoodMass(src.likelihoodMass),
+    maxLogLikelihoodNu(src.maxLogLikelihoodNu), maxLogLikelihoodMass(src.maxLogLikelihoodMass),
     bTagAlgorithm(src.bTagAlgorithm), bTagCut(src.bTagCut),
-    bTagSelAtLeastOne(src.bTagSelAtLeastOne)
+    bTagWorkingPoint(src.bTagWorkingPoint),
+    jetFlagsPluginName(src.jetFlagsPluginName), jetFlagsPlugin(nullptr), bTagMask(0),
+    jetFlags(nullptr),
+    bTagSelAtLeastOne(src.bTagSelAtLeastOne), maxBTagLight(src.maxBTagLight),
+    nuMinimizer(src.nuMinimizer), nuMinimizerTolerance(src.nuMinimizerTolerance),
+    nuValidationPrecision(src.nuValidationPrecision),
+    nuEllipseSourceName(src.nuEllipseSourceName), nuEllipseSource(nullptr),
+    nuEllipseLookups(0), nuEllipseHits(0),
+    nuEllipseStats(src.nuEllipseStats),
+    batchCapacity(0), batchEllipsesReady(false)
 {}
 
 
@@ -40,6 +119,29 @@ void TTSemilepRecoRochester::BeginRun(Dataset const &dataset)
     // Save pointers to additional readers
     leptonPlugin = dynamic_cast<LeptonReader const *>(GetDependencyPlugin(leptonPluginName));
     
+    if (not nuEllipseSourceName.empty())
+    {
+        nuEllipseSource = dynamic_cast<TTSemilepRecoRochester const *>(
+          GetDependencyPlugin(nuEllipseSourceName));
+        
+        if (not nuEllipseSource)
+        {
+            std::ostringstream message;
+            message << "TTSemilepRecoRochester[\"" << GetName() <<
+              "\"]::BeginRun: Plugin \"" << nuEllipseSourceName << "\" is not an instance of "
+              "TTSemilepRecoRochester.";
+            throw std::runtime_error(message.str());
+        }
+    }
+    
+    nuEllipseLookups = nuEllipseHits = 0;
+    
+    if (not jetFlagsPluginName.empty())
+    {
+        jetFlagsPlugin = dynamic_cast<JetFlags const *>(GetDependencyPlugin(jetFlagsPluginName));
+        bTagMask = jetFlagsPlugin->GetBTagMask(BTagger(bTagAlgorithm, bTagWorkingPoint));
+    }
+    
     
     // Make sure histograms with likelihoods have been provided
     if (not likelihoodNeutrino or not likelihoodMass)
@@ -58,6 +160,27 @@ Plugin *TTSemilepRecoRochester::Clone() const
 }
 
 
+void TTSemilepRecoRochester::EndRun()
+{
+    if (nuEllipseStats)
+        nuEllipseStats->Add(nuEllipseLookups, nuEllipseHits);
+}
+
+
+NuRecoRochester const *TTSemilepRecoRochester::FindNuEllipse(TLorentzVector const &p4Lep,
+  TLorentzVector const &p4BJet) const
+{
+    // The number of ellipses is bounded by the number of jets, so a linear search is sufficient
+    for (auto const &ellipse: nuEllipses)
+    {
+        if (ellipse.p4BJet == p4BJet and ellipse.p4Lep == p4Lep)
+            return &ellipse.nuBuilder;
+    }
+    
+    return nullptr;
+}
+
+
 Lepton const &TTSemilepRecoRochester::GetLepton() const
 {
     if (not lepton)
@@ -92,6 +215,45 @@ void TTSemilepRecoRochester::SetBTagSelection(BTagger::Algorithm algorithm, doub
     bTagAlgorithm = algorithm;
     bTagCut = cut;
     bTagSelAtLeastOne = atLeastOne;
+    jetFlagsPluginName = "";
+}
+
+
+void TTSemilepRecoRochester::SetBTagSelection(BTagger const &bTagger,
+  bool atLeastOne /*= false*/, std::string const &jetFlagsPluginName_ /*= "JetFlags"*/)
+{
+    bTagAlgorithm = bTagger.GetAlgorithm();
+    bTagWorkingPoint = bTagger.GetWorkingPoint();
+    bTagCut = -std::numeric_limits<double>::infinity();
+    bTagSelAtLeastOne = atLeastOne;
+    jetFlagsPluginName = jetFlagsPluginName_;
+}
+
+
+void TTSemilepRecoRochester::SetLightJetBTagVeto(double maxBTag)
+{
+    maxBTagLight = maxBTag;
+}
+
+
+void TTSemilepRecoRochester::SetNuMinimizer(NuRecoRochester::Minimizer minimizer,
+  double tolerance /*= 1e-5*/, double validationPrecision /*= 0.*/)
+{
+    nuMinimizer = minimizer;
+    nuMinimizerTolerance = tolerance;
+    nuValidationPrecision = validationPrecision;
+}
+
+
+void TTSemilepRecoRochester::SetNuEllipseSource(std::string const &pluginName,
+  bool printStats /*= false*/)
+{
+    nuEllipseSourceName = pluginName;
+    
+    if (printStats)
+        nuEllipseStats.reset(new NuEllipseStats(GetName(), pluginName));
+    else
+        nuEllipseStats.reset();
 }
 
 
@@ -101,6 +263,28 @@ void TTSemilepRecoRochester::SetLikelihood(std::string const &path,
 {
     // Open file defining likelihoods
     std::string const resolvedPath(FileInPath::Resolve(path));
+    std::string const rootExtension(".root");
+    
+    if (resolvedPath.size() < rootExtension.size() or resolvedPath.compare(
+      resolvedPath.size() - rootExtension.size(), rootExtension.size(), rootExtension) != 0)
+    {
+        // This is a binary file with precomputed tables
+        LikelihoodFile inputFile(resolvedPath);
+        likelihoodNeutrino = inputFile.GetTable(histNeutrinoName);
+        likelihoodMass = inputFile.GetTable(histMassName);
+        
+        if (likelihoodNeutrino->GetDimension() != 1 or likelihoodMass->GetDimension() != 2)
+        {
+            std::ostringstream message;
+            message << "TTSemilepRecoRochester[\"" << GetName() << "\"]::SetLikelihood: " <<
+              "Tables in file \"" << resolvedPath << "\" have unexpected dimensions.";
+            throw std::runtime_error(message.str());
+        }
+        
+        maxLogLikelihoodNu = likelihoodNeutrino->GetMaxValue();
+        maxLogLikelihoodMass = likelihoodMass->GetMaxValue();
+        return;
+    }
     
     ROOTLock::Lock();
     TFile inputFile(resolvedPath.c_str());
@@ -118,9 +302,9 @@ void TTSemilepRecoRochester::SetLikelihood(std::string const &path,
     // Read the histograms
     ROOTLock::Lock();
     
-    likelihoodNeutrino.reset(dynamic_cast<TH1 *>(inputFile.Get(histNeutrinoName.c_str())));
+    std::unique_ptr<TH1> histNeutrino(dynamic_cast<TH1 *>(inputFile.Get(histNeutrinoName.c_str())));
     
-    if (not likelihoodNeutrino)
+    if (not histNeutrino)
     {
         ROOTLock::Unlock();
         
@@ -130,9 +314,9 @@ void TTSemilepRecoRochester::SetLikelihood(std::string const &path,
         throw std::runtime_error(message.str());
     }
     
-    likelihoodMass.reset(dynamic_cast<TH2 *>(inputFile.Get(histMassName.c_str())));
+    std::unique_ptr<TH2> histMass(dynamic_cast<TH2 *>(inputFile.Get(histMassName.c_str())));
     
-    if (not likelihoodMass)
+    if (not histMass)
     {
         ROOTLock::Unlock();
         
@@ -142,139 +326,379 @@ void TTSemilepRecoRochester::SetLikelihood(std::string const &path,
         throw std::runtime_error(message.str());
     }
     
-    likelihoodNeutrino->SetDirectory(nullptr);
-    likelihoodMass->SetDirectory(nullptr);
+    histNeutrino->SetDirectory(nullptr);
+    histMass->SetDirectory(nullptr);
     
     ROOTLock::Unlock();
     
     
     // Make sure the histograms are normalized to describe probability density
-    likelihoodNeutrino->Scale(1. / likelihoodNeutrino->Integral(), "width");
-    likelihoodMass->Scale(1. / likelihoodMass->Integral(), "width");
+    histNeutrino->Scale(1. / histNeutrino->Integral(), "width");
+    histMass->Scale(1. / histMass->Integral(), "width");
+    
+    SetLikelihood(*histNeutrino, *histMass);
+    
+    ROOTLock::Lock();
+    histNeutrino.reset();
+    histMass.reset();
+    ROOTLock::Unlock();
+}
+
+
+void TTSemilepRecoRochester::SetLikelihood(TH1 const &histNeutrino, TH2 const &histMass)
+{
+    // Convert the histograms into tables of log-likelihood, which are used in the hot loop. The
+    //maximal values of the likelihoods are used for pruning and early termination in the search
+    //for the best interpretation
+    likelihoodNeutrino.reset(new LogLikelihoodTable(histNeutrino));
+    likelihoodMass.reset(new LogLikelihoodTable(histMass));
+    maxLogLikelihoodNu = likelihoodNeutrino->GetMaxValue();
+    maxLogLikelihoodMass = likelihoodMass->GetMaxValue();
 }
 
 
-double TTSemilepRecoRochester::ComputeRank(Jet const &bTopLep, Jet const &bTopHad,
-  Jet const &q1TopHad, Jet const &q2TopHad)
+void TTSemilepRecoRochester::BeginRepeatedSearch()
 {
-    double logLikelihood = 0.;
-    TLorentzVector p4Nu;
+    massLikelihoodInRange = false;
+}
+
+
+double TTSemilepRecoRochester::ComputeRank(unsigned iBTopLep, unsigned iBTopHad,
+  unsigned iQ1TopHad, unsigned iQ2TopHad)
+{
+    // Check if the assumed b-quark jets pass the selection on the b-tagging (if any)
+    if (not IsBPairAllowed(iBTopLep, iBTopHad))
+        return -std::numeric_limits<double>::infinity();
     
     
-    // Check if the assumed b-quark jets pass the selection on the b-tagging (if any)
-    if (bTagCut > -std::numeric_limits<double>::infinity())
-    {
-        if (bTagSelAtLeastOne)
-        {
-            if (bTopLep.BTag(bTagAlgorithm) < bTagCut and bTopHad.BTag(bTagAlgorithm) < bTagCut)
-                return -std::numeric_limits<double>::infinity();
-        }
-        else
-        {
-            if (bTopLep.BTag(bTagAlgorithm) < bTagCut or bTopHad.BTag(bTagAlgorithm) < bTagCut)
-                return -std::numeric_limits<double>::infinity();
-        }
-    }
+    // Compute (logarithm of) the likelihood for the neutrino. Skip the current interpretation if
+    //the neutrino cannot be reconstructed
+    double const logLikelihoodNu = ComputeRankTopLep(iBTopLep);
     
-    bTaggedJetsFound = true;
-        
-        
-    // Check if the b-quark jet from t -> blv has changed since previous interpretation
-    if (&bTopLep == cachedBTopLep)
+    if (logLikelihoodNu == -std::numeric_limits<double>::infinity())
+        return logLikelihoodNu;
+    
+    
+    // Add (logarithm of) the likelihood for the masses
+    return logLikelihoodNu + ComputeRankTopHad(iBTopHad, iQ1TopHad, iQ2TopHad);
+}
+
+
+double TTSemilepRecoRochester::ComputeRankTopLep(unsigned iBTopLep)
+{
+    // Check if the neutrino has already been reconstructed with this jet
+    if (not std::isnan(cachedLogLikelihoodNu[iBTopLep]))
+        return cachedLogLikelihoodNu[iBTopLep];
+    
+    cachedLogLikelihoodNu[iBTopLep] = -std::numeric_limits<double>::infinity();
+    
+    
+    // Build the neutrino ellipsis or copy it from the source plugin if it has already been built
+    //there for the same lepton and jet
+    Jet const &bTopLep = GetSelectedJet(iBTopLep);
+    NuRecoRochester const *sourceEllipse = nullptr;
+    
+    if (nuEllipseSource)
     {
-        // The jet is the same. No need to reconstruct the neutrino again
-        logLikelihood += cachedLogLikelihoodNu;
-        p4Nu = cachedP4Nu;
+        ++nuEllipseLookups;
+        sourceEllipse = nuEllipseSource->FindNuEllipse(lepton->P4(), bTopLep.P4());
+        
+        if (sourceEllipse)
+            ++nuEllipseHits;
     }
+    
+    if (sourceEllipse)
+        nuEllipses.emplace_back(NuEllipse{lepton->P4(), bTopLep.P4(), *sourceEllipse});
     else
     {
-        // Reconstruct the neutrino. Skip the current interpretation if it cannot be reconstructed
-        NuRecoRochester nuBuilder(&lepton->P4(), &bTopLep.P4());
-        
-        if (not nuBuilder.IsReconstructable())
-            return -std::numeric_limits<double>::infinity();
-        
-        double nuDistance;
-        p4Nu = nuBuilder.GetBest(met->P4().Px(), met->P4().Py(), 1., 1., 0., nuDistance);
-        nuDistance = std::sqrt(nuDistance);  // It is actually set to the squared value
-        neutrinoReconstructed = true;
-        
-        
-        // Compute (logarithm of) the likelihood for the neutrino distance. If the distance falls
-        //into the overflow bin of the histogram, reject the current interpretation
-        int bin = likelihoodNeutrino->FindFixBin(nuDistance);
-        
-        if (likelihoodNeutrino->IsBinOverflow(bin))
-            return -std::numeric_limits<double>::infinity();
-        
-        neutrinoLikelihoodInRange = true;
-        
-        
-        // Update the cached values
-        cachedBTopLep = &bTopLep;
-        cachedP4Nu = p4Nu;
-        cachedLogLikelihoodNu = std::log(likelihoodNeutrino->GetBinContent(bin));
+        if (not batchEllipsesReady)
+            ComputeNuEllipsesBatch();
         
+        nuEllipses.emplace_back(NuEllipse{lepton->P4(), bTopLep.P4(),
+          NuRecoRochester(batchEllipses.data() + NuKernels::ellipseSize * iBTopLep,
+          batchReconstructable[iBTopLep])});
+    }
+    
+    
+    // Reconstruct the neutrino
+    NuRecoRochester nuBuilder(nuEllipses.back().nuBuilder);
+    nuBuilder.SetMinimizer(nuMinimizer, nuMinimizerTolerance);
+    
+    if (not nuBuilder.IsReconstructable())
+        return cachedLogLikelihoodNu[iBTopLep];
+    
+    double nuDistance;
+    cachedP4Nu[iBTopLep] = nuBuilder.GetBest(met->P4().Px(), met->P4().Py(), 1., 1., 0.,
+      nuDistance);
+    nuDistance = std::sqrt(nuDistance);  // It is actually set to the squared value
+    neutrinoReconstructed = true;
+    
+    
+    // If requested, compare the distance to the one found with the reference algorithm
+    if (nuValidationPrecision > 0.)
+    {
+        NuRecoRochester refNuBuilder(&lepton->P4(), &bTopLep.P4());
+        double refNuDistance;
+        refNuBuilder.GetBest(met->P4().Px(), met->P4().Py(), 1., 1., 0., refNuDistance);
+        refNuDistance = std::sqrt(refNuDistance);
         
-        // Include neutrino likelihood to the full one
-        logLikelihood += cachedLogLikelihoodNu;
+        if (nuDistance > refNuDistance + nuValidationPrecision)
+        {
+            std::ostringstream message;
+            message << "TTSemilepRecoRochester[\"" << GetName() << "\"]::ComputeRankTopLep: "
+              "Neutrino distance " << nuDistance << " found with the selected algorithm "
+              "exceeds the reference value " << refNuDistance << " by more than " <<
+              nuValidationPrecision << ".";
+            throw std::runtime_error(message.str());
+        }
     }
     
     
-    // Compute masses of hadronically decaying top quark and W boson
-    TLorentzVector const p4W(q1TopHad.P4() + q2TopHad.P4());
-    double const mW = p4W.M();
-    double const mTop = (p4W + bTopHad.P4()).M();
+    // Look up (logarithm of) the likelihood for the neutrino distance. If the distance falls
+    //into the overflow bin of the histogram, reject the jet
+    double const logLikelihood = likelihoodNeutrino->Eval(nuDistance);
+    
+    if (LogLikelihoodTable::IsOverflow(logLikelihood))
+        return cachedLogLikelihoodNu[iBTopLep];
     
+    neutrinoLikelihoodInRange = true;
+    cachedLogLikelihoodNu[iBTopLep] = logLikelihood;
     
-    // Add (logarithm of) the likelihood for the masses. Reject the current interpretation is at
-    //least one of the masses falls into overflow
-    int bin = likelihoodMass->FindFixBin(mW, mTop);
+    return logLikelihood;
+}
+
+
+void TTSemilepRecoRochester::ComputeNuEllipsesBatch()
+{
+    RecoJetCache const &jetCache = GetJetCache();
+    unsigned const nJets = jetCache.GetNumJets();
+    
+    batchEllipses.resize(NuKernels::ellipseSize * nJets);
+    
+    if (nJets > batchCapacity)
+    {
+        batchReconstructable.reset(new bool[nJets]);
+        batchCapacity = nJets;
+    }
     
-    if (likelihoodMass->IsBinOverflow(bin))
+    TLorentzVector const &p4Lep = lepton->P4();
+    NuKernels::ComputeRochesterEllipses(p4Lep.Px(), p4Lep.Py(), p4Lep.Pz(), p4Lep.E(), nJets,
+      jetCache.PxData(), jetCache.PyData(), jetCache.PzData(), jetCache.EData(),
+      batchEllipses.data(), batchReconstructable.get());
+    batchEllipsesReady = true;
+}
+
+
+double TTSemilepRecoRochester::ComputeRankTopHad(unsigned iBTopHad, unsigned iQ1TopHad,
+  unsigned iQ2TopHad)
+{
+    // Read masses of hadronically decaying top quark and W boson from the cache
+    RecoJetCache const &jetCache = GetJetCache();
+    double const mW = jetCache.GetMassPair(iQ1TopHad, iQ2TopHad);
+    double const mTop = jetCache.GetMassTriplet(iBTopHad, iQ1TopHad, iQ2TopHad);
+    
+    
+    // Look up (logarithm of) the likelihood for the masses. Reject the triplet if at least one of
+    //the masses falls into overflow
+    double const logLikelihood = likelihoodMass->Eval(mW, mTop);
+    
+    if (LogLikelihoodTable::IsOverflow(logLikelihood))
         return -std::numeric_limits<double>::infinity();
     
     massLikelihoodInRange = true;
-    logLikelihood += std::log(likelihoodMass->GetBinContent(bin));
+    return logLikelihood;
+}
+
+
+void TTSemilepRecoRochester::ComputeRankTopHadBatch(unsigned n, unsigned const *bTopHad,
+  unsigned const *q1TopHad, unsigned const *q2TopHad, double *ranks)
+{
+    // Read masses from the cache and look up the likelihood for all triplets at once
+    batchMassW.resize(n);
+    batchMassTop.resize(n);
+    GetJetCache().GetMassesBatch(n, bTopHad, q1TopHad, q2TopHad, batchMassW.data(),
+      batchMassTop.data());
+    
+    likelihoodMass->EvalBatch(n, batchMassW.data(), batchMassTop.data(), ranks);
+    
+    
+    // Reject triplets with masses in overflow, in the same way as in ComputeRankTopHad
+    for (unsigned i = 0; i < n; ++i)
+    {
+        if (LogLikelihoodTable::IsOverflow(ranks[i]))
+            ranks[i] = -std::numeric_limits<double>::infinity();
+        else
+            massLikelihoodInRange = true;
+    }
+}
+
+
+unsigned TTSemilepRecoRochester::GetNumAssignmentPasses() const
+{
+    return (HasBTagSelection() and bTagSelAtLeastOne) ? 2 : 1;
+}
+
+
+bool TTSemilepRecoRochester::HasBTagSelection() const
+{
+    return (not jetFlagsPluginName.empty() or bTagCut > -std::numeric_limits<double>::infinity());
+}
+
+
+TLorentzVector const &TTSemilepRecoRochester::GetNeutrinoP4(unsigned iBTopLep, unsigned,
+  unsigned, unsigned) const
+{
+    return cachedP4Nu[iBTopLep];
+}
+
+
+double TTSemilepRecoRochester::GetRankTopHadUpperBound() const
+{
+    return maxLogLikelihoodMass;
+}
+
+
+double TTSemilepRecoRochester::GetRankTopLepUpperBound() const
+{
+    return maxLogLikelihoodNu;
+}
+
+
+bool TTSemilepRecoRochester::IsBPairAllowed(unsigned iBTopLep, unsigned iBTopHad)
+{
+    if (HasBTagSelection())
+    {
+        bool const taggedTopLep = IsTagged(iBTopLep);
+        bool const taggedTopHad = IsTagged(iBTopHad);
+        
+        if (bTagSelAtLeastOne)
+        {
+            if (not taggedTopLep and not taggedTopHad)
+                return false;
+        }
+        else
+        {
+            if (not taggedTopLep or not taggedTopHad)
+                return false;
+        }
+    }
     
+    bTaggedJetsFound = true;
+    return true;
+}
+
+
+bool TTSemilepRecoRochester::IsJetAdmissible(unsigned pass, DecayJet role, unsigned index) const
+{
+    // Apply the veto to jets from light quarks
+    if (role == DecayJet::q1TopHad or role == DecayJet::q2TopHad)
+        return (maxBTagLight == std::numeric_limits<double>::infinity() or
+          GetSelectedJet(index).BTag(bTagAlgorithm) < maxBTagLight);
     
-    // Update best neutrino candidate if needed. At this point GetRank() returns log-likelihood of
-    //the best interpretation found so far
-    if (logLikelihood > GetRank())
-        neutrino.SetP4(p4Nu);
     
+    // Selection on b tags of jets from b quarks. Its logic is the same as in IsBPairAllowed
+    if (not HasBTagSelection())
+        return true;
     
-    return logLikelihood;
+    bool const tagged = IsTagged(index);
+    
+    if (not bTagSelAtLeastOne)
+        return tagged;
+    
+    
+    // If only one of the jets needs to be b-tagged, split the enumeration into two mutually
+    //exclusive passes. In the first one the b-quark jet from t -> blv is tagged, and there is no
+    //requirement for the other one. In the second one the former is untagged while the latter is
+    //tagged.
+    if (role == DecayJet::bTopLep)
+        return (pass == 0) ? tagged : not tagged;
+    else
+        return (pass == 0) ? true : tagged;
+}
+
+
+bool TTSemilepRecoRochester::IsRankSeparable() const
+{
+    return true;
+}
+
+
+bool TTSemilepRecoRochester::IsTagged(unsigned index) const
+{
+    if (not jetFlagsPluginName.empty())
+        return ((*jetFlags)[GetSelectedJetSourceIndex(index)] & bTagMask);
+    else
+        return not (GetSelectedJet(index).BTag(bTagAlgorithm) < bTagCut);
 }
 
 
 bool TTSemilepRecoRochester::ProcessEvent()
 {
+    allocationCheck.Begin();
+    
+    auto const &leptons = leptonPlugin->GetLeptons();
+    ReconstructEvent((leptons.size() > 0) ? &leptons.front() : nullptr, jetmetPlugin->GetMET(),
+      jetmetPlugin->GetJets(), (jetFlagsPlugin) ? &jetFlagsPlugin->GetFlags() : nullptr);
+    
+    allocationCheck.End(GetName());
+    
+    // Always return true since this plugin does not perform event filtering
+    return true;
+}
+
+
+void TTSemilepRecoRochester::ReconstructEvent(Lepton const *lepton_, Candidate const &met_,
+  std::vector<Jet> const &jets, std::vector<std::uint32_t> const *jetFlags_ /*= nullptr*/)
+{
+    // Flags of jets are needed if the selection on b tags has been given with a working point
+    if (not jetFlagsPluginName.empty() and (not jetFlags_ or jetFlags_->size() != jets.size()))
+    {
+        std::ostringstream message;
+        message << "TTSemilepRecoRochester[\"" << GetName() << "\"]::ReconstructEvent: " <<
+          "Selection on b tags relies on flags of jets, but they have not been provided or do " <<
+          "not match the collection of jets.";
+        throw std::runtime_error(message.str());
+    }
+    
+    jetFlags = jetFlags_;
+    
+    
+    // Ellipses from the previous event must not be provided to other plugins
+    nuEllipses.clear();
+    batchEllipsesReady = false;
+    
+    
     // Do not attempt reconstruction if the current event contains no leptons
-    if (leptonPlugin->GetLeptons().size() == 0)
+    lepton = lepton_;
+    
+    if (not lepton)
     {
-        lepton = nullptr;
         SetRecoFailure(1);
-        return true;
+        return;
     }
-    else
-        lepton = &leptonPlugin->GetLeptons().front();
     
     
     // Per-event initialization
-    met = &jetmetPlugin->GetMET();
+    met = &met_;
     neutrino.SetPxPyPzE(0., 0., 0., 0.);
     
     bTaggedJetsFound = false;
     neutrinoReconstructed = neutrinoLikelihoodInRange = massLikelihoodInRange = false;
     
     
-    // Clear the cache
-    cachedBTopLep = nullptr;
+    // Clear the cache. Its size is set to the total number of jets, which is not smaller than the
+    //number of jets passing the selection
+    cachedP4Nu.resize(jets.size());
+    cachedLogLikelihoodNu.assign(jets.size(), std::numeric_limits<double>::quiet_NaN());
     
     
     // Perform jet assigment calling dedicated method from the base class
-    PerformJetAssignment(jetmetPlugin->GetJets());
+    PerformJetAssignment(jets);
+    
+    
+    // Save the neutrino from the accepted interpretation
+    if (GetRank() > -std::numeric_limits<double>::infinity())
+        neutrino.SetP4(cachedP4Nu[GetBestJetIndex(DecayJet::bTopLep)]);
     
     
     // Declare failure of the reconstruction if the best rank is (-inf). This could have happend
@@ -292,8 +716,4 @@ bool TTSemilepRecoRochester::ProcessEvent()
         else
             SetRecoFailure(6);
     }
-    
-    
-    // Always return true since this plugin does not perform event filtering
-    return true;
 }
@@ -0,0 +1,49 @@
+#include <TimingProbe.hpp>
+
+#include <mensura/core/Processor.hpp>
+
+
+TimingProbe::TimingProbe(std::string const &name, std::string const &label_,
+  std::string const &timerPluginName_ /*= "PipelineTimer"*/):
+    AnalysisPlugin(name),
+    label(label_),
+    timerPluginName(timerPluginName_), timerPlugin(nullptr),
+    index(0)
+{}
+
+
+void TimingProbe::BeginRun(Dataset const &)
+{
+    timerPlugin = dynamic_cast<PipelineTimer const *>(GetDependencyPlugin(timerPluginName));
+    
+    // The timer starts a new record for each dataset, and probes are registered in it in the
+    //order of their execution
+    auto &segments = timerPlugin->GetRecord().segments;
+    index = segments.size();
+    segments.emplace_back(PipelineTimer::Segment{label, 0, 0, 0., 0.});
+}
+
+
+Plugin *TimingProbe::Clone() const
+{
+    return new TimingProbe(GetName(), label, timerPluginName);
+}
+
+
+bool TimingProbe::ProcessEvent()
+{
+    double wallTime, cpuTime;
+    PipelineTimer::GetTime(wallTime, cpuTime);
+    
+    auto &record = timerPlugin->GetRecord();
+    auto &segment = record.segments[index];
+    ++segment.calls;
+    segment.wallTime += wallTime - record.lastWallTime;
+    segment.cpuTime += cpuTime - record.lastCPUTime;
+    
+    record.lastProbe = index;
+    record.lastWallTime = wallTime;
+    record.lastCPUTime = cpuTime;
+    
+    return true;
+}